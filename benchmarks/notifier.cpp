@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <zmq.hpp>
+
+#include "../src/reactor/reactor.h"
+#include "../src/reactor/router_socket_wrapper.h"
+
+/**
+ * Measures the cost of a message passed to an asynchronous handler, such as the status notifier.
+ * A client sends notifier-like messages (three frames) through a socket, the reactor passes them to an asynchronous
+ * handler and the handler answers each of them through the reactor. At most a window of messages is in flight.
+ *
+ * Usage: run_benchmark_notifier [poll|epoll] [message count] [window]
+ */
+
+namespace
+{
+	const std::string KEY_SOCKET = "socket";
+	const std::string ADDRESS = "inproc://benchmark_notifier";
+
+	/**
+	 * Replies to every message right away
+	 */
+	class echo_handler : public handler_interface
+	{
+	public:
+		void on_request(const message_container &message, const response_cb &respond) override
+		{
+			respond(message_container(KEY_SOCKET, message.identity, {"ok"}));
+		}
+	};
+
+	void send_job_status(zmq::socket_t &client, std::size_t index)
+	{
+		std::string job_id = "job_" + std::to_string(index);
+
+		client.send("type", 4, ZMQ_SNDMORE);
+		client.send(job_id.data(), job_id.size(), ZMQ_SNDMORE);
+		client.send("OK", 2, 0);
+	}
+
+	void receive_reply(zmq::socket_t &client)
+	{
+		zmq::message_t frame;
+
+		do {
+			client.recv(&frame);
+		} while (frame.more());
+	}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	std::string backend_name = argc > 1 ? argv[1] : "poll";
+	std::size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+	std::size_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 500;
+
+	if ((backend_name != "poll" && backend_name != "epoll") || count == 0 || window == 0) {
+		std::cerr << "Usage: " << argv[0] << " [poll|epoll] [message count] [window]" << std::endl;
+		return 1;
+	}
+
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context, backend_name == "epoll" ? reactor_backend::epoll : reactor_backend::poll);
+
+	r.add_socket(KEY_SOCKET, std::make_shared<router_socket_wrapper>(context, ADDRESS, true));
+	r.add_async_handler({KEY_SOCKET}, std::make_shared<echo_handler>());
+
+	std::thread loop([&r]() { r.start_loop(); });
+
+	zmq::socket_t client(*context, zmq::socket_type::dealer);
+	client.setsockopt(ZMQ_LINGER, 0);
+	client.connect(ADDRESS);
+
+	// The first message also waits until the reactor binds the socket
+	send_job_status(client, 0);
+	receive_reply(client);
+
+	auto start = std::chrono::steady_clock::now();
+	std::size_t sent = 0;
+	std::size_t received = 0;
+
+	while (received < count) {
+		while (sent < count && sent - received < window) {
+			send_job_status(client, ++sent);
+		}
+
+		receive_reply(client);
+		received += 1;
+	}
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+	r.terminate();
+	loop.join();
+
+	std::cout << backend_name << ": " << count << " messages in " << elapsed.count() / 1000 << " ms, "
+			  << static_cast<double>(elapsed.count()) / count << " us/message" << std::endl;
+
+	return 0;
+}
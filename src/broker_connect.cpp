@@ -1,4 +1,5 @@
 #include "broker_connect.h"
+#include "handlers/replication_handler.h"
 
 const std::string broker_connect::KEY_WORKERS = "workers";
 const std::string broker_connect::KEY_CLIENTS = "clients";
@@ -8,14 +9,23 @@ const std::string broker_connect::KEY_STATUS_NOTIFIER = "status_notifier";
 // FIXME This must be equal to reactor::KEY_TIMER, but we can't assign that directly
 const std::string broker_connect::KEY_TIMER = "timer";
 
+const std::string broker_connect::KEY_REPLICATION = "replication";
+
+const std::string broker_connect::KEY_WORKER_EVENTS = "worker_events";
+
 const std::string broker_connect::MONITOR_IDENTITY = "recodex-monitor";
 
+const std::string broker_connect::STANDBY_IDENTITY = "recodex-broker-standby";
+
+const std::string broker_connect::REQUEST_ID = "request-id";
+
 broker_connect::broker_connect(std::shared_ptr<const broker_config> config,
 	std::shared_ptr<zmq::context_t> context,
 	std::shared_ptr<worker_registry> router,
 	std::shared_ptr<queue_manager_interface> queue,
 	std::shared_ptr<spdlog::logger> logger)
-	: config_(config), logger_(logger), workers_(router), queue_(queue), reactor_(context)
+	: config_(config), logger_(logger), workers_(router), queue_(queue),
+	  reactor_(context, config->get_reactor_backend() == "epoll" ? reactor_backend::epoll : reactor_backend::poll)
 {
 	if (logger_ == nullptr) {
 		logger_ = helpers::create_null_logger();
@@ -31,14 +41,62 @@ broker_connect::broker_connect(std::shared_ptr<const broker_config> config,
 		"tcp://" + config_->get_monitor_address() + ":" + std::to_string(config_->get_monitor_port());
 	logger_->debug("Binding monitor to {}", monitor_endpoint);
 
-	reactor_.add_socket(KEY_WORKERS, std::make_shared<router_socket_wrapper>(context, workers_endpoint, true));
-	reactor_.add_socket(KEY_CLIENTS, std::make_shared<router_socket_wrapper>(context, clients_endpoint, true));
+	auto workers_socket = std::make_shared<router_socket_wrapper>(context, workers_endpoint, true);
+	auto clients_socket = std::make_shared<router_socket_wrapper>(context, clients_endpoint, true);
+
+	reactor_.add_socket(KEY_WORKERS, workers_socket);
+	reactor_.add_socket(KEY_CLIENTS, clients_socket);
 	reactor_.add_socket(KEY_MONITOR, std::make_shared<router_socket_wrapper>(context, monitor_endpoint, false));
 
-	reactor_.add_handler(
-		{KEY_CLIENTS, KEY_WORKERS, KEY_TIMER}, std::make_shared<broker_handler>(config_, workers_, queue_, logger_));
-	reactor_.add_async_handler(
-		{KEY_STATUS_NOTIFIER}, std::make_shared<status_notifier_handler>(config_->get_notifier_config(), logger_));
+	// Workers whose connection was closed are expired right away, missed pings are only a fallback
+	reactor_.add_socket(KEY_WORKER_EVENTS, std::make_shared<peer_monitor_wrapper>(context, workers_socket));
+
+	// The timer messages might come only on demand, the heartbeats and job runtimes need a precise time
+	handler_ = std::make_shared<broker_handler>(config_, workers_, queue_, logger_, []() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch());
+	});
+
+	// Messages wait in the sockets when the peers cannot take them, they are dropped when there are too many
+	handler_->add_runtime_stats_source([workers_socket, clients_socket]() {
+		return std::map<std::string, std::size_t>{{"workers-queued-messages", workers_socket->get_queued_output()},
+			{"workers-dropped-messages", workers_socket->get_dropped_count()},
+			{"clients-queued-messages", clients_socket->get_queued_output()},
+			{"clients-dropped-messages", clients_socket->get_dropped_count()}};
+	});
+
+	// The replication wraps the broker handler, so that the changes are streamed right after they are made and
+	// the replies to the clients can wait until the standby has them
+	auto replicated_queue = std::dynamic_pointer_cast<replicated_queue_manager>(queue_);
+	if (replicated_queue != nullptr) {
+		auto &replication = config_->get_replication_config();
+		auto replication_endpoint = "tcp://" + replication.address + ":" + std::to_string(replication.port);
+		logger_->debug("Connecting standby broker to {}", replication_endpoint);
+
+		reactor_.add_socket(
+			KEY_REPLICATION, std::make_shared<router_socket_wrapper>(context, replication_endpoint, false));
+		reactor_.add_handler({KEY_CLIENTS, KEY_WORKERS, KEY_TIMER, KEY_WORKER_EVENTS, KEY_REPLICATION},
+			std::make_shared<replication_handler>(
+				replicated_queue, replication.heartbeat_interval, handler_, replication.ack_timeout, logger_));
+	} else {
+		reactor_.add_handler({KEY_CLIENTS, KEY_WORKERS, KEY_TIMER, KEY_WORKER_EVENTS}, handler_);
+
+		// Without the heartbeats of the replication, the broker needs the timer only when something can time out
+		reactor_.set_tick_on_demand(true);
+		handler_->set_timer_request_callback([this](std::chrono::milliseconds delay) { reactor_.request_tick(delay); });
+	}
+
+	// The notifications of a job must not overtake each other, the other ones can be sent in any order
+	auto &notifier = config_->get_notifier_config();
+	auto notifications = reactor_.add_async_handler({KEY_STATUS_NOTIFIER},
+		std::make_shared<status_notifier_handler>(notifier, logger_),
+		notifier.concurrency,
+		status_notifier_handler::get_ordering_key);
+
+	handler_->add_runtime_stats_source([notifications]() {
+		return std::map<std::string, std::size_t>{{"notifier-queue-depth", notifications->get_queue_depth()},
+			{"notifier-busy-threads", notifications->get_busy_threads()}};
+	});
 }
 
 void broker_connect::start_brokering()
@@ -46,3 +104,14 @@ void broker_connect::start_brokering()
 	reactor_.start_loop();
 	logger_->critical("The main loop terminated");
 }
+
+void broker_connect::restore(const replica_state &state)
+{
+	handler_->restore(state);
+
+	// The restored workers and jobs are checked before any of them sends a message
+	auto delay = handler_->get_timer_delay();
+	if (delay.count() >= 0) {
+		reactor_.request_tick(delay);
+	}
+}
@@ -9,8 +9,10 @@
 #include "notifier/empty_status_notifier.h"
 #include "notifier/status_notifier.h"
 #include "reactor/command_holder.h"
+#include "reactor/peer_monitor_wrapper.h"
 #include "reactor/reactor.h"
 #include "reactor/router_socket_wrapper.h"
+#include "replication/replica_state.h"
 #include "worker_registry.h"
 #include <chrono>
 #include <memory>
@@ -29,6 +31,8 @@ private:
 	std::shared_ptr<worker_registry> workers_;
 	/** Queue manager */
 	std::shared_ptr<queue_manager_interface> queue_;
+	/** Processes the messages from the clients and workers */
+	std::shared_ptr<broker_handler> handler_;
 	/** A reactor that provides us with an event-based API to communicate with the clients and workers */
 	reactor reactor_;
 
@@ -48,10 +52,23 @@ public:
 	/** A string key for messages about time elapsed in the poll loop */
 	const static std::string KEY_TIMER;
 
+	/** A string key for the socket connected to the standby broker */
+	const static std::string KEY_REPLICATION;
+
+	/** A string key for the notifications about closed connections of the workers */
+	const static std::string KEY_WORKER_EVENTS;
+
 	/** Identity of the monitor peer (necessary when working with router sockets) */
 	const static std::string MONITOR_IDENTITY;
 
+	/** Identity of the standby broker peer */
+	const static std::string STANDBY_IDENTITY;
+
+	/** First frame of a client request tagged with an id, which is copied to all the replies to the request */
+	const static std::string REQUEST_ID;
+
 	/**
+	 * If the queue manager is a @ref replicated_queue_manager, its changes are streamed to the standby broker.
 	 * @param config a configuration object used to set up the connections
 	 * @param context ZeroMQ context
 	 * @param router A registry used to track workers and their jobs
@@ -69,6 +86,13 @@ public:
 	 * Blocks execution until the underlying ZeroMQ context is terminated.
 	 */
 	void start_brokering();
+
+	/**
+	 * Take over the workers and jobs of a failed primary broker (before brokering is started).
+	 * The registry and the queue manager must be empty.
+	 * @param state replica of the state of the primary broker
+	 */
+	void restore(const replica_state &state);
 };
 
 
@@ -1,9 +1,12 @@
 #include "broker_core.h"
 #include "queuing/single_queue_manager.h"
 #include "queuing/multi_queue_manager.h"
+#include "queuing/cache_affinity_worker_selector.h"
+#include "replication/replicated_queue_manager.h"
 
 broker_core::broker_core(std::vector<std::string> args)
-	: args_(args), config_filename_("config.yml"), logger_(nullptr), broker_(nullptr)
+	: args_(args), config_filename_("config.yml"), logger_(nullptr), broker_(nullptr), standby_(nullptr),
+	  dispatcher_(nullptr)
 {
 	// parse cmd parameters
 	parse_params();
@@ -25,6 +28,23 @@ broker_core::~broker_core()
 
 void broker_core::run()
 {
+	if (dispatcher_ != nullptr) {
+		logger_->info("Broker will now dispatch requests to the back-end brokers.");
+		dispatcher_->start_dispatching();
+		logger_->info("Broker will now end.");
+		return;
+	}
+
+	if (standby_ != nullptr) {
+		logger_->info("Broker will now mirror the primary broker.");
+		auto state = standby_->wait_for_takeover();
+
+		// Release the replication endpoint and take over the endpoints of the primary
+		standby_ = nullptr;
+		broker_ = std::make_shared<broker_connect>(config_, context_, workers_, queue_, logger_);
+		broker_->restore(*state);
+	}
+
 	logger_->info("Broker will now start brokering.");
 	broker_->start_brokering();
 	logger_->info("Broker will now end.");
@@ -126,6 +146,14 @@ void broker_core::log_init()
 void broker_core::broker_init()
 {
 	logger_->info("Initializing broker connection...");
+
+	if (!config_->get_dispatcher_config().backends.empty()) {
+		context_ = std::make_shared<zmq::context_t>(1);
+		dispatcher_ = std::make_shared<dispatcher_connect>(config_, context_, logger_);
+		logger_->info("Dispatcher connection initialized.");
+		return;
+	}
+
 	workers_ = std::make_shared<worker_registry>();
 	context_ = std::make_shared<zmq::context_t>(1);
 
@@ -135,8 +163,28 @@ void broker_core::broker_init()
 		queue_ = std::make_shared<multi_queue_manager>();
 	} else if (queue_manager_id == "single") {
 		queue_ = std::make_shared<single_queue_manager<>>();
+	} else if (queue_manager_id == "edf") {
+		queue_ = std::make_shared<single_queue_manager<edf_job_comparator>>();
+	} else if (queue_manager_id == "affinity") {
+		queue_ = std::make_shared<single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector>>(
+			std::make_unique<fcfs_job_comparator>(),
+			std::make_unique<cache_affinity_worker_selector>(config_->get_affinity_metadata_key(),
+				config_->get_affinity_cache_size(),
+				config_->get_affinity_max_wait()));
 	} else {
-		force_exit("Unknown queue manager '" + queue_manager_id + "'. Available managers are 'single' and 'multi'.");
+		force_exit("Unknown queue manager '" + queue_manager_id +
+			"'. Available managers are 'single', 'multi', 'edf' and 'affinity'.");
+	}
+
+	auto &replication = config_->get_replication_config();
+	if (replication.role == "standby") {
+		standby_ = std::make_shared<standby_connect>(config_, context_, logger_);
+		logger_->info("Standby broker connection initialized.");
+		return;
+	}
+
+	if (replication.role == "primary") {
+		queue_ = std::make_shared<replicated_queue_manager>(queue_);
 	}
 
 	broker_ = std::make_shared<broker_connect>(config_, context_, workers_, queue_, logger_);
@@ -21,7 +21,9 @@ namespace fs = boost::filesystem;
 #include "broker_connect.h"
 #include "config/broker_config.h"
 #include "config/log_config.h"
+#include "dispatcher_connect.h"
 #include "reactor/command_holder.h"
+#include "standby_connect.h"
 
 
 /**
@@ -71,7 +73,8 @@ private:
 	void log_init();
 
 	/**
-	 * Construct and setup broker connection.
+	 * Construct and setup broker connection (or the replication channel of a standby broker, or the connections
+	 * of a dispatcher to the back-end brokers).
 	 * libCURL (@a curl_init) and @ref status_notifier (@a notifier_init) should be initialized before this.
 	 */
 	void broker_init();
@@ -127,6 +130,12 @@ private:
 
 	/** Main broker class which handles incoming and outgoing connections. */
 	std::shared_ptr<broker_connect> broker_;
+
+	/** Mirrors the state of the primary broker (nullptr if this broker is not a standby). */
+	std::shared_ptr<standby_connect> standby_;
+
+	/** Forwards the requests to back-end brokers (nullptr if this broker is not a dispatcher). */
+	std::shared_ptr<dispatcher_connect> dispatcher_;
 };
 
 #endif // RECODEX_BROKER_CORE_H
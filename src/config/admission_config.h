@@ -0,0 +1,50 @@
+#ifndef RECODEX_ADMISSION_CONFIG_H
+#define RECODEX_ADMISSION_CONFIG_H
+
+#include <chrono>
+#include <map>
+#include <string>
+
+
+/**
+ * Limits that a hardware group must satisfy to admit a new job.
+ */
+struct admission_limits {
+public:
+	/**
+	 * Maximal amount of queued jobs (zero means unlimited).
+	 */
+	std::size_t max_queue_depth = 0;
+	/**
+	 * Maximal estimated time a new job waits before it is started (zero means unlimited).
+	 */
+	std::chrono::milliseconds max_wait = std::chrono::milliseconds(0);
+};
+
+/**
+ * Configuration of the admission control which rejects jobs when the queues are overloaded.
+ */
+struct admission_config {
+public:
+	/**
+	 * Limits used for hardware groups that are not configured explicitly.
+	 */
+	admission_limits defaults;
+	/**
+	 * Limits for particular hardware groups.
+	 */
+	std::map<std::string, admission_limits> hwgroups;
+
+	/**
+	 * Get the limits of given hardware group.
+	 * @param hwgroup identifier of the hardware group
+	 * @return limits of the group (or the default limits if the group is not configured)
+	 */
+	const admission_limits &get_limits(const std::string &hwgroup) const
+	{
+		auto it = hwgroups.find(hwgroup);
+		return it != hwgroups.end() ? it->second : defaults;
+	}
+};
+
+#endif // RECODEX_ADMISSION_CONFIG_H
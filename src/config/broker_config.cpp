@@ -1,5 +1,22 @@
 #include "broker_config.h"
 
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * Load admission limits from given YAML map (omitted items keep their values)
+	 */
+	void load_admission_limits(const YAML::Node &node, admission_limits &limits)
+	{
+		if (node["max_queue_depth"] && node["max_queue_depth"].IsScalar()) {
+			limits.max_queue_depth = node["max_queue_depth"].as<std::size_t>();
+		} // no throw... can be omitted
+		if (node["max_wait"] && node["max_wait"].IsScalar()) {
+			limits.max_wait = std::chrono::milliseconds(node["max_wait"].as<std::size_t>());
+		} // no throw... can be omitted
+	}
+} // namespace
 
 broker_config::broker_config(const YAML::Node &config)
 {
@@ -39,6 +56,24 @@ broker_config::broker_config(const YAML::Node &config)
 			if (config["workers"]["ping_interval"] && config["workers"]["ping_interval"].IsScalar()) {
 				worker_ping_interval_ = std::chrono::milliseconds(config["workers"]["ping_interval"].as<std::size_t>());
 			} // no throw... can be omitted
+			if (config["workers"]["retry_backoff"] && config["workers"]["retry_backoff"].IsScalar()) {
+				retry_backoff_ = std::chrono::milliseconds(config["workers"]["retry_backoff"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (config["workers"]["max_retry_backoff"] && config["workers"]["max_retry_backoff"].IsScalar()) {
+				max_retry_backoff_ = std::chrono::milliseconds(config["workers"]["max_retry_backoff"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (config["workers"]["ack_timeout"] && config["workers"]["ack_timeout"].IsScalar()) {
+				worker_ack_timeout_ = std::chrono::milliseconds(config["workers"]["ack_timeout"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (config["workers"]["max_redeliveries"] && config["workers"]["max_redeliveries"].IsScalar()) {
+				max_job_redeliveries_ = config["workers"]["max_redeliveries"].as<std::size_t>();
+			} // no throw... can be omitted
+			if (config["workers"]["phi_threshold"] && config["workers"]["phi_threshold"].IsScalar()) {
+				worker_phi_threshold_ = config["workers"]["phi_threshold"].as<double>();
+			} // no throw... can be omitted
+			if (config["workers"]["phi_min_samples"] && config["workers"]["phi_min_samples"].IsScalar()) {
+				worker_phi_min_samples_ = config["workers"]["phi_min_samples"].as<std::size_t>();
+			} // no throw... can be omitted
 		}
 
 		// load monitor address and port
@@ -65,6 +100,136 @@ broker_config::broker_config(const YAML::Node &config)
 			if (config["notifier"]["password"] && config["notifier"]["password"].IsScalar()) {
 				notifier_config_.password = config["notifier"]["password"].as<std::string>();
 			} // no throw... can be omitted
+			if (config["notifier"]["concurrency"] && config["notifier"]["concurrency"].IsScalar()) {
+				notifier_config_.concurrency =
+					std::max<std::size_t>(1, config["notifier"]["concurrency"].as<std::size_t>());
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load admission control limits
+		if (config["admission"] && config["admission"].IsMap()) {
+			load_admission_limits(config["admission"], admission_config_.defaults);
+
+			if (config["admission"]["hwgroups"] && config["admission"]["hwgroups"].IsMap()) {
+				for (auto &item : config["admission"]["hwgroups"]) {
+					if (!item.second.IsMap()) {
+						continue;
+					}
+
+					// hardware groups inherit the items they do not override from the defaults
+					admission_limits limits = admission_config_.defaults;
+					load_admission_limits(item.second, limits);
+					admission_config_.hwgroups.emplace(item.first.as<std::string>(), limits);
+				}
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load quarantine of failing workers
+		if (config["quarantine"] && config["quarantine"].IsMap()) {
+			auto node = config["quarantine"];
+			if (node["error_threshold"] && node["error_threshold"].IsScalar()) {
+				quarantine_config_.error_threshold = node["error_threshold"].as<double>();
+			} // no throw... can be omitted
+			if (node["window"] && node["window"].IsScalar()) {
+				quarantine_config_.window = node["window"].as<std::size_t>();
+			} // no throw... can be omitted
+			if (node["min_samples"] && node["min_samples"].IsScalar()) {
+				quarantine_config_.min_samples = node["min_samples"].as<std::size_t>();
+			} // no throw... can be omitted
+			if (node["duration"] && node["duration"].IsScalar()) {
+				quarantine_config_.duration = std::chrono::milliseconds(node["duration"].as<std::size_t>());
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load hedging of straggling jobs
+		if (config["hedging"] && config["hedging"].IsMap()) {
+			if (config["hedging"]["runtime_multiple"] && config["hedging"]["runtime_multiple"].IsScalar()) {
+				hedging_runtime_multiple_ = config["hedging"]["runtime_multiple"].as<double>();
+			} // no throw... can be omitted
+			if (config["hedging"]["min_samples"] && config["hedging"]["min_samples"].IsScalar()) {
+				hedging_min_samples_ = config["hedging"]["min_samples"].as<std::size_t>();
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load reactor backend
+		if (config["reactor_backend"] && config["reactor_backend"].IsScalar()) {
+			reactor_backend_ = config["reactor_backend"].as<std::string>();
+			if (reactor_backend_ != "poll" && reactor_backend_ != "epoll") {
+				throw config_error("Unknown reactor backend '" + reactor_backend_ + "'");
+			}
+		} // no throw... can be omitted
+
+		// load scheduling trace
+		if (config["trace_file"] && config["trace_file"].IsScalar()) {
+			trace_file_ = config["trace_file"].as<std::string>();
+		} // no throw... can be omitted
+
+		// load cache affinity dispatching
+		if (config["affinity"] && config["affinity"].IsMap()) {
+			if (config["affinity"]["metadata_key"] && config["affinity"]["metadata_key"].IsScalar()) {
+				affinity_metadata_key_ = config["affinity"]["metadata_key"].as<std::string>();
+			} // no throw... can be omitted
+			if (config["affinity"]["cache_size"] && config["affinity"]["cache_size"].IsScalar()) {
+				affinity_cache_size_ = config["affinity"]["cache_size"].as<std::size_t>();
+			} // no throw... can be omitted
+			if (config["affinity"]["max_wait"] && config["affinity"]["max_wait"].IsScalar()) {
+				affinity_max_wait_ = std::chrono::milliseconds(config["affinity"]["max_wait"].as<std::size_t>());
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load hot-standby replication
+		if (config["replication"] && config["replication"].IsMap()) {
+			auto node = config["replication"];
+			if (node["role"] && node["role"].IsScalar()) {
+				replication_config_.role = node["role"].as<std::string>();
+				auto &role = replication_config_.role;
+				if (!role.empty() && role != "primary" && role != "standby") {
+					throw config_error("Unknown replication role '" + replication_config_.role + "'");
+				}
+			} // no throw... can be omitted
+			if (node["address"] && node["address"].IsScalar()) {
+				replication_config_.address = node["address"].as<std::string>();
+			} // no throw... can be omitted
+			if (node["port"] && node["port"].IsScalar()) {
+				replication_config_.port = node["port"].as<std::uint16_t>();
+			} // no throw... can be omitted
+			if (node["heartbeat_interval"] && node["heartbeat_interval"].IsScalar()) {
+				replication_config_.heartbeat_interval =
+					std::chrono::milliseconds(node["heartbeat_interval"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (node["takeover_timeout"] && node["takeover_timeout"].IsScalar()) {
+				replication_config_.takeover_timeout =
+					std::chrono::milliseconds(node["takeover_timeout"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (node["ack_timeout"] && node["ack_timeout"].IsScalar()) {
+				replication_config_.ack_timeout = std::chrono::milliseconds(node["ack_timeout"].as<std::size_t>());
+			} // no throw... can be omitted
+		} // no throw... can be omitted
+
+		// load front dispatcher
+		if (config["dispatcher"] && config["dispatcher"].IsMap()) {
+			auto node = config["dispatcher"];
+			if (node["timeout"] && node["timeout"].IsScalar()) {
+				dispatcher_config_.timeout = std::chrono::milliseconds(node["timeout"].as<std::size_t>());
+			} // no throw... can be omitted
+			if (node["backends"] && node["backends"].IsSequence()) {
+				for (const auto &item : node["backends"]) {
+					if (!item.IsMap() || !item["port"] || !item["port"].IsScalar()) {
+						throw config_error("Dispatcher back-ends must be maps with a port");
+					}
+
+					dispatcher_backend backend;
+					backend.port = item["port"].as<std::uint16_t>();
+					if (item["address"] && item["address"].IsScalar()) {
+						backend.address = item["address"].as<std::string>();
+					} // no throw... can be omitted
+					if (item["hwgroups"] && item["hwgroups"].IsSequence()) {
+						backend.hwgroups = item["hwgroups"].as<std::vector<std::string>>();
+					} // no throw... can be omitted
+
+					dispatcher_config_.backends.push_back(backend);
+				}
+			} // no throw... can be omitted
 		} // no throw... can be omitted
 
 		// load logger
@@ -134,6 +299,36 @@ std::chrono::milliseconds broker_config::get_worker_ping_interval() const
 	return worker_ping_interval_;
 }
 
+std::chrono::milliseconds broker_config::get_retry_backoff() const
+{
+	return retry_backoff_;
+}
+
+std::chrono::milliseconds broker_config::get_max_retry_backoff() const
+{
+	return max_retry_backoff_;
+}
+
+std::chrono::milliseconds broker_config::get_worker_ack_timeout() const
+{
+	return worker_ack_timeout_;
+}
+
+std::size_t broker_config::get_max_job_redeliveries() const
+{
+	return max_job_redeliveries_;
+}
+
+double broker_config::get_worker_phi_threshold() const
+{
+	return worker_phi_threshold_;
+}
+
+std::size_t broker_config::get_worker_phi_min_samples() const
+{
+	return worker_phi_min_samples_;
+}
+
 const log_config &broker_config::get_log_config() const
 {
 	return log_config_;
@@ -144,6 +339,61 @@ const notifier_config &broker_config::get_notifier_config() const
 	return notifier_config_;
 }
 
+const std::string &broker_config::get_reactor_backend() const
+{
+	return reactor_backend_;
+}
+
+const std::string &broker_config::get_trace_file() const
+{
+	return trace_file_;
+}
+
+const admission_config &broker_config::get_admission_config() const
+{
+	return admission_config_;
+}
+
+const quarantine_config &broker_config::get_quarantine_config() const
+{
+	return quarantine_config_;
+}
+
+double broker_config::get_hedging_runtime_multiple() const
+{
+	return hedging_runtime_multiple_;
+}
+
+std::size_t broker_config::get_hedging_min_samples() const
+{
+	return hedging_min_samples_;
+}
+
+const std::string &broker_config::get_affinity_metadata_key() const
+{
+	return affinity_metadata_key_;
+}
+
+std::size_t broker_config::get_affinity_cache_size() const
+{
+	return affinity_cache_size_;
+}
+
+std::chrono::milliseconds broker_config::get_affinity_max_wait() const
+{
+	return affinity_max_wait_;
+}
+
+const replication_config &broker_config::get_replication_config() const
+{
+	return replication_config_;
+}
+
+const dispatcher_config &broker_config::get_dispatcher_config() const
+{
+	return dispatcher_config_;
+}
+
 std::size_t broker_config::get_max_request_failures() const
 {
 	return max_request_failures_;
@@ -12,8 +12,12 @@
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
+#include "admission_config.h"
+#include "dispatcher_config.h"
 #include "log_config.h"
 #include "notifier_config.h"
+#include "quarantine_config.h"
+#include "replication_config.h"
 
 
 /**
@@ -83,6 +87,39 @@ public:
 	 * @return Interval between two concurrent pings.
 	 */
 	virtual std::chrono::milliseconds get_worker_ping_interval() const;
+	/**
+	 * Get the delay before a failed request is retried for the first time (it doubles with every further failure).
+	 * @return The initial delay (zero if failed requests are retried right away).
+	 */
+	virtual std::chrono::milliseconds get_retry_backoff() const;
+	/**
+	 * Get the maximal delay before a failed request is retried.
+	 * @return The maximal delay.
+	 */
+	virtual std::chrono::milliseconds get_max_retry_backoff() const;
+	/**
+	 * Get the time a worker has to confirm the receipt of a job before the job is sent to it again
+	 * (only the workers that announce it confirm their jobs).
+	 * @return The time to wait for the confirmation.
+	 */
+	virtual std::chrono::milliseconds get_worker_ack_timeout() const;
+	/**
+	 * Get the amount of times an unconfirmed job is sent to the same worker again before it is reassigned.
+	 * @return Maximum amount of redeliveries.
+	 */
+	virtual std::size_t get_max_job_redeliveries() const;
+	/**
+	 * Get the suspicion level (phi) at which a worker whose pings stopped is considered dead. The level is computed
+	 * from the observed intervals between the pings of the worker, zero disables it (only the liveness is used).
+	 * @return The suspicion level.
+	 */
+	virtual double get_worker_phi_threshold() const;
+	/**
+	 * Get the amount of observed intervals between the pings of a worker needed before its suspicion level is used
+	 * instead of its liveness.
+	 * @return Minimal amount of intervals.
+	 */
+	virtual std::size_t get_worker_phi_min_samples() const;
 	/**
 	 * Get wrapper for logger configuration.
 	 * @return Logging config as @ref log_config structure.
@@ -93,6 +130,62 @@ public:
 	 * @return Frontend connection information as @ref notifier_config structure.
 	 */
 	const notifier_config &get_notifier_config() const;
+	/**
+	 * Get the path of the file where the scheduling events are recorded.
+	 * @return The path (empty if tracing is disabled).
+	 */
+	const std::string &get_trace_file() const;
+	/**
+	 * Get the system call used by the reactors to wait for events.
+	 * @return "poll" or "epoll"
+	 */
+	const std::string &get_reactor_backend() const;
+	/**
+	 * Get the limits used to reject jobs when the queues are overloaded.
+	 * @return Admission control settings as @ref admission_config structure.
+	 */
+	virtual const admission_config &get_admission_config() const;
+	/**
+	 * Get the settings of the quarantine of workers that report too many internal errors.
+	 * @return Quarantine settings as @ref quarantine_config structure.
+	 */
+	virtual const quarantine_config &get_quarantine_config() const;
+	/**
+	 * Get the multiple of the 99th percentile of job processing times after which a running job gets
+	 * a speculative duplicate on an idle worker.
+	 * @return The multiple (zero if hedging is disabled).
+	 */
+	virtual double get_hedging_runtime_multiple() const;
+	/**
+	 * Get the amount of processing times that must be observed in a hardware group before its jobs can be hedged.
+	 * @return Minimal amount of samples.
+	 */
+	virtual std::size_t get_hedging_min_samples() const;
+	/**
+	 * Get the name of the metadata item that identifies the content cached by workers (e.g. the exercise).
+	 * @return Name of the metadata item.
+	 */
+	virtual const std::string &get_affinity_metadata_key() const;
+	/**
+	 * Get the amount of recently processed cache keys remembered for each worker.
+	 * @return The amount of keys.
+	 */
+	virtual std::size_t get_affinity_cache_size() const;
+	/**
+	 * Get the time a job can wait for a busy worker with a warm cache before it is given to any free worker.
+	 * @return The time in milliseconds.
+	 */
+	virtual std::chrono::milliseconds get_affinity_max_wait() const;
+	/**
+	 * Get the settings of the replication of the broker state to a hot standby.
+	 * @return Replication settings as @ref replication_config structure.
+	 */
+	const replication_config &get_replication_config() const;
+	/**
+	 * Get the settings of the front dispatcher that forwards jobs to back-end broker processes.
+	 * @return Dispatcher settings as @ref dispatcher_config structure.
+	 */
+	const dispatcher_config &get_dispatcher_config() const;
 
 private:
 	/** Identifier of the queue manager being used for job dispatching */
@@ -118,10 +211,44 @@ private:
 	std::size_t max_request_failures_ = 3;
 	/** Time (in milliseconds) expected to pass between pings from the worker */
 	std::chrono::milliseconds worker_ping_interval_ = std::chrono::milliseconds(1000);
+	/** Delay before the first retry of a failed request (doubled with every further failure) */
+	std::chrono::milliseconds retry_backoff_ = std::chrono::milliseconds(500);
+	/** Maximal delay before a retry of a failed request */
+	std::chrono::milliseconds max_retry_backoff_ = std::chrono::milliseconds(30000);
+	/** Time a worker has to confirm the receipt of a job */
+	std::chrono::milliseconds worker_ack_timeout_ = std::chrono::milliseconds(500);
+	/** The amount of times an unconfirmed job is sent again before it is reassigned */
+	std::size_t max_job_redeliveries_ = 2;
+	/** Suspicion level at which a silent worker is considered dead (0 means that only the liveness is used) */
+	double worker_phi_threshold_ = 8;
+	/** Amount of intervals between pings observed before the suspicion level of a worker is used */
+	std::size_t worker_phi_min_samples_ = 10;
 	/** Configuration of logger */
 	log_config log_config_;
 	/** Configuration of frontend notifier */
 	notifier_config notifier_config_;
+	/** Path of the scheduling trace (empty if tracing is disabled) */
+	std::string trace_file_ = "";
+	/** System call used by the reactors to wait for events */
+	std::string reactor_backend_ = "poll";
+	/** Configuration of admission control */
+	admission_config admission_config_;
+	/** Configuration of the quarantine of failing workers */
+	quarantine_config quarantine_config_;
+	/** Multiple of the 99th percentile of processing times after which jobs are hedged (zero disables hedging) */
+	double hedging_runtime_multiple_ = 0;
+	/** Amount of observed processing times needed before jobs are hedged */
+	std::size_t hedging_min_samples_ = 20;
+	/** Metadata item that identifies the content cached by workers */
+	std::string affinity_metadata_key_ = "exercise";
+	/** Amount of recent cache keys remembered for each worker */
+	std::size_t affinity_cache_size_ = 4;
+	/** Time a job can wait for a worker with a warm cache */
+	std::chrono::milliseconds affinity_max_wait_ = std::chrono::milliseconds(1000);
+	/** Configuration of the hot-standby replication */
+	replication_config replication_config_;
+	/** Configuration of the front dispatcher */
+	dispatcher_config dispatcher_config_;
 };
 
 
@@ -0,0 +1,44 @@
+#ifndef RECODEX_DISPATCHER_CONFIG_H
+#define RECODEX_DISPATCHER_CONFIG_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * A back-end broker process that serves a part of the hardware groups.
+ */
+struct dispatcher_backend {
+public:
+	/**
+	 * Address of the client endpoint of the back-end broker.
+	 */
+	std::string address = "127.0.0.1";
+	/**
+	 * Port of the client endpoint of the back-end broker.
+	 */
+	std::uint16_t port = 0;
+	/**
+	 * Hardware groups served by the back-end (empty if it serves the jobs no other back-end can take).
+	 */
+	std::vector<std::string> hwgroups;
+};
+
+/**
+ * Configuration of the front dispatcher that shards hardware groups across several broker processes.
+ */
+struct dispatcher_config {
+public:
+	/**
+	 * The back-end brokers (the dispatcher mode is disabled if there are none).
+	 */
+	std::vector<dispatcher_backend> backends;
+	/**
+	 * Time the dispatcher waits for the replies of the back-ends (of all of them to a request sent to each one).
+	 */
+	std::chrono::milliseconds timeout = std::chrono::milliseconds(5000);
+};
+
+#endif // RECODEX_DISPATCHER_CONFIG_H
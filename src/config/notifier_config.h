@@ -1,6 +1,7 @@
 #ifndef RECODEX_NOTIFIER_CONFIG_H
 #define RECODEX_NOTIFIER_CONFIG_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -27,6 +28,10 @@ public:
 	 * Password for HTTP authentication.
 	 */
 	std::string password;
+	/**
+	 * Amount of notifications sent at the same time (the notifications of a single job are sent in order).
+	 */
+	std::size_t concurrency = 1;
 };
 
 #endif // RECODEX_NOTIFIER_CONFIG_H
@@ -0,0 +1,31 @@
+#ifndef RECODEX_QUARANTINE_CONFIG_H
+#define RECODEX_QUARANTINE_CONFIG_H
+
+#include <chrono>
+#include <cstddef>
+
+
+/**
+ * Configuration of the quarantine of workers that report too many internal errors.
+ */
+struct quarantine_config {
+public:
+	/**
+	 * Fraction of internal errors among the recent results that makes a worker quarantined (zero disables it).
+	 */
+	double error_threshold = 0;
+	/**
+	 * Amount of recent results of each worker (and hardware group) used to compute the error rate.
+	 */
+	std::size_t window = 20;
+	/**
+	 * Minimal amount of recent results needed before a worker can be quarantined.
+	 */
+	std::size_t min_samples = 5;
+	/**
+	 * Time a quarantined worker does not get any jobs.
+	 */
+	std::chrono::milliseconds duration = std::chrono::milliseconds(60000);
+};
+
+#endif // RECODEX_QUARANTINE_CONFIG_H
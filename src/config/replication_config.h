@@ -0,0 +1,43 @@
+#ifndef RECODEX_REPLICATION_CONFIG_H
+#define RECODEX_REPLICATION_CONFIG_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * Configuration of the hot-standby replication between two broker processes.
+ */
+struct replication_config {
+public:
+	/**
+	 * Role of this broker - "primary" streams its state to a standby, "standby" mirrors the state of a primary
+	 * and takes over when the primary stops responding (empty if the replication is disabled).
+	 */
+	std::string role = "";
+	/**
+	 * Address of the replication channel (the standby binds it, the primary connects to it).
+	 */
+	std::string address = "127.0.0.1";
+	/**
+	 * Port of the replication channel.
+	 */
+	std::uint16_t port = 9659;
+	/**
+	 * Time between two heartbeats sent by the primary.
+	 */
+	std::chrono::milliseconds heartbeat_interval = std::chrono::milliseconds(500);
+	/**
+	 * Time without any message from the primary after which the standby takes over.
+	 */
+	std::chrono::milliseconds takeover_timeout = std::chrono::milliseconds(3000);
+	/**
+	 * Longest time the primary holds the replies to the clients until the standby confirms that it has the changes
+	 * they report (when it does not, the primary stops waiting until the standby confirms something again).
+	 * Zero makes the replication asynchronous.
+	 */
+	std::chrono::milliseconds ack_timeout = std::chrono::milliseconds(1000);
+};
+
+#endif // RECODEX_REPLICATION_CONFIG_H
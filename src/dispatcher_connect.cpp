@@ -0,0 +1,44 @@
+#include "dispatcher_connect.h"
+
+#include "broker_connect.h"
+#include "handlers/dispatcher_handler.h"
+#include "reactor/dealer_socket_wrapper.h"
+#include "reactor/router_socket_wrapper.h"
+
+dispatcher_connect::dispatcher_connect(std::shared_ptr<const broker_config> config,
+	std::shared_ptr<zmq::context_t> context,
+	std::shared_ptr<spdlog::logger> logger)
+	: logger_(logger),
+	  reactor_(context, config->get_reactor_backend() == "epoll" ? reactor_backend::epoll : reactor_backend::poll)
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+
+	auto clients_endpoint = "tcp://" + config->get_client_address() + ":" + std::to_string(config->get_client_port());
+	logger_->debug("Binding clients to {}", clients_endpoint);
+
+	reactor_.add_socket(
+		broker_connect::KEY_CLIENTS, std::make_shared<router_socket_wrapper>(context, clients_endpoint, true));
+
+	auto &dispatcher = config->get_dispatcher_config();
+	std::vector<std::string> keys = {broker_connect::KEY_CLIENTS, broker_connect::KEY_TIMER};
+
+	// The back-ends see the dispatcher as one of their clients
+	for (std::size_t i = 0; i < dispatcher.backends.size(); ++i) {
+		auto &backend = dispatcher.backends[i];
+		auto backend_endpoint = "tcp://" + backend.address + ":" + std::to_string(backend.port);
+		logger_->debug("Connecting broker {} to {}", i, backend_endpoint);
+
+		keys.push_back(dispatcher_handler::backend_key(i));
+		reactor_.add_socket(keys.back(), std::make_shared<dealer_socket_wrapper>(context, backend_endpoint, false));
+	}
+
+	reactor_.add_handler(keys, std::make_shared<dispatcher_handler>(dispatcher, logger_));
+}
+
+void dispatcher_connect::start_dispatching()
+{
+	reactor_.start_loop();
+	logger_->critical("The main loop terminated");
+}
@@ -0,0 +1,39 @@
+#ifndef RECODEX_BROKER_DISPATCHER_CONNECT_H
+#define RECODEX_BROKER_DISPATCHER_CONNECT_H
+
+#include <memory>
+
+#include "config/broker_config.h"
+#include "helpers/logger.h"
+#include "reactor/reactor.h"
+
+/**
+ * Receives requests from clients and forwards them to back-end brokers that serve their hardware groups.
+ * Only the client endpoint is bound, the workers connect to the back-end brokers.
+ */
+class dispatcher_connect
+{
+private:
+	/** System logger. */
+	std::shared_ptr<spdlog::logger> logger_;
+	/** A reactor that passes the messages between the clients and the back-end brokers */
+	reactor reactor_;
+
+public:
+	/**
+	 * @param config a configuration object used to set up the connections
+	 * @param context ZeroMQ context
+	 * @param logger
+	 */
+	dispatcher_connect(std::shared_ptr<const broker_config> config,
+		std::shared_ptr<zmq::context_t> context,
+		std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/**
+	 * Bind to sockets and start forwarding requests.
+	 * Blocks execution until the underlying ZeroMQ context is terminated.
+	 */
+	void start_dispatching();
+};
+
+#endif // RECODEX_BROKER_DISPATCHER_CONNECT_H
@@ -1,30 +1,72 @@
 #include "broker_handler.h"
 
 #include "../broker_connect.h"
+#include "../helpers/string_to_hex.h"
 #include "../notifier/reactor_status_notifier.h"
+#include <algorithm>
+#include <fstream>
 #include <memory>
+#include <unordered_set>
 
 broker_handler::broker_handler(std::shared_ptr<const broker_config> config,
 	std::shared_ptr<worker_registry> workers,
 	std::shared_ptr<queue_manager_interface> queue,
-	std::shared_ptr<spdlog::logger> logger)
-	: config_(config), workers_(workers), queue_(queue), logger_(logger)
+	std::shared_ptr<spdlog::logger> logger,
+	clock_fn clock)
+	: config_(config), workers_(workers), queue_(queue), logger_(logger),
+	  heartbeats_(100, config->get_worker_ping_interval() / 4), time_source_(std::move(clock)),
+	  worker_errors_(config->get_quarantine_config().window), hwgroup_errors_(config->get_quarantine_config().window)
 {
 	if (logger_ == nullptr) {
 		logger_ = helpers::create_null_logger();
 	}
 
+	if (time_source_) {
+		clock_ = time_source_();
+	}
+
+	if (!config_->get_trace_file().empty()) {
+		trace_ = std::make_unique<trace_writer>(
+			std::make_unique<std::ofstream>(config_->get_trace_file(), std::ios::binary));
+
+		if (!trace_->good()) {
+			logger_->error("Cannot open scheduling trace file {}", config_->get_trace_file());
+			trace_ = nullptr;
+		}
+	}
+
 	runtime_stats_.emplace(STATS_QUEUED_JOBS, 0);
 	runtime_stats_.emplace(STATS_EVALUATED_JOBS, 0);
 	runtime_stats_.emplace(STATS_FAILED_JOBS, 0);
 	runtime_stats_.emplace(STATS_WORKER_COUNT, 0);
 	runtime_stats_.emplace(STATS_IDLE_WORKER_COUNT, 0);
+	runtime_stats_.emplace(STATS_CANCELLED_JOBS, 0);
+	runtime_stats_.emplace(STATS_HEDGED_JOBS, 0);
+	runtime_stats_.emplace(STATS_DEADLINES_MET, 0);
+	runtime_stats_.emplace(STATS_DEADLINES_MISSED, 0);
+	runtime_stats_.emplace(STATS_DEADLINES_AT_RISK, 0);
+	runtime_stats_.emplace(STATS_QUARANTINED_WORKERS, 0);
+	runtime_stats_.emplace(STATS_DELAYED_RETRIES, 0);
+	runtime_stats_.emplace(STATS_DRAINING_WORKERS, 0);
+	runtime_stats_.emplace(STATS_DRAINED_WORKERS, 0);
+	runtime_stats_.emplace(STATS_REDELIVERED_JOBS, 0);
+	runtime_stats_.emplace(STATS_UNACKNOWLEDGED_JOBS, 0);
 
 	client_commands_.register_command(
 		"eval", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
 			process_client_eval(identity, message, respond);
 		});
 
+	client_commands_.register_command("eval-batch",
+		[this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_eval_batch(identity, message, respond);
+		});
+
+	client_commands_.register_command(
+		"cancel", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_cancel(identity, message, respond);
+		});
+
 	client_commands_.register_command("get-runtime-stats",
 		[this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
 			process_client_get_runtime_stats(identity, message, respond);
@@ -40,6 +82,16 @@ broker_handler::broker_handler(std::shared_ptr<const broker_config> config,
 			process_client_unfreeze(identity, message, respond);
 		});
 
+	client_commands_.register_command(
+		"drain", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_drain(identity, message, respond);
+		});
+
+	client_commands_.register_command(
+		"undrain", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_undrain(identity, message, respond);
+		});
+
 	worker_commands_.register_command(
 		"init", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
 			process_worker_init(identity, message, respond);
@@ -55,6 +107,11 @@ broker_handler::broker_handler(std::shared_ptr<const broker_config> config,
 			process_worker_ping(identity, message, respond);
 		});
 
+	worker_commands_.register_command(
+		"ack", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_worker_ack(identity, message, respond);
+		});
+
 	worker_commands_.register_command(
 		"progress", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
 			process_worker_progress(identity, message, respond);
@@ -75,12 +132,66 @@ void broker_handler::on_request(const message_container &message, const response
 	}
 
 	if (message.key == broker_connect::KEY_CLIENTS) {
-		client_commands_.call_function(message.data.at(0), message.identity, message.data, respond);
+		process_client_request(message, respond);
+	}
+
+	if (message.key == broker_connect::KEY_WORKER_EVENTS) {
+		process_worker_disconnected(message, respond);
 	}
 
 	if (message.key == broker_connect::KEY_TIMER) {
 		process_timer(message, respond);
 	}
+
+	if (timer_request_) {
+		auto delay = get_timer_delay();
+		if (delay.count() >= 0) {
+			timer_request_(delay);
+		}
+	}
+}
+
+void broker_handler::restore(const replica_state &state)
+{
+	restored_assignments_ = state.restore(*workers_, *queue_, config_->get_max_worker_liveness());
+
+	for (const auto &worker : workers_->get_workers()) {
+		worker_timers_[worker] = std::chrono::milliseconds(0);
+		mark_started_requests(worker);
+
+		if (trace_) {
+			trace_->worker_added(*worker);
+		}
+	}
+
+	logger_->info("Restored {} workers and {} jobs of the failed broker",
+		state.get_workers().size(),
+		state.get_job_count());
+}
+
+void broker_handler::process_client_request(const message_container &message, const response_cb &respond)
+{
+	if (message.data.size() < 3 || message.data.front() != broker_connect::REQUEST_ID) {
+		client_commands_.call_function(message.data.at(0), message.identity, message.data, respond);
+		return;
+	}
+
+	// The commands reply before they return, so the callback can refer to the request
+	const std::string &request_id = message.data[1];
+	std::vector<std::string> data(message.data.begin() + 2, message.data.end());
+
+	auto tagged_respond = [&message, &request_id, &respond](const message_container &response) {
+		if (response.key != broker_connect::KEY_CLIENTS || response.identity != message.identity) {
+			respond(response);
+			return;
+		}
+
+		message_container tagged(response);
+		tagged.data.insert(tagged.data.begin(), {broker_connect::REQUEST_ID, request_id});
+		respond(tagged);
+	};
+
+	client_commands_.call_function(data.front(), message.identity, data, tagged_respond);
 }
 
 void broker_handler::process_client_eval(
@@ -94,42 +205,27 @@ void broker_handler::process_client_eval(
 
 	// Get job identification and parse headers
 	std::string job_id = message.at(1);
-	request::headers_t headers;
 
+	// The frontend might submit the job again (e.g. after a timeout) - it is already being taken care of
+	auto existing = queue_->find_request(job_id);
+	bool delayed = existing.request == nullptr && find_delayed_retry(job_id) != delayed_retries_.end();
+	if (existing.request != nullptr || delayed) {
+		logger_->info("Request '{}' is already {}, duplicate submission ignored",
+			job_id,
+			delayed ? "waiting for a retry" : existing.worker != nullptr ? "being processed" : "queued");
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"accept"}));
+		return;
+	}
+
+	request::headers_t headers;
 	request::metadata_t metadata;
-	const static std::string metadata_key_prefix = "meta.";
 
 	// Load headers terminated by an empty frame
 	auto it = std::begin(message) + 2;
 
-	while (true) {
-		// End of headers
-		if (it->empty()) {
-			++it;
-			break;
-		}
-
-		// Unexpected end of message - do nothing and return
-		if (std::next(it) == std::end(message)) {
-			logger_->warn("Unexpected end of message from frontend. Skipped.");
-			return;
-		}
-
-		// Parse header, save it and continue
-		std::size_t pos = it->find('=');
-		std::size_t value_size = it->size() - (pos + 1);
-
-		const auto &key = it->substr(0, pos);
-		const auto &value = it->substr(pos + 1, value_size);
-
-		// Headers that start with the metadata prefix get stored in the separate metadata field
-		if (key.substr(0, metadata_key_prefix.size()) == metadata_key_prefix) {
-			metadata.emplace(key.substr(metadata_key_prefix.size()), value);
-		} else {
-			headers.emplace(key, value);
-		}
-
-		++it;
+	if (!parse_client_headers(it, std::end(message), headers, metadata)) {
+		logger_->warn("Unexpected end of message from frontend. Skipped.");
+		return;
 	}
 
 	// If the broker is frozen, reject the request
@@ -151,6 +247,26 @@ void broker_handler::process_client_eval(
 	logger_->debug(" - incoming job {}", job_id);
 
 	auto eval_request = std::make_shared<request>(headers, metadata, request_data);
+
+	if (trace_) {
+		trace_->job_arrived(*eval_request);
+	}
+
+	// If the queues are overloaded, reject the request and let the client try again later
+	auto admission = check_admission(eval_request);
+	if (!admission.admitted) {
+		std::string reject_message = "The queues are overloaded.";
+		respond(message_container(broker_connect::KEY_CLIENTS,
+			identity,
+			{"reject", reject_message, std::to_string(admission.retry_after.count())}));
+		logger_->error("Request '{}' rejected. {}", job_id, reject_message);
+		return;
+	}
+
+	// Flag the request before it is enqueued so that deadline-aware queues can take it into account
+	check_deadline(eval_request,
+		std::chrono::system_clock::now() + admission.estimated_delay + admission.expected_runtime);
+
 	enqueue_result result = queue_->enqueue_request(eval_request);
 
 	if (result.enqueued) {
@@ -160,7 +276,13 @@ void broker_handler::process_client_eval(
 			logger_->debug(" - saved to queue");
 		}
 
-		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"accept"}));
+		if (admission.delay_known) {
+			respond(message_container(broker_connect::KEY_CLIENTS,
+				identity,
+				{"accept", std::to_string(admission.estimated_delay.count())}));
+		} else {
+			respond(message_container(broker_connect::KEY_CLIENTS, identity, {"accept"}));
+		}
 	} else {
 		std::string reject_message = "No worker available for given headers: ";
 		logger_->error("Request '{}' rejected. No worker available for headers:", job_id);
@@ -174,6 +296,208 @@ void broker_handler::process_client_eval(
 	}
 }
 
+void broker_handler::process_client_eval_batch(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	logger_->info("Received message 'eval-batch' from clients");
+
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack"}));
+
+	// The headers are shared by all the jobs in the batch
+	request::headers_t headers;
+	request::metadata_t metadata;
+	auto it = std::begin(message) + 1;
+
+	if (!parse_client_headers(it, std::end(message), headers, metadata) || it == std::end(message)) {
+		logger_->warn("Unexpected end of batch message from frontend. Skipped.");
+		return;
+	}
+
+	// Every job consists of its id followed by a fixed amount of frames
+	std::size_t frame_count;
+	try {
+		frame_count = std::stoul(*it++);
+	} catch (std::exception &) {
+		logger_->warn("Invalid frame count in batch message from frontend. Skipped.");
+		return;
+	}
+
+	std::size_t remaining = std::distance(it, std::end(message));
+	if (remaining % (frame_count + 1) != 0) {
+		logger_->warn("Unexpected amount of frames in batch message from frontend. Skipped.");
+		return;
+	}
+
+	std::size_t job_count = remaining / (frame_count + 1);
+	logger_->debug(" - batch of {} jobs", job_count);
+
+	// Results for each job ('1' for accepted, '0' for rejected)
+	std::string results(job_count, '0');
+
+	if (is_frozen_) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"batch-result", results}));
+		logger_->error("Batch of {} requests rejected. The broker is frozen.", job_count);
+		return;
+	}
+
+	// Create the requests, jobs that are already queued or being processed are accepted right away
+	std::vector<request_ptr> new_requests;
+	std::vector<std::size_t> positions;
+	std::unordered_set<std::string> job_ids;
+
+	for (std::size_t i = 0; i < job_count; ++i, it += frame_count + 1) {
+		const auto &job_id = *it;
+
+		bool known = queue_->find_request(job_id).request != nullptr ||
+			find_delayed_retry(job_id) != delayed_retries_.end();
+		if (known || !job_ids.insert(job_id).second) {
+			results[i] = '1';
+			continue;
+		}
+
+		job_request_data request_data(job_id, std::vector<std::string>(std::next(it), it + frame_count + 1));
+		new_requests.push_back(std::make_shared<request>(headers, metadata, request_data));
+		positions.push_back(i);
+
+		if (trace_) {
+			trace_->job_arrived(*new_requests.back());
+		}
+	}
+
+	if (new_requests.empty()) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"batch-result", results}));
+		return;
+	}
+
+	// The whole batch is rejected if it would overload the queues
+	auto admission = check_admission(new_requests.front(), new_requests.size());
+	if (!admission.admitted) {
+		respond(message_container(broker_connect::KEY_CLIENTS,
+			identity,
+			{"batch-result", results, std::to_string(admission.retry_after.count())}));
+		logger_->error("Batch of {} requests rejected. The queues are overloaded.", new_requests.size());
+		return;
+	}
+
+	for (const auto &eval_request : new_requests) {
+		check_deadline(eval_request,
+			std::chrono::system_clock::now() + admission.estimated_delay + admission.expected_runtime);
+	}
+
+	auto enqueue_results = queue_->enqueue_requests(new_requests);
+	bool rejected = false;
+
+	for (std::size_t i = 0; i < new_requests.size(); ++i) {
+		if (!enqueue_results[i].enqueued) {
+			notify_monitor(new_requests[i], "FAILED", respond);
+			rejected = true;
+			continue;
+		}
+
+		results[positions[i]] = '1';
+
+		if (enqueue_results[i].assigned_to != nullptr) {
+			send_request(enqueue_results[i].assigned_to, new_requests[i], respond);
+		}
+	}
+
+	if (rejected) {
+		logger_->error("Requests from a batch rejected. No worker available for headers:");
+		for (auto &header : headers) {
+			logger_->error(" - {}: {}", header.first, header.second);
+		}
+	}
+
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"batch-result", results}));
+}
+
+void broker_handler::process_client_cancel(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	logger_->info("Received message 'cancel' from clients");
+
+	if (message.size() < 2) {
+		logger_->warn("Cancel command without a job id. Nothing to do.");
+		return;
+	}
+
+	const auto &job_id = message.at(1);
+	auto location = queue_->find_request(job_id);
+
+	// The job might be waiting for a retry after a failure
+	auto delayed = find_delayed_retry(job_id);
+
+	if (location.request == nullptr && delayed == delayed_retries_.end()) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"reject", "No such job."}));
+		logger_->warn("Job {} cannot be cancelled, it is neither queued nor being processed", job_id);
+		return;
+	}
+
+	if (location.request == nullptr) {
+		queue_->request_discarded(delayed->second);
+		delayed_retries_.erase(delayed);
+		logger_->debug(" - job {} will not be retried", job_id);
+	} else if (location.worker == nullptr) {
+		queue_->remove_queued_request(job_id);
+		logger_->debug(" - job {} removed from the queue", job_id);
+	} else {
+		// Let the worker abort the job and give it something else to do
+		abort_request(location.worker, job_id, respond);
+
+		// The job might have been duplicated to another worker
+		auto hedged = hedged_jobs_.find(job_id);
+		if (hedged != hedged_jobs_.end()) {
+			abort_request(hedged->second.duplicate_worker, job_id, respond);
+			hedged_jobs_.erase(hedged);
+		}
+	}
+
+	runtime_stats_[STATS_CANCELLED_JOBS] += 1;
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack"}));
+}
+
+bool broker_handler::parse_client_headers(std::vector<std::string>::const_iterator &it,
+	std::vector<std::string>::const_iterator end,
+	request::headers_t &headers,
+	request::metadata_t &metadata)
+{
+	const static std::string metadata_key_prefix = "meta.";
+
+	while (true) {
+		// Unexpected end of message
+		if (it == end) {
+			return false;
+		}
+
+		// End of headers
+		if (it->empty()) {
+			++it;
+			return true;
+		}
+
+		// Unexpected end of message
+		if (std::next(it) == end) {
+			return false;
+		}
+
+		// Parse header, save it and continue
+		std::size_t pos = it->find('=');
+		std::size_t value_size = it->size() - (pos + 1);
+
+		const auto &key = it->substr(0, pos);
+		const auto &value = it->substr(pos + 1, value_size);
+
+		// Headers that start with the metadata prefix get stored in the separate metadata field
+		if (key.substr(0, metadata_key_prefix.size()) == metadata_key_prefix) {
+			metadata.emplace(key.substr(metadata_key_prefix.size()), value);
+		} else {
+			headers.emplace(key, value);
+		}
+
+		++it;
+	}
+}
+
 void broker_handler::process_worker_init(
 	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
 {
@@ -234,22 +558,103 @@ void broker_handler::process_worker_init(
 
 		if (key == "description") {
 			new_worker->description = value;
+		} else if (key == "host") {
+			new_worker->host = value;
+		} else if (key == "session") {
+			new_worker->session = value;
 		} else if (key == "current_job") {
 			current_request = std::make_shared<request>(job_request_data(value));
+		} else if (key == "prefetch") {
+			new_worker->prefetch = value == "1" || value == "true";
+		} else if (key == "ack") {
+			new_worker->acks = value == "1" || value == "true";
+		} else if (key == "slots") {
+			// A malformed count keeps the default single slot (so that the queue is not dumped on the worker)
+			try {
+				std::size_t parsed = 0;
+				auto slots = std::stoll(value, &parsed);
+
+				if (parsed != value.size() || slots < 1 || slots > static_cast<long long>(MAX_WORKER_SLOTS)) {
+					throw std::out_of_range(value);
+				}
+
+				new_worker->slots = static_cast<std::size_t>(slots);
+			} catch (std::exception &) {
+				logger_->warn("Invalid slot count '{}' received from worker {}", value, new_worker->get_description());
+			}
+		}
+	}
+
+	// A restarted worker does not escape its quarantine (nor does a worker that reconnected with a new identity)
+	auto quarantined = quarantined_.find(identity);
+	if (quarantined == quarantined_.end() && !new_worker->session.empty()) {
+		quarantined = std::find_if(quarantined_.begin(), quarantined_.end(), [&new_worker](const auto &pair) {
+			return pair.second.worker->session == new_worker->session;
+		});
+	}
+
+	if (quarantined != quarantined_.end()) {
+		auto until = quarantined->second.until;
+		quarantined_.erase(quarantined);
+		quarantined_[identity] = quarantined_worker{new_worker, until};
+		logger_->info("Worker {} stays in quarantine after its restart", new_worker->get_description());
+		return;
+	}
+
+	// A worker that reconnected with a new identity keeps its jobs, they do not wait for the old connection to expire
+	auto previous_worker = find_session(new_worker->session, identity);
+	if (previous_worker != nullptr) {
+		if (previous_worker->hwgroup == hwgroup && previous_worker->headers_equal(headers)) {
+			resume_session(previous_worker, new_worker, respond);
+			return;
+		}
+
+		// The worker was restarted with a different configuration, its jobs are gone
+		logger_->info("Worker {} was replaced by {}", previous_worker->get_description(), new_worker->get_description());
+		expire_worker(previous_worker, "Worker restarted and its job cannot be reassigned", respond);
+	}
+
+	// The reported job might be known already - e.g. when the worker reconnects with a new identity after a broker
+	// failover. It is taken from the stale worker (or from the queue) so that it does not run twice.
+	if (current_request != nullptr) {
+		const auto &job_id = current_request->data.get_job_id();
+		auto location = queue_->find_request(job_id);
+		request_ptr known_request = nullptr;
+
+		if (location.worker != nullptr) {
+			known_request = queue_->worker_cancelled(location.worker, job_id);
+		} else if (location.request != nullptr) {
+			known_request = queue_->remove_queued_request(job_id);
+		}
+
+		if (known_request != nullptr) {
+			logger_->info("Job {} reported by worker {} is already known", job_id, new_worker->get_description());
+			current_request = known_request;
 		}
 	}
 
 	// Insert the worker into the registry
 	workers_->add_worker(new_worker);
+
+	if (trace_) {
+		trace_->worker_added(*new_worker);
+	}
+
 	request_ptr request = queue_->add_worker(new_worker, current_request);
 
 	// Give the worker a job if necessary
 	if (request != nullptr) {
 		send_request(new_worker, request, respond);
+	} else {
+		mark_started_requests(new_worker);
 	}
 
+	// A prefetching worker can also get its next job right away
+	assign_queued_requests(new_worker, respond);
+
 	// Start an idle timer for our new worker
 	worker_timers_.emplace(new_worker, std::chrono::milliseconds(0));
+	heartbeats_.reset(identity);
 
 	if (logger_->should_log(spdlog::level::debug)) {
 		std::stringstream ss;
@@ -258,72 +663,242 @@ void broker_handler::process_worker_init(
 	}
 }
 
-void broker_handler::process_worker_done(
-	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+worker_registry::worker_ptr broker_handler::find_session(const std::string &session, const std::string &identity)
+{
+	if (session.empty()) {
+		return nullptr;
+	}
+
+	for (const auto &worker : workers_->get_workers()) {
+		if (worker->session == session && worker->identity != identity) {
+			return worker;
+		}
+	}
+
+	return nullptr;
+}
+
+void broker_handler::resume_session(
+	worker_registry::worker_ptr previous_worker, worker_registry::worker_ptr worker, const response_cb &respond)
 {
 	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
 
-	// first let us know that message arrived (logging moved from main loop)
-	logger_->info("Received message 'done' from workers");
+	logger_->info("Worker {} resumed the session of {}",
+		worker->get_description(),
+		helpers::string_to_hex(previous_worker->identity));
 
-	worker_registry::worker_ptr worker = workers_->find_worker_by_identity(identity);
+	// The jobs the worker holds (in the order they were assigned, so that the prefetched one stays last)
+	auto current_requests = queue_->get_current_requests(previous_worker);
+	auto requests = queue_->worker_terminated(previous_worker);
+	workers_->remove_worker(previous_worker);
+	worker_timers_.erase(previous_worker);
+	heartbeats_.reset(previous_worker->identity);
 
-	if (worker == nullptr) {
-		logger_->warn("Got 'done' message from an unknown worker");
-		return;
+	if (trace_) {
+		trace_->worker_removed(*previous_worker);
 	}
 
-	if (message.size() < 3) {
-		logger_->error("Got 'done' message with not enough arguments from worker {}", worker->get_description());
-		return;
+	auto probation = probation_.find(previous_worker);
+	if (probation != probation_.end()) {
+		probation_.erase(probation);
+		probation_[worker] = probation_state{worker->slots, worker->prefetch};
+		worker->slots = 1;
+		worker->prefetch = false;
 	}
 
-	request_ptr current = queue_->get_current_request(worker);
+	workers_->add_worker(worker);
+	worker_timers_[worker] = std::chrono::milliseconds(0);
+	heartbeats_.reset(worker->identity);
 
-	if (message.at(1) != current->data.get_job_id()) {
-		logger_->error("Got 'done' message from worker {} with mismatched job id - {} (message) vs. {} (worker)",
-			worker->get_description(),
-			message.at(1),
-			current->data.get_job_id());
-		return;
+	if (trace_) {
+		trace_->worker_added(*worker);
 	}
 
-	auto status = message.at(2);
-
-	if (status == "OK") {
-		// notify frontend that job ended successfully and complete it internally
-		status_notifier.job_done(message.at(1));
-		request_ptr next_request = queue_->worker_finished(worker);
-
-		if (next_request != nullptr) {
-			send_request(worker, next_request, respond);
+	for (auto &pair : hedged_jobs_) {
+		if (pair.second.original_worker == previous_worker) {
+			pair.second.original_worker = worker;
 		}
 
-		runtime_stats_[STATS_EVALUATED_JOBS] += 1;
-	} else if (status == "INTERNAL_ERROR") {
-		if (message.size() != 4) {
-			logger_->warn(
-				"Invalid number of arguments in a 'done' message with status 'INTERNAL_FAILURE' from worker {}",
-				worker->get_description());
-			return;
+		if (pair.second.duplicate_worker == previous_worker) {
+			pair.second.duplicate_worker = worker;
 		}
+	}
 
-		auto failed_request = queue_->worker_cancelled(worker);
-		failed_request->failure_count += 1;
+	// The worker is registered without a job, then the jobs it holds are added in their original order
+	worker->draining = previous_worker->draining;
+	queue_->add_unassigned_worker(worker);
+
+	// The jobs keep running on the worker machine, they are not sent again
+	for (const auto &request : current_requests) {
+		const auto &job_id = request->data.get_job_id();
+		auto hedged = hedged_jobs_.find(job_id);
+
+		if (hedged == hedged_jobs_.end() || hedged->second.duplicate_worker != worker) {
+			queue_->add_current_request(worker, request);
+			continue;
+		}
+
+		// A duplicate is not indexed, the index keeps pointing to the original copy
+		if (!queue_->assign_duplicate_request(worker, request)) {
+			// The worker announced fewer slots than before, the original copy is enough
+			hedged_jobs_.erase(hedged);
+			forget_start_time(request);
+			respond(message_container(broker_connect::KEY_WORKERS, worker->identity, {"cancel", job_id}));
+		}
+	}
+
+	// Unconfirmed jobs are sent again through the new connection
+	for (auto it = pending_acks_.begin(); it != pending_acks_.end();) {
+		if (it->first.first != previous_worker) {
+			++it;
+			continue;
+		}
+
+		pending_acks_.emplace(std::make_pair(worker, it->first.second), it->second);
+		it = pending_acks_.erase(it);
+	}
+
+	// Requests queued for the previous connection are dispatched again
+	for (const auto &queued_request : *requests) {
+		if (std::find(current_requests.begin(), current_requests.end(), queued_request) != current_requests.end()) {
+			continue;
+		}
+
+		if (!reassign_request(queued_request, respond)) {
+			status_notifier.rejected_job(
+				queued_request->data.get_job_id(), "Worker reconnected and its job cannot be reassigned");
+		}
+	}
+
+	assign_queued_requests(worker, respond);
+}
+
+void broker_handler::process_worker_done(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+
+	// first let us know that message arrived (logging moved from main loop)
+	logger_->info("Received message 'done' from workers");
+
+	worker_registry::worker_ptr worker = workers_->find_worker_by_identity(identity);
+
+	if (worker == nullptr) {
+		logger_->warn("Got 'done' message from an unknown worker");
+		return;
+	}
+
+	if (message.size() < 3) {
+		logger_->error("Got 'done' message with not enough arguments from worker {}", worker->get_description());
+		return;
+	}
+
+	auto current_requests = queue_->get_current_requests(worker);
+	auto current = std::find_if(current_requests.begin(), current_requests.end(), [&message](request_ptr request) {
+		return request->data.get_job_id() == message.at(1);
+	});
+
+	if (current == current_requests.end()) {
+		logger_->error("Got 'done' message from worker {} with job id {} which is not assigned to the worker",
+			worker->get_description(),
+			message.at(1));
+		return;
+	}
+
+	// A result also confirms that the worker got the job
+	pending_acks_.erase({worker, message.at(1)});
+
+	auto status = message.at(2);
+
+	if (trace_) {
+		trace_->job_finished(*worker, message.at(1), status);
+	}
+
+	bool quarantine = false;
+	if (status == "OK" || status == "FAILED" || status == "INTERNAL_ERROR") {
+		quarantine = record_result(worker, status == "INTERNAL_ERROR", status_notifier);
+	}
+
+	auto hedged = hedged_jobs_.find(message.at(1));
+	if (hedged != hedged_jobs_.end()) {
+		auto other_worker = hedged->second.original_worker == worker ? hedged->second.duplicate_worker
+																	 : hedged->second.original_worker;
+
+		if (status != "OK") {
+			// The other copy of the job is still being processed, so this result is not needed
+			logger_->info("Duplicated job {} failed on worker {}, waiting for the other copy",
+				message.at(1),
+				worker->get_description());
+			queue_->worker_cancelled(worker, message.at(1));
+			forget_start_time(*current);
+			drop_hedged_copy(message.at(1), worker);
+
+			if (quarantine) {
+				quarantine_worker(worker, status_notifier, respond);
+				return;
+			}
+
+			mark_started_requests(worker);
+			assign_queued_requests(worker, respond);
+			return;
+		}
+
+		// The first result wins
+		hedged_jobs_.erase(hedged);
+		abort_request(other_worker, message.at(1), respond);
+	}
+
+	if (status == "OK") {
+		// notify frontend that job ended successfully and complete it internally
+		status_notifier.job_done(message.at(1));
+		record_deadline(*current);
+
+		auto start_time = start_times_.find(*current);
+		if (start_time != start_times_.end()) {
+			add_runtime_sample(worker->hwgroup, now() - start_time->second.time);
+			forget_start_time(*current);
+		}
+
+		request_ptr next_request = queue_->worker_finished(worker, message.at(1));
+
+		if (next_request != nullptr) {
+			send_request(worker, next_request, respond);
+			assign_queued_requests(worker, respond);
+		}
+
+		runtime_stats_[STATS_EVALUATED_JOBS] += 1;
+	} else if (status == "INTERNAL_ERROR") {
+		if (message.size() != 4) {
+			logger_->warn(
+				"Invalid number of arguments in a 'done' message with status 'INTERNAL_FAILURE' from worker {}",
+				worker->get_description());
+			return;
+		}
+
+		auto failed_request = queue_->worker_cancelled(worker, message.at(1));
+		failed_request->failure_count += 1;
+		failed_request->record_failure(*worker);
+		forget_start_time(failed_request);
+
+		// The worker is taken out of the pool first, so that the failed job is reassigned elsewhere
+		if (quarantine) {
+			quarantine_worker(worker, status_notifier, respond);
+		}
 
 		if (!failed_request->data.is_complete()) {
 			status_notifier.rejected_job(
 				failed_request->data.get_job_id(), "Job failed with '" + message.at(3) + "' and cannot be reassigned");
 		} else if (check_failure_count(failed_request, status_notifier, respond, message.at(3))) {
 			reassign_request(failed_request, respond);
-		} else {
-			auto new_request = queue_->assign_request(worker);
-			if (new_request) {
-				send_request(worker, new_request, respond);
-			}
 		}
 
 		runtime_stats_[STATS_FAILED_JOBS] += 1;
+
+		if (quarantine) {
+			return;
+		}
+
+		assign_queued_requests(worker, respond);
 	} else if (status == "FAILED") {
 		if (message.size() != 4) {
 			logger_->warn("Invalid number of arguments in a 'done' message with status 'FAILED' from worker {}",
@@ -332,22 +907,35 @@ void broker_handler::process_worker_done(
 		}
 
 		status_notifier.job_failed(message.at(1), message.at(3));
+		record_deadline(*current);
 
-		auto failed_request = queue_->worker_cancelled(worker);
+		auto failed_request = queue_->worker_cancelled(worker, message.at(1));
 		failed_request->failure_count += 1;
-		auto new_request = queue_->assign_request(worker);
-
-		if (new_request) {
-			send_request(worker, new_request, respond);
-		}
+		forget_start_time(failed_request);
+		assign_queued_requests(worker, respond);
 
 		runtime_stats_[STATS_FAILED_JOBS] += 1;
 	} else {
 		logger_->warn("Received unexpected status code {} from worker {}", status, worker->get_description());
 	}
 
+	// The probe job passed, the worker can use all its slots again
+	auto probation = probation_.find(worker);
+	if (probation != probation_.end()) {
+		worker->slots = probation->second.slots;
+		worker->prefetch = probation->second.prefetch;
+		probation_.erase(probation);
+
+		logger_->info("Worker {} passed its probe job and was readmitted", worker->get_description());
+		assign_queued_requests(worker, respond);
+	}
+
+	// The prefetched request (if any) has taken the freed slot
+	mark_started_requests(worker);
+
 	if (queue_->get_current_request(worker) == nullptr) {
 		logger_->debug(" - worker {} is now free", worker->get_description());
+		check_drained(worker);
 	}
 }
 
@@ -360,13 +948,32 @@ void broker_handler::process_worker_ping(
 	worker_registry::worker_ptr worker = workers_->find_worker_by_identity(identity);
 
 	if (worker == nullptr) {
-		respond(message_container(broker_connect::KEY_WORKERS, identity, {"intro"}));
+		// A quarantined worker is alive, it just does not get any jobs
+		auto reply = quarantined_.count(identity) > 0 ? "pong" : "intro";
+		respond(message_container(broker_connect::KEY_WORKERS, identity, {reply}));
 		return;
 	}
 
+	heartbeats_.heartbeat(identity, now());
 	respond(message_container(broker_connect::KEY_WORKERS, identity, {"pong"}));
 }
 
+void broker_handler::process_worker_ack(
+	const std::string &identity, const std::vector<std::string> &message, const handler_interface::response_cb &respond)
+{
+	worker_registry::worker_ptr worker = workers_->find_worker_by_identity(identity);
+
+	if (worker == nullptr || message.size() < 2) {
+		return;
+	}
+
+	if (pending_acks_.erase({worker, message.at(1)}) == 0) {
+		logger_->debug("Worker {} confirmed job {} which was not waiting for a confirmation",
+			worker->get_description(),
+			message.at(1));
+	}
+}
+
 void broker_handler::process_worker_progress(
 	const std::string &identity, const std::vector<std::string> &message, const handler_interface::response_cb &respond)
 {
@@ -385,7 +992,25 @@ void broker_handler::process_timer(const message_container &message, const handl
 	std::chrono::milliseconds time(std::stoll(message.data.front()));
 	std::list<worker_registry::worker_ptr> to_remove;
 
+	clock_ = time_source_ ? time_source_() : clock_ + time;
+
+	if (!restored_assignments_.empty()) {
+		send_restored_requests(respond);
+	}
+
+	auto phi_threshold = config_->get_worker_phi_threshold();
+	auto phi_min_samples = config_->get_worker_phi_min_samples();
+
 	for (const auto &worker : workers_->get_workers()) {
+		// The pings of the worker were observed long enough to tell whether it is late better than the liveness
+		if (phi_threshold > 0 && heartbeats_.get_sample_count(worker->identity) >= phi_min_samples) {
+			if (heartbeats_.get_phi(worker->identity, clock_) >= phi_threshold) {
+				to_remove.push_back(worker);
+			}
+
+			continue;
+		}
+
 		if (worker_timers_.find(worker) == std::end(worker_timers_)) {
 			worker_timers_[worker] = std::chrono::milliseconds(0);
 		}
@@ -402,60 +1027,539 @@ void broker_handler::process_timer(const message_container &message, const handl
 		}
 	}
 
-	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
-	const static std::string failure_msg = "Worker timed out and its job cannot be reassigned";
-
 	for (const auto &worker : to_remove) {
 		logger_->info("Worker {} expired", worker->get_description());
+		expire_worker(worker, "Worker timed out and its job cannot be reassigned", respond);
+	}
+
+	check_acks(respond);
+	readmit_workers(respond);
+	retry_delayed_requests(respond);
 
-		workers_->remove_worker(worker);
-		if (queue_->get_current_request(worker) != nullptr) {
-			queue_->get_current_request(worker)->failure_count += 1;
+	// requests that were held back by the queue manager for too long can be processed by any worker now
+	for (auto &pair : queue_->assign_waiting_requests()) {
+		send_request(pair.first, pair.second, respond);
+	}
+
+	hedge_stragglers(respond);
+	update_runtime_stats();
+
+	if (trace_) {
+		trace_->flush();
+	}
+}
+
+std::chrono::milliseconds broker_handler::now() const
+{
+	return time_source_ ? time_source_() : clock_;
+}
+
+void broker_handler::update_runtime_stats()
+{
+	runtime_stats_[STATS_QUEUED_JOBS] = queue_->get_queued_request_count();
+	runtime_stats_[STATS_WORKER_COUNT] = workers_->get_workers().size();
+	runtime_stats_[STATS_QUARANTINED_WORKERS] = quarantined_.size();
+	runtime_stats_[STATS_DELAYED_RETRIES] = delayed_retries_.size();
+	runtime_stats_[STATS_UNACKNOWLEDGED_JOBS] = pending_acks_.size();
+
+	runtime_stats_[STATS_IDLE_WORKER_COUNT] = 0;
+	runtime_stats_[STATS_JOBS_IN_PROGRESS] = 0;
+	runtime_stats_[STATS_DRAINING_WORKERS] = 0;
+	runtime_stats_[STATS_DRAINED_WORKERS] = 0;
+	for (auto &worker : workers_->get_workers()) {
+		auto current_requests = queue_->get_current_requests(worker);
+
+		if (current_requests.empty()) {
+			runtime_stats_[STATS_IDLE_WORKER_COUNT] += 1;
 		}
 
-		auto requests = queue_->worker_terminated(worker);
-		std::vector<worker::request_ptr> unassigned_requests;
+		if (worker->draining) {
+			runtime_stats_[current_requests.empty() ? STATS_DRAINED_WORKERS : STATS_DRAINING_WORKERS] += 1;
+		}
 
-		for (const auto &request : *requests) {
-			if (!request->data.is_complete()) {
-				status_notifier.rejected_job(request->data.get_job_id(), failure_msg);
-				notify_monitor(request, "FAILED", respond);
+		// Prefetched jobs are not in progress yet
+		runtime_stats_[STATS_JOBS_IN_PROGRESS] += std::min(current_requests.size(), worker->slots);
+	}
+
+	for (auto &pair : queue_->get_statistics()) {
+		runtime_stats_[pair.first] = pair.second;
+	}
+}
+
+std::chrono::milliseconds broker_handler::get_timer_delay() const
+{
+	auto nearest = std::chrono::milliseconds::max();
+	auto current_time = now();
+	auto consider = [current_time, &nearest](std::chrono::milliseconds deadline) {
+		nearest = std::min(nearest, deadline - current_time);
+	};
+
+	if (!restored_assignments_.empty()) {
+		consider(current_time);
+	}
+
+	auto phi_threshold = config_->get_worker_phi_threshold();
+	auto phi_min_samples = config_->get_worker_phi_min_samples();
+
+	for (const auto &worker : workers_->get_workers()) {
+		if (phi_threshold > 0 && heartbeats_.get_sample_count(worker->identity) >= phi_min_samples) {
+			consider(heartbeats_.get_suspicion_time(worker->identity, phi_threshold));
+			continue;
+		}
+
+		// The liveness decreases once the worker is silent for longer than the ping interval
+		auto timer = worker_timers_.find(worker);
+		auto silence = timer != worker_timers_.end() ? timer->second : std::chrono::milliseconds(0);
+		consider(clock_ + config_->get_worker_ping_interval() - silence + std::chrono::milliseconds(1));
+
+	}
+
+	// Only the oldest job of each hardware group that does not straggle yet matters (those that straggle already are
+	// checked together with the liveness, there might be no idle worker for them)
+	for (const auto &pair : hwgroup_start_times_) {
+		auto threshold = get_straggler_threshold(pair.first);
+		if (threshold == std::chrono::milliseconds::max()) {
+			continue;
+		}
+
+		auto it = pair.second.lower_bound({current_time - threshold, nullptr});
+		while (it != pair.second.end() && hedged_jobs_.count(it->second->data.get_job_id()) > 0) {
+			++it;
+		}
+
+		if (it != pair.second.end()) {
+			consider(it->first + threshold + std::chrono::milliseconds(1));
+		}
+	}
+
+	for (const auto &pair : pending_acks_) {
+		consider(pair.second.deadline);
+	}
+
+	for (const auto &pair : quarantined_) {
+		consider(pair.second.until);
+	}
+
+	if (!delayed_retries_.empty()) {
+		consider(delayed_retries_.begin()->first);
+	}
+
+	// Queued jobs might be held back for a particular worker only for a while
+	auto waiting_delay = queue_->get_waiting_delay();
+	if (waiting_delay >= std::chrono::milliseconds(0)) {
+		consider(clock_ + waiting_delay);
+	}
+
+	if (nearest == std::chrono::milliseconds::max()) {
+		return std::chrono::milliseconds(-1);
+	}
+
+	return std::max(nearest, std::chrono::milliseconds(1));
+}
+
+void broker_handler::process_worker_disconnected(const message_container &message, const response_cb &respond)
+{
+	worker_registry::worker_ptr worker = workers_->find_worker_by_identity(message.identity);
+
+	if (worker == nullptr) {
+		return;
+	}
+
+	logger_->info("Worker {} disconnected", worker->get_description());
+	expire_worker(worker, "Worker disconnected and its job cannot be reassigned", respond);
+}
+
+void broker_handler::expire_worker(
+	worker_registry::worker_ptr worker, const std::string &failure_msg, const response_cb &respond)
+{
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+
+	workers_->remove_worker(worker);
+	probation_.erase(worker);
+	heartbeats_.reset(worker->identity);
+
+	if (trace_) {
+		trace_->worker_removed(*worker);
+	}
+
+	// Only the jobs that were actually running failed, the prefetched one was not started yet
+	auto prefetched_request = queue_->get_prefetched_request(worker);
+	for (const auto &request : queue_->get_current_requests(worker)) {
+		if (request != prefetched_request) {
+			request->failure_count += 1;
+			request->record_failure(*worker);
+		}
+	}
+
+	auto requests = queue_->worker_terminated(worker);
+	std::vector<worker::request_ptr> unassigned_requests;
+
+	for (const auto &request : *requests) {
+		forget_start_time(request);
+
+		// The other copy of a duplicated job is still being processed
+		if (drop_hedged_copy(request->data.get_job_id(), worker)) {
+			continue;
+		}
+
+		if (!request->data.is_complete()) {
+			status_notifier.rejected_job(request->data.get_job_id(), failure_msg);
+			notify_monitor(request, "FAILED", respond);
+			continue;
+		}
+
+		if (!check_failure_count(request, status_notifier, respond, failure_msg)) {
+			continue;
+		}
+
+		if (!reassign_request(request, respond)) {
+			unassigned_requests.push_back(request);
+		} else {
+			notify_monitor(request, "ABORTED", respond);
+		}
+	}
+
+	// there are requests which cannot be assigned, notify frontend about it
+	if (!unassigned_requests.empty()) {
+		std::string error_message = "Worker " + worker->get_description() + " dieded";
+
+		for (const auto &request : unassigned_requests) {
+			status_notifier.rejected_job(request->data.get_job_id(), error_message);
+		}
+	}
+}
+
+void broker_handler::send_restored_requests(const response_cb &respond)
+{
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+
+	for (auto &assignment : restored_assignments_) {
+		if (assignment.first != nullptr) {
+			send_request(assignment.first, assignment.second, respond);
+		} else {
+			status_notifier.rejected_job(assignment.second->data.get_job_id(), "No worker can process the job anymore");
+			notify_monitor(assignment.second, "FAILED", respond);
+		}
+	}
+
+	restored_assignments_.clear();
+}
+
+std::chrono::milliseconds broker_handler::get_straggler_threshold(const std::string &hwgroup) const
+{
+	auto threshold = straggler_thresholds_.find(hwgroup);
+	return threshold != straggler_thresholds_.end() ? threshold->second : std::chrono::milliseconds::max();
+}
+
+void broker_handler::add_runtime_sample(const std::string &hwgroup, std::chrono::milliseconds runtime)
+{
+	runtimes_.add_sample(hwgroup, runtime);
+
+	// The percentile is computed only here, the threshold is needed after every message
+	double runtime_multiple = config_->get_hedging_runtime_multiple();
+	if (runtime_multiple <= 0 || runtimes_.get_sample_count(hwgroup) < config_->get_hedging_min_samples()) {
+		return;
+	}
+
+	// Jobs shorter than a ping interval are not worth duplicating
+	auto threshold = runtimes_.get_percentile(hwgroup, 0.99) * runtime_multiple;
+	straggler_thresholds_[hwgroup] = std::max(
+		config_->get_worker_ping_interval(), std::chrono::duration_cast<std::chrono::milliseconds>(threshold));
+}
+
+void broker_handler::hedge_stragglers(const response_cb &respond)
+{
+	if (config_->get_hedging_runtime_multiple() <= 0) {
+		return;
+	}
+
+	for (const auto &worker : workers_->get_workers()) {
+		auto prefetched_request = queue_->get_prefetched_request(worker);
+
+		for (const auto &request : queue_->get_current_requests(worker)) {
+			const auto &job_id = request->data.get_job_id();
+
+			if (request == prefetched_request || !request->data.is_complete() || hedged_jobs_.count(job_id) > 0) {
 				continue;
 			}
 
-			if (!check_failure_count(request, status_notifier, respond, failure_msg)) {
+			auto start_time = start_times_.find(request);
+			if (start_time == start_times_.end()) {
 				continue;
 			}
 
-			if (!reassign_request(request, respond)) {
-				unassigned_requests.push_back(request);
-			} else {
-				notify_monitor(request, "ABORTED", respond);
+			if (now() - start_time->second.time <= get_straggler_threshold(start_time->second.hwgroup)) {
+				continue;
+			}
+
+			for (const auto &candidate : workers_->get_workers()) {
+				if (candidate == worker || candidate->draining || !queue_->get_current_requests(candidate).empty() ||
+					!candidate->check_headers(request->headers)) {
+					continue;
+				}
+
+				auto duplicate = std::make_shared<::request>(*request);
+				if (!queue_->assign_duplicate_request(candidate, duplicate)) {
+					continue;
+				}
+
+				logger_->info("Job {} is straggling on worker {}, duplicating it to worker {}",
+					job_id,
+					worker->get_description(),
+					candidate->get_description());
+
+				hedged_jobs_[job_id] = hedged_job{worker, candidate};
+				send_request(candidate, duplicate, respond);
+				runtime_stats_[STATS_HEDGED_JOBS] += 1;
+				break;
 			}
 		}
+	}
+}
+
+void broker_handler::check_acks(const response_cb &respond)
+{
+	std::vector<std::pair<worker_registry::worker_ptr, request_ptr>> lost_requests;
+
+	for (auto it = pending_acks_.begin(); it != pending_acks_.end();) {
+		auto worker = it->first.first;
+		auto &pending = it->second;
+
+		// The job might have been finished, cancelled or taken from the worker in the meantime
+		bool assigned = false;
+		if (workers_->find_worker_by_identity(worker->identity) == worker) {
+			auto current_requests = queue_->get_current_requests(worker);
+			assigned = std::find(current_requests.begin(), current_requests.end(), pending.request) !=
+				current_requests.end();
+		}
 
-		// there are requests which cannot be assigned, notify frontend about it
-		if (!unassigned_requests.empty()) {
-			std::string error_message = "Worker " + worker->get_description() + " dieded";
+		if (!assigned) {
+			it = pending_acks_.erase(it);
+			continue;
+		}
 
-			for (const auto &request : unassigned_requests) {
-				status_notifier.rejected_job(request->data.get_job_id(), error_message);
-			}
+		if (pending.deadline > clock_) {
+			++it;
+			continue;
 		}
+
+		if (pending.redeliveries >= config_->get_max_job_redeliveries()) {
+			lost_requests.emplace_back(worker, pending.request);
+			it = pending_acks_.erase(it);
+			continue;
+		}
+
+		// The worker is expected to confirm a job it already has without starting it again
+		pending.redeliveries += 1;
+		pending.deadline = clock_ + config_->get_worker_ack_timeout();
+		respond(message_container(broker_connect::KEY_WORKERS, worker->identity, pending.request->data.get()));
+		runtime_stats_[STATS_REDELIVERED_JOBS] += 1;
+
+		logger_->info("Job {} was not confirmed by worker {}, sending it again",
+			pending.request->data.get_job_id(),
+			worker->get_description());
+		++it;
 	}
 
-	runtime_stats_[STATS_QUEUED_JOBS] = queue_->get_queued_request_count();
-	runtime_stats_[STATS_WORKER_COUNT] = workers_->get_workers().size();
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+	const static std::string failure_msg = "Worker did not confirm the receipt of the job";
 
-	runtime_stats_[STATS_IDLE_WORKER_COUNT] = 0;
-	for (auto &worker : workers_->get_workers()) {
-		if (!queue_->get_current_request(worker)) {
-			runtime_stats_[STATS_IDLE_WORKER_COUNT] += 1;
+	for (const auto &lost : lost_requests) {
+		auto &worker = lost.first;
+		auto &request = lost.second;
+		const auto &job_id = request->data.get_job_id();
+
+		logger_->warn("Job {} was never confirmed by worker {}, reassigning it", job_id, worker->get_description());
+
+		// The worker is told to drop the job in case it got it after all
+		abort_request(worker, job_id, respond);
+		request->failure_count += 1;
+		request->record_failure(*worker);
+
+		// The other copy of a duplicated job is still being processed
+		if (drop_hedged_copy(job_id, worker)) {
+			continue;
+		}
+
+		if (!request->data.is_complete()) {
+			status_notifier.rejected_job(job_id, failure_msg);
+			notify_monitor(request, "FAILED", respond);
+			continue;
+		}
+
+		if (!check_failure_count(request, status_notifier, respond, failure_msg)) {
+			continue;
+		}
+
+		if (!reassign_request(request, respond)) {
+			status_notifier.rejected_job(job_id, failure_msg);
+		} else {
+			notify_monitor(request, "ABORTED", respond);
 		}
 	}
+}
+
+bool broker_handler::record_result(
+	worker_registry::worker_ptr worker, bool error, status_notifier_interface &status_notifier)
+{
+	const auto &quarantine = config_->get_quarantine_config();
+	if (quarantine.error_threshold <= 0) {
+		return false;
+	}
+
+	worker_errors_.add_result(worker->identity, error);
+	hwgroup_errors_.add_result(worker->hwgroup, error);
 
-	runtime_stats_[STATS_JOBS_IN_PROGRESS] =
-		runtime_stats_[STATS_WORKER_COUNT] - runtime_stats_[STATS_IDLE_WORKER_COUNT];
+	// Errors in the whole hardware group suggest a problem that is not specific to a single machine
+	bool hwgroup_failing = hwgroup_errors_.get_sample_count(worker->hwgroup) >= quarantine.min_samples &&
+		hwgroup_errors_.get_error_rate(worker->hwgroup) >= quarantine.error_threshold;
+
+	if (!hwgroup_failing) {
+		failing_hwgroups_.erase(worker->hwgroup);
+	} else if (failing_hwgroups_.insert(worker->hwgroup).second) {
+		auto percents = static_cast<int>(hwgroup_errors_.get_error_rate(worker->hwgroup) * 100);
+		status_notifier.error("Hardware group " + worker->hwgroup + " reports internal errors in " +
+			std::to_string(percents) + "% of recent jobs");
+	}
+
+	if (!error) {
+		return false;
+	}
+
+	// A failed probe job sends the worker straight back to quarantine
+	if (probation_.count(worker) > 0) {
+		return true;
+	}
+
+	return worker_errors_.get_sample_count(worker->identity) >= quarantine.min_samples &&
+		worker_errors_.get_error_rate(worker->identity) >= quarantine.error_threshold;
+}
+
+void broker_handler::quarantine_worker(
+	worker_registry::worker_ptr worker, status_notifier_interface &status_notifier, const response_cb &respond)
+{
+	auto duration = config_->get_quarantine_config().duration;
+	auto percents = static_cast<int>(worker_errors_.get_error_rate(worker->identity) * 100);
+
+	logger_->warn("Worker {} quarantined for {} ms ({}% of its recent jobs ended with an internal error)",
+		worker->get_description(),
+		duration.count(),
+		percents);
+	status_notifier.error("Worker " + worker->get_description() + " was quarantined for " +
+		std::to_string(duration.count()) + " ms because " + std::to_string(percents) +
+		"% of its recent jobs ended with an internal error");
+
+	auto probation = probation_.find(worker);
+	if (probation != probation_.end()) {
+		worker->slots = probation->second.slots;
+		worker->prefetch = probation->second.prefetch;
+		probation_.erase(probation);
+	}
+
+	// The worker is not trusted with the jobs it holds, they are processed elsewhere
+	for (const auto &request : queue_->get_current_requests(worker)) {
+		respond(
+			message_container(broker_connect::KEY_WORKERS, worker->identity, {"cancel", request->data.get_job_id()}));
+	}
+
+	auto requests = queue_->worker_terminated(worker);
+	workers_->remove_worker(worker);
+	worker_timers_.erase(worker);
+	quarantined_[worker->identity] = quarantined_worker{worker, clock_ + duration};
+	runtime_stats_[STATS_QUARANTINED_WORKERS] = quarantined_.size();
+
+	if (trace_) {
+		trace_->worker_removed(*worker);
+	}
+
+	for (const auto &request : *requests) {
+		forget_start_time(request);
+
+		// The other copy of a duplicated job is still being processed
+		if (drop_hedged_copy(request->data.get_job_id(), worker)) {
+			continue;
+		}
+
+		if (!request->data.is_complete()) {
+			status_notifier.rejected_job(request->data.get_job_id(), "Worker was quarantined");
+			notify_monitor(request, "FAILED", respond);
+			continue;
+		}
+
+		if (!reassign_request(request, respond)) {
+			status_notifier.rejected_job(request->data.get_job_id(), "Worker was quarantined");
+		}
+	}
+}
+
+void broker_handler::readmit_workers(const response_cb &respond)
+{
+	for (auto it = quarantined_.begin(); it != quarantined_.end();) {
+		if (it->second.until > clock_) {
+			++it;
+			continue;
+		}
+
+		auto worker = it->second.worker;
+		it = quarantined_.erase(it);
+
+		// The worker gets a single probe job before it is trusted with all its slots again
+		probation_[worker] = probation_state{worker->slots, worker->prefetch};
+		worker->slots = 1;
+		worker->prefetch = false;
+		worker->liveness = config_->get_max_worker_liveness();
+		worker_errors_.reset(worker->identity);
+		heartbeats_.reset(worker->identity);
+
+		workers_->add_worker(worker);
+		worker_timers_[worker] = std::chrono::milliseconds(0);
+
+		if (trace_) {
+			trace_->worker_added(*worker);
+		}
+
+		logger_->info("Worker {} left the quarantine and waits for a probe job", worker->get_description());
+
+		request_ptr request = queue_->add_worker(worker);
+		if (request != nullptr) {
+			send_request(worker, request, respond);
+		}
+	}
+}
+
+void broker_handler::abort_request(
+	worker_registry::worker_ptr worker, const std::string &job_id, const response_cb &respond)
+{
+	forget_start_time(queue_->worker_cancelled(worker, job_id));
+	respond(message_container(broker_connect::KEY_WORKERS, worker->identity, {"cancel", job_id}));
+	logger_->debug(" - job {} aborted on worker {}", job_id, worker->get_description());
+
+	mark_started_requests(worker);
+	assign_queued_requests(worker, respond);
+	check_drained(worker);
+}
+
+bool broker_handler::drop_hedged_copy(const std::string &job_id, worker_registry::worker_ptr worker)
+{
+	auto hedged = hedged_jobs_.find(job_id);
+	if (hedged == hedged_jobs_.end()) {
+		return false;
+	}
+
+	auto duplicate_worker = hedged->second.duplicate_worker;
+	bool original_dropped = hedged->second.original_worker == worker;
+	hedged_jobs_.erase(hedged);
+
+	if (original_dropped) {
+		for (const auto &request : queue_->get_current_requests(duplicate_worker)) {
+			if (request->data.get_job_id() == job_id) {
+				queue_->index_duplicate_request(duplicate_worker, request);
+				break;
+			}
+		}
+	}
+
+	return true;
 }
 
 bool broker_handler::reassign_request(worker::request_ptr request, const handler_interface::response_cb &respond)
@@ -463,6 +1567,31 @@ bool broker_handler::reassign_request(worker::request_ptr request, const handler
 	logger_->debug(
 		" - reassigning job {} ({} attempts already failed)", request->data.get_job_id(), request->failure_count);
 
+	auto delay = get_retry_delay(request);
+	if (delay == std::chrono::milliseconds(0)) {
+		return enqueue_retry(request, respond);
+	}
+
+	// Waiting makes no sense if there is nobody to process the job afterwards
+	auto &workers = workers_->get_workers();
+	if (std::none_of(workers.begin(), workers.end(), [&request](const worker_registry::worker_ptr &worker) {
+			return worker->check_headers(request->headers);
+		})) {
+		notify_monitor(request, "FAILED", respond);
+		logger_->debug(" - no worker can process job {}", request->data.get_job_id());
+		return false;
+	}
+
+	// The retry is scheduled on the handler clock, so the reactor is not blocked while the job waits
+	delayed_retries_.emplace(clock_ + delay, request);
+	queue_->request_postponed(request);
+	logger_->debug(" - job {} will be retried in {} ms", request->data.get_job_id(), delay.count());
+
+	return true;
+}
+
+bool broker_handler::enqueue_retry(worker::request_ptr request, const handler_interface::response_cb &respond)
+{
 	enqueue_result result = queue_->enqueue_request(request);
 
 	if (!result.enqueued) {
@@ -480,10 +1609,196 @@ bool broker_handler::reassign_request(worker::request_ptr request, const handler
 	return true;
 }
 
+std::chrono::milliseconds broker_handler::get_retry_delay(worker::request_ptr request) const
+{
+	auto delay = config_->get_retry_backoff();
+	auto max_delay = config_->get_max_retry_backoff();
+
+	if (request->failure_count == 0 || delay == std::chrono::milliseconds(0)) {
+		return std::chrono::milliseconds(0);
+	}
+
+	// The delay doubles with every failure after the first one
+	for (std::size_t i = 1; i < request->failure_count && delay < max_delay; ++i) {
+		delay *= 2;
+	}
+
+	return std::min(delay, max_delay);
+}
+
+void broker_handler::retry_delayed_requests(const response_cb &respond)
+{
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+
+	while (!delayed_retries_.empty() && delayed_retries_.begin()->first <= clock_) {
+		auto request = delayed_retries_.begin()->second;
+		delayed_retries_.erase(delayed_retries_.begin());
+
+		if (!enqueue_retry(request, respond)) {
+			status_notifier.rejected_job(request->data.get_job_id(), "No worker can process the job anymore");
+		}
+	}
+}
+
+std::multimap<std::chrono::milliseconds, request_ptr>::iterator broker_handler::find_delayed_retry(
+	const std::string &job_id)
+{
+	return std::find_if(delayed_retries_.begin(), delayed_retries_.end(), [&job_id](const auto &pair) {
+		return pair.second->data.get_job_id() == job_id;
+	});
+}
+
 void broker_handler::send_request(worker_registry::worker_ptr worker, request_ptr request, const response_cb &respond)
 {
 	respond(message_container(broker_connect::KEY_WORKERS, worker->identity, request->data.get()));
 	logger_->debug(" - job {} sent to worker {}", request->data.get_job_id(), worker->get_description());
+
+	mark_started_requests(worker);
+	check_deadline(request, std::chrono::system_clock::now() + runtimes_.get_mean(worker->hwgroup));
+
+	if (worker->acks) {
+		pending_acks_[{worker, request->data.get_job_id()}] =
+			pending_ack{request, clock_ + config_->get_worker_ack_timeout(), 0};
+	}
+}
+
+void broker_handler::assign_queued_requests(worker_registry::worker_ptr worker, const response_cb &respond)
+{
+	request_ptr request;
+
+	while ((request = queue_->assign_request(worker)) != nullptr) {
+		send_request(worker, request, respond);
+	}
+}
+
+void broker_handler::mark_started_requests(worker_registry::worker_ptr worker)
+{
+	auto prefetched_request = queue_->get_prefetched_request(worker);
+	auto current_time = now();
+
+	for (const auto &request : queue_->get_current_requests(worker)) {
+		if (request == prefetched_request ||
+			!start_times_.emplace(request, started_request{current_time, worker->hwgroup}).second) {
+			continue;
+		}
+
+		hwgroup_start_times_[worker->hwgroup].emplace(current_time, request);
+
+		if (trace_) {
+			trace_->job_started(*worker, request->data.get_job_id());
+		}
+	}
+}
+
+void broker_handler::forget_start_time(request_ptr request)
+{
+	auto start_time = start_times_.find(request);
+	if (start_time == start_times_.end()) {
+		return;
+	}
+
+	auto hwgroup = hwgroup_start_times_.find(start_time->second.hwgroup);
+	hwgroup->second.erase({start_time->second.time, request});
+	if (hwgroup->second.empty()) {
+		hwgroup_start_times_.erase(hwgroup);
+	}
+
+	start_times_.erase(start_time);
+}
+
+broker_handler::admission_result broker_handler::check_admission(request_ptr request, std::size_t count)
+{
+	admission_result result;
+
+	// Total amount of slots of the workers that can process the request in each hardware group
+	std::map<std::string, std::size_t> hwgroup_slots;
+	std::size_t free_slots = 0;
+
+	for (const auto &worker : workers_->get_workers()) {
+		if (worker->draining || !worker->check_headers(request->headers)) {
+			continue;
+		}
+
+		auto current_count = queue_->get_current_requests(worker).size();
+		if (current_count < worker->slots) {
+			free_slots += worker->slots - current_count;
+		}
+
+		hwgroup_slots[worker->hwgroup] += worker->slots;
+	}
+
+	// Nobody can process the request - the queue manager will reject it
+	// Otherwise, the requests might start right away in the free slots
+	if (hwgroup_slots.empty() || free_slots >= count) {
+		return result;
+	}
+
+	// The amount of requests that will have to wait in the queue
+	std::size_t queued_count = count - free_slots;
+
+	const static std::chrono::milliseconds min_retry_after(1000);
+	const auto &admission = config_->get_admission_config();
+	std::chrono::milliseconds retry_after = std::chrono::milliseconds::max();
+	result.admitted = false;
+
+	for (const auto &pair : hwgroup_slots) {
+		const auto &limits = admission.get_limits(pair.first);
+		std::size_t depth = queue_->get_queued_request_count(pair.first);
+		auto mean_runtime = runtimes_.get_mean(pair.first);
+
+		// The (last) request waits until the requests queued before it (and one running request) are processed
+		std::chrono::milliseconds wait = mean_runtime * (depth + queued_count) / pair.second;
+		bool delay_known = runtimes_.has_samples(pair.first);
+
+		std::chrono::milliseconds excess(0);
+		if (limits.max_queue_depth > 0 && depth + queued_count > limits.max_queue_depth) {
+			excess = mean_runtime * (depth + queued_count - limits.max_queue_depth) / pair.second;
+		} else if (limits.max_wait.count() > 0 && delay_known && wait > limits.max_wait) {
+			excess = wait - limits.max_wait;
+		} else {
+			// Prefer the hardware group where the request is expected to start first
+			if (!result.admitted || (delay_known && (!result.delay_known || wait < result.estimated_delay))) {
+				result.delay_known = delay_known;
+				result.estimated_delay = delay_known ? wait : std::chrono::milliseconds(0);
+				result.expected_runtime = mean_runtime;
+			}
+
+			result.admitted = true;
+			continue;
+		}
+
+		retry_after = std::min(retry_after, std::max(excess, min_retry_after));
+	}
+
+	if (!result.admitted) {
+		result.retry_after = retry_after;
+	}
+
+	return result;
+}
+
+void broker_handler::check_deadline(request_ptr request, std::chrono::system_clock::time_point expected_finish)
+{
+	if (!request->has_deadline() || request->deadline_at_risk || expected_finish <= request->deadline) {
+		return;
+	}
+
+	request->deadline_at_risk = true;
+	runtime_stats_[STATS_DEADLINES_AT_RISK] += 1;
+	logger_->warn("Job {} is not expected to be finished before its deadline", request->data.get_job_id());
+}
+
+void broker_handler::record_deadline(request_ptr request)
+{
+	if (!request->has_deadline()) {
+		return;
+	}
+
+	if (std::chrono::system_clock::now() <= request->deadline) {
+		runtime_stats_[STATS_DEADLINES_MET] += 1;
+	} else {
+		runtime_stats_[STATS_DEADLINES_MISSED] += 1;
+	}
 }
 
 bool broker_handler::check_failure_count(worker::request_ptr request,
@@ -514,6 +1829,16 @@ void broker_handler::notify_monitor(
 	respond(message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {job_id, message}));
 }
 
+void broker_handler::set_timer_request_callback(timer_request_fn request)
+{
+	timer_request_ = std::move(request);
+}
+
+void broker_handler::add_runtime_stats_source(stats_source_fn source)
+{
+	stats_sources_.push_back(std::move(source));
+}
+
 void broker_handler::process_client_get_runtime_stats(
 	const std::string &identity, const std::vector<std::string> &message, const handler_interface::response_cb &respond)
 {
@@ -521,11 +1846,21 @@ void broker_handler::process_client_get_runtime_stats(
 	response.key = broker_connect::KEY_CLIENTS;
 	response.identity = identity;
 
+	// The timer messages do not come while nothing happens, so the statistics might be out of date
+	update_runtime_stats();
+
 	for (auto &pair : runtime_stats_) {
 		response.data.push_back(pair.first);
 		response.data.push_back(std::to_string(pair.second));
 	}
 
+	for (auto &source : stats_sources_) {
+		for (auto &pair : source()) {
+			response.data.push_back(pair.first);
+			response.data.push_back(std::to_string(pair.second));
+		}
+	}
+
 	// additional statistics
 	response.data.push_back("is-frozen");
 	response.data.push_back(std::to_string(is_frozen_));
@@ -553,3 +1888,97 @@ void broker_handler::process_client_unfreeze(
 	// let client know that unfreeze was successful
 	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack"}));
 }
+
+std::vector<worker_registry::worker_ptr> broker_handler::find_drained_workers(
+	const std::vector<std::string> &message) const
+{
+	std::vector<worker_registry::worker_ptr> result;
+
+	if (message.size() < 3) {
+		return result;
+	}
+
+	const auto &kind = message.at(1);
+	const auto &value = message.at(2);
+
+	for (const auto &worker : workers_->get_workers()) {
+		if ((kind == "identity" && (worker->identity == value || helpers::string_to_hex(worker->identity) == value)) ||
+			(kind == "description" && worker->description == value) || (kind == "hwgroup" && worker->hwgroup == value)) {
+			result.push_back(worker);
+		}
+	}
+
+	return result;
+}
+
+void broker_handler::process_client_drain(
+	const std::string &identity, const std::vector<std::string> &message, const handler_interface::response_cb &respond)
+{
+	logger_->info("Received message 'drain' from clients");
+
+	auto workers = find_drained_workers(message);
+	if (workers.empty()) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"reject", "No such worker."}));
+		return;
+	}
+
+	reactor_status_notifier status_notifier(respond, broker_connect::KEY_STATUS_NOTIFIER);
+
+	for (const auto &worker : workers) {
+		if (worker->draining) {
+			continue;
+		}
+
+		worker->draining = true;
+		logger_->info("Worker {} is draining", worker->get_description());
+
+		// The jobs waiting for the worker are given to somebody else
+		for (const auto &request : queue_->worker_draining(worker)) {
+			enqueue_result result = queue_->enqueue_request(request);
+
+			if (!result.enqueued) {
+				status_notifier.rejected_job(request->data.get_job_id(), "Worker is draining");
+				notify_monitor(request, "FAILED", respond);
+			} else if (result.assigned_to != nullptr) {
+				send_request(result.assigned_to, request, respond);
+			}
+		}
+
+		check_drained(worker);
+	}
+
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack", std::to_string(workers.size())}));
+}
+
+void broker_handler::process_client_undrain(
+	const std::string &identity, const std::vector<std::string> &message, const handler_interface::response_cb &respond)
+{
+	logger_->info("Received message 'undrain' from clients");
+
+	auto workers = find_drained_workers(message);
+	if (workers.empty()) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"reject", "No such worker."}));
+		return;
+	}
+
+	for (const auto &worker : workers) {
+		if (!worker->draining) {
+			continue;
+		}
+
+		worker->draining = false;
+		logger_->info("Worker {} is no longer draining", worker->get_description());
+		assign_queued_requests(worker, respond);
+	}
+
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack", std::to_string(workers.size())}));
+}
+
+void broker_handler::check_drained(worker_registry::worker_ptr worker)
+{
+	if (!worker->draining || !queue_->get_current_requests(worker).empty()) {
+		return;
+	}
+
+	logger_->info("Worker {} is drained and can be shut down", worker->get_description());
+}
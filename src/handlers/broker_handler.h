@@ -1,11 +1,18 @@
 #ifndef RECODEX_BROKER_BROKER_HANDLER_H
 #define RECODEX_BROKER_BROKER_HANDLER_H
 
+#include <functional>
+#include <set>
 #include <spdlog/logger.h>
 
 #include "../config/broker_config.h"
 #include "../notifier/status_notifier.h"
 #include "../queuing/queue_manager_interface.h"
+#include "../queuing/error_rate_tracker.h"
+#include "../queuing/phi_accrual_detector.h"
+#include "../queuing/runtime_tracker.h"
+#include "../replication/replica_state.h"
+#include "../trace/scheduling_trace.h"
 #include "../reactor/command_holder.h"
 #include "../reactor/handler_interface.h"
 #include "../worker_registry.h"
@@ -16,22 +23,65 @@
 class broker_handler : public handler_interface
 {
 public:
+	/** A source of the current time */
+	using clock_fn = std::function<std::chrono::milliseconds()>;
+
 	/**
 	 * @param config broker configuration
 	 * @param workers worker registry (it's acceptable if it already contains some workers)
 	 * @param logger an optional logger
+	 * @param clock an optional source of the current time (e.g. a steady clock), the time is accumulated from
+	 * the timer messages without it
 	 */
 	broker_handler(std::shared_ptr<const broker_config> config,
 		std::shared_ptr<worker_registry> workers,
 		std::shared_ptr<queue_manager_interface> queue,
-		std::shared_ptr<spdlog::logger> logger);
+		std::shared_ptr<spdlog::logger> logger,
+		clock_fn clock = nullptr);
 
 	/** Destructor */
 	~broker_handler() override = default;
 
 	void on_request(const message_container &message, const response_cb &respond) override;
 
+	/**
+	 * Take over the workers and jobs of a failed broker. The jobs held by the workers are not sent again,
+	 * queued jobs that get assigned during the restoration are sent with the first timer message.
+	 * @param state replica of the state of the failed broker
+	 */
+	void restore(const replica_state &state);
+
+	/** Type of the function that provides additional runtime statistics */
+	using stats_source_fn = std::function<std::map<std::string, std::size_t>()>;
+
+	/**
+	 * Add statistics of another component (e.g. an asynchronous handler) to the replies to "get-runtime-stats".
+	 * @param source called from the reactor thread whenever the statistics are requested
+	 */
+	void add_runtime_stats_source(stats_source_fn source);
+
+	/** Type of the function that asks for a timer message */
+	using timer_request_fn = std::function<void(std::chrono::milliseconds delay)>;
+
+	/**
+	 * Ask for the timer messages only when there is a timeout to check instead of getting them periodically.
+	 * @param request called from the reactor thread after each processed message with the time until the nearest
+	 * timeout (it is not called when nothing waits for a timeout)
+	 */
+	void set_timer_request_callback(timer_request_fn request);
+
+	/**
+	 * Get the time until the nearest timeout that is checked when the timer message comes (a worker that might
+	 * stop responding, an unconfirmed job, a job waiting for a retry, a quarantined worker, a job that might become
+	 * a straggler, a queued job that stops waiting for a particular worker...).
+	 * @return -1 ms if nothing waits for a timeout
+	 */
+	std::chrono::milliseconds get_timer_delay() const;
+
 private:
+	/** The largest amount of slots a worker can announce */
+	static const std::size_t MAX_WORKER_SLOTS = 1024;
+
 	const std::string STATS_QUEUED_JOBS = "queued-jobs";
 
 	const std::string STATS_EVALUATED_JOBS = "evaluated-jobs";
@@ -44,6 +94,28 @@ private:
 
 	const std::string STATS_IDLE_WORKER_COUNT = "idle-worker-count";
 
+	const std::string STATS_CANCELLED_JOBS = "cancelled-jobs";
+
+	const std::string STATS_HEDGED_JOBS = "hedged-jobs";
+
+	const std::string STATS_DEADLINES_MET = "deadlines-met";
+
+	const std::string STATS_DEADLINES_MISSED = "deadlines-missed";
+
+	const std::string STATS_DEADLINES_AT_RISK = "deadlines-at-risk";
+
+	const std::string STATS_QUARANTINED_WORKERS = "quarantined-workers";
+
+	const std::string STATS_DELAYED_RETRIES = "delayed-retries";
+
+	const std::string STATS_DRAINING_WORKERS = "draining-workers";
+
+	const std::string STATS_DRAINED_WORKERS = "drained-workers";
+
+	const std::string STATS_REDELIVERED_JOBS = "redelivered-jobs";
+
+	const std::string STATS_UNACKNOWLEDGED_JOBS = "unacknowledged-jobs";
+
 	/** Broker configuration */
 	std::shared_ptr<const broker_config> config_;
 
@@ -59,9 +131,118 @@ private:
 	/** Time since we last heard from each worker or decreased their liveness */
 	std::map<worker_registry::worker_ptr, std::chrono::milliseconds> worker_timers_;
 
+	/** Intervals between the pings of each worker (by identity) used to tell when a worker is late */
+	phi_accrual_detector heartbeats_;
+
+	/** The source of the current time (nullptr if the time is accumulated from the timer messages) */
+	clock_fn time_source_;
+
+	/** Time of the last timer message (time elapsed since the handler was created if there is no time source) */
+	std::chrono::milliseconds clock_ = std::chrono::milliseconds(0);
+
+	/**
+	 * A request that is being processed by a worker
+	 */
+	struct started_request {
+		/** Time when the request was started */
+		std::chrono::milliseconds time;
+		/** Hardware group of the worker that started the request */
+		std::string hwgroup;
+	};
+
+	/** The requests currently being processed by workers */
+	std::map<request_ptr, started_request> start_times_;
+
+	/** Start times of the requests being processed in each hardware group (ordered from the oldest one) */
+	std::map<std::string, std::set<std::pair<std::chrono::milliseconds, request_ptr>>> hwgroup_start_times_;
+
+	/** Processing times of jobs observed in each hardware group */
+	runtime_tracker runtimes_;
+
+	/** Running times after which the jobs of each hardware group are duplicated (only groups with enough samples) */
+	std::map<std::string, std::chrono::milliseconds> straggler_thresholds_;
+
+	/**
+	 * Workers processing a job that was speculatively duplicated
+	 */
+	struct hedged_job {
+		/** The worker that got the job first */
+		worker_registry::worker_ptr original_worker;
+		/** The worker that processes the duplicate */
+		worker_registry::worker_ptr duplicate_worker;
+	};
+
+	/** Jobs that are being processed by two workers at once (by job id) */
+	std::map<std::string, hedged_job> hedged_jobs_;
+
+	/** Failed requests waiting for their retry (by the time on the handler clock when they are retried) */
+	std::multimap<std::chrono::milliseconds, request_ptr> delayed_retries_;
+
+	/** Recent results of each worker (by identity) used to detect broken machines */
+	error_rate_tracker worker_errors_;
+
+	/** Recent results in each hardware group */
+	error_rate_tracker hwgroup_errors_;
+
+	/** Hardware groups whose error rate crossed the quarantine threshold (reported only once) */
+	std::set<std::string> failing_hwgroups_;
+
+	/**
+	 * A worker that does not get any jobs for a while
+	 */
+	struct quarantined_worker {
+		/** The worker (it is not in the worker registry nor in the queue manager) */
+		worker_registry::worker_ptr worker;
+		/** Time (on the handler clock) when the worker gets a probe job */
+		std::chrono::milliseconds until;
+	};
+
+	/** Quarantined workers (by identity) */
+	std::map<std::string, quarantined_worker> quarantined_;
+
+	/**
+	 * Original settings of a readmitted worker that processes a single probe job
+	 */
+	struct probation_state {
+		/** The amount of slots of the worker */
+		std::size_t slots;
+		/** Whether the worker supports prefetching */
+		bool prefetch;
+	};
+
+	/** Readmitted workers waiting for the result of their probe job */
+	std::map<worker_registry::worker_ptr, probation_state> probation_;
+
+	/**
+	 * A job sent to a worker that has not confirmed its receipt yet
+	 */
+	struct pending_ack {
+		/** The sent request */
+		request_ptr request;
+		/** Time (on the handler clock) when the job is sent again if it is still not confirmed */
+		std::chrono::milliseconds deadline;
+		/** The amount of times the job has been sent again */
+		std::size_t redeliveries;
+	};
+
+	/** Unconfirmed jobs sent to the workers that acknowledge their jobs (by the worker and job id) */
+	std::map<std::pair<worker_registry::worker_ptr, std::string>, pending_ack> pending_acks_;
+
+	/** Jobs assigned while the state of a failed broker was restored (nullptr worker if they cannot be processed) */
+	std::vector<std::pair<worker_registry::worker_ptr, request_ptr>> restored_assignments_;
+
 	/** Various statistics */
 	std::map<std::string, std::size_t> runtime_stats_;
 
+	/** Statistics of other components */
+	std::vector<stats_source_fn> stats_sources_;
+
+	/** Asks for the timer messages (empty if they come periodically) */
+	timer_request_fn timer_request_;
+
+	/** Records the scheduling events for offline analysis (nullptr if tracing is disabled) */
+	std::unique_ptr<trace_writer> trace_;
+
 	/** Handlers for commands received from the workers */
 	command_holder worker_commands_;
 
@@ -71,18 +252,54 @@ private:
 	/** Frozen state does not process requests */
 	bool is_frozen_ = false;
 
+	/**
+	 * Outcome of the admission control for a new request
+	 */
+	struct admission_result {
+		/** True if the request can be enqueued */
+		bool admitted = true;
+		/** True if the request will probably wait in a queue and its start delay could be estimated */
+		bool delay_known = false;
+		/** Estimated time before the request is started */
+		std::chrono::milliseconds estimated_delay = std::chrono::milliseconds(0);
+		/** Mean processing time in the hardware group where the request is expected to start first */
+		std::chrono::milliseconds expected_runtime = std::chrono::milliseconds(0);
+		/** Suggested time after which a rejected request should be submitted again */
+		std::chrono::milliseconds retry_after = std::chrono::milliseconds(0);
+	};
+
 	/** Type of the most common callback */
 	using handler_fn = void(const std::string &, const std::vector<std::string> &, const response_cb &);
 
 	/**
 	 * Process an "init" request from a worker.
 	 * That means storing the identity and headers of the worker so that we can forward jobs to it.
+	 * A worker that presents the session token of a known worker with another identity takes over its jobs.
 	 */
 	handler_fn process_worker_init;
 
+	/**
+	 * Find a worker connected with another identity that has given session token.
+	 * @param session the session token (no worker is found if it is empty)
+	 * @param identity the identity of the new connection
+	 * @return the worker or nullptr if there is none
+	 */
+	worker_registry::worker_ptr find_session(const std::string &session, const std::string &identity);
+
+	/**
+	 * Move the jobs and the state of a worker to its new connection (so that they do not run twice).
+	 * @param previous_worker the worker with the old identity
+	 * @param worker the worker with the new identity (it is not registered yet)
+	 * @param respond a callback to notify the workers and the frontend
+	 */
+	void resume_session(
+		worker_registry::worker_ptr previous_worker, worker_registry::worker_ptr worker, const response_cb &respond);
+
 	/**
 	 * Process a "done" message from a worker.
+	 * The finished job is matched by its id (a worker with multiple slots processes several jobs at once).
 	 * We notify the frontend and if possible, assign a new job to the worker.
+	 * If the job was duplicated, the first successful result is used and the other copy is aborted.
 	 */
 	handler_fn process_worker_done;
 
@@ -92,19 +309,51 @@ private:
 	 */
 	handler_fn process_worker_ping;
 
+	/**
+	 * Process an "ack" message from a worker that confirms it received a job.
+	 * Only the workers that announced it in their "init" message (ack=1) confirm their jobs.
+	 */
+	handler_fn process_worker_ack;
+
 	/**
 	 * Process a "state" message from worker.
 	 * Resend "state" message to monitor service.
 	 */
 	handler_fn process_worker_progress;
 
+	/**
+	 * Process a request from a client. A request that starts with a "request-id" frame and an id (used by the
+	 * dispatcher) is processed without them and each reply to the client is prefixed with the same two frames.
+	 */
+	void process_client_request(const message_container &message, const response_cb &respond);
+
 	/**
 	 * Process an "eval" request from a client.
 	 * Client requested evaluation, so hand it over to proper worker with corresponding headers.
-	 * "accept" or "reject" message is send back to client.
+	 * "accept" or "reject" message is send back to client. When the job has to wait in a queue and its start delay
+	 * can be estimated, the "accept" message carries the delay in milliseconds. When the job is rejected because
+	 * the queues are overloaded, the "reject" message carries a suggested retry delay in milliseconds.
+	 * A job that is already queued or being processed is not enqueued again, its submission is just accepted.
 	 */
 	handler_fn process_client_eval;
 
+	/**
+	 * Process an "eval-batch" request from a client.
+	 * The message carries the headers shared by all the jobs terminated by an empty frame, the amount of data frames
+	 * of each job and then the jobs themselves (each of them is an id followed by its data frames).
+	 * The client gets a single "batch-result" message with a string of '1' (accepted) and '0' (rejected) characters
+	 * for each of the jobs. When the batch is rejected because the queues are overloaded, a suggested retry delay
+	 * in milliseconds follows.
+	 */
+	handler_fn process_client_eval_batch;
+
+	/**
+	 * Process a "cancel" request from a client.
+	 * A queued job is removed from the queue, a job that is being processed is aborted by its worker
+	 * (which can then take another job). "ack" is sent back if the job was cancelled, "reject" otherwise.
+	 */
+	handler_fn process_client_cancel;
+
 	/**
 	 * Process a request for data about system load.
 	 */
@@ -120,21 +369,179 @@ private:
 	 */
 	handler_fn process_client_unfreeze;
 
+	/**
+	 * Process a "drain" request from a client. The workers selected by their identity (raw or hexadecimal),
+	 * description or hardware group (e.g. "drain hwgroup group_1") do not get any new jobs, but they finish those
+	 * they already have. "ack" with the amount of affected workers is sent back, "reject" if there are none.
+	 */
+	handler_fn process_client_drain;
+
+	/**
+	 * Process an "undrain" request from a client. The selected workers get new jobs again.
+	 * The request has the same format and replies as "drain".
+	 */
+	handler_fn process_client_undrain;
+
+	/**
+	 * Get the current time on the handler clock. Unlike the time of the last timer message, it is precise even when
+	 * the timer messages come only on demand.
+	 */
+	std::chrono::milliseconds now() const;
+
 	/**
 	 * Process a message about elapsed time from the reactor.
 	 * If we haven't heard from a worker in a long time, we decrease its liveness counter. When this counter
 	 * reaches zero, we consider it dead and try to reassign its jobs.
+	 * Once we know the usual intervals between the pings of a worker, it is considered dead when its suspicion
+	 * level (see @ref phi_accrual_detector) reaches the configured threshold instead.
 	 */
 	void process_timer(const message_container &message, const response_cb &respond);
 
 	/**
-	 * Find a substitute worker to try and process the request again.
+	 * Process a notification about a closed connection of a worker (the identity of the message is the worker).
+	 * The worker is expired right away, without waiting for it to miss its pings.
+	 */
+	void process_worker_disconnected(const message_container &message, const response_cb &respond);
+
+	/**
+	 * Remove a dead worker and reassign its jobs.
+	 * @param worker the worker
+	 * @param failure_msg reported for the jobs that cannot be reassigned
+	 * @param respond a callback to notify the workers and the frontend
+	 */
+	void expire_worker(worker_registry::worker_ptr worker, const std::string &failure_msg, const response_cb &respond);
+
+	/**
+	 * Send the jobs assigned while the state of a failed broker was restored
+	 * @param respond a callback to notify the workers and the frontend
+	 */
+	void send_restored_requests(const response_cb &respond);
+
+	/**
+	 * Dispatch duplicates of the jobs that run much longer than usual in their hardware group to idle workers.
+	 * The first result that arrives is used and the other copy of the job is cancelled.
+	 * @param respond a callback to notify the workers about the duplicated jobs
+	 */
+	void hedge_stragglers(const response_cb &respond);
+
+	/**
+	 * Get the running time after which the jobs of a hardware group are considered straggling.
+	 * @return the maximal duration if hedging is disabled or there are not enough samples of the hardware group
+	 */
+	std::chrono::milliseconds get_straggler_threshold(const std::string &hwgroup) const;
+
+	/**
+	 * Record the processing time of a finished job and update the straggler threshold of its hardware group.
+	 * @param hwgroup hardware group of the worker that processed the job
+	 * @param runtime the processing time
+	 */
+	void add_runtime_sample(const std::string &hwgroup, std::chrono::milliseconds runtime);
+
+	/**
+	 * Recompute the statistics that describe the current state (queue lengths, worker counts...).
+	 */
+	void update_runtime_stats();
+
+	/**
+	 * Send the jobs whose receipt was not confirmed in time again. When a worker does not confirm a job even after
+	 * the last redelivery, the job is taken from it and reassigned as if the worker failed to process it.
+	 * @param respond a callback to notify the workers and the frontend
+	 */
+	void check_acks(const response_cb &respond);
+
+	/**
+	 * Update the error rates of a worker and its hardware group with a job result. The frontend is notified when
+	 * the error rate of a whole hardware group crosses the quarantine threshold.
+	 * @param worker the worker that processed the job
+	 * @param error true if the job ended with an internal error
+	 * @param status_notifier used to notify the frontend
+	 * @return true if the worker should be quarantined
+	 */
+	bool record_result(worker_registry::worker_ptr worker, bool error, status_notifier_interface &status_notifier);
+
+	/**
+	 * Stop giving jobs to a worker for the configured time. The jobs it holds are cancelled and reassigned.
+	 * @param worker the worker to be quarantined
+	 * @param status_notifier used to report the quarantine to the frontend
+	 * @param respond a callback to notify the workers
+	 */
+	void quarantine_worker(
+		worker_registry::worker_ptr worker, status_notifier_interface &status_notifier, const response_cb &respond);
+
+	/**
+	 * Return the workers whose quarantine is over to the pool. Each of them gets a single probe job first,
+	 * all its slots are used again only when the probe does not end with an internal error.
+	 * @param respond a callback to notify the workers about the assigned jobs
+	 */
+	void readmit_workers(const response_cb &respond);
+
+	/**
+	 * Tell a worker to abort a job it holds and give the worker another job if possible
+	 * @param worker the worker processing the job
+	 * @param job_id identifier of the job
+	 * @param respond a callback to notify the worker
+	 */
+	void abort_request(worker_registry::worker_ptr worker, const std::string &job_id, const response_cb &respond);
+
+	/**
+	 * Forget that a job is duplicated once one of its copies was dropped. If the dropped copy was the original one,
+	 * the queue manager indexes the duplicate instead, so that the job can still be found by its id.
+	 * @param job_id identifier of the job
+	 * @param worker the worker whose copy was dropped
+	 * @return true if the job was duplicated (i.e. its other copy is still being processed)
+	 */
+	bool drop_hedged_copy(const std::string &job_id, worker_registry::worker_ptr worker);
+
+	/**
+	 * Find the workers selected by a drain or undrain request.
+	 * @param message the request (the selector kind and its value follow the command)
+	 * @return the selected workers
+	 */
+	std::vector<worker_registry::worker_ptr> find_drained_workers(const std::vector<std::string> &message) const;
+
+	/**
+	 * Report that a draining worker has finished all its jobs and can be shut down.
+	 * @param worker the worker (nothing happens if it is not draining or if it still has some jobs)
+	 */
+	void check_drained(worker_registry::worker_ptr worker);
+
+	/**
+	 * Find a substitute worker to try and process the request again. A request that has already failed
+	 * is retried after an exponential backoff.
 	 * @param request the request to reassign
 	 * @param respond a callback to notify the worker about the reassigned job
-	 * @return true on success, false otherwise
+	 * @return true on success (including a scheduled retry), false otherwise
 	 */
 	bool reassign_request(worker::request_ptr request, const response_cb &respond);
 
+	/**
+	 * Put a request back in the queue right away.
+	 * @param request the request to reassign
+	 * @param respond a callback to notify the worker about the reassigned job
+	 * @return true on success, false if no worker can process the request
+	 */
+	bool enqueue_retry(worker::request_ptr request, const response_cb &respond);
+
+	/**
+	 * Get the time a failed request waits before it is retried.
+	 * @param request the request
+	 * @return the delay (zero if the request should be retried right away)
+	 */
+	std::chrono::milliseconds get_retry_delay(worker::request_ptr request) const;
+
+	/**
+	 * Retry the failed requests whose backoff has elapsed.
+	 * @param respond a callback to notify the workers and the frontend
+	 */
+	void retry_delayed_requests(const response_cb &respond);
+
+	/**
+	 * Find a failed request that waits for its retry.
+	 * @param job_id identifier of the job
+	 * @return position of the request in delayed_retries_ (the end if there is no such request)
+	 */
+	std::multimap<std::chrono::milliseconds, request_ptr>::iterator find_delayed_retry(const std::string &job_id);
+
 	/**
 	 * Send a job to a worker
 	 * @param worker the worker in need of a new job (it must be free)
@@ -144,6 +551,64 @@ private:
 	 */
 	void send_request(worker_registry::worker_ptr worker, request_ptr request, const response_cb &respond);
 
+	/**
+	 * Send queued requests to a worker until all its slots are occupied
+	 * (a worker that supports prefetching can hold one more request besides those in its slots)
+	 * @param worker the worker that might have a free slot
+	 * @param respond a callback to notify the worker about the assigned jobs
+	 */
+	void assign_queued_requests(worker_registry::worker_ptr worker, const response_cb &respond);
+
+	/**
+	 * Remember the start time of the requests that occupy a slot of a worker (and do not have one yet)
+	 * @param worker the worker whose requests should be checked
+	 */
+	void mark_started_requests(worker_registry::worker_ptr worker);
+
+	/**
+	 * Forget the start time of a request that is not processed anymore
+	 * @param request the request (nothing happens if it was not started)
+	 */
+	void forget_start_time(request_ptr request);
+
+	/**
+	 * Decide if a new request can be admitted with respect to the configured per-hwgroup limits.
+	 * The waiting time is estimated from the queue depth, the amount of slots and the observed processing times
+	 * in each hardware group able to process the request. The request is admitted if at least one such group
+	 * is within its limits.
+	 * @param request the new request
+	 * @param count the amount of requests with the same headers that are admitted together
+	 * @return the decision along with the estimated delay (of the last request) or suggested retry time
+	 */
+	admission_result check_admission(request_ptr request, std::size_t count = 1);
+
+	/**
+	 * Parse headers of a client request terminated by an empty frame
+	 * (headers that start with the metadata prefix are stored as metadata)
+	 * @param it the first header, it is moved behind the terminating frame
+	 * @param end the end of the message
+	 * @param headers the parsed headers
+	 * @param metadata the parsed metadata
+	 * @return false if the message ends before the headers are terminated
+	 */
+	static bool parse_client_headers(std::vector<std::string>::const_iterator &it,
+		std::vector<std::string>::const_iterator end,
+		request::headers_t &headers,
+		request::metadata_t &metadata);
+
+	/**
+	 * Flag a request with a deadline that is not expected to be met
+	 * @param request the request to be checked
+	 * @param expected_finish the time when the request is expected to be finished
+	 */
+	void check_deadline(request_ptr request, std::chrono::system_clock::time_point expected_finish);
+
+	/**
+	 * Update the deadline statistics with a finished request
+	 * @param request the finished request
+	 */
+	void record_deadline(request_ptr request);
+
 	/**
 	 * Check if a request can be reassigned one more time and notify the frontend if not.
 	 * @param request the request to be checked
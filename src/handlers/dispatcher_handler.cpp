@@ -0,0 +1,436 @@
+#include "dispatcher_handler.h"
+
+#include "../broker_connect.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+namespace
+{
+	/**
+	 * Find the end of the headers of an eval request (the frame after the empty one) and the hwgroup header
+	 * @return false if the headers are not terminated
+	 */
+	bool scan_headers(std::vector<std::string>::const_iterator &it,
+		std::vector<std::string>::const_iterator end,
+		std::string &hwgroup)
+	{
+		const static std::string hwgroup_prefix = "hwgroup=";
+
+		for (; it != end; ++it) {
+			if (it->empty()) {
+				++it;
+				return true;
+			}
+
+			if (it->compare(0, hwgroup_prefix.size(), hwgroup_prefix) == 0) {
+				hwgroup = it->substr(hwgroup_prefix.size());
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Split the alternatives of a hwgroup header
+	 */
+	std::vector<std::string> split_hwgroups(const std::string &value)
+	{
+		std::vector<std::string> result;
+		std::size_t offset = 0;
+
+		while (offset <= value.size()) {
+			std::size_t end = std::min(value.find('|', offset), value.size());
+			result.push_back(value.substr(offset, end - offset));
+			offset = end + 1;
+		}
+
+		return result;
+	}
+} // namespace
+
+dispatcher_handler::dispatcher_handler(const dispatcher_config &config, std::shared_ptr<spdlog::logger> logger)
+	: config_(config), logger_(logger), pending_(config.backends.size())
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+
+	client_commands_.register_command(
+		"eval", [this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_eval(identity, message, respond);
+		});
+
+	client_commands_.register_command("eval-batch",
+		[this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+			process_client_eval_batch(identity, message, respond);
+		});
+
+	for (auto command : {"cancel", "get-runtime-stats", "freeze", "unfreeze", "drain", "undrain"}) {
+		client_commands_.register_command(command,
+			[this](const std::string &identity, const std::vector<std::string> &message, response_cb respond) {
+				process_client_fan_out(identity, message, respond);
+			});
+	}
+}
+
+std::string dispatcher_handler::backend_key(std::size_t index)
+{
+	return "backend-" + std::to_string(index);
+}
+
+void dispatcher_handler::on_request(const message_container &message, const response_cb &respond)
+{
+	if (message.key == broker_connect::KEY_CLIENTS) {
+		client_commands_.call_function(message.data.at(0), message.identity, message.data, respond);
+		return;
+	}
+
+	if (message.key == broker_connect::KEY_TIMER) {
+		process_timer(message, respond);
+		return;
+	}
+
+	for (std::size_t i = 0; i < pending_.size(); ++i) {
+		if (message.key == backend_key(i)) {
+			process_backend_reply(i, message, respond);
+			return;
+		}
+	}
+}
+
+void dispatcher_handler::process_client_eval(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	logger_->info("Received message 'eval' from clients");
+
+	// The client gets the acknowledgement right away, the one from the back-end is dropped
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack"}));
+
+	// Malformed requests are not forwarded, the back-end would not reply to them
+	std::string hwgroup;
+	auto it = std::begin(message) + 1;
+
+	if (it == std::end(message) || !scan_headers(++it, std::end(message), hwgroup)) {
+		logger_->warn("Unexpected end of message from frontend. Skipped.");
+		return;
+	}
+
+	std::vector<std::string> timeout_reply = {"reject", "The broker did not reply in time."};
+
+	if (!forward_job(identity, message.at(1), hwgroup, message, timeout_reply, respond)) {
+		std::string reject_message = "No broker serves given hardware group: " + hwgroup;
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"reject", reject_message}));
+		logger_->error("Request '{}' rejected. {}", message.at(1), reject_message);
+	}
+}
+
+void dispatcher_handler::process_client_eval_batch(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	logger_->info("Received message 'eval-batch' from clients");
+
+	respond(message_container(broker_connect::KEY_CLIENTS, identity, {"ack"}));
+
+	// The checks of the back-end are repeated so that malformed batches (which get no reply) are not forwarded
+	std::string hwgroup;
+	auto it = std::begin(message) + 1;
+
+	if (!scan_headers(it, std::end(message), hwgroup) || it == std::end(message)) {
+		logger_->warn("Unexpected end of batch message from frontend. Skipped.");
+		return;
+	}
+
+	std::size_t frame_count;
+	try {
+		frame_count = std::stoul(*it++);
+	} catch (std::exception &) {
+		logger_->warn("Invalid frame count in batch message from frontend. Skipped.");
+		return;
+	}
+
+	std::size_t remaining = std::distance(it, std::end(message));
+	if (remaining % (frame_count + 1) != 0) {
+		logger_->warn("Unexpected amount of frames in batch message from frontend. Skipped.");
+		return;
+	}
+
+	std::size_t job_count = remaining / (frame_count + 1);
+	std::string first_job_id = job_count > 0 ? *it : "";
+
+	std::string results(job_count, '0');
+
+	if (!forward_job(identity, first_job_id, hwgroup, message, {"batch-result", results}, respond)) {
+		respond(message_container(broker_connect::KEY_CLIENTS, identity, {"batch-result", results}));
+		logger_->error("Batch of {} requests rejected. No broker serves hardware group {}", job_count, hwgroup);
+	}
+}
+
+void dispatcher_handler::process_client_fan_out(
+	const std::string &identity, const std::vector<std::string> &message, const response_cb &respond)
+{
+	logger_->info("Received message '{}' from clients", message.at(0));
+
+	// The back-ends do not reply to a cancellation without a job id
+	if (message.at(0) == "cancel" && message.size() < 2) {
+		logger_->warn("Cancel command without a job id. Nothing to do.");
+		return;
+	}
+
+	auto aggregate = std::make_shared<fan_out>();
+	aggregate->client = identity;
+	aggregate->command = message.at(0);
+
+	if (pending_.empty()) {
+		answer(*aggregate, respond);
+		return;
+	}
+
+	for (std::size_t i = 0; i < pending_.size(); ++i) {
+		send_to_backend(i, pending_request{"", false, aggregate}, message, respond);
+	}
+
+	fan_outs_.push_back(aggregate);
+}
+
+void dispatcher_handler::process_backend_reply(
+	std::size_t index, const message_container &message, const response_cb &respond)
+{
+	auto &pending = pending_[index];
+	std::uint64_t request_id = 0;
+
+	// The ids start at 1, so an untagged or malformed reply gets 0
+	if (message.data.size() > 2 && message.data.front() == broker_connect::REQUEST_ID) {
+		request_id = std::strtoull(message.data[1].c_str(), nullptr, 10);
+	}
+
+	if (request_id == 0) {
+		logger_->warn("Unexpected message from broker {}. Skipped.", index);
+		return;
+	}
+
+	// A reply that comes after the timeout is dropped
+	auto it = pending.find(request_id);
+	if (it == pending.end()) {
+		logger_->debug("Reply of broker {} to request {} came too late. Skipped.", index, request_id);
+		return;
+	}
+
+	std::vector<std::string> reply(message.data.begin() + 2, message.data.end());
+
+	if (it->second.expects_ack && reply.front() == "ack") {
+		it->second.expects_ack = false;
+		return;
+	}
+
+	auto request = std::move(it->second);
+	pending.erase(it);
+
+	if (request.aggregate == nullptr) {
+		respond(message_container(broker_connect::KEY_CLIENTS, request.client, reply));
+		return;
+	}
+
+	auto &aggregate = *request.aggregate;
+	if (aggregate.answered) {
+		return;
+	}
+
+	aggregate.replies.push_back(reply);
+
+	if (is_complete(aggregate)) {
+		answer(aggregate, respond);
+		fan_outs_.remove(request.aggregate);
+	}
+}
+
+void dispatcher_handler::process_timer(const message_container &message, const response_cb &respond)
+{
+	std::chrono::milliseconds time(std::stoll(message.data.front()));
+
+	for (auto it = fan_outs_.begin(); it != fan_outs_.end();) {
+		auto &aggregate = **it;
+		aggregate.elapsed += time;
+
+		if (aggregate.elapsed < config_.timeout) {
+			++it;
+			continue;
+		}
+
+		logger_->warn("Only {} of {} brokers replied to '{}' in time",
+			aggregate.replies.size(),
+			pending_.size(),
+			aggregate.command);
+		answer(aggregate, respond);
+		it = fan_outs_.erase(it);
+	}
+
+	// A reply can get lost (e.g. when a back-end restarts), the clients do not wait for it forever
+	for (std::size_t i = 0; i < pending_.size(); ++i) {
+		for (auto it = pending_[i].begin(); it != pending_[i].end();) {
+			auto &request = it->second;
+			request.elapsed += time;
+
+			if (request.elapsed < config_.timeout) {
+				++it;
+				continue;
+			}
+
+			if (request.aggregate == nullptr) {
+				logger_->warn("Broker {} did not reply to request {} in time", i, it->first);
+				respond(message_container(broker_connect::KEY_CLIENTS, request.client, request.timeout_reply));
+			}
+
+			it = pending_[i].erase(it);
+		}
+	}
+}
+
+bool dispatcher_handler::forward_job(const std::string &identity,
+	const std::string &job_id,
+	const std::string &hwgroup,
+	const std::vector<std::string> &message,
+	std::vector<std::string> timeout_reply,
+	const response_cb &respond)
+{
+	auto backends = find_backends(hwgroup);
+	if (backends.empty()) {
+		return false;
+	}
+
+	// A job submitted again goes to the same back-end, which recognizes it
+	std::size_t index = backends.at(std::hash<std::string>()(job_id) % backends.size());
+	logger_->debug(" - job {} forwarded to broker {}", job_id, index);
+
+	send_to_backend(index, pending_request{identity, true, nullptr, std::move(timeout_reply)}, message, respond);
+	return true;
+}
+
+void dispatcher_handler::send_to_backend(
+	std::size_t index, pending_request request, const std::vector<std::string> &message, const response_cb &respond)
+{
+	std::uint64_t request_id = ++last_request_id_;
+	pending_[index].emplace(request_id, std::move(request));
+
+	message_container tagged(backend_key(index), "", {broker_connect::REQUEST_ID, std::to_string(request_id)});
+	tagged.data.insert(tagged.data.end(), message.begin(), message.end());
+	respond(tagged);
+}
+
+std::vector<std::size_t> dispatcher_handler::find_backends(const std::string &hwgroup) const
+{
+	std::vector<std::size_t> result;
+	std::vector<std::size_t> fallback;
+
+	if (hwgroup.empty()) {
+		for (std::size_t i = 0; i < config_.backends.size(); ++i) {
+			result.push_back(i);
+		}
+
+		return result;
+	}
+
+	auto alternatives = split_hwgroups(hwgroup);
+
+	for (std::size_t i = 0; i < config_.backends.size(); ++i) {
+		const auto &served = config_.backends[i].hwgroups;
+
+		if (served.empty()) {
+			fallback.push_back(i);
+			continue;
+		}
+
+		for (const auto &alternative : alternatives) {
+			if (std::find(served.begin(), served.end(), alternative) != served.end()) {
+				result.push_back(i);
+				break;
+			}
+		}
+	}
+
+	return result.empty() ? fallback : result;
+}
+
+bool dispatcher_handler::is_complete(const fan_out &aggregate) const
+{
+	return aggregate.replies.size() == pending_.size();
+}
+
+void dispatcher_handler::answer(fan_out &aggregate, const response_cb &respond)
+{
+	aggregate.answered = true;
+	message_container response(broker_connect::KEY_CLIENTS, aggregate.client, {});
+
+	auto acknowledged = std::count_if(aggregate.replies.begin(),
+		aggregate.replies.end(),
+		[](const std::vector<std::string> &reply) { return reply.front() == "ack"; });
+
+	auto rejection = std::find_if(aggregate.replies.begin(),
+		aggregate.replies.end(),
+		[](const std::vector<std::string> &reply) { return reply.front() == "reject"; });
+
+	if (aggregate.command == "get-runtime-stats") {
+		// The statistics of the back-ends are added up, the dispatcher is frozen if any of the back-ends is
+		std::map<std::string, std::size_t> stats;
+		std::size_t is_frozen = 0;
+
+		for (const auto &reply : aggregate.replies) {
+			for (std::size_t i = 0; i + 1 < reply.size(); i += 2) {
+				std::size_t value;
+				try {
+					value = std::stoul(reply[i + 1]);
+				} catch (std::exception &) {
+					continue;
+				}
+
+				if (reply[i] == "is-frozen") {
+					is_frozen = std::max(is_frozen, value);
+				} else {
+					stats[reply[i]] += value;
+				}
+			}
+		}
+
+		stats["responding-brokers"] = aggregate.replies.size();
+
+		for (auto &pair : stats) {
+			response.data.push_back(pair.first);
+			response.data.push_back(std::to_string(pair.second));
+		}
+
+		response.data.push_back("is-frozen");
+		response.data.push_back(std::to_string(is_frozen));
+	} else if (aggregate.command == "drain" || aggregate.command == "undrain") {
+		// Each back-end reports how many of its workers matched
+		std::size_t count = 0;
+		for (const auto &reply : aggregate.replies) {
+			if (reply.front() == "ack" && reply.size() > 1) {
+				count += std::strtoul(reply[1].c_str(), nullptr, 10);
+			}
+		}
+
+		if (acknowledged > 0) {
+			response.data = {"ack", std::to_string(count)};
+		} else {
+			response.data = {"reject", "No such worker."};
+		}
+	} else if (aggregate.command == "cancel") {
+		// The job is held by a single back-end, the others do not know it
+		if (acknowledged > 0) {
+			response.data = {"ack"};
+		} else if (rejection != aggregate.replies.end()) {
+			response.data = *rejection;
+		} else {
+			response.data = {"reject", "No such job."};
+		}
+	} else {
+		// Freezing succeeds only if all the back-ends confirm it
+		if (static_cast<std::size_t>(acknowledged) == pending_.size()) {
+			response.data = {"ack"};
+		} else {
+			response.data = {"reject", "Not all brokers replied."};
+		}
+	}
+
+	respond(response);
+}
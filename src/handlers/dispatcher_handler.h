@@ -0,0 +1,163 @@
+#ifndef RECODEX_BROKER_DISPATCHER_HANDLER_H
+#define RECODEX_BROKER_DISPATCHER_HANDLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <spdlog/logger.h>
+
+#include "../config/dispatcher_config.h"
+#include "../reactor/command_holder.h"
+#include "../reactor/handler_interface.h"
+
+/**
+ * Forwards the requests of the clients to back-end brokers that serve disjoint sets of hardware groups.
+ * Jobs are sent to a back-end that serves one of their hardware groups. Requests that concern all the jobs or
+ * workers (cancellation, statistics, freezing and draining) are sent to every back-end and their replies are merged.
+ *
+ * The requests are tagged with an id that the back-ends copy to their replies, so a reply that gets lost (e.g. when
+ * a back-end restarts) does not confuse the replies to the following requests. A client whose request is not
+ * answered within the timeout gets a rejection.
+ */
+class dispatcher_handler : public handler_interface
+{
+public:
+	/**
+	 * @param config the back-ends and the time to wait for their replies
+	 * @param logger an optional logger
+	 */
+	dispatcher_handler(const dispatcher_config &config, std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/** Destructor */
+	~dispatcher_handler() override = default;
+
+	void on_request(const message_container &message, const response_cb &respond) override;
+
+	/**
+	 * Get the reactor key of the socket connected to given back-end.
+	 * @param index position of the back-end in the configuration
+	 */
+	static std::string backend_key(std::size_t index);
+
+private:
+	/**
+	 * A request sent to every back-end, waiting for the replies
+	 */
+	struct fan_out {
+		/** Identity of the client */
+		std::string client;
+		/** The command sent to the back-ends */
+		std::string command;
+		/** Replies received so far */
+		std::vector<std::vector<std::string>> replies;
+		/** Time since the request was sent */
+		std::chrono::milliseconds elapsed = std::chrono::milliseconds(0);
+		/** True if the client has already got a reply */
+		bool answered = false;
+	};
+
+	/**
+	 * A request waiting for a reply of a back-end
+	 */
+	struct pending_request {
+		/** Identity of the client (unused for fanned out requests) */
+		std::string client;
+		/** True if the back-end acknowledges the request before the actual reply */
+		bool expects_ack;
+		/** The request is a part of this fanned out request (nullptr if it was sent to this back-end only) */
+		std::shared_ptr<fan_out> aggregate;
+		/** Reply sent to the client if the back-end does not answer in time (unused for fanned out requests) */
+		std::vector<std::string> timeout_reply;
+		/** Time since the request was sent */
+		std::chrono::milliseconds elapsed = std::chrono::milliseconds(0);
+	};
+
+	/** Type of the function that processes a command */
+	using handler_fn = void(const std::string &, const std::vector<std::string> &, const response_cb &);
+
+	/** The back-ends and the time to wait for their replies */
+	dispatcher_config config_;
+
+	/** A system logger */
+	std::shared_ptr<spdlog::logger> logger_;
+
+	/** Requests waiting for a reply of each of the back-ends (indexed by their ids) */
+	std::vector<std::map<std::uint64_t, pending_request>> pending_;
+
+	/** Id of the last request sent to a back-end */
+	std::uint64_t last_request_id_ = 0;
+
+	/** Fanned out requests that have not been answered yet */
+	std::list<std::shared_ptr<fan_out>> fan_outs_;
+
+	/** Handlers of the client commands */
+	command_holder client_commands_;
+
+	/**
+	 * Process an "eval" request from a client (the job is forwarded to a back-end that serves its hardware group).
+	 */
+	handler_fn process_client_eval;
+
+	/**
+	 * Process an "eval-batch" request from a client (the whole batch is forwarded to a single back-end).
+	 */
+	handler_fn process_client_eval_batch;
+
+	/**
+	 * Send a request of a client to every back-end.
+	 */
+	handler_fn process_client_fan_out;
+
+	/**
+	 * Process a reply of a back-end.
+	 * @param index position of the back-end
+	 */
+	void process_backend_reply(std::size_t index, const message_container &message, const response_cb &respond);
+
+	/**
+	 * Answer the requests that have been waiting for too long.
+	 */
+	void process_timer(const message_container &message, const response_cb &respond);
+
+	/**
+	 * Forward a job to a back-end.
+	 * @param job_id a job id that picks a back-end when there are more of them for the hardware groups
+	 * @param hwgroup value of the hwgroup header of the job (empty if there is none)
+	 * @param timeout_reply reply sent to the client if the back-end does not answer in time
+	 * @return false if there is no back-end that serves the hardware group
+	 */
+	bool forward_job(const std::string &identity,
+		const std::string &job_id,
+		const std::string &hwgroup,
+		const std::vector<std::string> &message,
+		std::vector<std::string> timeout_reply,
+		const response_cb &respond);
+
+	/**
+	 * Tag a request with a new id and send it to a back-end.
+	 * @param index position of the back-end
+	 * @param request the record that waits for the reply
+	 */
+	void send_to_backend(
+		std::size_t index, pending_request request, const std::vector<std::string> &message, const response_cb &respond);
+
+	/**
+	 * Find the back-ends that can process a job.
+	 * @param hwgroup value of the hwgroup header of the job (alternatives separated by '|')
+	 */
+	std::vector<std::size_t> find_backends(const std::string &hwgroup) const;
+
+	/**
+	 * Merge the replies of the back-ends to a fanned out request and send the result to the client.
+	 */
+	void answer(fan_out &aggregate, const response_cb &respond);
+
+	/**
+	 * Check if all the back-ends replied to a fanned out request.
+	 */
+	bool is_complete(const fan_out &aggregate) const;
+};
+
+#endif // RECODEX_BROKER_DISPATCHER_HANDLER_H
@@ -0,0 +1,148 @@
+#include "replication_handler.h"
+
+#include <algorithm>
+
+#include "../broker_connect.h"
+#include "../helpers/logger.h"
+
+replication_handler::replication_handler(std::shared_ptr<replicated_queue_manager> queue,
+	std::chrono::milliseconds heartbeat_interval,
+	std::shared_ptr<handler_interface> broker,
+	std::chrono::milliseconds ack_timeout,
+	std::shared_ptr<spdlog::logger> logger)
+	: queue_(queue), heartbeat_interval_(heartbeat_interval), broker_(broker), ack_timeout_(ack_timeout),
+	  logger_(logger)
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+}
+
+void replication_handler::on_request(const message_container &message, const response_cb &respond)
+{
+	if (message.key == broker_connect::KEY_REPLICATION) {
+		if (!message.data.empty() && message.data.front() == "sync") {
+			logger_->info("Standby broker requested a snapshot of the state");
+			send_snapshot(respond);
+		}
+
+		if (message.data.size() >= 2 && message.data.front() == "ack") {
+			try {
+				confirm(std::stoul(message.data.at(1)), respond);
+			} catch (std::exception &) {
+				logger_->warn("Malformed confirmation received from the standby broker");
+			}
+		}
+
+		return;
+	}
+
+	if (broker_ != nullptr && ack_timeout_.count() > 0) {
+		// The replies to the clients are sent once the changes made by the message are streamed (and confirmed)
+		std::vector<message_container> replies;
+		broker_->on_request(message, [&replies, &respond](const message_container &response) {
+			if (response.key == broker_connect::KEY_CLIENTS) {
+				replies.push_back(response);
+			} else {
+				respond(response);
+			}
+		});
+
+		send_events(respond);
+		hold_replies(std::move(replies), respond);
+	} else {
+		if (broker_ != nullptr) {
+			broker_->on_request(message, respond);
+		}
+
+		send_events(respond);
+	}
+
+	if (message.key == broker_connect::KEY_TIMER) {
+		std::chrono::milliseconds time(std::stoll(message.data.front()));
+		since_heartbeat_ += time;
+
+		if (since_heartbeat_ >= heartbeat_interval_) {
+			since_heartbeat_ = std::chrono::milliseconds(0);
+			send({"heartbeat", std::to_string(sequence_)}, respond);
+		}
+
+		if (!held_replies_.empty()) {
+			unconfirmed_ += time;
+
+			if (unconfirmed_ >= ack_timeout_) {
+				logger_->warn("Standby broker did not confirm event {} in time, the replies do not wait for it until "
+							  "it confirms again",
+					held_replies_.front().first);
+				standby_lagging_ = true;
+				release_replies(respond);
+			}
+		}
+	}
+}
+
+void replication_handler::send(std::vector<std::string> frames, const response_cb &respond)
+{
+	respond(message_container(broker_connect::KEY_REPLICATION, broker_connect::STANDBY_IDENTITY, std::move(frames)));
+}
+
+void replication_handler::send_events(const response_cb &respond)
+{
+	for (auto &event : queue_->take_events()) {
+		std::vector<std::string> frames = {"event", std::to_string(++sequence_)};
+		frames.insert(frames.end(), event.begin(), event.end());
+		send(std::move(frames), respond);
+	}
+}
+
+void replication_handler::send_snapshot(const response_cb &respond)
+{
+	// The snapshot already contains the changes that were not sent yet
+	queue_->take_events();
+
+	send({"reset", std::to_string(sequence_)}, respond);
+
+	for (auto &event : queue_->get_state().snapshot()) {
+		std::vector<std::string> frames = {"event", std::to_string(++sequence_)};
+		frames.insert(frames.end(), event.begin(), event.end());
+		send(std::move(frames), respond);
+	}
+}
+
+void replication_handler::hold_replies(std::vector<message_container> replies, const response_cb &respond)
+{
+	for (auto &reply : replies) {
+		// A reply that does not wait must not overtake those that do
+		if (standby_lagging_ || (acknowledged_ >= sequence_ && held_replies_.empty())) {
+			respond(reply);
+			continue;
+		}
+
+		if (held_replies_.empty()) {
+			unconfirmed_ = std::chrono::milliseconds(0);
+		}
+
+		held_replies_.emplace_back(sequence_, std::move(reply));
+	}
+}
+
+void replication_handler::confirm(std::size_t sequence, const response_cb &respond)
+{
+	acknowledged_ = std::max(acknowledged_, sequence);
+	standby_lagging_ = false;
+	unconfirmed_ = std::chrono::milliseconds(0);
+
+	while (!held_replies_.empty() && held_replies_.front().first <= acknowledged_) {
+		respond(held_replies_.front().second);
+		held_replies_.pop_front();
+	}
+}
+
+void replication_handler::release_replies(const response_cb &respond)
+{
+	for (auto &reply : held_replies_) {
+		respond(reply.second);
+	}
+
+	held_replies_.clear();
+}
@@ -0,0 +1,107 @@
+#ifndef RECODEX_BROKER_REPLICATION_HANDLER_H
+#define RECODEX_BROKER_REPLICATION_HANDLER_H
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <spdlog/logger.h>
+
+#include "../reactor/handler_interface.h"
+#include "../replication/replicated_queue_manager.h"
+
+/**
+ * Streams the changes of the broker state to a standby broker. It either wraps the broker handler or it must be
+ * registered after it, so that the changes caused by a message are sent right after the message is processed.
+ * Every message carries a sequence number, so that the standby can detect a lost message and ask for a snapshot
+ * of the whole state ("sync"). Heartbeats are sent periodically so that the standby knows the primary is alive.
+ * The standby confirms the sequence numbers it has applied ("ack"). The replies of a wrapped broker handler to the
+ * clients are held until the changes made before them are confirmed, so that a client is not told a job was
+ * accepted before the standby knows about it.
+ */
+class replication_handler : public handler_interface
+{
+public:
+	/**
+	 * @param queue the queue manager whose changes are replicated
+	 * @param heartbeat_interval time between two heartbeats
+	 * @param broker an optional wrapped broker handler (it gets all the messages except those of the standby)
+	 * @param ack_timeout longest time the replies to the clients wait for a confirmation (zero does not wait)
+	 * @param logger an optional logger
+	 */
+	replication_handler(std::shared_ptr<replicated_queue_manager> queue,
+		std::chrono::milliseconds heartbeat_interval,
+		std::shared_ptr<handler_interface> broker = nullptr,
+		std::chrono::milliseconds ack_timeout = std::chrono::milliseconds(0),
+		std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/** Destructor */
+	~replication_handler() override = default;
+
+	void on_request(const message_container &message, const response_cb &respond) override;
+
+private:
+	/** The replicated queue manager */
+	std::shared_ptr<replicated_queue_manager> queue_;
+
+	/** Time between two heartbeats */
+	std::chrono::milliseconds heartbeat_interval_;
+
+	/** The wrapped broker handler (nullptr if it is registered separately) */
+	std::shared_ptr<handler_interface> broker_;
+
+	/** Longest time the replies to the clients wait for a confirmation */
+	std::chrono::milliseconds ack_timeout_;
+
+	/** A system logger */
+	std::shared_ptr<spdlog::logger> logger_;
+
+	/** Time since the last heartbeat */
+	std::chrono::milliseconds since_heartbeat_ = std::chrono::milliseconds(0);
+
+	/** Sequence number of the last event sent to the standby */
+	std::size_t sequence_ = 0;
+
+	/** Sequence number of the last event confirmed by the standby */
+	std::size_t acknowledged_ = 0;
+
+	/** Replies to the clients waiting for a confirmation along with the sequence number they wait for */
+	std::deque<std::pair<std::size_t, message_container>> held_replies_;
+
+	/** Time since the replies started waiting or since the last confirmation (whichever is later) */
+	std::chrono::milliseconds unconfirmed_ = std::chrono::milliseconds(0);
+
+	/** True if the standby did not confirm the events in time (the replies do not wait until it confirms again) */
+	bool standby_lagging_ = false;
+
+	/**
+	 * Send a replication message to the standby
+	 */
+	void send(std::vector<std::string> frames, const response_cb &respond);
+
+	/**
+	 * Send the events recorded by the queue manager
+	 */
+	void send_events(const response_cb &respond);
+
+	/**
+	 * Send a snapshot of the whole state (the standby drops its replica when it receives it)
+	 */
+	void send_snapshot(const response_cb &respond);
+
+	/**
+	 * Send the replies to the clients or hold them until the events sent so far are confirmed
+	 */
+	void hold_replies(std::vector<message_container> replies, const response_cb &respond);
+
+	/**
+	 * Process a confirmation of the events up to given sequence number and send the replies waiting for them
+	 */
+	void confirm(std::size_t sequence, const response_cb &respond);
+
+	/**
+	 * Send all the held replies
+	 */
+	void release_replies(const response_cb &respond);
+};
+
+#endif // RECODEX_BROKER_REPLICATION_HANDLER_H
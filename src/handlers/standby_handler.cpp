@@ -0,0 +1,127 @@
+#include "standby_handler.h"
+
+#include "../broker_connect.h"
+#include "../helpers/logger.h"
+
+standby_handler::standby_handler(std::shared_ptr<replica_state> state,
+	std::chrono::milliseconds takeover_timeout,
+	std::function<void()> takeover,
+	std::shared_ptr<spdlog::logger> logger)
+	: state_(state), takeover_timeout_(takeover_timeout), takeover_(takeover), logger_(logger)
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+}
+
+bool standby_handler::is_synced() const
+{
+	return synced_;
+}
+
+void standby_handler::on_request(const message_container &message, const response_cb &respond)
+{
+	if (message.key == broker_connect::KEY_REPLICATION && !message.data.empty()) {
+		silence_ = std::chrono::milliseconds(0);
+
+		try {
+			process_primary_message(message, respond);
+		} catch (std::exception &) {
+			logger_->warn("Malformed replication message received");
+			synced_ = false;
+			request_sync(message.identity, respond);
+		}
+	}
+
+	if (message.key == broker_connect::KEY_TIMER) {
+		std::chrono::milliseconds time(std::stoll(message.data.front()));
+		silence_ += time;
+		since_sync_request_ += time;
+
+		if (sync_requested_ && since_sync_request_ >= takeover_timeout_) {
+			sync_requested_ = false;
+		}
+
+		if (initialized_ && !taken_over_ && silence_ >= takeover_timeout_) {
+			taken_over_ = true;
+			logger_->critical("Primary broker has not responded for {} ms, taking over{}",
+				silence_.count(),
+				synced_ ? "" : " (the replica might be incomplete)");
+			takeover_();
+		}
+	}
+}
+
+void standby_handler::process_primary_message(const message_container &message, const response_cb &respond)
+{
+	const auto &type = message.data.at(0);
+
+	if (type == "reset") {
+		state_->clear();
+		primary_identity_ = message.identity;
+		sequence_ = std::stoul(message.data.at(1));
+		synced_ = true;
+		initialized_ = true;
+		sync_requested_ = false;
+		logger_->info("Receiving a snapshot of the primary broker state");
+		return;
+	}
+
+	// A restarted primary has a new identity and it starts counting from zero
+	if (!synced_ || message.identity != primary_identity_) {
+		synced_ = false;
+		request_sync(message.identity, respond);
+		return;
+	}
+
+	std::size_t sequence = std::stoul(message.data.at(1));
+
+	if (type == "heartbeat") {
+		if (sequence != sequence_) {
+			logger_->warn("Replication events {} to {} were lost", sequence_ + 1, sequence);
+			synced_ = false;
+			request_sync(message.identity, respond);
+			return;
+		}
+
+		// The confirmations might have been lost too
+		acknowledge(message.identity, respond);
+		return;
+	}
+
+	if (type == "event") {
+		if (sequence != sequence_ + 1) {
+			logger_->warn("Replication event {} was lost", sequence_ + 1);
+			synced_ = false;
+			request_sync(message.identity, respond);
+			return;
+		}
+
+		sequence_ = sequence;
+
+		if (!state_->apply(replica_state::event(message.data.begin() + 2, message.data.end()))) {
+			logger_->warn("Replication event {} cannot be applied", sequence);
+			synced_ = false;
+			request_sync(message.identity, respond);
+			return;
+		}
+
+		acknowledge(message.identity, respond);
+	}
+}
+
+void standby_handler::acknowledge(const std::string &identity, const response_cb &respond)
+{
+	respond(message_container(broker_connect::KEY_REPLICATION, identity, {"ack", std::to_string(sequence_)}));
+}
+
+void standby_handler::request_sync(const std::string &identity, const response_cb &respond)
+{
+	if (sync_requested_) {
+		return;
+	}
+
+	sync_requested_ = true;
+	since_sync_request_ = std::chrono::milliseconds(0);
+	respond(message_container(broker_connect::KEY_REPLICATION, identity, {"sync"}));
+}
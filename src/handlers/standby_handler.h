@@ -0,0 +1,96 @@
+#ifndef RECODEX_BROKER_STANDBY_HANDLER_H
+#define RECODEX_BROKER_STANDBY_HANDLER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <spdlog/logger.h>
+
+#include "../reactor/handler_interface.h"
+#include "../replication/replica_state.h"
+
+/**
+ * Mirrors the state of a primary broker from its replication messages. When a message is lost (there is a gap
+ * in the sequence numbers) or a message comes from a restarted primary, a snapshot of the whole state is requested.
+ * Every applied event (and every heartbeat of a synchronized replica) is confirmed by the last applied sequence number.
+ * When the primary falls silent for too long (and the replica was synchronized at least once), the takeover
+ * callback is invoked.
+ */
+class standby_handler : public handler_interface
+{
+public:
+	/**
+	 * @param state the replica that is kept up to date
+	 * @param takeover_timeout time without any message from the primary after which the standby takes over
+	 * @param takeover a callback invoked (once) when the standby should take over
+	 * @param logger an optional logger
+	 */
+	standby_handler(std::shared_ptr<replica_state> state,
+		std::chrono::milliseconds takeover_timeout,
+		std::function<void()> takeover,
+		std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/** Destructor */
+	~standby_handler() override = default;
+
+	void on_request(const message_container &message, const response_cb &respond) override;
+
+	/**
+	 * Check if the replica is consistent with the state of the primary.
+	 */
+	bool is_synced() const;
+
+private:
+	/** The replica */
+	std::shared_ptr<replica_state> state_;
+
+	/** Time without any message from the primary after which the standby takes over */
+	std::chrono::milliseconds takeover_timeout_;
+
+	/** Called when the standby should take over */
+	std::function<void()> takeover_;
+
+	/** A system logger */
+	std::shared_ptr<spdlog::logger> logger_;
+
+	/** Identity of the primary that sent the last snapshot */
+	std::string primary_identity_ = "";
+
+	/** Sequence number of the last applied event */
+	std::size_t sequence_ = 0;
+
+	/** True if the replica is consistent with the primary */
+	bool synced_ = false;
+
+	/** True if a snapshot was received at least once */
+	bool initialized_ = false;
+
+	/** True if the standby has already taken over */
+	bool taken_over_ = false;
+
+	/** Time since the last message from the primary */
+	std::chrono::milliseconds silence_ = std::chrono::milliseconds(0);
+
+	/** Time since a snapshot was requested (the request is repeated if it is not answered in time) */
+	std::chrono::milliseconds since_sync_request_ = std::chrono::milliseconds(0);
+
+	/** True if a snapshot was requested and it has not arrived yet */
+	bool sync_requested_ = false;
+
+	/**
+	 * Process a message from the primary
+	 */
+	void process_primary_message(const message_container &message, const response_cb &respond);
+
+	/**
+	 * Ask the primary for a snapshot of the whole state (unless it was asked recently)
+	 */
+	void request_sync(const std::string &identity, const response_cb &respond);
+
+	/**
+	 * Confirm to the primary that the replica contains all the events up to the last applied one
+	 */
+	void acknowledge(const std::string &identity, const response_cb &respond);
+};
+
+#endif // RECODEX_BROKER_STANDBY_HANDLER_H
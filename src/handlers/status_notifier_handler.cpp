@@ -64,3 +64,14 @@ void status_notifier_handler::on_request(
 		}
 	}
 }
+
+std::string status_notifier_handler::get_ordering_key(const message_container &message)
+{
+	for (std::size_t i = 0; i + 1 < message.data.size(); i += 2) {
+		if (message.data[i] == "id") {
+			return message.data[i + 1];
+		}
+	}
+
+	return "";
+}
@@ -35,6 +35,12 @@ public:
 
 	void on_request(const message_container &message, const response_cb &respond) override;
 
+	/**
+	 * Get the key that keeps the notifications of a job in order (the job id, empty for other notifications).
+	 * @param message a notification
+	 */
+	static std::string get_ordering_key(const message_container &message);
+
 private:
 	/**
 	 * A notifier configuration
@@ -0,0 +1,157 @@
+#include "cache_affinity_worker_selector.h"
+
+#include <algorithm>
+
+cache_affinity_worker_selector::cache_affinity_worker_selector(
+	const std::string &metadata_key, std::size_t cache_size, std::chrono::milliseconds max_wait, clock_fn clock)
+	: metadata_key_(metadata_key), cache_size_(cache_size), max_wait_(max_wait), clock_(std::move(clock))
+{
+	if (!clock_) {
+		clock_ = []() {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::system_clock::now().time_since_epoch());
+		};
+	}
+}
+
+worker_ptr cache_affinity_worker_selector::select(
+	const worker_jobs_t &worker_jobs, const std::vector<request_entry> &queued_jobs, request_ptr request)
+{
+	auto key = get_key(request);
+	worker_ptr first_idle = nullptr;
+	bool warm_worker_busy = false;
+
+	for (auto &pair : worker_jobs) {
+		if (!pair.first->check_headers(request->headers)) {
+			continue;
+		}
+
+		bool idle = pair.second.size() < pair.first->slots;
+		bool warm = !key.empty() && is_warm(pair.first, key);
+
+		if (idle && warm) {
+			return pair.first;
+		}
+
+		if (idle && first_idle == nullptr) {
+			first_idle = pair.first;
+		}
+
+		warm_worker_busy = warm_worker_busy || warm;
+	}
+
+	if (warm_worker_busy && max_wait_ > std::chrono::milliseconds(0)) {
+		stop_waiting(request);
+		waiting_[request] = clock_() + max_wait_;
+		wait_deadlines_.emplace(waiting_[request], request);
+		return nullptr;
+	}
+
+	return first_idle;
+}
+
+bool cache_affinity_worker_selector::accepts(worker_ptr worker, const request_entry &entry) const
+{
+	auto it = waiting_.find(entry.request);
+	if (it == waiting_.end()) {
+		return true;
+	}
+
+	return is_warm(worker, get_key(entry.request)) || it->second <= clock_();
+}
+
+void cache_affinity_worker_selector::assigned(worker_ptr worker, request_ptr request)
+{
+	stop_waiting(request);
+
+	auto key = get_key(request);
+	if (key.empty() || cache_size_ == 0) {
+		return;
+	}
+
+	auto &keys = recent_keys_[worker];
+	auto it = std::find(keys.begin(), keys.end(), key);
+
+	if (it != keys.end()) {
+		hits_ += 1;
+		keys.erase(it);
+	} else {
+		misses_ += 1;
+	}
+
+	keys.push_back(key);
+	if (keys.size() > cache_size_) {
+		keys.pop_front();
+	}
+}
+
+void cache_affinity_worker_selector::worker_removed(worker_ptr worker)
+{
+	recent_keys_.erase(worker);
+}
+
+void cache_affinity_worker_selector::request_removed(request_ptr request)
+{
+	stop_waiting(request);
+}
+
+bool cache_affinity_worker_selector::release_expired_requests()
+{
+	bool released = false;
+	auto current_time = clock_();
+
+	while (!wait_deadlines_.empty() && wait_deadlines_.begin()->first <= current_time) {
+		waiting_.erase(wait_deadlines_.begin()->second);
+		wait_deadlines_.erase(wait_deadlines_.begin());
+		released = true;
+	}
+
+	return released;
+}
+
+std::chrono::milliseconds cache_affinity_worker_selector::get_waiting_delay() const
+{
+	if (wait_deadlines_.empty()) {
+		return std::chrono::milliseconds(-1);
+	}
+
+	return std::max(wait_deadlines_.begin()->first - clock_(), std::chrono::milliseconds(0));
+}
+
+std::map<std::string, std::size_t> cache_affinity_worker_selector::get_statistics() const
+{
+	std::size_t total = hits_ + misses_;
+
+	return {
+		{"cache-hits", hits_},
+		{"cache-misses", misses_},
+		{"cache-hit-rate", total == 0 ? 0 : hits_ * 100 / total},
+	};
+}
+
+std::string cache_affinity_worker_selector::get_key(request_ptr request) const
+{
+	auto it = request->metadata.find(metadata_key_);
+	return it == request->metadata.end() ? "" : it->second;
+}
+
+bool cache_affinity_worker_selector::is_warm(worker_ptr worker, const std::string &key) const
+{
+	auto it = recent_keys_.find(worker);
+	if (it == recent_keys_.end()) {
+		return false;
+	}
+
+	return std::find(it->second.begin(), it->second.end(), key) != it->second.end();
+}
+
+void cache_affinity_worker_selector::stop_waiting(request_ptr request)
+{
+	auto it = waiting_.find(request);
+	if (it == waiting_.end()) {
+		return;
+	}
+
+	wait_deadlines_.erase({it->second, request});
+	waiting_.erase(it);
+}
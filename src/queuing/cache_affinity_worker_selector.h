@@ -0,0 +1,124 @@
+#ifndef RECODEX_BROKER_CACHE_AFFINITY_WORKER_SELECTOR_H
+#define RECODEX_BROKER_CACHE_AFFINITY_WORKER_SELECTOR_H
+
+#include "single_queue_manager.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+
+/**
+ * An idle worker selector for the single_queue_manager that prefers workers which recently processed a job with
+ * the same key (e.g. the same exercise), so that they can reuse their cached files.
+ * The key is read from the metadata of the request. When no idle worker has the key cached, but a busy one does,
+ * the request waits for it for a limited time before it can be processed by any worker.
+ */
+class cache_affinity_worker_selector
+{
+public:
+	/** A source of the current time (the system clock is used by default) */
+	using clock_fn = std::function<std::chrono::milliseconds()>;
+
+	/**
+	 * @param metadata_key name of the metadata item that identifies the cached content
+	 * @param cache_size how many recent keys are remembered for each worker
+	 * @param max_wait how long a request can wait for a worker with a warm cache
+	 * @param clock an optional source of the current time (e.g. a virtual clock of a simulation)
+	 */
+	cache_affinity_worker_selector(const std::string &metadata_key,
+		std::size_t cache_size,
+		std::chrono::milliseconds max_wait,
+		clock_fn clock = nullptr);
+
+	/**
+	 * Select an idle worker for a new request
+	 * @return a worker with a warm cache if possible, nullptr if the request should wait for a busy worker
+	 */
+	worker_ptr select(const worker_jobs_t &worker_jobs, const std::vector<request_entry> &queued_jobs, request_ptr request);
+
+	/**
+	 * Check if a queued request can be assigned to given worker
+	 * (waiting requests are only given to workers with a warm cache until they wait too long)
+	 */
+	bool accepts(worker_ptr worker, const request_entry &entry) const;
+
+	/**
+	 * Remember the key of a request assigned to a worker and count a cache hit or miss
+	 */
+	void assigned(worker_ptr worker, request_ptr request);
+
+	/**
+	 * Forget everything about a worker
+	 */
+	void worker_removed(worker_ptr worker);
+
+	/**
+	 * Forget a request that was removed from the queue manager (e.g. a cancelled one)
+	 */
+	void request_removed(request_ptr request);
+
+	/**
+	 * Stop holding back the requests that waited too long for a worker with a warm cache
+	 * @return true if there were any such requests
+	 */
+	bool release_expired_requests();
+
+	/**
+	 * Get the time until the first waiting request stops waiting for a worker with a warm cache
+	 * @return -1 ms if no request is waiting
+	 */
+	std::chrono::milliseconds get_waiting_delay() const;
+
+	/**
+	 * Get the amount of cache hits and misses and the hit rate (in percent)
+	 */
+	std::map<std::string, std::size_t> get_statistics() const;
+
+private:
+	/** Name of the metadata item that identifies the cached content */
+	std::string metadata_key_;
+
+	/** How many recent keys are remembered for each worker */
+	std::size_t cache_size_;
+
+	/** How long a request can wait for a worker with a warm cache */
+	std::chrono::milliseconds max_wait_;
+
+	/** The source of the current time */
+	clock_fn clock_;
+
+	/** Keys of the requests recently assigned to each worker (the most recent last) */
+	std::map<worker_ptr, std::deque<std::string>> recent_keys_;
+
+	/** Requests waiting for a worker with a warm cache and the times when they stop waiting */
+	std::map<request_ptr, std::chrono::milliseconds> waiting_;
+
+	/** The waiting requests ordered by the time when they stop waiting */
+	std::set<std::pair<std::chrono::milliseconds, request_ptr>> wait_deadlines_;
+
+	/** The amount of requests assigned to a worker with a warm cache */
+	std::size_t hits_ = 0;
+
+	/** The amount of requests (with a key) assigned to a worker with a cold cache */
+	std::size_t misses_ = 0;
+
+	/**
+	 * Get the cache key of a request (empty if the request has none)
+	 */
+	std::string get_key(request_ptr request) const;
+
+	/**
+	 * Stop holding back a request (nothing happens if it is not waiting)
+	 */
+	void stop_waiting(request_ptr request);
+
+	/**
+	 * Check if a worker recently processed a request with given key
+	 */
+	bool is_warm(worker_ptr worker, const std::string &key) const;
+};
+
+#endif // RECODEX_BROKER_CACHE_AFFINITY_WORKER_SELECTOR_H
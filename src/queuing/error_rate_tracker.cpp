@@ -0,0 +1,43 @@
+#include "error_rate_tracker.h"
+
+#include <algorithm>
+
+error_rate_tracker::error_rate_tracker(std::size_t window_size) : window_size_(std::max<std::size_t>(1, window_size))
+{
+}
+
+void error_rate_tracker::add_result(const std::string &key, bool error)
+{
+	auto &results = results_[key];
+	auto &errors = errors_[key];
+
+	results.push_back(error);
+	errors += error ? 1 : 0;
+
+	if (results.size() > window_size_) {
+		errors -= results.front() ? 1 : 0;
+		results.pop_front();
+	}
+}
+
+double error_rate_tracker::get_error_rate(const std::string &key) const
+{
+	auto it = results_.find(key);
+	if (it == results_.end() || it->second.empty()) {
+		return 0;
+	}
+
+	return static_cast<double>(errors_.at(key)) / it->second.size();
+}
+
+std::size_t error_rate_tracker::get_sample_count(const std::string &key) const
+{
+	auto it = results_.find(key);
+	return it == results_.end() ? 0 : it->second.size();
+}
+
+void error_rate_tracker::reset(const std::string &key)
+{
+	results_.erase(key);
+	errors_.erase(key);
+}
@@ -0,0 +1,61 @@
+#ifndef RECODEX_BROKER_ERROR_RATE_TRACKER_H
+#define RECODEX_BROKER_ERROR_RATE_TRACKER_H
+
+#include <deque>
+#include <map>
+#include <string>
+
+
+/**
+ * Keeps track of the recent job results (successful or erroneous) of workers or hardware groups.
+ * Only a limited window of the most recent results is kept, so that old errors are eventually forgotten.
+ */
+class error_rate_tracker
+{
+public:
+	/**
+	 * @param window_size the amount of most recent results kept for each key
+	 */
+	explicit error_rate_tracker(std::size_t window_size = 20);
+
+	/** Destructor */
+	virtual ~error_rate_tracker() = default;
+
+	/**
+	 * Record a job result.
+	 * @param key identifier of the worker or the hardware group
+	 * @param error true if the job ended with an error
+	 */
+	void add_result(const std::string &key, bool error);
+
+	/**
+	 * Get the fraction of erroneous results.
+	 * @param key identifier of the worker or the hardware group
+	 * @return the error rate (between 0 and 1, zero if there are no results)
+	 */
+	double get_error_rate(const std::string &key) const;
+
+	/**
+	 * Get the amount of recent results kept for given key.
+	 * @param key identifier of the worker or the hardware group
+	 */
+	std::size_t get_sample_count(const std::string &key) const;
+
+	/**
+	 * Forget all results of given key.
+	 * @param key identifier of the worker or the hardware group
+	 */
+	void reset(const std::string &key);
+
+private:
+	/** Maximal amount of results kept for each key */
+	const std::size_t window_size_;
+
+	/** Recent results for each key (true for an error) */
+	std::map<std::string, std::deque<bool>> results_;
+
+	/** Amounts of errors among the recent results of each key */
+	std::map<std::string, std::size_t> errors_;
+};
+
+#endif // RECODEX_BROKER_ERROR_RATE_TRACKER_H
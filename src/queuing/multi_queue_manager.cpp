@@ -1,24 +1,43 @@
 #include "multi_queue_manager.h"
 
+#include <algorithm>
+
 request_ptr multi_queue_manager::add_worker(worker_ptr worker, request_ptr current_request)
 {
-	queues_.emplace(worker, std::queue<request_ptr>());
-	current_requests_.emplace(worker, current_request);
-	worker_queue_.push_front(worker);
+	add_unassigned_worker(worker);
+
+	if (current_request != nullptr) {
+		current_requests_[worker].push_back(current_request);
+		index_.add(current_request, worker);
+	}
+
 	return nullptr;
 }
 
-std::shared_ptr<std::vector<request_ptr>> multi_queue_manager::worker_terminated(worker_ptr worker)
+void multi_queue_manager::add_unassigned_worker(worker_ptr worker)
 {
-	auto result = std::make_shared<std::vector<request_ptr>>();
+	queues_.emplace(worker, std::deque<request_ptr>());
+	current_requests_.emplace(worker, std::vector<request_ptr>());
+	worker_queue_.push_front(worker);
+}
 
-	if (current_requests_[worker] != nullptr) {
-		result->push_back(current_requests_[worker]);
-	}
+void multi_queue_manager::add_current_request(worker_ptr worker, request_ptr request)
+{
+	current_requests_[worker].push_back(request);
+	index_.add(request, worker);
+}
+
+std::shared_ptr<std::vector<request_ptr>> multi_queue_manager::worker_terminated(worker_ptr worker)
+{
+	auto result = std::make_shared<std::vector<request_ptr>>(current_requests_[worker]);
 
 	while (!queues_[worker].empty()) {
 		result->push_back(queues_[worker].front());
-		queues_[worker].pop();
+		queues_[worker].pop_front();
+	}
+
+	for (auto &request : *result) {
+		index_.remove(request);
 	}
 
 	worker_queue_.remove(worker);
@@ -28,18 +47,36 @@ std::shared_ptr<std::vector<request_ptr>> multi_queue_manager::worker_terminated
 	return result;
 }
 
+std::vector<request_ptr> multi_queue_manager::worker_draining(worker_ptr worker)
+{
+	std::vector<request_ptr> result(queues_[worker].begin(), queues_[worker].end());
+	queues_[worker].clear();
+
+	for (auto &request : result) {
+		index_.remove(request);
+	}
+
+	return result;
+}
+
 enqueue_result multi_queue_manager::enqueue_request(request_ptr request)
 {
 	enqueue_result result;
 	result.enqueued = false;
 
-	// Look for a suitable worker
+	// Look for a suitable worker, preferably one that is not draining and on which the request has not failed yet
 	worker_ptr worker = nullptr;
 
 	for (auto it = std::begin(worker_queue_); it != std::end(worker_queue_); it++) {
 		if ((*it)->check_headers(request->headers)) {
-			worker = *it;
-			break;
+			if (!(*it)->draining && !request->failed_on(**it)) {
+				worker = *it;
+				break;
+			}
+
+			if (worker == nullptr || (worker->draining && !(*it)->draining)) {
+				worker = *it;
+			}
 		}
 	}
 
@@ -51,59 +88,159 @@ enqueue_result multi_queue_manager::enqueue_request(request_ptr request)
 		worker_queue_.remove(worker);
 		worker_queue_.push_back(worker);
 
-		if (current_requests_[worker] == nullptr) {
-			// The worker is free -> assign the request right away
-			current_requests_[worker] = request;
+		if (enqueue_to_worker(worker, request)) {
 			result.assigned_to = worker;
-		} else {
-			// The worker is occupied -> put the request in its queue
-			queues_[worker].push(request);
 		}
 	}
 
 	return result;
 }
 
-request_ptr multi_queue_manager::worker_finished(worker_ptr worker)
+std::vector<enqueue_result> multi_queue_manager::enqueue_requests(const std::vector<request_ptr> &requests)
 {
-	current_requests_[worker] = nullptr;
+	std::vector<enqueue_result> results;
+	results.reserve(requests.size());
 
-	if (queues_[worker].empty()) {
-		return nullptr;
+	if (requests.empty()) {
+		return results;
+	}
+
+	// All the requests have the same headers, so the suitable workers are looked up only once
+	std::list<worker_ptr> suitable_workers;
+	std::list<worker_ptr> draining_workers;
+	for (auto &worker : worker_queue_) {
+		if (worker->check_headers(requests.front()->headers)) {
+			(worker->draining ? draining_workers : suitable_workers).push_back(worker);
+		}
+	}
+
+	// The requests wait for the draining workers only if there is nobody else
+	if (suitable_workers.empty()) {
+		suitable_workers.swap(draining_workers);
+	}
+
+	for (auto &request : requests) {
+		enqueue_result result;
+		result.enqueued = !suitable_workers.empty();
+
+		if (result.enqueued) {
+			// Take the suitable workers in the same round-robin order as enqueue_request
+			auto worker = suitable_workers.front();
+			suitable_workers.splice(suitable_workers.end(), suitable_workers, suitable_workers.begin());
+			worker_queue_.remove(worker);
+			worker_queue_.push_back(worker);
+
+			if (enqueue_to_worker(worker, request)) {
+				result.assigned_to = worker;
+			}
+		}
+
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+bool multi_queue_manager::enqueue_to_worker(worker_ptr worker, request_ptr request)
+{
+	if (current_requests_[worker].size() < worker->get_capacity() && !worker->draining) {
+		// The worker has a free slot (or it can prefetch the request) -> assign the request right away
+		current_requests_[worker].push_back(request);
+		index_.add(request, worker);
+		return true;
 	}
 
-	request_ptr new_request = queues_[worker].front();
-	queues_[worker].pop();
-	current_requests_[worker] = new_request;
+	// The worker is occupied -> put the request in its queue
+	queues_[worker].push_back(request);
+	index_.add(request);
+	return false;
+}
 
-	return new_request;
+request_ptr multi_queue_manager::worker_finished(worker_ptr worker, const std::string &job_id)
+{
+	index_.remove(take_request(current_requests_[worker], job_id));
+	return assign_request(worker);
 }
 
 request_ptr multi_queue_manager::get_current_request(worker_ptr worker)
+{
+	auto &requests = current_requests_[worker];
+	return requests.empty() ? nullptr : requests.front();
+}
+
+std::vector<request_ptr> multi_queue_manager::get_current_requests(worker_ptr worker)
 {
 	return current_requests_[worker];
 }
 
+request_ptr multi_queue_manager::get_prefetched_request(worker_ptr worker)
+{
+	auto &requests = current_requests_[worker];
+	return requests.size() > worker->slots ? requests.back() : nullptr;
+}
+
 request_ptr multi_queue_manager::assign_request(worker_ptr worker)
 {
-	if (queues_[worker].empty()) {
+	auto &requests = current_requests_[worker];
+
+	if (requests.size() >= worker->get_capacity() || queues_[worker].empty() || worker->draining) {
 		return nullptr;
 	}
 
-	request_ptr new_request = queues_[worker].front();
-	queues_[worker].pop();
-	current_requests_[worker] = new_request;
+	requests.push_back(queues_[worker].front());
+	queues_[worker].pop_front();
+	index_.add(requests.back(), worker);
 
-	return new_request;
+	return requests.back();
 }
 
-request_ptr multi_queue_manager::worker_cancelled(worker_ptr worker)
+request_ptr multi_queue_manager::worker_cancelled(worker_ptr worker, const std::string &job_id)
 {
-	auto request = current_requests_[worker];
-	current_requests_[worker] = nullptr;
+	auto request = take_request(current_requests_[worker], job_id);
+	index_.remove(request);
 	return request;
 }
 
+request_location multi_queue_manager::find_request(const std::string &job_id)
+{
+	return index_.find(job_id);
+}
+
+bool multi_queue_manager::assign_duplicate_request(worker_ptr worker, request_ptr duplicate)
+{
+	auto &requests = current_requests_[worker];
+	if (requests.size() >= worker->slots) {
+		return false;
+	}
+
+	requests.push_back(duplicate);
+	return true;
+}
+
+void multi_queue_manager::index_duplicate_request(worker_ptr worker, request_ptr duplicate)
+{
+	index_.add(duplicate, worker);
+}
+
+request_ptr multi_queue_manager::remove_queued_request(const std::string &job_id)
+{
+	auto location = index_.find(job_id);
+	if (location.request == nullptr || location.worker != nullptr) {
+		return nullptr;
+	}
+
+	for (auto &pair : queues_) {
+		auto it = std::find(pair.second.begin(), pair.second.end(), location.request);
+		if (it != pair.second.end()) {
+			pair.second.erase(it);
+			index_.remove(location.request);
+			return location.request;
+		}
+	}
+
+	return nullptr;
+}
+
 std::size_t multi_queue_manager::get_queued_request_count()
 {
 	std::size_t result = 0;
@@ -114,3 +251,16 @@ std::size_t multi_queue_manager::get_queued_request_count()
 
 	return result;
 }
+
+std::size_t multi_queue_manager::get_queued_request_count(const std::string &hwgroup)
+{
+	std::size_t result = 0;
+
+	for (auto &pair : queues_) {
+		if (pair.first->hwgroup == hwgroup) {
+			result += pair.second.size();
+		}
+	}
+
+	return result;
+}
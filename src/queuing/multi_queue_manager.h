@@ -2,6 +2,7 @@
 #define RECODEX_BROKER_MULTI_QUEUE_MANAGER_HPP
 
 #include "queue_manager_interface.h"
+#include <deque>
 #include <list>
 
 /**
@@ -10,20 +11,39 @@
 class multi_queue_manager : public queue_manager_interface
 {
 private:
-	std::map<worker_ptr, std::queue<request_ptr>> queues_;
-	std::map<worker_ptr, request_ptr> current_requests_;
+	std::map<worker_ptr, std::deque<request_ptr>> queues_;
+	std::map<worker_ptr, std::vector<request_ptr>> current_requests_;
 	std::list<worker_ptr> worker_queue_;
+	request_index index_;
+
+	/**
+	 * Assign a request to a worker right away if it has a free slot (or it can prefetch the request),
+	 * put the request in the queue of the worker otherwise
+	 * @return true if the request was assigned to the worker
+	 */
+	bool enqueue_to_worker(worker_ptr worker, request_ptr request);
 
 public:
 	~multi_queue_manager() override = default;
 	request_ptr add_worker(worker_ptr worker, request_ptr current_request = nullptr) override;
+	void add_unassigned_worker(worker_ptr worker) override;
+	void add_current_request(worker_ptr worker, request_ptr request) override;
 	request_ptr assign_request(worker_ptr worker) override;
 	std::shared_ptr<std::vector<request_ptr>> worker_terminated(worker_ptr) override;
+	std::vector<request_ptr> worker_draining(worker_ptr worker) override;
 	enqueue_result enqueue_request(request_ptr request) override;
+	std::vector<enqueue_result> enqueue_requests(const std::vector<request_ptr> &requests) override;
 	std::size_t get_queued_request_count() override;
+	std::size_t get_queued_request_count(const std::string &hwgroup) override;
 	request_ptr get_current_request(worker_ptr worker) override;
-	request_ptr worker_finished(worker_ptr worker) override;
-	request_ptr worker_cancelled(worker_ptr worker) override;
+	std::vector<request_ptr> get_current_requests(worker_ptr worker) override;
+	request_ptr get_prefetched_request(worker_ptr worker) override;
+	request_location find_request(const std::string &job_id) override;
+	bool assign_duplicate_request(worker_ptr worker, request_ptr duplicate) override;
+	void index_duplicate_request(worker_ptr worker, request_ptr duplicate) override;
+	request_ptr remove_queued_request(const std::string &job_id) override;
+	request_ptr worker_finished(worker_ptr worker, const std::string &job_id = "") override;
+	request_ptr worker_cancelled(worker_ptr worker, const std::string &job_id = "") override;
 };
 
 
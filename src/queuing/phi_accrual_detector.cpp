@@ -0,0 +1,100 @@
+#include "phi_accrual_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+phi_accrual_detector::phi_accrual_detector(std::size_t window_size, std::chrono::milliseconds min_std_deviation)
+	: window_size_(std::max<std::size_t>(1, window_size)),
+	  min_std_deviation_(std::max<double>(1, static_cast<double>(min_std_deviation.count())))
+{
+}
+
+void phi_accrual_detector::heartbeat(const std::string &key, std::chrono::milliseconds now)
+{
+	auto it = history_.find(key);
+	if (it == history_.end()) {
+		history_[key].last = now;
+		return;
+	}
+
+	auto &history = it->second;
+	double interval = static_cast<double>((now - history.last).count());
+	history.last = now;
+
+	history.intervals.push_back(interval);
+	history.sum += interval;
+	history.squares += interval * interval;
+
+	if (history.intervals.size() > window_size_) {
+		double oldest = history.intervals.front();
+		history.sum -= oldest;
+		history.squares -= oldest * oldest;
+		history.intervals.pop_front();
+	}
+}
+
+double phi_accrual_detector::get_phi(const std::string &key, std::chrono::milliseconds now) const
+{
+	auto it = history_.find(key);
+	if (it == history_.end() || it->second.intervals.empty()) {
+		return 0;
+	}
+
+	const auto &history = it->second;
+	double count = static_cast<double>(history.intervals.size());
+	double mean = history.sum / count;
+	double variance = std::max(0.0, history.squares / count - mean * mean);
+	double std_deviation = std::max(min_std_deviation_, std::sqrt(variance));
+
+	// A logistic approximation of the cumulative distribution function of the normal distribution, which stays
+	// precise far in the tail (where 1 - CDF would just be rounded to zero)
+	double elapsed = static_cast<double>((now - history.last).count());
+	double y = (elapsed - mean) / std_deviation;
+	double e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+
+	if (elapsed > mean) {
+		return -std::log10(e / (1.0 + e));
+	}
+
+	return -std::log10(1.0 - 1.0 / (1.0 + e));
+}
+
+std::chrono::milliseconds phi_accrual_detector::get_suspicion_time(const std::string &key, double threshold) const
+{
+	auto it = history_.find(key);
+	if (it == history_.end() || it->second.intervals.empty()) {
+		return std::chrono::milliseconds::max();
+	}
+
+	// The suspicion grows with the silence, so the moment it crosses the threshold is found by bisection
+	auto last = it->second.last;
+	std::chrono::milliseconds low(0);
+	std::chrono::milliseconds high(1);
+
+	while (get_phi(key, last + high) < threshold) {
+		low = high;
+		high *= 2;
+	}
+
+	while (high - low > std::chrono::milliseconds(1)) {
+		auto middle = low + (high - low) / 2;
+		if (get_phi(key, last + middle) < threshold) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+
+	return last + high;
+}
+
+std::size_t phi_accrual_detector::get_sample_count(const std::string &key) const
+{
+	auto it = history_.find(key);
+	return it == history_.end() ? 0 : it->second.intervals.size();
+}
+
+void phi_accrual_detector::reset(const std::string &key)
+{
+	history_.erase(key);
+}
@@ -0,0 +1,92 @@
+#ifndef RECODEX_BROKER_PHI_ACCRUAL_DETECTOR_H
+#define RECODEX_BROKER_PHI_ACCRUAL_DETECTOR_H
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+
+
+/**
+ * Detects failed workers from the arrival times of their heartbeats (a phi accrual failure detector).
+ * Instead of a fixed timeout, it learns the distribution of the intervals between the heartbeats of each worker
+ * (approximated by a normal distribution) and expresses the suspicion that a silent worker has failed as
+ * phi = -log10(probability that the next heartbeat would arrive even later). A phi of 1 thus means a 10% chance
+ * of a mistake, a phi of 8 a chance of 1e-8. Workers with regular heartbeats are suspected soon after they miss one,
+ * workers on a jittery network are given more time.
+ */
+class phi_accrual_detector
+{
+public:
+	/**
+	 * @param window_size the amount of most recent intervals kept for each key
+	 * @param min_std_deviation the lowest standard deviation of the intervals (so that a short delay after very
+	 * regular heartbeats does not look like a failure)
+	 */
+	explicit phi_accrual_detector(std::size_t window_size = 100,
+		std::chrono::milliseconds min_std_deviation = std::chrono::milliseconds(100));
+
+	/** Destructor */
+	virtual ~phi_accrual_detector() = default;
+
+	/**
+	 * Record the arrival of a heartbeat.
+	 * @param key identifier of the worker
+	 * @param now the current time
+	 */
+	void heartbeat(const std::string &key, std::chrono::milliseconds now);
+
+	/**
+	 * Get the suspicion that the worker has failed.
+	 * @param key identifier of the worker
+	 * @param now the current time
+	 * @return the suspicion level (zero if there are no intervals yet)
+	 */
+	double get_phi(const std::string &key, std::chrono::milliseconds now) const;
+
+	/**
+	 * Get the time when the suspicion reaches given level (unless a heartbeat arrives before).
+	 * @param key identifier of the worker
+	 * @param threshold the suspicion level
+	 * @return the time rounded up to milliseconds (the maximal duration if there are no intervals yet)
+	 */
+	std::chrono::milliseconds get_suspicion_time(const std::string &key, double threshold) const;
+
+	/**
+	 * Get the amount of recent intervals between heartbeats kept for given key.
+	 * @param key identifier of the worker
+	 */
+	std::size_t get_sample_count(const std::string &key) const;
+
+	/**
+	 * Forget all heartbeats of given key.
+	 * @param key identifier of the worker
+	 */
+	void reset(const std::string &key);
+
+private:
+	/**
+	 * The heartbeats of a single worker
+	 */
+	struct history {
+		/** Arrival of the last heartbeat */
+		std::chrono::milliseconds last;
+		/** Recent intervals between the heartbeats (in milliseconds) */
+		std::deque<double> intervals;
+		/** Sum of the intervals */
+		double sum = 0;
+		/** Sum of the squared intervals */
+		double squares = 0;
+	};
+
+	/** Maximal amount of intervals kept for each key */
+	const std::size_t window_size_;
+
+	/** The lowest standard deviation of the intervals (in milliseconds) */
+	const double min_std_deviation_;
+
+	/** Heartbeats of each key */
+	std::map<std::string, history> history_;
+};
+
+#endif // RECODEX_BROKER_PHI_ACCRUAL_DETECTOR_H
@@ -4,9 +4,72 @@
 #include "../worker.h"
 #include "../worker_registry.h"
 
+#include <chrono>
+#include <unordered_map>
+
 using worker_ptr = worker_registry::worker_ptr;
 using request_ptr = worker::request_ptr;
 
+/**
+ * Describes where a request held by a queue manager is
+ */
+struct request_location {
+	/**
+	 * The request (nullptr if there is no such request)
+	 */
+	request_ptr request;
+
+	/**
+	 * The worker that holds the request (nullptr if the request is queued)
+	 */
+	worker_ptr worker;
+};
+
+/**
+ * Index of the requests held by a queue manager by their job ids
+ */
+class request_index
+{
+public:
+	/**
+	 * Insert a request or update its location
+	 * @param request the request
+	 * @param worker the worker that holds the request (nullptr if it is queued)
+	 */
+	void add(request_ptr request, worker_ptr worker = nullptr)
+	{
+		index_[request->data.get_job_id()] = request_location{request, worker};
+	}
+
+	/**
+	 * Remove a request from the index (another request with the same job id is kept)
+	 */
+	void remove(request_ptr request)
+	{
+		if (request == nullptr) {
+			return;
+		}
+
+		auto it = index_.find(request->data.get_job_id());
+		if (it != index_.end() && it->second.request == request) {
+			index_.erase(it);
+		}
+	}
+
+	/**
+	 * Find a request by its job id
+	 * @return the location of the request (with nullptr request if there is none)
+	 */
+	request_location find(const std::string &job_id) const
+	{
+		auto it = index_.find(job_id);
+		return it != index_.end() ? it->second : request_location{nullptr, nullptr};
+	}
+
+private:
+	std::unordered_map<std::string, request_location> index_;
+};
+
 /**
  * Describes the result of an enqueue operation
  */
@@ -30,7 +93,7 @@ public:
 
 	/**
 	 * Register a new worker. This can result into a job being assigned to it right away.
-	 * Every worker used by the queue manager must be registered using this method.
+	 * Every worker used by the queue manager must be registered using this method or add_unassigned_worker.
 	 * @param worker the new worker
 	 * @param current_request the request that is currently being processed by the worker
 	 * @return a newly assigned request (nullptr is returned when current_request is specified or when there is no
@@ -38,22 +101,50 @@ public:
 	 */
 	virtual request_ptr add_worker(worker_ptr worker, request_ptr current_request = nullptr) = 0;
 
+	/**
+	 * Register a new worker without assigning it any request (e.g. when a reconnected worker resumes its session
+	 * and the requests it holds are added afterwards using add_current_request).
+	 * @param worker the new worker
+	 */
+	virtual void add_unassigned_worker(worker_ptr worker) = 0;
+
+	/**
+	 * Register another request that is already being processed by a registered worker (e.g. when the state of
+	 * a failed broker is taken over). The request is not sent to the worker again.
+	 * @param worker the worker that processes the request
+	 * @param request the request
+	 */
+	virtual void add_current_request(worker_ptr worker, request_ptr request) = 0;
+
 	/**
 	 * Assign a queued request to given worker. If this succeeds, the request must be sent to the actual worker
 	 * machine by the caller.
+	 * Only workers with a free slot get a new request. A worker that supports prefetching also gets a prefetched
+	 * request when all its slots are occupied (but only one at a time).
 	 * @param worker
 	 * @return a new request or nullptr if nothing can be assigned to the worker
 	 */
 	virtual request_ptr assign_request(worker_ptr worker) = 0;
 
 	/**
-	 * Remove a worker and return the request it was processing along with the requests that cannot be processed
-	 * after its departure.
+	 * Remove a worker and return the requests it was processing (and the one prefetched by it) along with
+	 * the requests that cannot be processed after its departure.
 	 * This method is called when the worker is considered dead. It should not attempt to reassign any requests.
 	 * @return requests that cannot be completed
 	 */
 	virtual std::shared_ptr<std::vector<request_ptr>> worker_terminated(worker_ptr) = 0;
 
+	/**
+	 * Notify the manager that a worker has started draining (its draining flag is set). The worker keeps its current
+	 * requests, but it must not get any new ones.
+	 * @param worker the draining worker
+	 * @return requests that were queued for the worker and must be enqueued again by the caller
+	 */
+	virtual std::vector<request_ptr> worker_draining(worker_ptr worker)
+	{
+		return {};
+	}
+
 	/**
 	 * Try to enqueue a request. If it is assigned, it must be sent to the actual worker by the caller.
 	 * @param request the request to be enqueued
@@ -61,32 +152,170 @@ public:
 	 */
 	virtual enqueue_result enqueue_request(request_ptr request) = 0;
 
+	/**
+	 * Try to enqueue multiple requests with the same headers at once. Requests that are assigned must be sent
+	 * to the actual workers by the caller.
+	 * The default implementation enqueues the requests one by one, managers should override it so that the headers
+	 * are matched against the workers only once.
+	 * @param requests the requests to be enqueued (all of them must have the same headers)
+	 * @return results for each of the requests (in the same order)
+	 */
+	virtual std::vector<enqueue_result> enqueue_requests(const std::vector<request_ptr> &requests)
+	{
+		std::vector<enqueue_result> results;
+		results.reserve(requests.size());
+
+		for (auto &request : requests) {
+			results.push_back(enqueue_request(request));
+		}
+
+		return results;
+	}
+
+	/**
+	 * Assign queued requests that were held back for a limited time (e.g. waiting for a particular worker) and
+	 * can now be processed by any worker. This method is called when get_waiting_delay elapses. The returned
+	 * requests must be sent to the actual workers by the caller.
+	 * @return pairs of workers and their newly assigned requests
+	 */
+	virtual std::vector<std::pair<worker_ptr, request_ptr>> assign_waiting_requests()
+	{
+		return {};
+	}
+
+	/**
+	 * Get the time until assign_waiting_requests should be called next, i.e. until the first request that is held
+	 * back stops waiting.
+	 * @return -1 ms if no request is held back (zero if some requests have waited long enough already)
+	 */
+	virtual std::chrono::milliseconds get_waiting_delay()
+	{
+		return std::chrono::milliseconds(-1);
+	}
+
+	/**
+	 * Notify the manager that a request it returned (e.g. from worker_cancelled) will be enqueued again later,
+	 * after a retry backoff. The request is not held by the manager in the meantime.
+	 * @param request the postponed request
+	 */
+	virtual void request_postponed(request_ptr request)
+	{
+	}
+
+	/**
+	 * Notify the manager that a postponed request will not be enqueued again (e.g. because it was cancelled).
+	 * @param request the discarded request
+	 */
+	virtual void request_discarded(request_ptr request)
+	{
+	}
+
+	/**
+	 * Get statistics specific to the queue manager and its scheduling policies
+	 */
+	virtual std::map<std::string, std::size_t> get_statistics()
+	{
+		return {};
+	}
+
 	/**
 	 * Get the total amount of queued requests
 	 */
 	virtual std::size_t get_queued_request_count() = 0;
 
 	/**
-	 * Get the request currently being processed by given worker
+	 * Get the amount of queued requests waiting for workers from given hardware group
+	 * (a request that can be processed by multiple hardware groups is counted in each of them)
+	 */
+	virtual std::size_t get_queued_request_count(const std::string &hwgroup) = 0;
+
+	/**
+	 * Get the oldest request currently being processed by given worker
 	 */
 	virtual request_ptr get_current_request(worker_ptr worker) = 0;
 
 	/**
-	 * Mark the current request of a worker as complete and possibly assign it another request.
-	 * Called when the actual worker machine finishes processing the request.
+	 * Get all requests held by given worker (including the prefetched one) in the order they were assigned
+	 */
+	virtual std::vector<request_ptr> get_current_requests(worker_ptr worker) = 0;
+
+	/**
+	 * Get the request that was sent to given worker in advance and that will be processed as soon as one of its
+	 * slots becomes free
+	 */
+	virtual request_ptr get_prefetched_request(worker_ptr worker) = 0;
+
+	/**
+	 * Find a queued request or a request held by a worker by its job id
+	 * @param job_id identifier of the job
+	 * @return the location of the request (with nullptr request if there is none)
+	 */
+	virtual request_location find_request(const std::string &job_id) = 0;
+
+	/**
+	 * Assign a speculative duplicate of a request held by another worker to given worker.
+	 * The duplicate is not indexed, find_request keeps returning the original request.
+	 * @param worker the worker that should process the duplicate (it must have a free slot)
+	 * @param duplicate a copy of the original request
+	 * @return true if the duplicate was assigned, false if the worker has no free slot
+	 */
+	virtual bool assign_duplicate_request(worker_ptr worker, request_ptr duplicate) = 0;
+
+	/**
+	 * Index a duplicate assigned by assign_duplicate_request in place of its original request, so that find_request
+	 * returns it (e.g. when the original request is gone and the duplicate is the only copy still being processed).
+	 * @param worker the worker that processes the duplicate
+	 * @param duplicate the duplicate
+	 */
+	virtual void index_duplicate_request(worker_ptr worker, request_ptr duplicate) = 0;
+
+	/**
+	 * Remove a request that waits in a queue (requests held by workers are not affected)
+	 * @param job_id identifier of the job
+	 * @return the removed request or nullptr if no such request is queued
+	 */
+	virtual request_ptr remove_queued_request(const std::string &job_id) = 0;
+
+	/**
+	 * Mark a current request of a worker as complete and possibly assign it another request.
+	 * Called when the actual worker machine finishes processing the request. The prefetched request (if any)
+	 * takes the freed slot.
 	 * @param worker the worker that finished its job
+	 * @param job_id identifier of the finished job (the oldest current request is used if empty)
 	 * @return a new request assigned to the worker (if any)
 	 */
-	virtual request_ptr worker_finished(worker_ptr worker) = 0;
+	virtual request_ptr worker_finished(worker_ptr worker, const std::string &job_id = "") = 0;
 
 	/**
-	 * Mark the current request of a worker as cancelled and do not (re)assign it to another worker.
-	 * Called when the worker machine fails to process the request.
+	 * Mark a current request of a worker as cancelled and do not (re)assign it to another worker.
+	 * Called when the worker machine fails to process the request. The prefetched request (if any)
+	 * takes the freed slot.
 	 * The caller can decide whether the request should be enqueued again or not.
 	 * @param worker the worker whose job was cancelled
-	 * @return the cancelled request
+	 * @param job_id identifier of the cancelled job (the oldest current request is used if empty)
+	 * @return the cancelled request (nullptr if the worker does not hold such request)
 	 */
-	virtual request_ptr worker_cancelled(worker_ptr worker) = 0;
+	virtual request_ptr worker_cancelled(worker_ptr worker, const std::string &job_id = "") = 0;
+
+protected:
+	/**
+	 * Remove a request from the list of requests held by a worker
+	 * @param requests the requests held by the worker
+	 * @param job_id identifier of the job to be removed (the oldest request is removed if empty)
+	 * @return the removed request or nullptr if there is no such request
+	 */
+	static request_ptr take_request(std::vector<request_ptr> &requests, const std::string &job_id)
+	{
+		for (auto it = requests.begin(); it != requests.end(); ++it) {
+			if (job_id.empty() || (*it)->data.get_job_id() == job_id) {
+				auto result = *it;
+				requests.erase(it);
+				return result;
+			}
+		}
+
+		return nullptr;
+	}
 };
 
 #endif // RECODEX_BROKER_QUEUE_MANAGER_INTERFACE_HPP
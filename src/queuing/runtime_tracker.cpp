@@ -0,0 +1,61 @@
+#include "runtime_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+runtime_tracker::runtime_tracker(std::size_t window_size) : window_size_(window_size > 0 ? window_size : 1)
+{
+}
+
+void runtime_tracker::add_sample(const std::string &hwgroup, std::chrono::milliseconds duration)
+{
+	auto &samples = samples_[hwgroup];
+	auto &sum = sums_[hwgroup];
+
+	samples.push_back(duration);
+	sum += duration;
+
+	if (samples.size() > window_size_) {
+		sum -= samples.front();
+		samples.pop_front();
+	}
+}
+
+bool runtime_tracker::has_samples(const std::string &hwgroup) const
+{
+	return samples_.find(hwgroup) != samples_.end();
+}
+
+std::chrono::milliseconds runtime_tracker::get_mean(const std::string &hwgroup) const
+{
+	auto it = samples_.find(hwgroup);
+
+	if (it == samples_.end()) {
+		return std::chrono::milliseconds(0);
+	}
+
+	return sums_.at(hwgroup) / it->second.size();
+}
+
+std::chrono::milliseconds runtime_tracker::get_percentile(const std::string &hwgroup, double percentile) const
+{
+	auto it = samples_.find(hwgroup);
+
+	if (it == samples_.end()) {
+		return std::chrono::milliseconds(0);
+	}
+
+	std::vector<std::chrono::milliseconds> samples(it->second.begin(), it->second.end());
+	auto rank = static_cast<std::size_t>(std::ceil(percentile * samples.size()));
+	auto nth = samples.begin() + (rank > 0 ? std::min(rank, samples.size()) - 1 : 0);
+	std::nth_element(samples.begin(), nth, samples.end());
+
+	return *nth;
+}
+
+std::size_t runtime_tracker::get_sample_count(const std::string &hwgroup) const
+{
+	auto it = samples_.find(hwgroup);
+	return it != samples_.end() ? it->second.size() : 0;
+}
@@ -0,0 +1,70 @@
+#ifndef RECODEX_BROKER_RUNTIME_TRACKER_H
+#define RECODEX_BROKER_RUNTIME_TRACKER_H
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+
+
+/**
+ * Keeps track of job processing times observed in each hardware group.
+ * Only a limited window of the most recent samples is kept, so that the estimates follow changes of the workload.
+ */
+class runtime_tracker
+{
+public:
+	/**
+	 * @param window_size the amount of most recent samples kept for each hardware group
+	 */
+	explicit runtime_tracker(std::size_t window_size = 100);
+
+	/** Destructor */
+	virtual ~runtime_tracker() = default;
+
+	/**
+	 * Record the processing time of a finished job.
+	 * @param hwgroup hardware group of the worker that processed the job
+	 * @param duration the time between dispatching the job and receiving its results
+	 */
+	void add_sample(const std::string &hwgroup, std::chrono::milliseconds duration);
+
+	/**
+	 * Check if any processing time was observed in given hardware group.
+	 * @param hwgroup identifier of the hardware group
+	 */
+	bool has_samples(const std::string &hwgroup) const;
+
+	/**
+	 * Get the mean processing time of a job in given hardware group.
+	 * @param hwgroup identifier of the hardware group
+	 * @return the mean of the recent samples (zero if there are none)
+	 */
+	std::chrono::milliseconds get_mean(const std::string &hwgroup) const;
+
+	/**
+	 * Get a percentile of the processing times in given hardware group.
+	 * @param hwgroup identifier of the hardware group
+	 * @param percentile the requested percentile (between 0 and 1)
+	 * @return the processing time (using the nearest-rank method) or zero if there are no samples
+	 */
+	std::chrono::milliseconds get_percentile(const std::string &hwgroup, double percentile) const;
+
+	/**
+	 * Get the amount of recent samples kept for given hardware group.
+	 * @param hwgroup identifier of the hardware group
+	 */
+	std::size_t get_sample_count(const std::string &hwgroup) const;
+
+private:
+	/** Maximal amount of samples kept for each hardware group */
+	const std::size_t window_size_;
+
+	/** Recent samples for each hardware group */
+	std::map<std::string, std::deque<std::chrono::milliseconds>> samples_;
+
+	/** Sums of the recent samples for each hardware group */
+	std::map<std::string, std::chrono::milliseconds> sums_;
+};
+
+#endif // RECODEX_BROKER_RUNTIME_TRACKER_H
@@ -7,11 +7,14 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <set>
 #include <algorithm>
 
 struct request_entry {
     request_ptr request;
     std::chrono::milliseconds arrived_at;
+    /** Hardware groups of the registered workers that are able to process the request */
+    std::set<std::string> hwgroups;
 };
 
 struct fcfs_job_comparator {
@@ -21,18 +24,83 @@ struct fcfs_job_comparator {
     }
 };
 
+/**
+ * Earliest deadline first ordering. Jobs without a deadline follow those that have one (in FCFS order).
+ * Jobs that are not expected to meet their deadline anyway are postponed so that they do not make other jobs
+ * miss their deadlines too. They are treated as jobs without a deadline, so they cannot be postponed forever
+ * by the jobs that arrived after them.
+ */
+struct edf_job_comparator {
+    bool compare(const request_entry &a, const request_entry &b, worker_ptr worker) const
+    {
+        bool a_on_time = a.request->has_deadline() && !a.request->deadline_at_risk;
+        bool b_on_time = b.request->has_deadline() && !b.request->deadline_at_risk;
+
+        if (a_on_time != b_on_time) {
+            return a_on_time;
+        }
+
+        if (a_on_time && a.request->deadline != b.request->deadline) {
+            return a.request->deadline < b.request->deadline;
+        }
+
+        return a.arrived_at < b.arrived_at;
+    }
+};
+
 
+/** Requests held by each worker (in the order they were assigned) */
+using worker_jobs_t = std::map<worker_ptr, std::vector<request_ptr>>;
+
+/**
+ * Besides selecting an idle worker for a new request, a selector can defer the request (by returning nullptr
+ * from select) and keep it from workers it does not like (accepts) for a limited time (it tells when the first
+ * deferred request stops waiting). It is notified about every assignment and about removed workers and it can
+ * provide its own statistics.
+ */
 struct first_idle_worker_selector {
-    worker_ptr select(const std::map<worker_ptr, request_ptr> &worker_jobs, const std::vector<request_entry> &queued_jobs, request_ptr request) const
+    worker_ptr select(const worker_jobs_t &worker_jobs, const std::vector<request_entry> &queued_jobs, request_ptr request) const
     {
         for (auto &pair: worker_jobs) {
-            if (pair.second == nullptr && pair.first->check_headers(request->headers)) {
+            if (pair.second.size() < pair.first->slots && pair.first->check_headers(request->headers)) {
                 return pair.first;
             }
         }
 
         return nullptr;
     }
+
+    bool accepts(worker_ptr worker, const request_entry &entry) const
+    {
+        return true;
+    }
+
+    void assigned(worker_ptr worker, request_ptr request)
+    {
+    }
+
+    void worker_removed(worker_ptr worker)
+    {
+    }
+
+    void request_removed(request_ptr request)
+    {
+    }
+
+    bool release_expired_requests()
+    {
+        return false;
+    }
+
+    std::chrono::milliseconds get_waiting_delay() const
+    {
+        return std::chrono::milliseconds(-1);
+    }
+
+    std::map<std::string, std::size_t> get_statistics() const
+    {
+        return {};
+    }
 };
 
 template <typename JobComparator = fcfs_job_comparator, typename IdleWorkerSelector = first_idle_worker_selector>
@@ -42,8 +110,56 @@ private:
     std::unique_ptr<JobComparator> comparator_;
     std::unique_ptr<IdleWorkerSelector> selector_;
     std::vector<request_entry> jobs_;
-    std::map<worker_ptr, request_ptr> worker_jobs_;
+    worker_jobs_t worker_jobs_;
     std::vector<worker_ptr> workers_;
+    std::map<std::string, std::size_t> hwgroup_queue_sizes_;
+    request_index index_;
+
+    /**
+     * Update the queue sizes of hardware groups that can process given queued request
+     * @param entry the queued request
+     * @param added true if the request was queued, false if it left the queue
+     */
+    void count_queued_request(const request_entry &entry, bool added)
+    {
+        for (auto &hwgroup : entry.hwgroups) {
+            if (added) {
+                hwgroup_queue_sizes_[hwgroup] += 1;
+            } else {
+                hwgroup_queue_sizes_[hwgroup] -= 1;
+            }
+        }
+    }
+
+    /**
+     * Update the hardware groups that can process the queued requests (and their queue sizes) when a worker joins
+     * or leaves
+     * @param worker the worker (it must be registered already when it joins and not anymore when it leaves)
+     * @param added true if the worker joined, false if it left
+     */
+    void update_queued_hwgroups(worker_ptr worker, bool added)
+    {
+        for (auto &entry : jobs_) {
+            if (!worker->check_headers(entry.request->headers)) {
+                continue;
+            }
+
+            if (added) {
+                if (entry.hwgroups.insert(worker->hwgroup).second) {
+                    hwgroup_queue_sizes_[worker->hwgroup] += 1;
+                }
+                continue;
+            }
+
+            bool served = std::any_of(workers_.begin(), workers_.end(), [&worker, &entry](const worker_ptr &other) {
+                return other->hwgroup == worker->hwgroup && other->check_headers(entry.request->headers);
+            });
+
+            if (!served && entry.hwgroups.erase(worker->hwgroup) > 0) {
+                hwgroup_queue_sizes_[worker->hwgroup] -= 1;
+            }
+        }
+    }
 
     /**
      * Check whether a worker exists capable of processing given request (according to headers)
@@ -60,6 +176,62 @@ private:
         return false;
     }
 
+    /**
+     * Check whether a request should be kept from a worker because its processing already failed there
+     * (or on the same host) and another worker that has not failed it yet can process it
+     */
+    bool avoids_worker(worker_ptr worker, request_ptr request) const
+    {
+        if (!request->failed_on(*worker)) {
+            return false;
+        }
+
+        return std::any_of(workers_.begin(), workers_.end(), [&request](const worker_ptr &other) {
+            return other->check_headers(request->headers) && !request->failed_on(*other);
+        });
+    }
+
+    /**
+     * Select an idle worker for a request. Draining workers are skipped and so are the workers on which
+     * the request has already failed (if possible).
+     */
+    worker_ptr select_idle_worker(request_ptr request)
+    {
+        bool any_draining = std::any_of(workers_.begin(), workers_.end(), [](const worker_ptr &worker) {
+            return worker->draining;
+        });
+
+        if (!any_draining && request->failed_workers.empty() && request->failed_hosts.empty()) {
+            return selector_->select(worker_jobs_, jobs_, request);
+        }
+
+        worker_jobs_t candidates;
+        for (auto &pair : worker_jobs_) {
+            if (!pair.first->draining && !avoids_worker(pair.first, request)) {
+                candidates.insert(pair);
+            }
+        }
+
+        return selector_->select(candidates, jobs_, request);
+    }
+
+    /**
+     * Find a busy worker that supports prefetching, has not prefetched anything yet and can process given request
+     * @param request_ptr request to be prefetched
+     * @return the worker or nullptr if there is no such worker
+     */
+    worker_ptr find_prefetching_worker(request_ptr request)
+    {
+        for (auto &worker : workers_) {
+            if (worker_jobs_[worker].size() < worker->get_capacity() && !worker->draining &&
+                worker->check_headers(request->headers) && !avoids_worker(worker, request) &&
+                selector_->accepts(worker, request_entry{.request = request})) {
+                return worker;
+            }
+        }
+        return nullptr;
+    }
+
 public:
     explicit single_queue_manager():
         comparator_(std::make_unique<JobComparator>()), selector_(std::make_unique<IdleWorkerSelector>())
@@ -77,32 +249,56 @@ public:
 
     request_ptr add_worker(worker_ptr worker, request_ptr current_request = nullptr) override
     {
-        worker_jobs_[worker] = current_request;
-        workers_.push_back(worker);
+        add_unassigned_worker(worker);
 
         if (current_request != nullptr) {
-            return current_request;
+            worker_jobs_[worker].push_back(current_request);
+            index_.add(current_request, worker);
+            selector_->assigned(worker, current_request);
+            return nullptr;
         }
 
         return assign_request(worker);
     }
 
+    void add_unassigned_worker(worker_ptr worker) override
+    {
+        worker_jobs_[worker] = {};
+        workers_.push_back(worker);
+        update_queued_hwgroups(worker, true);
+    }
+
+    void add_current_request(worker_ptr worker, request_ptr request) override
+    {
+        worker_jobs_[worker].push_back(request);
+        index_.add(request, worker);
+        selector_->assigned(worker, request);
+    }
+
     request_ptr assign_request(worker_ptr worker) override
     {
-        worker_jobs_[worker] = nullptr;
-        std::sort(jobs_.begin(), jobs_.end(), [this, worker] (const request_entry &a, const request_entry &b) {
+        auto &current_jobs = worker_jobs_[worker];
+        if (current_jobs.size() >= worker->get_capacity() || worker->draining) {
+            return nullptr;
+        }
+
+        std::stable_sort(jobs_.begin(), jobs_.end(), [this, worker] (const request_entry &a, const request_entry &b) {
             return comparator_->compare(a, b, worker);
         });
 
         for (auto it = jobs_.cbegin(); it != jobs_.cend(); ++it) {
-            if (!worker->check_headers(it->request->headers)) {
+            if (!worker->check_headers(it->request->headers) || avoids_worker(worker, it->request) ||
+                !selector_->accepts(worker, *it)) {
                 continue;
             }
 
-            worker_jobs_[worker] = it->request;
+            current_jobs.push_back(it->request);
+            index_.add(it->request, worker);
+            selector_->assigned(worker, it->request);
+            count_queued_request(*it, false);
             jobs_.erase(it);
 
-            return worker_jobs_[worker];
+            return current_jobs.back();
         }
 
         return nullptr;
@@ -110,18 +306,24 @@ public:
 
     std::shared_ptr<std::vector<request_ptr>> worker_terminated(worker_ptr worker) override
     {
-        auto result = std::make_shared<std::vector<request_ptr>>();
-        if (worker_jobs_[worker] != nullptr) {
-            result->push_back(worker_jobs_[worker]); // currently running job (returned for possible reasignment)
+        // currently running (and prefetched) jobs are returned for possible reasignment
+        auto result = std::make_shared<std::vector<request_ptr>>(worker_jobs_[worker]);
+        for (auto &request : *result) {
+            index_.remove(request);
         }
         worker_jobs_.erase(worker);
         workers_.erase(std::remove(workers_.begin(), workers_.end(), worker), workers_.end());
+        selector_->worker_removed(worker);
+        update_queued_hwgroups(worker, false);
 
         // filter jobs and remove those wich are no longer process-able (after worker removal)
         for (auto &&job : jobs_) {
             if (!is_request_assignable(job.request)) {
                 // the job cannot be accomodated anymore...
                 result->push_back(job.request);
+                index_.remove(job.request);
+                selector_->request_removed(job.request);
+                count_queued_request(job, false);
                 job.request = nullptr; // mark the job for removal
             }
         }
@@ -136,9 +338,11 @@ public:
     enqueue_result enqueue_request(request_ptr request) override
     {
         // Try to find an idle worker and assign the job
-        auto idle_worker = selector_->select(worker_jobs_, jobs_, request);
+        auto idle_worker = select_idle_worker(request);
         if (idle_worker) {
-            worker_jobs_[idle_worker] = request;
+            worker_jobs_[idle_worker].push_back(request);
+            index_.add(request, idle_worker);
+            selector_->assigned(idle_worker, request);
 
             return enqueue_result{
                 .assigned_to = idle_worker,
@@ -146,7 +350,27 @@ public:
             };
         }
 
-        bool assignable = is_request_assignable(request);
+        // All suitable workers are busy, try to send the job in advance to one of them
+        auto prefetching_worker = find_prefetching_worker(request);
+        if (prefetching_worker) {
+            worker_jobs_[prefetching_worker].push_back(request);
+            index_.add(request, prefetching_worker);
+            selector_->assigned(prefetching_worker, request);
+
+            return enqueue_result{
+                .assigned_to = prefetching_worker,
+                .enqueued = true,
+            };
+        }
+
+        std::set<std::string> hwgroups;
+        for (auto &worker : workers_) {
+            if (worker->check_headers(request->headers)) {
+                hwgroups.insert(worker->hwgroup);
+            }
+        }
+
+        bool assignable = !hwgroups.empty();
         if (assignable) {
             // Enqueue the job
             jobs_.push_back(request_entry{
@@ -154,7 +378,10 @@ public:
                 .arrived_at = std::chrono::duration_cast<std::chrono::milliseconds>(
                     std::chrono::system_clock::now().time_since_epoch()
                 ),
+                .hwgroups = std::move(hwgroups),
             });
+            count_queued_request(jobs_.back(), true);
+            index_.add(request);
         }
 
         return enqueue_result{
@@ -163,26 +390,197 @@ public:
         };
     }
 
+    std::vector<enqueue_result> enqueue_requests(const std::vector<request_ptr> &requests) override
+    {
+        std::vector<enqueue_result> results;
+        results.reserve(requests.size());
+
+        if (requests.empty()) {
+            return results;
+        }
+
+        // All the requests have the same headers, so the suitable workers are looked up only once
+        std::vector<worker_ptr> suitable_workers;
+        std::set<std::string> hwgroups;
+        for (auto &worker : workers_) {
+            if (worker->check_headers(requests.front()->headers)) {
+                // Draining workers do not get new jobs, but the jobs can wait for them
+                if (!worker->draining) {
+                    suitable_workers.push_back(worker);
+                }
+                hwgroups.insert(worker->hwgroup);
+            }
+        }
+
+        auto arrived_at = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        );
+
+        bool idle_workers_left = !suitable_workers.empty();
+        bool prefetching_workers_left = !suitable_workers.empty();
+
+        for (auto &request : requests) {
+            worker_ptr assigned_to = nullptr;
+
+            if (idle_workers_left) {
+                assigned_to = select_idle_worker(request);
+                // The selector might also have held the request back for a particular worker
+                idle_workers_left = assigned_to != nullptr ||
+                    std::any_of(suitable_workers.begin(), suitable_workers.end(), [this](const worker_ptr &worker) {
+                        return worker_jobs_[worker].size() < worker->slots;
+                    });
+            }
+
+            if (assigned_to == nullptr && prefetching_workers_left) {
+                bool free_capacity = false;
+                for (auto &worker : suitable_workers) {
+                    if (worker_jobs_[worker].size() < worker->get_capacity()) {
+                        free_capacity = true;
+                        if (selector_->accepts(worker, request_entry{.request = request})) {
+                            assigned_to = worker;
+                            break;
+                        }
+                    }
+                }
+                prefetching_workers_left = free_capacity;
+            }
+
+            if (assigned_to != nullptr) {
+                worker_jobs_[assigned_to].push_back(request);
+                index_.add(request, assigned_to);
+                selector_->assigned(assigned_to, request);
+            } else if (!hwgroups.empty()) {
+                jobs_.push_back(request_entry{
+                    .request = request,
+                    .arrived_at = arrived_at,
+                    .hwgroups = hwgroups,
+                });
+                count_queued_request(jobs_.back(), true);
+                index_.add(request);
+            }
+
+            results.push_back(enqueue_result{
+                .assigned_to = assigned_to,
+                .enqueued = !hwgroups.empty(),
+            });
+        }
+
+        return results;
+    }
+
+    std::vector<std::pair<worker_ptr, request_ptr>> assign_waiting_requests() override
+    {
+        std::vector<std::pair<worker_ptr, request_ptr>> result;
+
+        if (!selector_->release_expired_requests()) {
+            return result;
+        }
+
+        for (auto &worker : workers_) {
+            request_ptr request;
+            while ((request = assign_request(worker)) != nullptr) {
+                result.emplace_back(worker, request);
+            }
+        }
+
+        return result;
+    }
+
+    std::chrono::milliseconds get_waiting_delay() override
+    {
+        return selector_->get_waiting_delay();
+    }
+
+    std::map<std::string, std::size_t> get_statistics() override
+    {
+        return selector_->get_statistics();
+    }
+
     std::size_t get_queued_request_count() override
     {
         return jobs_.size();
     }
 
+    std::size_t get_queued_request_count(const std::string &hwgroup) override
+    {
+        auto it = hwgroup_queue_sizes_.find(hwgroup);
+        return it != hwgroup_queue_sizes_.end() ? it->second : 0;
+    }
+
     request_ptr get_current_request(worker_ptr worker) override
+    {
+        auto &current_jobs = worker_jobs_[worker];
+        return current_jobs.empty() ? nullptr : current_jobs.front();
+    }
+
+    std::vector<request_ptr> get_current_requests(worker_ptr worker) override
     {
         return worker_jobs_[worker];
     }
 
-    request_ptr worker_finished(worker_ptr worker) override
+    request_ptr get_prefetched_request(worker_ptr worker) override
+    {
+        auto &current_jobs = worker_jobs_[worker];
+        return current_jobs.size() > worker->slots ? current_jobs.back() : nullptr;
+    }
+
+    request_location find_request(const std::string &job_id) override
+    {
+        return index_.find(job_id);
+    }
+
+    bool assign_duplicate_request(worker_ptr worker, request_ptr duplicate) override
+    {
+        auto &current_jobs = worker_jobs_[worker];
+        if (current_jobs.size() >= worker->slots) {
+            return false;
+        }
+
+        current_jobs.push_back(duplicate);
+        selector_->assigned(worker, duplicate);
+        return true;
+    }
+
+    void index_duplicate_request(worker_ptr worker, request_ptr duplicate) override
+    {
+        index_.add(duplicate, worker);
+    }
+
+    request_ptr remove_queued_request(const std::string &job_id) override
+    {
+        auto location = index_.find(job_id);
+        if (location.request == nullptr || location.worker != nullptr) {
+            return nullptr;
+        }
+
+        auto it = std::find_if(jobs_.begin(), jobs_.end(), [&location](const request_entry &entry) {
+            return entry.request == location.request;
+        });
+
+        if (it == jobs_.end()) {
+            return nullptr;
+        }
+
+        count_queued_request(*it, false);
+        index_.remove(location.request);
+        selector_->request_removed(location.request);
+        jobs_.erase(it);
+
+        return location.request;
+    }
+
+    request_ptr worker_finished(worker_ptr worker, const std::string &job_id = "") override
     {
+        index_.remove(take_request(worker_jobs_[worker], job_id));
         return assign_request(worker);
     }
 
-    request_ptr worker_cancelled(worker_ptr worker) override
+    request_ptr worker_cancelled(worker_ptr worker, const std::string &job_id = "") override
     {
-        auto current_request = worker_jobs_[worker];
-        worker_jobs_[worker] = nullptr;
-        return current_request;
+        auto request = take_request(worker_jobs_[worker], job_id);
+        index_.remove(request);
+        selector_->request_removed(request);
+        return request;
     }
 };
 
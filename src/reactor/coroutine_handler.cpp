@@ -0,0 +1,249 @@
+#include "coroutine_handler.h"
+
+#include "../helpers/logger.h"
+#include "reactor.h"
+#include <set>
+
+coroutine_handler::task coroutine_handler::task::promise_type::get_return_object()
+{
+	return task(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+std::suspend_always coroutine_handler::task::promise_type::initial_suspend() noexcept
+{
+	return {};
+}
+
+std::suspend_never coroutine_handler::task::promise_type::final_suspend() noexcept
+{
+	return {};
+}
+
+void coroutine_handler::task::promise_type::return_void()
+{
+}
+
+void coroutine_handler::task::promise_type::unhandled_exception()
+{
+	try {
+		throw;
+	} catch (std::exception &e) {
+		owner->logger_->error("Coroutine terminated with an exception: {}", e.what());
+	} catch (...) {
+		owner->logger_->error("Coroutine terminated with an unknown exception");
+	}
+}
+
+coroutine_handler::task::task(std::coroutine_handle<promise_type> coroutine) : coroutine_(coroutine)
+{
+}
+
+coroutine_handler::task::task(task &&other) noexcept : coroutine_(other.coroutine_)
+{
+	other.coroutine_ = nullptr;
+}
+
+coroutine_handler::task::~task()
+{
+	if (coroutine_) {
+		coroutine_.destroy();
+	}
+}
+
+coroutine_handler::wait_awaitable::wait_awaitable(coroutine_handler &owner,
+	std::string key,
+	std::optional<std::string> identity,
+	std::optional<std::chrono::milliseconds> deadline,
+	std::optional<message_container> request)
+	: owner_(owner), key_(std::move(key)), identity_(std::move(identity)), deadline_(deadline),
+	  request_(std::move(request))
+{
+}
+
+bool coroutine_handler::wait_awaitable::await_ready() const noexcept
+{
+	// A sleep that has already ended does not suspend the coroutine
+	return key_.empty() && deadline_.has_value() && *deadline_ <= owner_.now();
+}
+
+void coroutine_handler::wait_awaitable::await_suspend(std::coroutine_handle<> coroutine)
+{
+	coroutine_ = coroutine;
+	owner_.suspend(*this);
+
+	if (request_) {
+		// The reply can arrive (and resume the coroutine) before send returns, the awaitable cannot be used then
+		auto &owner = owner_;
+		auto message = std::move(*request_);
+		owner.send(message);
+	}
+}
+
+std::optional<message_container> coroutine_handler::wait_awaitable::await_resume()
+{
+	return std::move(result_);
+}
+
+coroutine_handler::coroutine_handler(std::shared_ptr<spdlog::logger> logger) : logger_(logger)
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+}
+
+coroutine_handler::~coroutine_handler()
+{
+	std::set<wait_awaitable *> waiting;
+	for (auto &pair : by_key_) {
+		waiting.insert(pair.second.begin(), pair.second.end());
+	}
+
+	for (auto &pair : by_deadline_) {
+		waiting.insert(pair.second);
+	}
+
+	std::vector<std::coroutine_handle<>> coroutines;
+	for (auto awaitable : waiting) {
+		coroutines.push_back(awaitable->coroutine_);
+	}
+
+	// Destroying a frame destroys the awaitables in it
+	by_key_.clear();
+	by_deadline_.clear();
+
+	for (auto coroutine : coroutines) {
+		coroutine.destroy();
+	}
+}
+
+void coroutine_handler::on_request(const message_container &message, const response_cb &respond)
+{
+	respond_ = respond;
+
+	if (message.key == reactor::KEY_TIMER) {
+		clock_ += std::chrono::milliseconds(std::stoll(message.data.front()));
+
+		// The resumed coroutines can only start waiting for a later deadline, so the loop terminates
+		while (!by_deadline_.empty() && by_deadline_.begin()->first <= clock_) {
+			resume(*by_deadline_.begin()->second);
+		}
+
+		return;
+	}
+
+	auto awaitable = find_waiting(message);
+	if (awaitable != nullptr) {
+		awaitable->result_ = message;
+		resume(*awaitable);
+		return;
+	}
+
+	start(handle(message));
+}
+
+std::size_t coroutine_handler::get_waiting_count() const
+{
+	return waiting_count_;
+}
+
+void coroutine_handler::send(const message_container &message)
+{
+	// The reactor can pass the message back to the handler right away, which replaces the callback
+	auto respond = respond_;
+	respond(message);
+}
+
+std::chrono::milliseconds coroutine_handler::now() const
+{
+	return clock_;
+}
+
+coroutine_handler::wait_awaitable coroutine_handler::sleep_until(std::chrono::milliseconds time)
+{
+	return wait_awaitable(*this, "", std::nullopt, time);
+}
+
+coroutine_handler::wait_awaitable coroutine_handler::sleep_for(std::chrono::milliseconds duration)
+{
+	return sleep_until(clock_ + duration);
+}
+
+coroutine_handler::wait_awaitable coroutine_handler::request(
+	const message_container &message, std::chrono::milliseconds timeout)
+{
+	std::optional<std::chrono::milliseconds> deadline;
+	if (timeout.count() > 0) {
+		deadline = clock_ + timeout;
+	}
+
+	return wait_awaitable(*this, message.key, message.identity, deadline, message);
+}
+
+coroutine_handler::wait_awaitable coroutine_handler::readable(
+	const std::string &name, std::chrono::milliseconds timeout)
+{
+	std::optional<std::chrono::milliseconds> deadline;
+	if (timeout.count() > 0) {
+		deadline = clock_ + timeout;
+	}
+
+	return wait_awaitable(*this, name, std::nullopt, deadline);
+}
+
+void coroutine_handler::start(task &&coroutine)
+{
+	auto handle = coroutine.coroutine_;
+	coroutine.coroutine_ = nullptr;
+
+	handle.promise().owner = this;
+	handle.resume();
+}
+
+void coroutine_handler::suspend(wait_awaitable &awaitable)
+{
+	if (!awaitable.key_.empty()) {
+		auto &waiting = by_key_[awaitable.key_];
+		awaitable.key_position_ = waiting.insert(waiting.end(), &awaitable);
+	}
+
+	if (awaitable.deadline_) {
+		awaitable.deadline_position_ = by_deadline_.emplace(*awaitable.deadline_, &awaitable);
+	}
+
+	++waiting_count_;
+}
+
+void coroutine_handler::resume(wait_awaitable &awaitable)
+{
+	if (!awaitable.key_.empty()) {
+		auto waiting = by_key_.find(awaitable.key_);
+		waiting->second.erase(awaitable.key_position_);
+
+		if (waiting->second.empty()) {
+			by_key_.erase(waiting);
+		}
+	}
+
+	if (awaitable.deadline_) {
+		by_deadline_.erase(awaitable.deadline_position_);
+	}
+
+	--waiting_count_;
+	awaitable.coroutine_.resume();
+}
+
+coroutine_handler::wait_awaitable *coroutine_handler::find_waiting(const message_container &message) const
+{
+	auto waiting = by_key_.find(message.key);
+	if (waiting == by_key_.end()) {
+		return nullptr;
+	}
+
+	for (auto awaitable : waiting->second) {
+		if (!awaitable->identity_ || *awaitable->identity_ == message.identity) {
+			return awaitable;
+		}
+	}
+
+	return nullptr;
+}
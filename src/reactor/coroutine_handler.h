@@ -0,0 +1,213 @@
+#ifndef RECODEX_BROKER_COROUTINE_HANDLER_H
+#define RECODEX_BROKER_COROUTINE_HANDLER_H
+
+#include <chrono>
+#include <coroutine>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <spdlog/logger.h>
+
+#include "handler_interface.h"
+
+/**
+ * A base of reactor event handlers that process each message in a coroutine. A coroutine can wait for a while,
+ * for a reply to a message it sent or for a file descriptor to become readable without blocking the reactor thread,
+ * so waiting costs a coroutine frame instead of a thread or a hand-written state machine.
+ *
+ * Everything runs in the reactor thread. The handler must be subscribed to the timer messages of the reactor
+ * (@ref reactor::KEY_TIMER) if its coroutines sleep or wait with a timeout, the time is measured by adding up the
+ * time elapsed between the timer messages.
+ */
+class coroutine_handler : public handler_interface
+{
+public:
+	/**
+	 * Return type of the coroutines started by the handler. The coroutine starts running when it is passed to the
+	 * handler and it is destroyed when it finishes (or when the handler is destroyed while it waits).
+	 */
+	class task
+	{
+	public:
+		/**
+		 * The promise of the coroutine
+		 */
+		struct promise_type {
+			/** The handler that runs the coroutine (used to report exceptions) */
+			coroutine_handler *owner = nullptr;
+
+			task get_return_object();
+			std::suspend_always initial_suspend() noexcept;
+			std::suspend_never final_suspend() noexcept;
+			void return_void();
+			void unhandled_exception();
+		};
+
+		/** Move constructor */
+		task(task &&other) noexcept;
+
+		/** Disabled copy constructor */
+		task(const task &) = delete;
+
+		/** Destroys the coroutine if it has not been started */
+		~task();
+
+	private:
+		/** The coroutine (null once it is started) */
+		std::coroutine_handle<promise_type> coroutine_;
+
+		explicit task(std::coroutine_handle<promise_type> coroutine);
+
+		friend class coroutine_handler;
+	};
+
+	/**
+	 * An awaitable that suspends the coroutine until a message arrives or a deadline passes.
+	 * The result of co_await is the message (std::nullopt if the deadline passed first).
+	 */
+	class wait_awaitable
+	{
+	public:
+		/** Disabled copy constructor (the handler refers to the awaitable while the coroutine waits) */
+		wait_awaitable(const wait_awaitable &) = delete;
+
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> coroutine);
+		std::optional<message_container> await_resume();
+
+	private:
+		/** The handler that resumes the coroutine */
+		coroutine_handler &owner_;
+		/** Origin of the awaited message (empty if the coroutine only sleeps) */
+		std::string key_;
+		/** Identity of the awaited message (std::nullopt if any identity matches) */
+		std::optional<std::string> identity_;
+		/** Time (measured by the handler clock) when the waiting ends (std::nullopt if there is no deadline) */
+		std::optional<std::chrono::milliseconds> deadline_;
+		/** The message sent once the coroutine is suspended (so that an immediate reply cannot be missed) */
+		std::optional<message_container> request_;
+		/** The message that ended the waiting */
+		std::optional<message_container> result_;
+		/** The suspended coroutine */
+		std::coroutine_handle<> coroutine_;
+		/** Position among the coroutines waiting for a message from the same origin */
+		std::list<wait_awaitable *>::iterator key_position_;
+		/** Position among the coroutines waiting for a deadline */
+		std::multimap<std::chrono::milliseconds, wait_awaitable *>::iterator deadline_position_;
+
+		wait_awaitable(coroutine_handler &owner,
+			std::string key,
+			std::optional<std::string> identity,
+			std::optional<std::chrono::milliseconds> deadline,
+			std::optional<message_container> request = std::nullopt);
+
+		friend class coroutine_handler;
+	};
+
+	/**
+	 * @param logger an optional logger (used to report exceptions thrown by the coroutines)
+	 */
+	explicit coroutine_handler(std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/**
+	 * Destroys the coroutines that are still waiting.
+	 */
+	~coroutine_handler() override;
+
+	/**
+	 * Resume the coroutine waiting for the message or start a new one using @ref handle.
+	 * Timer messages only resume the coroutines whose deadline has passed.
+	 */
+	void on_request(const message_container &message, const response_cb &respond) override;
+
+	/**
+	 * Get the amount of coroutines that wait for something.
+	 */
+	std::size_t get_waiting_count() const;
+
+protected:
+	/**
+	 * Start a coroutine that processes a message no other coroutine waits for.
+	 * @param message the message (it is passed by value, a reference would not outlive the first suspension)
+	 */
+	virtual task handle(message_container message) = 0;
+
+	/**
+	 * Send a message through the reactor.
+	 */
+	void send(const message_container &message);
+
+	/**
+	 * Get the current time of the handler clock (the time elapsed since the handler was created).
+	 */
+	std::chrono::milliseconds now() const;
+
+	/**
+	 * Suspend the coroutine until given time of the handler clock.
+	 */
+	wait_awaitable sleep_until(std::chrono::milliseconds time);
+
+	/**
+	 * Suspend the coroutine for given time.
+	 */
+	wait_awaitable sleep_for(std::chrono::milliseconds duration);
+
+	/**
+	 * Send a message and suspend the coroutine until a message from the same origin and identity arrives
+	 * (the replies are matched with the requests in the order they were sent).
+	 * @param message the request
+	 * @param timeout time to wait for the reply (zero to wait indefinitely)
+	 */
+	wait_awaitable request(const message_container &message,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+	/**
+	 * Suspend the coroutine until a file descriptor registered by @ref reactor::add_fd becomes readable.
+	 * @param name name of the file descriptor in the reactor
+	 * @param timeout time to wait (zero to wait indefinitely)
+	 */
+	wait_awaitable readable(const std::string &name, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+	/** A system logger */
+	std::shared_ptr<spdlog::logger> logger_;
+
+private:
+	/** Time elapsed since the handler was created (accumulated from the timer messages) */
+	std::chrono::milliseconds clock_ = std::chrono::milliseconds(0);
+
+	/** The callback of the reactor (the coroutines can be resumed after the call that provided it returns) */
+	response_cb respond_;
+
+	/** Coroutines waiting for a message, by the origin of the message (in the order they started waiting) */
+	std::map<std::string, std::list<wait_awaitable *>> by_key_;
+
+	/** Coroutines waiting for a deadline */
+	std::multimap<std::chrono::milliseconds, wait_awaitable *> by_deadline_;
+
+	/** Amount of waiting coroutines */
+	std::size_t waiting_count_ = 0;
+
+	/**
+	 * Start a coroutine.
+	 */
+	void start(task &&coroutine);
+
+	/**
+	 * Register a suspended coroutine.
+	 */
+	void suspend(wait_awaitable &awaitable);
+
+	/**
+	 * Unregister a coroutine and resume it.
+	 */
+	void resume(wait_awaitable &awaitable);
+
+	/**
+	 * Find the coroutine that waits for a message.
+	 * @return nullptr if there is none
+	 */
+	wait_awaitable *find_waiting(const message_container &message) const;
+};
+
+#endif // RECODEX_BROKER_COROUTINE_HANDLER_H
@@ -0,0 +1,39 @@
+#include "dealer_socket_wrapper.h"
+
+dealer_socket_wrapper::dealer_socket_wrapper(
+	std::shared_ptr<zmq::context_t> context, const std::string &addr, const bool bound)
+	: socket_wrapper_base(context, zmq::socket_type::dealer, addr, bound)
+{
+}
+
+bool dealer_socket_wrapper::send_message(const message_container &source)
+{
+	for (auto it = std::begin(source.data); it != std::end(source.data); ++it) {
+		try {
+			socket_.send(it->c_str(), it->size(), std::next(it) != std::end(source.data) ? ZMQ_SNDMORE : 0);
+		} catch (const zmq::error_t &) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool dealer_socket_wrapper::receive_message(message_container &target)
+{
+	zmq::message_t msg;
+	target.identity = "";
+	target.data.clear();
+
+	do {
+		try {
+			socket_.recv(&msg, 0);
+		} catch (const zmq::error_t &) {
+			return false;
+		}
+
+		target.data.emplace_back(static_cast<char *>(msg.data()), msg.size());
+	} while (msg.more());
+
+	return true;
+}
@@ -0,0 +1,73 @@
+#include "event_fd.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+event_fd::event_fd()
+{
+#ifdef __linux__
+	read_fd_ = write_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+	int fds[2];
+	if (pipe(fds) == 0) {
+		read_fd_ = fds[0];
+		write_fd_ = fds[1];
+		fcntl(read_fd_, F_SETFL, O_NONBLOCK);
+		fcntl(write_fd_, F_SETFL, O_NONBLOCK);
+	}
+#endif
+}
+
+event_fd::~event_fd()
+{
+	if (read_fd_ >= 0) {
+		close(read_fd_);
+	}
+
+	if (write_fd_ >= 0 && write_fd_ != read_fd_) {
+		close(write_fd_);
+	}
+}
+
+void event_fd::notify()
+{
+	// A full pipe or counter is readable anyway, so a failed write does not matter
+	uint64_t value = 1;
+	ssize_t written = write(write_fd_, &value, write_fd_ == read_fd_ ? sizeof(value) : 1);
+	(void) written;
+}
+
+void event_fd::wait()
+{
+	pollfd item = {read_fd_, POLLIN, 0};
+	int result;
+
+	do {
+		result = poll(&item, 1, -1);
+	} while (result < 0 && errno == EINTR);
+
+	reset();
+}
+
+void event_fd::reset()
+{
+	// An eventfd is cleared by a single read, a pipe is read until it is empty
+	uint64_t buffer[16];
+	ssize_t size;
+
+	do {
+		size = read(read_fd_, buffer, sizeof(buffer));
+	} while (size > 0 && read_fd_ != write_fd_);
+}
+
+int event_fd::get_fd() const
+{
+	return read_fd_;
+}
@@ -0,0 +1,50 @@
+#ifndef RECODEX_BROKER_EVENT_FD_H
+#define RECODEX_BROKER_EVENT_FD_H
+
+/**
+ * A file descriptor used to wake up another thread (an eventfd on Linux, a pipe elsewhere).
+ * It can be watched by the reactor like any other descriptor.
+ */
+class event_fd
+{
+public:
+	event_fd();
+
+	/** Close the descriptors */
+	~event_fd();
+
+	/** Disabled copy constructor */
+	event_fd(const event_fd &) = delete;
+
+	/** Disabled copy assignment operator */
+	event_fd &operator=(const event_fd &) = delete;
+
+	/**
+	 * Make the descriptor readable (thread-safe)
+	 */
+	void notify();
+
+	/**
+	 * Block until the descriptor is readable and clear it
+	 */
+	void wait();
+
+	/**
+	 * Clear the descriptor without blocking
+	 */
+	void reset();
+
+	/**
+	 * Get the descriptor to be watched
+	 */
+	int get_fd() const;
+
+private:
+	/** The descriptor that becomes readable */
+	int read_fd_ = -1;
+
+	/** The descriptor written by @ref notify (the same as read_fd_ for an eventfd) */
+	int write_fd_ = -1;
+};
+
+#endif // RECODEX_BROKER_EVENT_FD_H
@@ -0,0 +1,83 @@
+#include "message_ring.h"
+
+message_ring::message_ring(std::size_t capacity) : head_(0), tail_(0)
+{
+	std::size_t size = 1;
+	while (size < capacity) {
+		size *= 2;
+	}
+
+	slots_ = std::make_unique<slot[]>(size);
+	mask_ = size - 1;
+
+	for (std::size_t i = 0; i < size; ++i) {
+		slots_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool message_ring::try_push(message_container &&message)
+{
+	std::size_t position = head_.load(std::memory_order_relaxed);
+
+	while (true) {
+		slot &target = slots_[position & mask_];
+		std::size_t sequence = target.sequence.load(std::memory_order_acquire);
+		auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+		if (difference == 0) {
+			// The slot is free, try to claim it
+			if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				target.message = std::move(message);
+				target.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (difference < 0) {
+			// The slot still holds a message from the previous round
+			return false;
+		} else {
+			// Another producer was faster
+			position = head_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool message_ring::try_pop(message_container &message)
+{
+	std::size_t position = tail_.load(std::memory_order_relaxed);
+
+	while (true) {
+		slot &source = slots_[position & mask_];
+		std::size_t sequence = source.sequence.load(std::memory_order_acquire);
+		auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+		if (difference == 0) {
+			// The slot is filled, try to claim it
+			if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				message = std::move(source.message);
+				source.message = message_container();
+				source.sequence.store(position + mask_ + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (difference < 0) {
+			// The slot has not been filled yet
+			return false;
+		} else {
+			// Another consumer was faster
+			position = tail_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+std::size_t message_ring::capacity() const
+{
+	return mask_ + 1;
+}
+
+std::size_t message_ring::size() const
+{
+	std::size_t tail = tail_.load(std::memory_order_relaxed);
+	std::size_t head = head_.load(std::memory_order_relaxed);
+
+	// The positions are read separately, a consumer may have moved past the head read afterwards
+	return head > tail ? head - tail : 0;
+}
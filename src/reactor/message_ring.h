@@ -0,0 +1,77 @@
+#ifndef RECODEX_BROKER_MESSAGE_RING_H
+#define RECODEX_BROKER_MESSAGE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "message_container.h"
+
+/**
+ * A bounded lock-free queue of messages that can be used by any number of producer and consumer threads
+ * (a ring buffer with a sequence number in each slot). The messages are moved in and out, their frames are not
+ * copied.
+ */
+class message_ring
+{
+public:
+	/**
+	 * @param capacity maximum amount of queued messages (rounded up to a power of two)
+	 */
+	explicit message_ring(std::size_t capacity);
+
+	/** Disabled copy constructor */
+	message_ring(const message_ring &) = delete;
+
+	/** Disabled copy assignment operator */
+	message_ring &operator=(const message_ring &) = delete;
+
+	/**
+	 * Add a message to the queue.
+	 * @param message the message (it is left intact if the queue is full)
+	 * @return false if the queue is full
+	 */
+	bool try_push(message_container &&message);
+
+	/**
+	 * Take the oldest message from the queue.
+	 * @param message the message is moved here
+	 * @return false if the queue is empty
+	 */
+	bool try_pop(message_container &message);
+
+	/**
+	 * Get the maximum amount of queued messages.
+	 */
+	std::size_t capacity() const;
+
+	/**
+	 * Get the amount of queued messages (only an estimate while other threads use the queue).
+	 */
+	std::size_t size() const;
+
+private:
+	/**
+	 * A slot of the ring
+	 */
+	struct slot {
+		/** Position of the producer that can fill the slot, or of the consumer that can empty it (plus one) */
+		std::atomic<std::size_t> sequence;
+		/** The stored message */
+		message_container message;
+	};
+
+	/** The slots */
+	std::unique_ptr<slot[]> slots_;
+
+	/** Capacity minus one (used to get the slot of a position) */
+	std::size_t mask_;
+
+	/** Position of the next message to be pushed (on its own cache line) */
+	alignas(64) std::atomic<std::size_t> head_;
+
+	/** Position of the next message to be popped (on its own cache line) */
+	alignas(64) std::atomic<std::size_t> tail_;
+};
+
+#endif // RECODEX_BROKER_MESSAGE_RING_H
@@ -0,0 +1,72 @@
+#include "peer_monitor_wrapper.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+	/**
+	 * Get an unused address for a socket monitor
+	 */
+	std::string create_monitor_address()
+	{
+		static std::atomic<std::size_t> counter(0);
+		return "inproc://peer-monitor-" + std::to_string(counter++);
+	}
+} // namespace
+
+peer_monitor_wrapper::peer_monitor_wrapper(
+	std::shared_ptr<zmq::context_t> context, std::shared_ptr<router_socket_wrapper> router)
+	: socket_wrapper_base(context, zmq::socket_type::pair, create_monitor_address(), false), router_(router)
+{
+	router_->monitor_peers(addr_);
+}
+
+bool peer_monitor_wrapper::send_message(const message_container &message)
+{
+	return false;
+}
+
+bool peer_monitor_wrapper::receive_message(message_container &target)
+{
+	zmq::message_t msg;
+	target.data.clear();
+
+	try {
+		socket_.recv(&msg, 0);
+	} catch (const zmq::error_t &) {
+		return false;
+	}
+
+	// The first frame holds the event (16 bits) and its value (32 bits), the descriptor of the connection here
+	std::uint16_t event = 0;
+	std::uint32_t value = 0;
+	bool valid = msg.size() >= sizeof(event) + sizeof(value);
+
+	if (valid) {
+		std::memcpy(&event, msg.data(), sizeof(event));
+		std::memcpy(&value, static_cast<char *>(msg.data()) + sizeof(event), sizeof(value));
+	}
+
+	// The address of the socket follows
+	while (msg.more()) {
+		try {
+			socket_.recv(&msg, 0);
+		} catch (const zmq::error_t &) {
+			return false;
+		}
+	}
+
+	if (!valid || event != ZMQ_EVENT_DISCONNECTED) {
+		return false;
+	}
+
+	auto identity = router_->peer_disconnected(static_cast<int>(value));
+	if (!identity) {
+		return false;
+	}
+
+	target.identity = *identity;
+	target.data.push_back("disconnected");
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef RECODEX_BROKER_PEER_MONITOR_WRAPPER_H
+#define RECODEX_BROKER_PEER_MONITOR_WRAPPER_H
+
+#include <memory>
+
+#include "router_socket_wrapper.h"
+
+/**
+ * Reads the events of a ZeroMQ socket monitor attached to a router socket and reports the peers whose connection
+ * was closed. The received messages have the identity of the peer and a single "disconnected" frame, so the handlers
+ * learn about a dead peer right away instead of waiting until it stops sending messages.
+ *
+ * Only the peers connected by a transport with file descriptors (e.g. TCP) are reported. Sending messages through
+ * the socket is not possible.
+ */
+class peer_monitor_wrapper : public socket_wrapper_base
+{
+public:
+	/**
+	 * @param context a ZeroMQ context (the same one the router socket uses)
+	 * @param router the monitored socket
+	 */
+	peer_monitor_wrapper(std::shared_ptr<zmq::context_t> context, std::shared_ptr<router_socket_wrapper> router);
+
+	~peer_monitor_wrapper() override = default;
+
+	/**
+	 * The monitor is read-only.
+	 * @return always false
+	 */
+	bool send_message(const message_container &message) override;
+
+	/**
+	 * Receive a monitor event.
+	 * @return false if the event does not concern a known peer (nothing is reported then)
+	 */
+	bool receive_message(message_container &target) override;
+
+private:
+	/** The monitored socket */
+	std::shared_ptr<router_socket_wrapper> router_;
+};
+
+#endif // RECODEX_BROKER_PEER_MONITOR_WRAPPER_H
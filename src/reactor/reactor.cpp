@@ -1,14 +1,34 @@
+#include <algorithm>
+#include <functional>
+#include <optional>
 #include <thread>
 
 #include "reactor.h"
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
 const std::string reactor::KEY_TIMER = "timer";
+const std::chrono::milliseconds reactor::TICK_INTERVAL = std::chrono::milliseconds(100);
+const std::chrono::milliseconds reactor::OUTPUT_RETRY_INTERVAL = std::chrono::milliseconds(10);
+
+reactor::reactor(std::shared_ptr<zmq::context_t> context, reactor_backend backend)
+	: backend_(backend), async_messages_(asynchronous_handler_wrapper::DEFAULT_CAPACITY), context_(context),
+	  termination_flag_(false)
+{
+#ifndef __linux__
+	backend_ = reactor_backend::poll;
+#endif
+}
 
-reactor::reactor(std::shared_ptr<zmq::context_t> context)
-	: unique_id("reactor_" + std::to_string((uintptr_t) this)), context_(context),
-	  async_handler_socket_(*context, zmq::socket_type::router)
+reactor::~reactor()
 {
-	async_handler_socket_.bind("inproc://" + unique_id);
+	termination_flag_.store(true);
+	wake_ring_waiters();
+	handlers_.clear();
+	async_handlers_.clear();
 }
 
 void reactor::add_socket(const std::string &name, std::shared_ptr<socket_wrapper_base> socket)
@@ -16,6 +36,56 @@ void reactor::add_socket(const std::string &name, std::shared_ptr<socket_wrapper
 	sockets_.emplace(name, socket);
 }
 
+void reactor::add_fd(const std::string &name, int fd)
+{
+	fds_.emplace(name, fd);
+}
+
+void reactor::add_timer(const std::string &name, std::chrono::milliseconds interval)
+{
+	timers_.schedule_periodic(
+		interval, [this, name](std::chrono::milliseconds elapsed) { notify_timer(name, elapsed); });
+}
+
+timer_service::timer_id reactor::schedule_timer(std::chrono::milliseconds delay, timer_service::callback_fn callback)
+{
+	return timers_.schedule_once(delay, std::move(callback));
+}
+
+timer_service::timer_id reactor::schedule_periodic_timer(
+	std::chrono::milliseconds interval, timer_service::callback_fn callback)
+{
+	return timers_.schedule_periodic(interval, std::move(callback));
+}
+
+bool reactor::cancel_timer(timer_service::timer_id id)
+{
+	return timers_.cancel(id);
+}
+
+void reactor::set_tick_on_demand(bool on_demand)
+{
+	tick_on_demand_ = on_demand;
+}
+
+void reactor::request_tick(std::chrono::milliseconds delay)
+{
+	auto time = timer_service::clock::now() + delay;
+	if (requested_tick_ && requested_tick_time_ <= time) {
+		return;
+	}
+
+	if (requested_tick_) {
+		timers_.cancel(*requested_tick_);
+	}
+
+	requested_tick_time_ = time;
+	requested_tick_ = timers_.schedule_once(delay, [this](std::chrono::milliseconds) {
+		requested_tick_.reset();
+		tick();
+	});
+}
+
 void reactor::add_handler(const std::vector<std::string> &origins, std::shared_ptr<handler_interface> handler)
 {
 	auto wrapper = std::make_shared<handler_wrapper>(*this, handler);
@@ -25,13 +95,20 @@ void reactor::add_handler(const std::vector<std::string> &origins, std::shared_p
 	}
 }
 
-void reactor::add_async_handler(const std::vector<std::string> &origins, std::shared_ptr<handler_interface> handler)
+std::shared_ptr<asynchronous_handler_wrapper> reactor::add_async_handler(const std::vector<std::string> &origins,
+	std::shared_ptr<handler_interface> handler,
+	std::size_t concurrency,
+	asynchronous_handler_wrapper::ordering_key_fn ordering_key)
 {
-	auto wrapper = std::make_shared<asynchronous_handler_wrapper>(*context_, async_handler_socket_, *this, handler);
+	auto wrapper =
+		std::make_shared<asynchronous_handler_wrapper>(*this, handler, concurrency, std::move(ordering_key));
+	async_handlers_.push_back(wrapper);
 
 	for (auto &origin : origins) {
 		handlers_.emplace(origin, wrapper);
 	}
+
+	return wrapper;
 }
 
 void reactor::send_message(const message_container &message)
@@ -46,6 +123,32 @@ void reactor::send_message(const message_container &message)
 	}
 }
 
+void reactor::post_message(message_container &&message)
+{
+	if (!async_messages_.try_push(std::move(message))) {
+		// Sleep until the reactor makes some room (unless it is not going to)
+		std::unique_lock<std::mutex> lock(ring_mutex_);
+		ring_waiters_.fetch_add(1);
+		ring_space_.wait(lock, [this, &message]() {
+			return termination_flag_.load() || async_messages_.try_push(std::move(message));
+		});
+		ring_waiters_.fetch_sub(1);
+	}
+
+	async_signal_.notify();
+}
+
+void reactor::wake_ring_waiters()
+{
+	// Pairs with the increment of the waiters before they check the ring
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (ring_waiters_.load() > 0) {
+		std::lock_guard<std::mutex> lock(ring_mutex_);
+		ring_space_.notify_all();
+	}
+}
+
 void reactor::process_message(const message_container &message)
 {
 	auto range = handlers_.equal_range(message.key);
@@ -56,82 +159,268 @@ void reactor::process_message(const message_container &message)
 }
 
 void reactor::start_loop()
+{
+	for (auto it : sockets_) {
+		it.second->initialize();
+	}
+
+	termination_flag_.store(false);
+	wakeup_.reset();
+
+	// Nobody needs the tick if no handler keeps track of elapsed time
+	last_tick_ = timer_service::clock::now();
+	std::optional<timer_service::timer_id> periodic_tick;
+	if (handlers_.count(KEY_TIMER) > 0 && !tick_on_demand_) {
+		periodic_tick = timers_.schedule_periodic(TICK_INTERVAL, [this](std::chrono::milliseconds) { tick(); });
+	}
+
+	if (backend_ == reactor_backend::epoll) {
+		epoll_loop();
+	} else {
+		poll_loop();
+	}
+
+	if (periodic_tick) {
+		timers_.cancel(*periodic_tick);
+	}
+
+	if (requested_tick_) {
+		timers_.cancel(*requested_tick_);
+		requested_tick_.reset();
+	}
+
+	handlers_.clear();
+	async_handlers_.clear();
+}
+
+void reactor::poll_loop()
 {
 	std::vector<zmq::pollitem_t> pollitems;
 	std::vector<std::string> pollitem_names;
 
 	// Poll all registered sockets
 	for (auto it : sockets_) {
-		it.second->initialize();
 		pollitems.push_back(it.second->get_pollitem());
 		pollitem_names.push_back(it.first);
 	}
 
-	// Also poll the internal socket for asynchronous communication
-	pollitems.push_back(
-		zmq_pollitem_t{.socket = (void *) async_handler_socket_, .fd = 0, .events = ZMQ_POLLIN, .revents = 0});
+	// Sockets whose last flush sent nothing are not polled for output (a router reports it can send if any of its
+	// peers can take a message), they are retried after a while
+	std::vector<bool> stalled(sockets_.size(), false);
 
-	termination_flag_.store(false);
+	// Then the registered file descriptors
+	for (auto &it : fds_) {
+		pollitems.push_back(zmq_pollitem_t{.socket = nullptr, .fd = it.second, .events = ZMQ_POLLIN, .revents = 0});
+		pollitem_names.push_back(it.first);
+	}
+
+	// Also poll the descriptor signalled by asynchronous handlers and the one that interrupts the loop
+	pollitems.push_back(
+		zmq_pollitem_t{.socket = nullptr, .fd = async_signal_.get_fd(), .events = ZMQ_POLLIN, .revents = 0});
+	pollitems.push_back(zmq_pollitem_t{.socket = nullptr, .fd = wakeup_.get_fd(), .events = ZMQ_POLLIN, .revents = 0});
 
 	// Enter the poll loop
 	while (!termination_flag_.load()) {
-		auto time_before_poll = std::chrono::system_clock::now();
-		zmq::poll(pollitems, std::chrono::milliseconds(100));
-		auto time_after_poll = std::chrono::system_clock::now();
+		// Sleep until the nearest timer expires (or indefinitely if there are none)
+		auto timeout = timers_.get_timeout();
+
+		for (std::size_t i = 0; i < sockets_.size(); ++i) {
+			pollitems[i].events = ZMQ_POLLIN;
+
+			if (sockets_.at(pollitem_names[i])->get_queued_output() > 0) {
+				pollitems[i].events |= stalled[i] ? 0 : ZMQ_POLLOUT;
+				timeout = timeout.count() < 0 ? OUTPUT_RETRY_INTERVAL : std::min(timeout, OUTPUT_RETRY_INTERVAL);
+			}
+		}
 
-		auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(time_after_poll - time_before_poll);
+		zmq::poll(pollitems, timeout);
 
 		std::size_t i = 0;
 		for (auto item : pollitems) {
 			if (item.revents & ZMQ_POLLIN) {
-				message_container received_msg;
+				if (i < sockets_.size()) {
+					// message came from a registered socket
+					receive_socket_message(pollitem_names.at(i), *sockets_.at(pollitem_names.at(i)));
+				} else if (i < pollitem_names.size()) {
+					// a registered file descriptor is readable
+					process_message(message_container(pollitem_names.at(i), "", {std::to_string(item.fd)}));
+				}
+			}
 
-				if (i < pollitem_names.size()) {
-					// message came from a registered socket, fill in its key
-					received_msg.key = pollitem_names.at(i);
-					sockets_.at(received_msg.key)->receive_message(received_msg);
+			++i;
+		}
 
-					// messages from sockets must go through a handler
-					process_message(received_msg);
-				} else {
-					// message from the asynchronous handler socket
-					zmq::message_t zmessage;
+		// The backlogs of the asynchronous handlers are flushed even when they did not send anything
+		receive_async_messages();
 
-					// this is the async handler identity - we don't care about that
-					async_handler_socket_.recv(&zmessage);
+		timers_.run_expired();
 
-					async_handler_socket_.recv(&zmessage);
-					received_msg.key = std::string(static_cast<char *>(zmessage.data()), zmessage.size());
+		for (std::size_t j = 0; j < sockets_.size(); ++j) {
+			auto &socket = *sockets_.at(pollitem_names[j]);
+			if (socket.get_queued_output() > 0) {
+				stalled[j] = !socket.flush_output();
+			}
+		}
+	}
+}
+
+void reactor::epoll_loop()
+{
+#ifdef __linux__
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		poll_loop();
+		return;
+	}
+
+	// The index of the callback invoked for an event is stored in the event data
+	std::vector<std::function<void()>> callbacks;
 
-					async_handler_socket_.recv(&zmessage);
-					received_msg.identity = std::string(static_cast<char *>(zmessage.data()), zmessage.size());
+	auto watch = [&](int fd, uint32_t events, std::function<void()> callback) {
+		epoll_event event = {};
+		event.events = events;
+		event.data.u64 = callbacks.size();
+		callbacks.push_back(callback);
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	};
 
-					while (zmessage.more()) {
-						async_handler_socket_.recv(&zmessage);
-						received_msg.data.emplace_back(static_cast<char *>(zmessage.data()), zmessage.size());
-					}
+	// The ZeroMQ sockets only wake the loop up, their messages are received below
+	for (auto &it : sockets_) {
+		watch(it.second->get_fd(), EPOLLIN | EPOLLET, []() {});
+	}
 
-					// messages from async handlers might be destined to a socket
-					send_message(received_msg);
+	watch(async_signal_.get_fd(), EPOLLIN, []() {});
+
+	for (auto &it : fds_) {
+		const auto &name = it.first;
+		int fd = it.second;
+		watch(fd, EPOLLIN, [this, name, fd]() { process_message(message_container(name, "", {std::to_string(fd)})); });
+	}
+
+	watch(wakeup_.get_fd(), EPOLLIN, [this]() { wakeup_.reset(); });
+
+	std::vector<epoll_event> events(callbacks.size());
+
+	while (!termination_flag_.load()) {
+		// ZMQ_FD is edge triggered (and it might have been signalled before it was watched) and sending through
+		// a socket can consume the notification of an incoming message, so all the sockets are checked until none
+		// of them has anything to receive
+		bool received = true;
+		while (received && !termination_flag_.load()) {
+			received = receive_async_messages();
+
+			for (auto &it : sockets_) {
+				while (it.second->has_input()) {
+					receive_socket_message(it.first, *it.second);
+					received = true;
 				}
 			}
+		}
 
-			++i;
+		// The queued messages are sent when the sockets can take them (which also changes ZMQ_FD),
+		// but the sockets are retried after a while in case only some of the peers of a router can
+		bool queued_output = false;
+		for (auto &it : sockets_) {
+			if (it.second->get_queued_output() > 0) {
+				it.second->flush_output();
+				queued_output = queued_output || it.second->get_queued_output() > 0;
+			}
+		}
+
+		// Sleep until the nearest timer expires (or indefinitely if there are none)
+		auto timeout = timers_.get_timeout();
+		if (queued_output) {
+			timeout = timeout.count() < 0 ? OUTPUT_RETRY_INTERVAL : std::min(timeout, OUTPUT_RETRY_INTERVAL);
 		}
 
-		message_container timer_msg;
-		timer_msg.key = KEY_TIMER;
-		timer_msg.data.push_back(std::to_string(elapsed_time.count()));
+		int count = epoll_wait(epoll_fd, events.data(), events.size(), timeout.count());
+
+		for (int i = 0; i < count; ++i) {
+			callbacks.at(events[i].data.u64)();
+		}
 
-		process_message(timer_msg);
+		timers_.run_expired();
 	}
 
-	handlers_.clear();
+	close(epoll_fd);
+#else
+	poll_loop();
+#endif
+}
+
+void reactor::receive_socket_message(const std::string &name, socket_wrapper_base &socket)
+{
+	message_container received_msg;
+
+	// fill in the key of the socket
+	received_msg.key = name;
+
+	// messages from sockets must go through a handler (a socket can also consume a message without passing it on)
+	if (socket.receive_message(received_msg)) {
+		if (tick_on_demand_ && timer_service::clock::now() - last_tick_ >= TICK_INTERVAL) {
+			tick();
+		}
+
+		process_message(received_msg);
+	}
+}
+
+bool reactor::receive_async_messages()
+{
+	// Clear the signal first, so that a message posted while the ring is being emptied signals again
+	async_signal_.reset();
+
+	bool received = false;
+	message_container received_msg;
+
+	while (async_messages_.try_pop(received_msg)) {
+		// messages from async handlers might be destined to a socket
+		send_message(received_msg);
+		received = true;
+	}
+
+	if (received) {
+		wake_ring_waiters();
+	}
+
+	for (auto &wrapper : async_handlers_) {
+		wrapper->flush();
+	}
+
+	return received;
+}
+
+void reactor::notify_timer(const std::string &name, std::chrono::milliseconds elapsed)
+{
+	message_container timer_msg;
+	timer_msg.key = name;
+	timer_msg.data.push_back(std::to_string(elapsed.count()));
+
+	process_message(timer_msg);
+}
+
+void reactor::tick()
+{
+	// The remainder of a millisecond is carried over to the next tick
+	auto elapsed =
+		std::chrono::duration_cast<std::chrono::milliseconds>(timer_service::clock::now() - last_tick_);
+	last_tick_ += elapsed;
+
+	notify_timer(KEY_TIMER, elapsed);
 }
 
 void reactor::terminate()
 {
 	termination_flag_.store(true);
+	wake_ring_waiters();
+
+	// Interrupt epoll_wait
+	wakeup_.notify();
+}
+
+reactor_backend reactor::get_backend() const
+{
+	return backend_;
 }
 
 handler_wrapper::handler_wrapper(reactor &reactor_ref, std::shared_ptr<handler_interface> handler)
@@ -144,79 +433,135 @@ void handler_wrapper::operator()(const message_container &message)
 	handler_->on_request(message, [this](const message_container &response) { reactor_.send_message(response); });
 }
 
-const std::string asynchronous_handler_wrapper::TERMINATE_MSG = "TERMINATE";
+const std::size_t asynchronous_handler_wrapper::DEFAULT_CAPACITY = 4096;
 
-asynchronous_handler_wrapper::asynchronous_handler_wrapper(zmq::context_t &context,
-	zmq::socket_t &async_handler_socket,
-	reactor &reactor_ref,
-	std::shared_ptr<handler_interface> handler)
-	: handler_wrapper(reactor_ref, handler), context_(context), reactor_socket_(async_handler_socket),
-	  unique_id_(std::to_string((uintptr_t) this))
+asynchronous_handler_wrapper::lane::lane(std::size_t capacity) : requests(capacity)
 {
-	worker_ = std::thread([this]() { handler_thread(); });
+}
+
+asynchronous_handler_wrapper::asynchronous_handler_wrapper(reactor &reactor_ref,
+	std::shared_ptr<handler_interface> handler,
+	std::size_t concurrency,
+	ordering_key_fn ordering_key,
+	std::size_t capacity)
+	: handler_wrapper(reactor_ref, handler), ordering_key_(std::move(ordering_key)), stop_(false), busy_(0)
+{
+	concurrency = std::max<std::size_t>(1, concurrency);
+
+	// Ordered messages need a lane for each thread, otherwise all the threads share a single one
+	std::size_t lane_count = ordering_key_ ? concurrency : 1;
+	for (std::size_t i = 0; i < lane_count; ++i) {
+		lanes_.push_back(std::make_unique<lane>(capacity));
+	}
+
+	for (std::size_t i = 0; i < concurrency; ++i) {
+		lane &source = *lanes_[i % lane_count];
+		workers_.emplace_back([this, &source]() { handler_thread(source); });
+	}
 }
 
 asynchronous_handler_wrapper::~asynchronous_handler_wrapper()
 {
-	// Send a message to terminate the worker thread
-	reactor_socket_.send(unique_id_.data(), unique_id_.size(), ZMQ_SNDMORE);
-	reactor_socket_.send(TERMINATE_MSG.data(), TERMINATE_MSG.size());
+	// Let the handler process everything it was given
+	for (auto &target : lanes_) {
+		while (!target->backlog.empty()) {
+			flush(*target);
+			std::this_thread::yield();
+		}
+	}
+
+	stop_.store(true);
+	for (auto &target : lanes_) {
+		target->signal.notify();
+	}
 
-	// Join it
-	worker_.join();
+	// Join them
+	for (auto &worker : workers_) {
+		worker.join();
+	}
 }
 
 void asynchronous_handler_wrapper::operator()(const message_container &message)
 {
-	reactor_socket_.send(unique_id_.data(), unique_id_.size(), ZMQ_SNDMORE);
-	reactor_socket_.send(message.key.data(), message.key.size(), ZMQ_SNDMORE);
-	reactor_socket_.send(message.identity.data(), message.identity.size(), ZMQ_SNDMORE);
-
-	for (auto it = std::begin(message.data); it != std::end(message.data); ++it) {
-		reactor_socket_.send(it->c_str(), it->size(), std::next(it) != std::end(message.data) ? ZMQ_SNDMORE : 0);
+	lane &target = lanes_.size() == 1 ? *lanes_.front() :
+										*lanes_[std::hash<std::string>()(ordering_key_(message)) % lanes_.size()];
+	message_container copy = message;
+
+	// Keep the order of the messages
+	if (!target.backlog.empty() || !target.requests.try_push(std::move(copy))) {
+		target.backlog.push_back(std::move(copy));
+		return;
 	}
+
+	target.signal.notify();
 }
 
-void asynchronous_handler_wrapper::handler_thread()
+void asynchronous_handler_wrapper::flush()
 {
-	zmq::socket_t socket(context_, zmq::socket_type::dealer);
-	socket.setsockopt(ZMQ_IDENTITY, unique_id_.data(), unique_id_.size());
-	socket.connect("inproc://" + reactor_.unique_id);
+	for (auto &target : lanes_) {
+		flush(*target);
+	}
+}
 
-	while (true) {
-		message_container request;
-		zmq::message_t message;
+void asynchronous_handler_wrapper::flush(lane &target)
+{
+	if (target.backlog.empty()) {
+		return;
+	}
 
-		socket.recv(&message, 0);
-		request.key = std::string(static_cast<char *>(message.data()), message.size());
+	while (!target.backlog.empty() && target.requests.try_push(std::move(target.backlog.front()))) {
+		target.backlog.pop_front();
+	}
 
-		if (request.key == TERMINATE_MSG) {
-			return;
-		}
+	target.signal.notify();
+}
 
-		if (!message.more()) {
-			continue;
-		}
+std::size_t asynchronous_handler_wrapper::get_queue_depth() const
+{
+	std::size_t result = 0;
+	for (auto &source : lanes_) {
+		result += source->requests.size() + source->backlog.size();
+	}
 
-		socket.recv(&message, 0);
-		request.identity = std::string(static_cast<char *>(message.data()), message.size());
+	return result;
+}
 
-		while (message.more()) {
-			socket.recv(&message, 0);
-			request.data.emplace_back(static_cast<char *>(message.data()), message.size());
-		}
+std::size_t asynchronous_handler_wrapper::get_busy_threads() const
+{
+	return busy_.load(std::memory_order_relaxed);
+}
 
-		handler_->on_request(
-			request, [this, &socket](const message_container &response) { send_response(socket, response); });
-	}
+std::size_t asynchronous_handler_wrapper::get_concurrency() const
+{
+	return workers_.size();
 }
 
-void asynchronous_handler_wrapper::send_response(zmq::socket_t &socket, const message_container &message)
+void asynchronous_handler_wrapper::handler_thread(lane &source)
 {
-	socket.send(message.key.data(), message.key.size(), ZMQ_SNDMORE);
-	socket.send(message.identity.data(), message.identity.size(), ZMQ_SNDMORE);
+	handler_interface::response_cb respond = [this](const message_container &response) {
+		reactor_.post_message(message_container(response));
+	};
+
+	while (true) {
+		message_container request;
+
+		while (source.requests.try_pop(request)) {
+			// Whoever consumed the signal wakes up another thread if there is more work
+			if (source.requests.size() > 0) {
+				source.signal.notify();
+			}
+
+			busy_.fetch_add(1, std::memory_order_relaxed);
+			handler_->on_request(request, respond);
+			busy_.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		if (stop_.load()) {
+			// The other threads of the lane have to see the signal too
+			source.signal.notify();
+			return;
+		}
 
-	for (auto it = std::begin(message.data); it != std::end(message.data); ++it) {
-		socket.send(it->c_str(), it->size(), std::next(it) != std::end(message.data) ? ZMQ_SNDMORE : 0);
+		source.signal.wait();
 	}
 }
@@ -2,18 +2,38 @@
 #define RECODEX_BROKER_REACTOR_H
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 #include <zmq.hpp>
 
+#include "event_fd.h"
 #include "handler_interface.h"
 #include "message_container.h"
+#include "message_ring.h"
 #include "socket_wrapper_base.h"
+#include "timer_service.h"
 
 /* Forward */
 class reactor;
 
+/**
+ * The system call used by the reactor to wait for events
+ */
+enum class reactor_backend {
+	/** zmq::poll over all the sockets and descriptors (available everywhere) */
+	poll,
+	/** epoll with the notification descriptors of the ZeroMQ sockets (Linux only) */
+	epoll
+};
+
 /**
  * A basic wrapper for reactor event handlers, which just calls the handler callback directly
  * This class is meant to be extended to provide more complicated calling strategies (e.g. async callbacks).
@@ -47,73 +67,122 @@ protected:
 };
 
 /**
- * A wrapper for reactor event handlers which calls the handler asynchronously, using ZeroMQ inprocess sockets.
- * The handler itself runs in its own (exactly one) thread.
+ * A wrapper for reactor event handlers which calls the handler asynchronously, on a pool of threads. The messages are
+ * passed to the threads through lock-free rings and the threads are woken up with an @ref event_fd.
+ *
+ * Without an ordering key, all the threads take the messages from a single ring, so the messages can be processed
+ * in any order. With an ordering key, each thread has its own ring and the messages with the same key always go to
+ * the same thread, so they are processed in the order they came in.
+ * The handler must be thread-safe if it runs on more than one thread.
  */
 class asynchronous_handler_wrapper : public handler_wrapper
 {
 public:
+	/** Default maximum amount of messages waiting for the handler in each ring */
+	static const std::size_t DEFAULT_CAPACITY;
+
+	/** Type of the function that gets the ordering key of a message */
+	using ordering_key_fn = std::function<std::string(const message_container &)>;
+
 	/**
-	 * @param context ZeroMQ context used to communicate with the reactor
-	 * @param async_handler_socket The socket used to communicate with our worker thread (the reactor side)
-	 * @param reactor_ref The reactor whcih owns the handler
+	 * @param reactor_ref The reactor which owns the handler
 	 * @param handler The handler object
+	 * @param concurrency amount of threads that run the handler
+	 * @param ordering_key messages with the same key are processed in order (all messages can be reordered if empty)
+	 * @param capacity maximum amount of messages in each ring (more messages wait in the reactor thread)
 	 */
-	asynchronous_handler_wrapper(zmq::context_t &context,
-		zmq::socket_t &async_handler_socket,
-		reactor &reactor_ref,
-		std::shared_ptr<handler_interface> handler);
+	asynchronous_handler_wrapper(reactor &reactor_ref,
+		std::shared_ptr<handler_interface> handler,
+		std::size_t concurrency = 1,
+		ordering_key_fn ordering_key = nullptr,
+		std::size_t capacity = DEFAULT_CAPACITY);
 
 	/**
-	 * Destroy the handler by sending a termination message to the worker thread.
-	 * The ZeroMQ connection must still work for this to function.
+	 * Destroy the handler after it processes all the messages passed to it.
+	 * Must be called from the reactor thread.
 	 */
 	~asynchronous_handler_wrapper() override;
 
 	/**
 	 * Pass a message to the handler asynchronously.
-	 * The message is copied when being sent through the inprocess socket.
+	 * The message is copied once, the copy is moved through the ring.
 	 * @param message The message to be passed
 	 */
 	void operator()(const message_container &message) override;
 
+	/**
+	 * Move the messages that did not fit in the rings there (called by the reactor thread regularly).
+	 */
+	void flush();
+
+	/**
+	 * Get the amount of messages waiting for the handler (must be called from the reactor thread).
+	 */
+	std::size_t get_queue_depth() const;
+
+	/**
+	 * Get the amount of threads that are processing a message right now.
+	 */
+	std::size_t get_busy_threads() const;
+
+	/**
+	 * Get the amount of threads that run the handler.
+	 */
+	std::size_t get_concurrency() const;
+
 private:
 	/**
-	 * A message used to signal that the worker thread should terminate
+	 * A ring of messages served by one or more threads
 	 */
-	static const std::string TERMINATE_MSG;
+	struct lane {
+		/**
+		 * @param capacity maximum amount of messages in the ring
+		 */
+		explicit lane(std::size_t capacity);
+
+		/** Messages waiting for the threads */
+		message_ring requests;
+		/** Wakes up the threads */
+		event_fd signal;
+		/** Messages that did not fit in the ring (only used by the reactor thread, which must never block) */
+		std::deque<message_container> backlog;
+	};
 
 	/**
-	 * A ZeroMQ context
+	 * Gets the ordering key of a message
 	 */
-	zmq::context_t &context_;
+	ordering_key_fn ordering_key_;
 
 	/**
-	 * A reference to the socket used by the reactor to communicate with asynchronous handlers.
-	 * It can only be used by the main reactor thread (i.e. not by the worker thread)
+	 * The rings (one shared by all the threads, or one for each of them if the messages are ordered)
 	 */
-	zmq::socket_t &reactor_socket_;
+	std::vector<std::unique_ptr<lane>> lanes_;
 
 	/**
-	 * A reference to the worker thread
+	 * Tells the threads to terminate once the rings are empty
 	 */
-	std::thread worker_;
+	std::atomic<bool> stop_;
 
 	/**
-	 * The worker thread function. It contains a loop that doesn't terminate until a termination message arrives
-	 * from the reactor.
+	 * Amount of threads that are processing a message
 	 */
-	void handler_thread();
+	std::atomic<std::size_t> busy_;
 
 	/**
-	 * Send a message back to the reactor through the inprocess socket
+	 * The worker threads
 	 */
-	void send_response(zmq::socket_t &socket, const message_container &message);
+	std::vector<std::thread> workers_;
 
 	/**
-	 * A unique identifier of the handler used in inprocess communication with the reactor
+	 * The worker thread function. It contains a loop that doesn't terminate until the wrapper is destroyed.
+	 * @param source the lane served by the thread
 	 */
-	const std::string unique_id_;
+	void handler_thread(lane &source);
+
+	/**
+	 * Move the messages from the backlog of a lane to its ring
+	 */
+	void flush(lane &target);
 };
 
 /**
@@ -130,14 +199,20 @@ public:
 	const static std::string KEY_TIMER;
 
 	/**
-	 * A unique identifier for the asynchronous handler socket
+	 * Time between two messages with the @ref KEY_TIMER key
 	 */
-	const std::string unique_id;
+	const static std::chrono::milliseconds TICK_INTERVAL;
 
 	/**
-	 * @param context A ZeroMQ context used to create sockets for asynchronous communication
+	 * @param context A ZeroMQ context used by the sockets of the reactor
+	 * @param backend the system call used to wait for events (poll is used where epoll is not available)
 	 */
-	reactor(std::shared_ptr<zmq::context_t> context);
+	reactor(std::shared_ptr<zmq::context_t> context, reactor_backend backend = reactor_backend::poll);
+
+	/**
+	 * Stop the asynchronous handlers before the channels they use are destroyed
+	 */
+	~reactor();
 
 	/**
 	 * Add a socket to be polled by the reactor
@@ -146,6 +221,62 @@ public:
 	 */
 	void add_socket(const std::string &name, std::shared_ptr<socket_wrapper_base> socket);
 
+	/**
+	 * Add a file descriptor (e.g. an eventfd or a socket that is not managed by ZeroMQ) to be watched by the reactor.
+	 * When it becomes readable, the handlers get a message with given key and the descriptor in its only frame.
+	 * The handlers must read the available data, otherwise they are notified again right away.
+	 * @param name a name used as the key of the notifications
+	 * @param fd the descriptor (it is not closed by the reactor)
+	 */
+	void add_fd(const std::string &name, int fd);
+
+	/**
+	 * Add a timer that notifies the handlers periodically. The messages carry the time elapsed since the previous
+	 * notification in milliseconds (like the messages with the @ref KEY_TIMER key).
+	 * @param name a name used as the key of the notifications
+	 * @param interval time between two notifications
+	 */
+	void add_timer(const std::string &name, std::chrono::milliseconds interval);
+
+	/**
+	 * Call a function in the reactor thread once given time passes.
+	 * Like the other timer methods, it must be called from the reactor thread (or before the loop starts).
+	 * @param delay time until the call
+	 * @param callback the function, it gets the time elapsed since it was scheduled
+	 * @return identifier that can be used to cancel the timer
+	 */
+	timer_service::timer_id schedule_timer(std::chrono::milliseconds delay, timer_service::callback_fn callback);
+
+	/**
+	 * Call a function in the reactor thread periodically.
+	 * @param interval time between two calls
+	 * @param callback the function, it gets the time elapsed since the previous call
+	 * @return identifier that can be used to cancel the timer
+	 */
+	timer_service::timer_id schedule_periodic_timer(
+		std::chrono::milliseconds interval, timer_service::callback_fn callback);
+
+	/**
+	 * Cancel a timer scheduled by @ref schedule_timer or @ref schedule_periodic_timer.
+	 * @return false if there is no such timer (e.g. it has already expired)
+	 */
+	bool cancel_timer(timer_service::timer_id id);
+
+	/**
+	 * Deliver the messages with the @ref KEY_TIMER key only when they are requested by @ref request_tick instead
+	 * of every @ref TICK_INTERVAL. So that the handlers do not work with an outdated time, a message received from
+	 * a socket is still preceded by a tick if the last one is older than @ref TICK_INTERVAL.
+	 * It must be called before the loop starts.
+	 */
+	void set_tick_on_demand(bool on_demand);
+
+	/**
+	 * Deliver a message with the @ref KEY_TIMER key after given time (unless an earlier one is already requested).
+	 * Like the other timer methods, it must be called from the reactor thread (or before the loop starts).
+	 * @param delay time until the tick
+	 */
+	void request_tick(std::chrono::milliseconds delay);
+
 	/**
 	 * Add a handler for messages from given origins that is invoked directly
 	 * (reactor waits for its completion, any calls to a response callback are processed immediately).
@@ -155,12 +286,18 @@ public:
 	void add_handler(const std::vector<std::string> &origins, std::shared_ptr<handler_interface> handler);
 
 	/**
-	 * Add a handler for messages from given origins that is invoked asynchronously
-	 * (messages are passed to it through an in-process socket pair, which is also used by the response callback).
+	 * Add a handler for messages from given origins that is invoked asynchronously on a pool of threads
+	 * (messages are passed to it through lock-free rings, which are also used by the response callback).
 	 * @param origins
 	 * @param handler
+	 * @param concurrency amount of threads that run the handler (it must be thread-safe if there are more)
+	 * @param ordering_key messages with the same key are processed in order (all messages can be reordered if empty)
+	 * @return the wrapper of the handler, which provides the statistics of the pool
 	 */
-	void add_async_handler(const std::vector<std::string> &origins, std::shared_ptr<handler_interface> handler);
+	std::shared_ptr<asynchronous_handler_wrapper> add_async_handler(const std::vector<std::string> &origins,
+		std::shared_ptr<handler_interface> handler,
+		std::size_t concurrency = 1,
+		asynchronous_handler_wrapper::ordering_key_fn ordering_key = nullptr);
 
 	/**
 	 * Send a message through one of the sockets.
@@ -169,6 +306,14 @@ public:
 	 */
 	void send_message(const message_container &message);
 
+	/**
+	 * Pass a message to the reactor thread, which sends it through one of the sockets (or to the handlers).
+	 * This method is thread-safe, it is used by the asynchronous handlers. It must not be called from the reactor
+	 * thread, because it sleeps while the messages posted before fill the whole ring.
+	 * @param message frames of the message
+	 */
+	void post_message(message_container &&message);
+
 	/**
 	 * Pass a message received from one of the sockets to the handlers.
 	 * Public for easier testing and extensibility.
@@ -179,7 +324,9 @@ public:
 	/**
 	 * Start polling the underlying sockets and invoking handlers if needed.
 	 * Handlers that need to keep track of elapsed time should subscribe to messages
-	 * from ORIGIN_TIMER - it will notify them periodically.
+	 * from @ref KEY_TIMER - it will notify them every @ref TICK_INTERVAL (the tick is only scheduled if there is such
+	 * a handler and the ticks are not requested on demand). The reactor sleeps until the nearest timer expires,
+	 * no matter how many messages it processes.
 	 *
 	 * The loop can be interrupted using the @a terminate method. When this happens, all handlers will be
 	 * destroyed.
@@ -192,12 +339,92 @@ public:
 	 */
 	void terminate();
 
+	/**
+	 * Get the system call the reactor actually uses to wait for events.
+	 */
+	reactor_backend get_backend() const;
+
 private:
+	/**
+	 * Time after which the reactor tries again to send the messages queued in the sockets
+	 */
+	const static std::chrono::milliseconds OUTPUT_RETRY_INTERVAL;
+
+	/**
+	 * The system call used to wait for events
+	 */
+	reactor_backend backend_;
+
 	/**
 	 * Sockets indexed by their keys
 	 */
 	std::map<std::string, std::shared_ptr<socket_wrapper_base>> sockets_;
 
+	/**
+	 * Watched file descriptors indexed by their keys
+	 */
+	std::map<std::string, int> fds_;
+
+	/**
+	 * Timers of the handlers (including the periodic notifications)
+	 */
+	timer_service timers_;
+
+	/**
+	 * True if the ticks are delivered only when requested
+	 */
+	bool tick_on_demand_ = false;
+
+	/**
+	 * The requested tick (if there is one)
+	 */
+	std::optional<timer_service::timer_id> requested_tick_;
+
+	/**
+	 * Time of the requested tick
+	 */
+	timer_service::clock::time_point requested_tick_time_;
+
+	/**
+	 * Time of the last tick (the next one carries the time elapsed since then)
+	 */
+	timer_service::clock::time_point last_tick_;
+
+	/**
+	 * Interrupts the wait for events when the reactor is terminated
+	 */
+	event_fd wakeup_;
+
+	/**
+	 * The asynchronous handlers (their backlogs are flushed regularly)
+	 */
+	std::vector<std::shared_ptr<asynchronous_handler_wrapper>> async_handlers_;
+
+	/**
+	 * Messages sent by the asynchronous handlers
+	 */
+	message_ring async_messages_;
+
+	/**
+	 * Signals that there are messages from the asynchronous handlers
+	 */
+	event_fd async_signal_;
+
+	/**
+	 * Guards the sleep of the threads that wait for room in @ref async_messages_
+	 */
+	std::mutex ring_mutex_;
+
+	/**
+	 * Wakes up the threads waiting for room in @ref async_messages_ (when the reactor takes messages or terminates)
+	 */
+	std::condition_variable ring_space_;
+
+	/**
+	 * Amount of threads waiting for room in @ref async_messages_
+	 */
+	std::atomic<std::size_t> ring_waiters_{0};
+
 	/**
 	 * Handlers indexed by the keys of all the events they are subscribed to
 	 */
@@ -209,14 +436,46 @@ private:
 	std::shared_ptr<zmq::context_t> context_;
 
 	/**
-	 * An in-process socket used to communicate with asynchronous handlers
+	 * Flag used to tell the reactor to terminate the main loop
 	 */
-	zmq::socket_t async_handler_socket_;
+	std::atomic<bool> termination_flag_;
 
 	/**
-	 * Flag used to tell the reactor to terminate the main loop
+	 * The main loop of the poll backend
 	 */
-	std::atomic<bool> termination_flag_;
+	void poll_loop();
+
+	/**
+	 * The main loop of the epoll backend
+	 */
+	void epoll_loop();
+
+	/**
+	 * Receive the messages from the asynchronous handlers and send them where they belong, then pass the messages
+	 * waiting in the backlogs to the handlers
+	 * @return true if there was a message from an asynchronous handler
+	 */
+	bool receive_async_messages();
+
+	/**
+	 * Receive a message from a registered socket and pass it to the handlers
+	 */
+	void receive_socket_message(const std::string &name, socket_wrapper_base &socket);
+
+	/**
+	 * Pass a message with the time elapsed since the last notification to the handlers
+	 */
+	void notify_timer(const std::string &name, std::chrono::milliseconds elapsed);
+
+	/**
+	 * Pass a message with the time elapsed since the last tick to the handlers of @ref KEY_TIMER
+	 */
+	void tick();
+
+	/**
+	 * Wake up the threads that wait in @ref post_message for room in the ring (if there are any).
+	 */
+	void wake_ring_waiters();
 };
 
 #endif // RECODEX_BROKER_REACTOR_H
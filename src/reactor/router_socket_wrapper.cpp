@@ -1,30 +1,166 @@
 #include "router_socket_wrapper.h"
 
-router_socket_wrapper::router_socket_wrapper(
-	std::shared_ptr<zmq::context_t> context, const std::string &addr, const bool bound)
-	: socket_wrapper_base(context, zmq::socket_type::router, addr, bound)
+const std::size_t router_socket_wrapper::DEFAULT_MAX_QUEUED = 1000;
+
+router_socket_wrapper::router_socket_wrapper(std::shared_ptr<zmq::context_t> context,
+	const std::string &addr,
+	const bool bound,
+	const std::string &identity,
+	std::size_t max_queued)
+	: socket_wrapper_base(context, zmq::socket_type::router, addr, bound), max_queued_(max_queued)
 {
+	if (!identity.empty()) {
+		socket_.setsockopt(ZMQ_IDENTITY, identity.data(), identity.size());
+	}
+
+	// Report unknown peers instead of dropping the messages silently (and full pipes instead of blocking)
+	socket_.setsockopt(ZMQ_ROUTER_MANDATORY, 1);
 }
 
 bool router_socket_wrapper::send_message(const message_container &source)
 {
+	auto queue = queues_.find(source.identity);
 
-	try {
-		socket_.send(source.identity.c_str(), source.identity.size(), ZMQ_SNDMORE);
-	} catch (const zmq::error_t &) {
+	// The messages for a peer must not overtake the ones already waiting
+	if (queue == std::end(queues_)) {
+		switch (try_send(source)) {
+		case send_result::sent:
+			return true;
+		case send_result::unroutable:
+			++dropped_;
+			++unroutable_;
+			return false;
+		case send_result::would_block:
+			queue = queues_.emplace(source.identity, std::deque<message_container>()).first;
+			break;
+		}
+	}
+
+	if (queue->second.size() >= max_queued_) {
+		++dropped_;
 		return false;
 	}
 
+	queue->second.push_back(source);
+	++queued_;
+	return true;
+}
+
+bool router_socket_wrapper::flush_output()
+{
+	bool sent = false;
+
+	for (auto queue = std::begin(queues_); queue != std::end(queues_);) {
+		auto &messages = queue->second;
+		auto result = send_result::sent;
+
+		while (!messages.empty() && (result = try_send(messages.front())) == send_result::sent) {
+			messages.pop_front();
+			--queued_;
+			sent = true;
+		}
+
+		// The peer has gone away, nothing waiting for it can be delivered
+		if (result == send_result::unroutable) {
+			dropped_ += messages.size();
+			unroutable_ += messages.size();
+			queued_ -= messages.size();
+			messages.clear();
+		}
+
+		queue = messages.empty() ? queues_.erase(queue) : std::next(queue);
+	}
+
+	return sent;
+}
+
+std::size_t router_socket_wrapper::get_queued_output() const
+{
+	return queued_;
+}
+
+std::size_t router_socket_wrapper::get_dropped_count() const
+{
+	return dropped_;
+}
+
+std::size_t router_socket_wrapper::get_unroutable_count() const
+{
+	return unroutable_;
+}
 
+void router_socket_wrapper::monitor_peers(const std::string &monitor_addr)
+{
+	if (zmq_socket_monitor(static_cast<void *>(socket_), monitor_addr.c_str(), ZMQ_EVENT_DISCONNECTED) != 0) {
+		throw zmq::error_t();
+	}
+
+	monitored_ = true;
+}
+
+std::optional<std::string> router_socket_wrapper::peer_disconnected(int fd)
+{
+	auto peer = peers_.find(fd);
+	if (peer == std::end(peers_)) {
+		return std::nullopt;
+	}
+
+	// A peer that has sent a message through another connection since is not reported
+	std::optional<std::string> result;
+	auto last_fd = peer_fds_.find(peer->second);
+	if (last_fd != std::end(peer_fds_) && last_fd->second == fd) {
+		result = peer->second;
+		peer_fds_.erase(last_fd);
+	}
+
+	auto next_peer = next_peers_.find(fd);
+	if (next_peer != std::end(next_peers_)) {
+		peer->second = next_peer->second;
+		next_peers_.erase(next_peer);
+	} else {
+		peers_.erase(peer);
+	}
+
+	return result;
+}
+
+void router_socket_wrapper::track_peer(const std::string &identity, int fd)
+{
+	peer_fds_[identity] = fd;
+
+	// The closed connection that used the descriptor before is reported to the monitor first, but the monitor might
+	// not have been read yet
+	auto peer = peers_.emplace(fd, identity).first;
+	if (peer->second != identity) {
+		next_peers_[fd] = identity;
+	}
+}
+
+router_socket_wrapper::send_result router_socket_wrapper::try_send(const message_container &source)
+{
+	int flags = source.data.empty() ? ZMQ_DONTWAIT : ZMQ_SNDMORE | ZMQ_DONTWAIT;
+
+	// Only the identity frame can fail, the router either routes the whole message or none of it
+	try {
+		if (socket_.send(source.identity.c_str(), source.identity.size(), flags) == 0) {
+			return send_result::would_block;
+		}
+	} catch (const zmq::error_t &error) {
+		return error.num() == EHOSTUNREACH ? send_result::unroutable : send_result::would_block;
+	}
+
+	// The high water mark is only checked at the first frame, so the rest of the message is taken without blocking.
+	// It is sent without ZMQ_DONTWAIT anyway, a message cut short would be completed by the frames of the next one.
 	for (auto it = std::begin(source.data); it != std::end(source.data); ++it) {
 		try {
 			socket_.send(it->c_str(), it->size(), std::next(it) != std::end(source.data) ? ZMQ_SNDMORE : 0);
 		} catch (const zmq::error_t &) {
-			return false;
+			// The socket is being closed, the message cannot be queued (its beginning has already been sent)
+			return send_result::unroutable;
 		}
 	}
 
-	return true;
+	return send_result::sent;
 }
 
 bool router_socket_wrapper::receive_message(message_container &target)
@@ -40,6 +176,14 @@ bool router_socket_wrapper::receive_message(message_container &target)
 
 	target.identity = std::string(static_cast<char *>(msg.data()), msg.size());
 
+	if (monitored_) {
+		// Messages that do not come from a connection (e.g. inproc ones) have no descriptor
+		try {
+			track_peer(target.identity, msg.get(ZMQ_SRCFD));
+		} catch (const zmq::error_t &) {
+		}
+	}
+
 	while (msg.more()) {
 		try {
 			socket_.recv(&msg, 0);
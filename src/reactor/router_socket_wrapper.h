@@ -1,28 +1,115 @@
 #ifndef RECODEX_BROKER_ROUTER_SOCKET_WRAPPER_H
 #define RECODEX_BROKER_ROUTER_SOCKET_WRAPPER_H
 
+#include <deque>
+#include <map>
+#include <optional>
 #include <zmq.hpp>
 
 #include "socket_wrapper_base.h"
 
 /**
- * Wraps a ZeroMQ router socket
+ * Wraps a ZeroMQ router socket. Messages are sent without blocking - when the pipe to a peer is full, they wait in
+ * a bounded queue of that peer until the reactor flushes it, so a slow peer cannot stall the others.
+ * Messages for unknown peers (ZMQ_ROUTER_MANDATORY) and messages that do not fit in the queue are dropped and counted.
  */
 class router_socket_wrapper : public socket_wrapper_base
 {
 public:
+	/** Default maximum amount of messages waiting for a single peer */
+	static const std::size_t DEFAULT_MAX_QUEUED;
+
 	/**
 	 * @param context a ZeroMQ context
 	 * @param addr address used by the socket
 	 * @param bound true if the socket should bind, false if it connects
+	 * @param identity an identity of the socket presented to its peers (a random one is used if empty)
+	 * @param max_queued maximum amount of messages waiting for a single peer
 	 */
-	router_socket_wrapper(std::shared_ptr<zmq::context_t> context, const std::string &addr, const bool bound);
+	router_socket_wrapper(std::shared_ptr<zmq::context_t> context,
+		const std::string &addr,
+		const bool bound,
+		const std::string &identity = "",
+		std::size_t max_queued = DEFAULT_MAX_QUEUED);
 
 	~router_socket_wrapper() override = default;
 
+	/**
+	 * Send a message or queue it if the peer cannot take it now.
+	 * @return false if the message was dropped
+	 */
 	bool send_message(const message_container &message) override;
 
 	bool receive_message(message_container &target) override;
+
+	bool flush_output() override;
+
+	std::size_t get_queued_output() const override;
+
+	/**
+	 * Get the amount of messages dropped because their peer was unknown or its queue was full.
+	 */
+	std::size_t get_dropped_count() const;
+
+	/**
+	 * Get the amount of messages dropped because their peer was unknown.
+	 */
+	std::size_t get_unroutable_count() const;
+
+	/**
+	 * Report closed connections of the peers to a socket monitor at given inproc address (it is read by
+	 * @ref peer_monitor_wrapper). The connection of each peer is recognized by the descriptor of its last message.
+	 */
+	void monitor_peers(const std::string &monitor_addr);
+
+	/**
+	 * Find the peer whose connection was closed.
+	 * @param fd the descriptor of the closed connection
+	 * @return identity of the peer (std::nullopt if it is unknown or if it has connected again since)
+	 */
+	std::optional<std::string> peer_disconnected(int fd);
+
+private:
+	/** Result of an attempt to send a message */
+	enum class send_result { sent, would_block, unroutable };
+
+	/** Maximum amount of messages waiting for a single peer */
+	std::size_t max_queued_;
+
+	/** Messages waiting for each of the peers (peers without waiting messages are not present) */
+	std::map<std::string, std::deque<message_container>> queues_;
+
+	/** Amount of messages in the queues */
+	std::size_t queued_ = 0;
+
+	/** Amount of dropped messages */
+	std::size_t dropped_ = 0;
+
+	/** Amount of messages dropped because their peer was unknown */
+	std::size_t unroutable_ = 0;
+
+	/** True if the connections of the peers are tracked */
+	bool monitored_ = false;
+
+	/** The peer connected through each descriptor */
+	std::map<int, std::string> peers_;
+
+	/** Peers of reused descriptors whose previous connection has not been reported as closed yet */
+	std::map<int, std::string> next_peers_;
+
+	/** The descriptor of the last message of each peer */
+	std::map<std::string, int> peer_fds_;
+
+	/**
+	 * Try to send a message without blocking. The message is either sent whole or not at all (unless the socket
+	 * fails in the middle of it, which is reported as unroutable so that the rest is not queued).
+	 */
+	send_result try_send(const message_container &message);
+
+	/**
+	 * Remember the descriptor through which a message from a peer came.
+	 */
+	void track_peer(const std::string &identity, int fd);
 };
 
 #endif // RECODEX_BROKER_ROUTER_SOCKET_WRAPPER_H
@@ -13,6 +13,16 @@ zmq_pollitem_t socket_wrapper_base::get_pollitem()
 	return zmq_pollitem_t{.socket = (void *) socket_, .fd = 0, .events = ZMQ_POLLIN, .revents = 0};
 }
 
+int socket_wrapper_base::get_fd()
+{
+	return socket_.getsockopt<int>(ZMQ_FD);
+}
+
+bool socket_wrapper_base::has_input()
+{
+	return (socket_.getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) != 0;
+}
+
 void socket_wrapper_base::restart()
 {
 	if (bound_) {
@@ -32,3 +42,13 @@ void socket_wrapper_base::initialize()
 		socket_.connect(addr_);
 	}
 }
+
+bool socket_wrapper_base::flush_output()
+{
+	return false;
+}
+
+std::size_t socket_wrapper_base::get_queued_output() const
+{
+	return 0;
+}
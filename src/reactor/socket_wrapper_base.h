@@ -50,6 +50,18 @@ public:
 	 */
 	zmq_pollitem_t get_pollitem();
 
+	/**
+	 * Get the file descriptor that signals a change of the events of the socket (ZMQ_FD). It is edge triggered -
+	 * after a notification, the pending events must be checked with @ref has_input until there are none.
+	 * @return a descriptor that can be watched by epoll
+	 */
+	int get_fd();
+
+	/**
+	 * Check if a message can be received without blocking (ZMQ_EVENTS)
+	 */
+	bool has_input();
+
 	/**
 	 * Connect or bind the socket
 	 */
@@ -68,9 +80,21 @@ public:
 
 	/**
 	 * Receive a message from the socket
-	 * @return true on success, false otherwise
+	 * @return true on success, false otherwise (the message is not passed to the handlers then)
 	 */
 	virtual bool receive_message(message_container &) = 0;
+
+	/**
+	 * Send the messages that were queued because the socket could not take them without blocking
+	 * (called by the reactor while there are any).
+	 * @return true if at least one message was sent
+	 */
+	virtual bool flush_output();
+
+	/**
+	 * Get the amount of messages waiting to be sent.
+	 */
+	virtual std::size_t get_queued_output() const;
 };
 
 
@@ -0,0 +1,131 @@
+#include "timer_service.h"
+
+#include <algorithm>
+
+bool timer_service::entry::operator>(const entry &other) const
+{
+	return deadline > other.deadline || (deadline == other.deadline && id > other.id);
+}
+
+timer_service::timer_id timer_service::schedule_once(
+	std::chrono::milliseconds delay, callback_fn callback, clock::time_point now)
+{
+	return schedule(delay, std::chrono::milliseconds(0), std::move(callback), now);
+}
+
+timer_service::timer_id timer_service::schedule_periodic(
+	std::chrono::milliseconds interval, callback_fn callback, clock::time_point now)
+{
+	interval = std::max(interval, std::chrono::milliseconds(1));
+	return schedule(interval, interval, std::move(callback), now);
+}
+
+bool timer_service::cancel(timer_id id)
+{
+	if (timers_.erase(id) == 0) {
+		return false;
+	}
+
+	// Rebuild the heap when it is mostly made of cancelled deadlines
+	if (heap_.size() > 2 * timers_.size() + 16) {
+		heap_.clear();
+		for (auto &pair : timers_) {
+			heap_.push_back(entry{pair.second.deadline, pair.first});
+		}
+
+		std::make_heap(heap_.begin(), heap_.end(), std::greater<entry>());
+	}
+
+	return true;
+}
+
+std::chrono::milliseconds timer_service::get_timeout(clock::time_point now)
+{
+	prune();
+
+	if (heap_.empty()) {
+		return std::chrono::milliseconds(-1);
+	}
+
+	// Rounded up, so that the owner does not wake up just before the deadline and spin
+	auto remaining = std::chrono::ceil<std::chrono::milliseconds>(heap_.front().deadline - now);
+	return std::max(remaining, std::chrono::milliseconds(0));
+}
+
+std::size_t timer_service::run_expired(clock::time_point now)
+{
+	std::size_t count = 0;
+
+	while (!heap_.empty() && heap_.front().deadline <= now) {
+		auto expired = heap_.front();
+		std::pop_heap(heap_.begin(), heap_.end(), std::greater<entry>());
+		heap_.pop_back();
+
+		// Skip the deadlines of cancelled timers
+		auto it = timers_.find(expired.id);
+		if (it == timers_.end() || it->second.deadline != expired.deadline) {
+			continue;
+		}
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second.last);
+		it->second.last = now;
+
+		// The callback can cancel the timer (which destroys the stored callback) or schedule new ones
+		auto callback = it->second.callback;
+		if (it->second.interval.count() == 0) {
+			timers_.erase(it);
+		} else {
+			// Expirations missed while the owner was busy are merged into this one
+			auto &periodic = it->second;
+			periodic.deadline += periodic.interval;
+			if (periodic.deadline <= now) {
+				periodic.deadline = now + periodic.interval;
+			}
+
+			push(periodic.deadline, expired.id);
+		}
+
+		callback(elapsed);
+		++count;
+	}
+
+	return count;
+}
+
+std::size_t timer_service::size() const
+{
+	return timers_.size();
+}
+
+timer_service::timer_id timer_service::schedule(std::chrono::milliseconds delay,
+	std::chrono::milliseconds interval,
+	callback_fn callback,
+	clock::time_point now)
+{
+	timer_id id = next_id_++;
+	auto deadline = now + delay;
+
+	timers_.emplace(id, timer{interval, deadline, now, std::move(callback)});
+	push(deadline, id);
+
+	return id;
+}
+
+void timer_service::push(clock::time_point deadline, timer_id id)
+{
+	heap_.push_back(entry{deadline, id});
+	std::push_heap(heap_.begin(), heap_.end(), std::greater<entry>());
+}
+
+void timer_service::prune()
+{
+	while (!heap_.empty()) {
+		auto it = timers_.find(heap_.front().id);
+		if (it != timers_.end() && it->second.deadline == heap_.front().deadline) {
+			return;
+		}
+
+		std::pop_heap(heap_.begin(), heap_.end(), std::greater<entry>());
+		heap_.pop_back();
+	}
+}
@@ -0,0 +1,131 @@
+#ifndef RECODEX_BROKER_TIMER_SERVICE_H
+#define RECODEX_BROKER_TIMER_SERVICE_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <vector>
+
+/**
+ * One-shot and periodic timers ordered by their deadlines in a min-heap. The owner asks for the time until the
+ * nearest deadline (so that it knows how long it can sleep) and then runs the callbacks of the expired timers.
+ * Cancelled timers are removed from the heap lazily, when they get to its top (or when most of the heap is made of
+ * them).
+ *
+ * The timers are measured by the monotonic clock, so they are not affected by changes of the system time.
+ * The class is not thread-safe.
+ */
+class timer_service
+{
+public:
+	/** The clock that measures the timers */
+	using clock = std::chrono::steady_clock;
+
+	/** Identifier of a scheduled timer */
+	using timer_id = std::size_t;
+
+	/** Type of the timer callbacks, they get the time since the timer was scheduled or since it last expired */
+	using callback_fn = std::function<void(std::chrono::milliseconds elapsed)>;
+
+	/**
+	 * Schedule a timer that expires once.
+	 * @param delay time until the timer expires
+	 * @param callback called when the timer expires
+	 * @param now the current time
+	 * @return identifier that can be used to cancel the timer
+	 */
+	timer_id schedule_once(std::chrono::milliseconds delay, callback_fn callback, clock::time_point now = clock::now());
+
+	/**
+	 * Schedule a timer that expires repeatedly until it is cancelled.
+	 * @param interval time between two expirations (at least a millisecond)
+	 * @param callback called whenever the timer expires (expirations missed while the owner was busy are merged)
+	 * @param now the current time
+	 * @return identifier that can be used to cancel the timer
+	 */
+	timer_id schedule_periodic(
+		std::chrono::milliseconds interval, callback_fn callback, clock::time_point now = clock::now());
+
+	/**
+	 * Cancel a timer (a timer can cancel itself from its callback).
+	 * @return false if there is no such timer (e.g. it was a one-shot timer that has already expired)
+	 */
+	bool cancel(timer_id id);
+
+	/**
+	 * Get the time until the nearest deadline.
+	 * @param now the current time
+	 * @return zero if a timer has already expired, -1 ms if there are no timers
+	 */
+	std::chrono::milliseconds get_timeout(clock::time_point now = clock::now());
+
+	/**
+	 * Run the callbacks of the timers that have expired.
+	 * @param now the current time
+	 * @return amount of callbacks that were run
+	 */
+	std::size_t run_expired(clock::time_point now = clock::now());
+
+	/**
+	 * Get the amount of scheduled timers.
+	 */
+	std::size_t size() const;
+
+private:
+	/**
+	 * A scheduled timer
+	 */
+	struct timer {
+		/** Time between two expirations (zero for one-shot timers) */
+		std::chrono::milliseconds interval;
+		/** The next expiration */
+		clock::time_point deadline;
+		/** Time when the timer was scheduled or last expired */
+		clock::time_point last;
+		/** Called when the timer expires */
+		callback_fn callback;
+	};
+
+	/**
+	 * A deadline in the heap
+	 */
+	struct entry {
+		/** Time of the expiration */
+		clock::time_point deadline;
+		/** The timer (it might have been cancelled or rescheduled since) */
+		timer_id id;
+
+		/** The heap is ordered by the deadlines, the entry with the nearest one is on the top */
+		bool operator>(const entry &other) const;
+	};
+
+	/** The scheduled timers */
+	std::map<timer_id, timer> timers_;
+
+	/** Deadlines of the timers (a min-heap) */
+	std::vector<entry> heap_;
+
+	/** Identifier of the next scheduled timer */
+	timer_id next_id_ = 1;
+
+	/**
+	 * Add a timer and its deadline.
+	 */
+	timer_id schedule(std::chrono::milliseconds delay,
+		std::chrono::milliseconds interval,
+		callback_fn callback,
+		clock::time_point now);
+
+	/**
+	 * Add a deadline to the heap.
+	 */
+	void push(clock::time_point deadline, timer_id id);
+
+	/**
+	 * Remove the deadlines of cancelled timers from the top of the heap.
+	 */
+	void prune();
+};
+
+#endif // RECODEX_BROKER_TIMER_SERVICE_H
@@ -0,0 +1,315 @@
+#include "replica_state.h"
+
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * Split a key=value frame
+	 */
+	std::pair<std::string, std::string> split_pair(const std::string &frame)
+	{
+		std::size_t pos = frame.find('=');
+		if (pos == std::string::npos) {
+			return {frame, ""};
+		}
+
+		return {frame.substr(0, pos), frame.substr(pos + 1)};
+	}
+
+	/**
+	 * Read a count followed by that many frames
+	 * @return false if the event ends prematurely
+	 */
+	bool read_list(std::vector<std::string>::const_iterator &it,
+		std::vector<std::string>::const_iterator end,
+		std::vector<std::string> &result)
+	{
+		if (it == end) {
+			return false;
+		}
+
+		std::size_t count = std::stoul(*it++);
+		if (static_cast<std::size_t>(std::distance(it, end)) < count) {
+			return false;
+		}
+
+		result.assign(it, it + count);
+		it += count;
+		return true;
+	}
+} // namespace
+
+replica_state::event replica_state::worker_added(const worker &worker)
+{
+	event result = {"worker",
+		worker.identity,
+		worker.hwgroup,
+		std::to_string(worker.slots),
+		worker.prefetch ? "1" : "0",
+		worker.acks ? "1" : "0",
+		worker.description,
+		worker.host,
+		worker.session};
+
+	for (auto &header : worker.get_headers()) {
+		result.push_back(header.first + "=" + header.second);
+	}
+
+	return result;
+}
+
+replica_state::event replica_state::worker_removed(const std::string &identity)
+{
+	return {"worker-removed", identity};
+}
+
+replica_state::event replica_state::job_placed(const request &request, const std::string &location)
+{
+	event result = {"job",
+		request.data.get_job_id(),
+		location,
+		request.data.is_complete() ? "1" : "0",
+		std::to_string(request.failure_count)};
+
+	result.push_back(std::to_string(request.headers.size()));
+	for (auto &header : request.headers) {
+		result.push_back(header.first + "=" + header.second);
+	}
+
+	result.push_back(std::to_string(request.metadata.size()));
+	for (auto &item : request.metadata) {
+		result.push_back(item.first + "=" + item.second);
+	}
+
+	result.push_back(std::to_string(request.failed_workers.size()));
+	result.insert(result.end(), request.failed_workers.begin(), request.failed_workers.end());
+
+	result.push_back(std::to_string(request.failed_hosts.size()));
+	result.insert(result.end(), request.failed_hosts.begin(), request.failed_hosts.end());
+
+	// The first two frames of the request data are the command and the job id
+	auto frames = request.data.get();
+	if (frames.size() > 2) {
+		result.insert(result.end(), frames.begin() + 2, frames.end());
+	}
+
+	return result;
+}
+
+replica_state::event replica_state::job_moved(const std::string &job_id, const std::string &location)
+{
+	return {"job-moved", job_id, location};
+}
+
+replica_state::event replica_state::job_removed(const std::string &job_id)
+{
+	return {"job-removed", job_id};
+}
+
+bool replica_state::apply(const event &event)
+{
+	if (event.empty()) {
+		return false;
+	}
+
+	const auto &type = event.front();
+
+	try {
+		if (type == "worker") {
+			return apply_worker(event);
+		}
+
+		if (type == "job") {
+			return apply_job(event);
+		}
+	} catch (std::exception &) {
+		return false;
+	}
+
+	if (type == "worker-removed" && event.size() == 2) {
+		workers_.erase(event.at(1));
+		return true;
+	}
+
+	if (type == "job-moved" && event.size() == 3) {
+		auto it = jobs_.find(event.at(1));
+		if (it == jobs_.end()) {
+			return false;
+		}
+
+		it->second.location = event.at(2);
+		return true;
+	}
+
+	if (type == "job-removed" && event.size() == 2) {
+		jobs_.erase(event.at(1));
+		return true;
+	}
+
+	return false;
+}
+
+bool replica_state::apply_worker(const event &event)
+{
+	if (event.size() < 9) {
+		return false;
+	}
+
+	request::headers_t headers;
+	for (auto it = event.begin() + 9; it != event.end(); ++it) {
+		headers.insert(split_pair(*it));
+	}
+
+	auto new_worker = std::make_shared<worker>(event.at(1), event.at(2), headers);
+	new_worker->slots = std::max<std::size_t>(1, std::stoul(event.at(3)));
+	new_worker->prefetch = event.at(4) == "1";
+	new_worker->acks = event.at(5) == "1";
+	new_worker->description = event.at(6);
+	new_worker->host = event.at(7);
+	new_worker->session = event.at(8);
+
+	workers_[new_worker->identity] = new_worker;
+	return true;
+}
+
+bool replica_state::apply_job(const event &event)
+{
+	if (event.size() < 5) {
+		return false;
+	}
+
+	const auto &job_id = event.at(1);
+	bool complete = event.at(3) == "1";
+	std::size_t failure_count = std::stoul(event.at(4));
+
+	std::vector<std::string> header_frames, metadata_frames, failed_workers, failed_hosts;
+	auto it = event.cbegin() + 5;
+
+	if (!read_list(it, event.end(), header_frames) || !read_list(it, event.end(), metadata_frames) ||
+		!read_list(it, event.end(), failed_workers) || !read_list(it, event.end(), failed_hosts)) {
+		return false;
+	}
+
+	request::headers_t headers;
+	for (auto &frame : header_frames) {
+		headers.insert(split_pair(frame));
+	}
+
+	request::metadata_t metadata;
+	for (auto &frame : metadata_frames) {
+		metadata.insert(split_pair(frame));
+	}
+
+	// The remaining frames are the data of the request
+	std::vector<std::string> frames(it, event.end());
+	auto replicated_request = complete ?
+		std::make_shared<request>(headers, metadata, job_request_data(job_id, frames)) :
+		std::make_shared<request>(job_request_data(job_id));
+
+	replicated_request->failure_count = failure_count;
+	replicated_request->failed_workers.insert(failed_workers.begin(), failed_workers.end());
+	replicated_request->failed_hosts.insert(failed_hosts.begin(), failed_hosts.end());
+
+	// A job that is placed again keeps its position among the queued jobs
+	auto existing = jobs_.find(job_id);
+	std::size_t arrival = existing != jobs_.end() ? existing->second.arrival : next_arrival_++;
+
+	jobs_[job_id] = replicated_job{replicated_request, event.at(2), arrival};
+	return true;
+}
+
+void replica_state::clear()
+{
+	workers_.clear();
+	jobs_.clear();
+}
+
+std::vector<replica_state::event> replica_state::snapshot() const
+{
+	std::vector<event> result;
+
+	for (auto &pair : workers_) {
+		result.push_back(worker_added(*pair.second));
+	}
+
+	std::vector<const replicated_job *> jobs;
+	for (auto &pair : jobs_) {
+		jobs.push_back(&pair.second);
+	}
+
+	std::sort(jobs.begin(), jobs.end(), [](const replicated_job *a, const replicated_job *b) {
+		return a->arrival < b->arrival;
+	});
+
+	for (auto job : jobs) {
+		result.push_back(job_placed(*job->request, job->location));
+	}
+
+	return result;
+}
+
+const replica_state::replicated_job *replica_state::find_job(const std::string &job_id) const
+{
+	auto it = jobs_.find(job_id);
+	return it != jobs_.end() ? &it->second : nullptr;
+}
+
+const std::map<std::string, worker_ptr> &replica_state::get_workers() const
+{
+	return workers_;
+}
+
+std::size_t replica_state::get_job_count() const
+{
+	return jobs_.size();
+}
+
+std::vector<std::pair<worker_ptr, request_ptr>> replica_state::restore(
+	worker_registry &workers, queue_manager_interface &queue, std::size_t liveness) const
+{
+	std::vector<std::pair<worker_ptr, request_ptr>> result;
+
+	for (auto &pair : workers_) {
+		pair.second->liveness = liveness;
+		workers.add_worker(pair.second);
+		queue.add_worker(pair.second);
+	}
+
+	std::vector<const replicated_job *> jobs;
+	for (auto &pair : jobs_) {
+		jobs.push_back(&pair.second);
+	}
+
+	std::sort(jobs.begin(), jobs.end(), [](const replicated_job *a, const replicated_job *b) {
+		return a->arrival < b->arrival;
+	});
+
+	// The jobs held by workers occupy their slots first, so that queued jobs do not take them
+	std::vector<const replicated_job *> queued;
+	for (auto job : jobs) {
+		auto worker = workers_.find(job->location);
+		if (worker == workers_.end()) {
+			queued.push_back(job);
+			continue;
+		}
+
+		queue.add_current_request(worker->second, job->request);
+	}
+
+	for (auto job : queued) {
+		// A job reported by a worker that is gone cannot be sent anywhere else
+		if (!job->request->data.is_complete()) {
+			result.emplace_back(nullptr, job->request);
+			continue;
+		}
+
+		auto enqueued = queue.enqueue_request(job->request);
+
+		if (!enqueued.enqueued || enqueued.assigned_to != nullptr) {
+			result.emplace_back(enqueued.assigned_to, job->request);
+		}
+	}
+
+	return result;
+}
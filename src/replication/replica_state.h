@@ -0,0 +1,139 @@
+#ifndef RECODEX_BROKER_REPLICA_STATE_H
+#define RECODEX_BROKER_REPLICA_STATE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../queuing/queue_manager_interface.h"
+#include "../worker_registry.h"
+
+
+/**
+ * A copy of the workers and jobs held by a broker, built from a stream of replication events.
+ * The primary broker publishes an event for every change of its queue manager, a standby broker applies them
+ * and restores the whole state when it takes over.
+ *
+ * Events are multipart messages with the event type in the first frame:
+ *  - "worker", identity, hwgroup, slots, prefetch, acks, description, host, session, headers (key=value)...
+ *  - "worker-removed", identity
+ *  - "job", job id, location, complete, failure count, header count, headers..., metadata count, metadata...,
+ *    failed worker count, failed workers..., failed host count, failed hosts..., request frames...
+ *  - "job-moved", job id, location
+ *  - "job-removed", job id
+ *
+ * The location of a job is the identity of the worker that holds it or an empty string if the job is queued.
+ */
+class replica_state
+{
+public:
+	/** Frames of a replication event */
+	using event = std::vector<std::string>;
+
+	/**
+	 * A job known to the replica
+	 */
+	struct replicated_job {
+		/** The request */
+		request_ptr request;
+		/** Identity of the worker that holds the request (empty if it is queued) */
+		std::string location;
+		/** Order in which the jobs were added (queued jobs are restored in this order) */
+		std::size_t arrival;
+	};
+
+	/**
+	 * Create an event that describes a new worker
+	 */
+	static event worker_added(const worker &worker);
+
+	/**
+	 * Create an event that describes a worker that is gone
+	 */
+	static event worker_removed(const std::string &identity);
+
+	/**
+	 * Create an event that describes a new job (or a job that is placed again after it was removed)
+	 * @param request the request
+	 * @param location identity of the worker that holds the request (empty if it is queued)
+	 */
+	static event job_placed(const request &request, const std::string &location);
+
+	/**
+	 * Create an event that describes a known job that was assigned to a worker
+	 */
+	static event job_moved(const std::string &job_id, const std::string &location);
+
+	/**
+	 * Create an event that describes a job that is finished, cancelled or otherwise gone
+	 */
+	static event job_removed(const std::string &job_id);
+
+	/**
+	 * Apply an event to the replica.
+	 * @param event frames of the event
+	 * @return false if the event is malformed (the replica is not changed then)
+	 */
+	bool apply(const event &event);
+
+	/**
+	 * Forget all workers and jobs.
+	 */
+	void clear();
+
+	/**
+	 * Describe the whole replica by events that recreate it when applied to an empty replica.
+	 */
+	std::vector<event> snapshot() const;
+
+	/**
+	 * Find a job by its id.
+	 * @return the job or nullptr if it is not known
+	 */
+	const replicated_job *find_job(const std::string &job_id) const;
+
+	/**
+	 * Get the known workers (by identity).
+	 */
+	const std::map<std::string, worker_ptr> &get_workers() const;
+
+	/**
+	 * Get the amount of known jobs.
+	 */
+	std::size_t get_job_count() const;
+
+	/**
+	 * Fill an empty worker registry and queue manager with the replicated state. The jobs held by the workers are
+	 * registered without being sent again, queued jobs are enqueued in their original order.
+	 * @param workers the worker registry
+	 * @param queue the queue manager
+	 * @param liveness initial liveness of the restored workers
+	 * @return queued jobs that got assigned to a worker and must be sent to it (the worker is nullptr if the job
+	 *         cannot be processed anymore)
+	 */
+	std::vector<std::pair<worker_ptr, request_ptr>> restore(
+		worker_registry &workers, queue_manager_interface &queue, std::size_t liveness) const;
+
+private:
+	/** Known workers by identity */
+	std::map<std::string, worker_ptr> workers_;
+
+	/** Known jobs by id */
+	std::map<std::string, replicated_job> jobs_;
+
+	/** Arrival number of the next new job */
+	std::size_t next_arrival_ = 0;
+
+	/**
+	 * Apply a "worker" event
+	 */
+	bool apply_worker(const event &event);
+
+	/**
+	 * Apply a "job" event
+	 */
+	bool apply_job(const event &event);
+};
+
+#endif // RECODEX_BROKER_REPLICA_STATE_H
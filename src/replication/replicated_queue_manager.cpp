@@ -0,0 +1,253 @@
+#include "replicated_queue_manager.h"
+
+replicated_queue_manager::replicated_queue_manager(std::shared_ptr<queue_manager_interface> inner) : inner_(inner)
+{
+}
+
+std::vector<replica_state::event> replicated_queue_manager::take_events()
+{
+	std::vector<replica_state::event> result;
+	result.swap(events_);
+	return result;
+}
+
+const replica_state &replicated_queue_manager::get_state() const
+{
+	return state_;
+}
+
+void replicated_queue_manager::publish(replica_state::event event)
+{
+	state_.apply(event);
+	events_.push_back(std::move(event));
+}
+
+void replicated_queue_manager::publish_location(request_ptr request, worker_ptr worker)
+{
+	const auto &job_id = request->data.get_job_id();
+	std::string location = worker != nullptr ? worker->identity : "";
+
+	if (state_.find_job(job_id) != nullptr) {
+		publish(replica_state::job_moved(job_id, location));
+	} else {
+		publish(replica_state::job_placed(*request, location));
+	}
+}
+
+void replicated_queue_manager::publish_removal(request_ptr request, worker_ptr worker)
+{
+	if (request == nullptr) {
+		return;
+	}
+
+	auto job = state_.find_job(request->data.get_job_id());
+	if (job == nullptr) {
+		return;
+	}
+
+	// Queued requests can be returned along with those held by a worker
+	if (job->location.empty() || (worker != nullptr && job->location == worker->identity)) {
+		publish(replica_state::job_removed(request->data.get_job_id()));
+	}
+}
+
+request_ptr replicated_queue_manager::add_worker(worker_ptr worker, request_ptr current_request)
+{
+	auto result = inner_->add_worker(worker, current_request);
+	publish(replica_state::worker_added(*worker));
+
+	if (current_request != nullptr) {
+		publish(replica_state::job_placed(*current_request, worker->identity));
+	}
+
+	if (result != nullptr) {
+		publish_location(result, worker);
+	}
+
+	return result;
+}
+
+void replicated_queue_manager::add_unassigned_worker(worker_ptr worker)
+{
+	inner_->add_unassigned_worker(worker);
+	publish(replica_state::worker_added(*worker));
+}
+
+void replicated_queue_manager::add_current_request(worker_ptr worker, request_ptr request)
+{
+	inner_->add_current_request(worker, request);
+	publish(replica_state::job_placed(*request, worker->identity));
+}
+
+request_ptr replicated_queue_manager::assign_request(worker_ptr worker)
+{
+	auto result = inner_->assign_request(worker);
+
+	if (result != nullptr) {
+		publish_location(result, worker);
+	}
+
+	return result;
+}
+
+std::shared_ptr<std::vector<request_ptr>> replicated_queue_manager::worker_terminated(worker_ptr worker)
+{
+	auto result = inner_->worker_terminated(worker);
+
+	for (auto &request : *result) {
+		publish_removal(request, worker);
+	}
+
+	publish(replica_state::worker_removed(worker->identity));
+	return result;
+}
+
+std::vector<request_ptr> replicated_queue_manager::worker_draining(worker_ptr worker)
+{
+	auto result = inner_->worker_draining(worker);
+
+	for (auto &request : result) {
+		publish_removal(request, nullptr);
+	}
+
+	return result;
+}
+
+enqueue_result replicated_queue_manager::enqueue_request(request_ptr request)
+{
+	auto result = inner_->enqueue_request(request);
+
+	if (result.enqueued) {
+		publish(replica_state::job_placed(*request, result.assigned_to != nullptr ? result.assigned_to->identity : ""));
+	} else {
+		// A postponed request that cannot be enqueued anymore is gone
+		publish_removal(request, nullptr);
+	}
+
+	return result;
+}
+
+std::vector<enqueue_result> replicated_queue_manager::enqueue_requests(const std::vector<request_ptr> &requests)
+{
+	auto results = inner_->enqueue_requests(requests);
+
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		if (results[i].enqueued) {
+			auto &assigned_to = results[i].assigned_to;
+			publish(replica_state::job_placed(*requests[i], assigned_to != nullptr ? assigned_to->identity : ""));
+		}
+	}
+
+	return results;
+}
+
+std::vector<std::pair<worker_ptr, request_ptr>> replicated_queue_manager::assign_waiting_requests()
+{
+	auto result = inner_->assign_waiting_requests();
+
+	for (auto &pair : result) {
+		publish_location(pair.second, pair.first);
+	}
+
+	return result;
+}
+
+std::chrono::milliseconds replicated_queue_manager::get_waiting_delay()
+{
+	return inner_->get_waiting_delay();
+}
+
+void replicated_queue_manager::request_postponed(request_ptr request)
+{
+	inner_->request_postponed(request);
+
+	// The standby enqueues the request right away if it takes over before the retry
+	publish(replica_state::job_placed(*request, ""));
+}
+
+void replicated_queue_manager::request_discarded(request_ptr request)
+{
+	inner_->request_discarded(request);
+	publish_removal(request, nullptr);
+}
+
+std::map<std::string, std::size_t> replicated_queue_manager::get_statistics()
+{
+	return inner_->get_statistics();
+}
+
+std::size_t replicated_queue_manager::get_queued_request_count()
+{
+	return inner_->get_queued_request_count();
+}
+
+std::size_t replicated_queue_manager::get_queued_request_count(const std::string &hwgroup)
+{
+	return inner_->get_queued_request_count(hwgroup);
+}
+
+request_ptr replicated_queue_manager::get_current_request(worker_ptr worker)
+{
+	return inner_->get_current_request(worker);
+}
+
+std::vector<request_ptr> replicated_queue_manager::get_current_requests(worker_ptr worker)
+{
+	return inner_->get_current_requests(worker);
+}
+
+request_ptr replicated_queue_manager::get_prefetched_request(worker_ptr worker)
+{
+	return inner_->get_prefetched_request(worker);
+}
+
+request_location replicated_queue_manager::find_request(const std::string &job_id)
+{
+	return inner_->find_request(job_id);
+}
+
+bool replicated_queue_manager::assign_duplicate_request(worker_ptr worker, request_ptr duplicate)
+{
+	return inner_->assign_duplicate_request(worker, duplicate);
+}
+
+void replicated_queue_manager::index_duplicate_request(worker_ptr worker, request_ptr duplicate)
+{
+	inner_->index_duplicate_request(worker, duplicate);
+	publish_location(duplicate, worker);
+}
+
+request_ptr replicated_queue_manager::remove_queued_request(const std::string &job_id)
+{
+	auto result = inner_->remove_queued_request(job_id);
+	publish_removal(result, nullptr);
+	return result;
+}
+
+request_ptr replicated_queue_manager::worker_finished(worker_ptr worker, const std::string &job_id)
+{
+	// Find out which request is finished before the manager forgets it
+	request_ptr finished = nullptr;
+	for (auto &request : inner_->get_current_requests(worker)) {
+		if (job_id.empty() || request->data.get_job_id() == job_id) {
+			finished = request;
+			break;
+		}
+	}
+
+	auto result = inner_->worker_finished(worker, job_id);
+	publish_removal(finished, worker);
+
+	if (result != nullptr) {
+		publish_location(result, worker);
+	}
+
+	return result;
+}
+
+request_ptr replicated_queue_manager::worker_cancelled(worker_ptr worker, const std::string &job_id)
+{
+	auto result = inner_->worker_cancelled(worker, job_id);
+	publish_removal(result, worker);
+	return result;
+}
@@ -0,0 +1,92 @@
+#ifndef RECODEX_BROKER_REPLICATED_QUEUE_MANAGER_H
+#define RECODEX_BROKER_REPLICATED_QUEUE_MANAGER_H
+
+#include <memory>
+
+#include "../queuing/queue_manager_interface.h"
+#include "replica_state.h"
+
+
+/**
+ * Wraps a queue manager and records every change of the workers and jobs it holds as a replication event,
+ * so that a standby broker can mirror them. A replica of the state is kept as well, so that a standby that
+ * (re)connects can get a snapshot of everything.
+ * Speculative duplicates are not replicated, only the original requests are.
+ */
+class replicated_queue_manager : public queue_manager_interface
+{
+public:
+	/**
+	 * @param inner the queue manager that does the actual work
+	 */
+	explicit replicated_queue_manager(std::shared_ptr<queue_manager_interface> inner);
+
+	~replicated_queue_manager() override = default;
+
+	/**
+	 * Take the events recorded since the last call.
+	 */
+	std::vector<replica_state::event> take_events();
+
+	/**
+	 * Get the replica of the state of the wrapped manager.
+	 */
+	const replica_state &get_state() const;
+
+	request_ptr add_worker(worker_ptr worker, request_ptr current_request = nullptr) override;
+	void add_unassigned_worker(worker_ptr worker) override;
+	void add_current_request(worker_ptr worker, request_ptr request) override;
+	request_ptr assign_request(worker_ptr worker) override;
+	std::shared_ptr<std::vector<request_ptr>> worker_terminated(worker_ptr worker) override;
+	std::vector<request_ptr> worker_draining(worker_ptr worker) override;
+	enqueue_result enqueue_request(request_ptr request) override;
+	std::vector<enqueue_result> enqueue_requests(const std::vector<request_ptr> &requests) override;
+	std::vector<std::pair<worker_ptr, request_ptr>> assign_waiting_requests() override;
+	std::chrono::milliseconds get_waiting_delay() override;
+	void request_postponed(request_ptr request) override;
+	void request_discarded(request_ptr request) override;
+	std::map<std::string, std::size_t> get_statistics() override;
+	std::size_t get_queued_request_count() override;
+	std::size_t get_queued_request_count(const std::string &hwgroup) override;
+	request_ptr get_current_request(worker_ptr worker) override;
+	std::vector<request_ptr> get_current_requests(worker_ptr worker) override;
+	request_ptr get_prefetched_request(worker_ptr worker) override;
+	request_location find_request(const std::string &job_id) override;
+	bool assign_duplicate_request(worker_ptr worker, request_ptr duplicate) override;
+	void index_duplicate_request(worker_ptr worker, request_ptr duplicate) override;
+	request_ptr remove_queued_request(const std::string &job_id) override;
+	request_ptr worker_finished(worker_ptr worker, const std::string &job_id = "") override;
+	request_ptr worker_cancelled(worker_ptr worker, const std::string &job_id = "") override;
+
+private:
+	/** The wrapped queue manager */
+	std::shared_ptr<queue_manager_interface> inner_;
+
+	/** Replica of the state of the wrapped manager */
+	replica_state state_;
+
+	/** Events recorded since the last call of take_events */
+	std::vector<replica_state::event> events_;
+
+	/**
+	 * Apply an event to the replica and record it
+	 */
+	void publish(replica_state::event event);
+
+	/**
+	 * Record a new location of a request (the whole request is published if the replica does not know it)
+	 * @param request the request
+	 * @param worker the worker that holds the request (nullptr if it is queued)
+	 */
+	void publish_location(request_ptr request, worker_ptr worker);
+
+	/**
+	 * Record that a request left given location (nothing is published if the request is not there - this is the
+	 * case of the speculative duplicates)
+	 * @param request the request
+	 * @param worker the worker that held the request (nullptr if it was queued)
+	 */
+	void publish_removal(request_ptr request, worker_ptr worker);
+};
+
+#endif // RECODEX_BROKER_REPLICATED_QUEUE_MANAGER_H
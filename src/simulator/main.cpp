@@ -0,0 +1,172 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "simulator.h"
+#include "../queuing/cache_affinity_worker_selector.h"
+#include "../queuing/multi_queue_manager.h"
+#include "../queuing/single_queue_manager.h"
+
+namespace
+{
+	/**
+	 * Create a queue manager identified the same way as in the broker configuration
+	 * @return the queue manager or nullptr if the identifier is unknown
+	 */
+	std::shared_ptr<queue_manager_interface> create_queue_manager(const std::string &id,
+		const simulator &sim,
+		const std::string &affinity_key,
+		std::size_t affinity_cache_size,
+		std::chrono::milliseconds affinity_max_wait)
+	{
+		if (id == "multi") {
+			return std::make_shared<multi_queue_manager>();
+		} else if (id == "single") {
+			return std::make_shared<single_queue_manager<>>();
+		} else if (id == "edf") {
+			return std::make_shared<single_queue_manager<edf_job_comparator>>();
+		} else if (id == "affinity") {
+			return std::make_shared<single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector>>(
+				std::make_unique<fcfs_job_comparator>(),
+				std::make_unique<cache_affinity_worker_selector>(
+					affinity_key, affinity_cache_size, affinity_max_wait, [&sim]() { return sim.now(); }));
+		}
+
+		return nullptr;
+	}
+
+	void print_report(const std::string &id, const simulation_report &report)
+	{
+		std::cout << std::left << std::setw(10) << id << std::right << std::setw(10) << report.completed
+				  << std::setw(10) << report.rejected << std::setw(12) << report.unfinished << std::setw(12)
+				  << std::fixed << std::setprecision(2) << report.throughput << std::setw(12)
+				  << report.mean_wait.count();
+
+		for (unsigned percentile : {50, 90, 99}) {
+			auto it = report.wait_percentiles.find(percentile);
+			std::cout << std::setw(10) << (it != report.wait_percentiles.end() ? it->second.count() : 0);
+		}
+
+		std::cout << "  ";
+		for (auto &pair : report.utilization) {
+			std::cout << pair.first << "=" << std::setprecision(1) << pair.second * 100 << "% ";
+		}
+
+		std::cout << std::endl;
+	}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	using namespace boost::program_options;
+
+	std::string trace_file;
+	std::vector<std::string> queue_managers;
+	synthetic_workload_params synthetic;
+	std::size_t mean_interarrival;
+	std::size_t mean_runtime;
+	std::string affinity_key;
+	std::size_t affinity_cache_size;
+	std::size_t affinity_max_wait;
+	std::size_t tick_interval;
+
+	options_description desc("Allowed options for broker simulator");
+	auto options = desc.add_options();
+	options("help,h", "Writes this help message to stderr");
+	options("trace,t", value<std::string>(&trace_file), "Replay a scheduling trace recorded by the broker");
+	options("queue-manager,q",
+		value<std::vector<std::string>>(&queue_managers)
+			->multitoken()
+			->default_value({"single", "multi", "edf", "affinity"}, "single multi edf affinity"),
+		"Queue managers to be compared");
+	options("workers", value<std::size_t>(&synthetic.workers)->default_value(4), "Synthetic workload: workers");
+	options("slots", value<std::size_t>(&synthetic.slots)->default_value(1), "Synthetic workload: slots per worker");
+	options("jobs", value<std::size_t>(&synthetic.jobs)->default_value(1000), "Synthetic workload: jobs");
+	options("interarrival",
+		value<std::size_t>(&mean_interarrival)->default_value(100),
+		"Synthetic workload: mean time between job arrivals (ms)");
+	options("runtime",
+		value<std::size_t>(&mean_runtime)->default_value(350),
+		"Synthetic workload: mean processing time of a job (ms)");
+	options("exercises",
+		value<std::size_t>(&synthetic.exercises)->default_value(10),
+		"Synthetic workload: distinct exercises");
+	options("seed", value<unsigned>(&synthetic.seed)->default_value(42), "Synthetic workload: random seed");
+	options("affinity-key",
+		value<std::string>(&affinity_key)->default_value("exercise"),
+		"Metadata item used by the affinity manager");
+	options("affinity-cache-size",
+		value<std::size_t>(&affinity_cache_size)->default_value(4),
+		"Recent keys remembered by the affinity manager");
+	options("affinity-max-wait",
+		value<std::size_t>(&affinity_max_wait)->default_value(1000),
+		"Time a job waits for a worker with a warm cache (ms)");
+	options("tick", value<std::size_t>(&tick_interval)->default_value(100), "Interval of the periodic work (ms)");
+
+	variables_map vm;
+	try {
+		store(parse_command_line(argc, argv, desc), vm);
+		notify(vm);
+	} catch (std::exception &e) {
+		std::cerr << "Error in loading a parameter: " << e.what() << std::endl;
+		return 1;
+	}
+
+	if (vm.count("help")) {
+		std::cerr << desc << std::endl;
+		return 1;
+	}
+
+	workload jobs;
+	if (!trace_file.empty()) {
+		std::ifstream input(trace_file, std::ios::binary);
+		if (!input) {
+			std::cerr << "Cannot open trace file " << trace_file << std::endl;
+			return 1;
+		}
+
+		try {
+			trace_reader reader(input);
+			jobs = workload::from_trace(reader);
+		} catch (trace_error &e) {
+			std::cerr << "Error loading trace: " << e.what() << std::endl;
+			return 1;
+		}
+	} else {
+		synthetic.mean_interarrival = std::chrono::milliseconds(mean_interarrival);
+		synthetic.mean_runtime = std::chrono::milliseconds(mean_runtime);
+		jobs = synthetic.generate();
+	}
+
+	std::cout << "Workload: " << jobs.workers.size() << " workers, " << jobs.jobs.size() << " jobs";
+	if (jobs.skipped_jobs > 0) {
+		std::cout << " (" << jobs.skipped_jobs << " traced jobs without a result skipped)";
+	}
+	std::cout << std::endl << std::endl;
+
+	std::cout << std::left << std::setw(10) << "manager" << std::right << std::setw(10) << "completed" << std::setw(10)
+			  << "rejected" << std::setw(12) << "unfinished" << std::setw(12) << "jobs/s" << std::setw(12)
+			  << "mean wait" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+			  << "  utilization" << std::endl;
+
+	simulator sim{std::chrono::milliseconds(tick_interval)};
+
+	for (auto &id : queue_managers) {
+		auto queue = create_queue_manager(
+			id, sim, affinity_key, affinity_cache_size, std::chrono::milliseconds(affinity_max_wait));
+
+		if (queue == nullptr) {
+			std::cerr << "Unknown queue manager '" << id << "'" << std::endl;
+			return 1;
+		}
+
+		print_report(id, sim.run(*queue, jobs));
+	}
+
+	return 0;
+}
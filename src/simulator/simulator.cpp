@@ -0,0 +1,344 @@
+#include "simulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <random>
+
+namespace
+{
+	/** Kinds of simulated events */
+	enum class event_kind { worker_joined, worker_left, job_arrived, job_finished, tick };
+
+	/**
+	 * An event scheduled in the virtual time
+	 */
+	struct simulation_event {
+		/** Time of the event */
+		std::chrono::milliseconds time;
+		/** Sequence number that keeps simultaneous events in the order they were scheduled */
+		std::uint64_t sequence;
+		/** Kind of the event */
+		event_kind kind;
+		/** Index of the worker or the job the event belongs to */
+		std::size_t index;
+		/** The finished request */
+		request_ptr finished_request;
+	};
+
+	/**
+	 * Orders the events in a priority queue so that the earliest one is on the top
+	 */
+	struct later_event {
+		bool operator()(const simulation_event &a, const simulation_event &b) const
+		{
+			return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+		}
+	};
+} // namespace
+
+workload workload::from_trace(trace_reader &reader)
+{
+	workload result;
+	std::vector<simulated_job> jobs;
+	std::vector<bool> finished;
+	std::map<std::string, std::size_t> workers_by_identity;
+	std::map<std::string, std::size_t> jobs_by_id;
+	std::map<std::string, std::chrono::milliseconds> start_times;
+
+	trace_event event;
+	while (reader.read(event)) {
+		switch (event.event_type) {
+		case trace_event::type::worker_added: {
+			simulated_worker added;
+			added.identity = event.identity;
+			added.hwgroup = event.hwgroup;
+			added.headers = event.headers;
+			added.slots = event.slots;
+			added.prefetch = event.prefetch;
+			added.joined = event.time;
+
+			workers_by_identity[event.identity] = result.workers.size();
+			result.workers.push_back(std::move(added));
+			break;
+		}
+		case trace_event::type::worker_removed: {
+			auto it = workers_by_identity.find(event.identity);
+			if (it != workers_by_identity.end()) {
+				result.workers[it->second].left = event.time;
+				workers_by_identity.erase(it);
+			}
+			break;
+		}
+		case trace_event::type::job_arrived: {
+			simulated_job arrived;
+			arrived.job_id = event.job_id;
+			arrived.headers = event.headers;
+			arrived.metadata = event.metadata;
+			arrived.arrival = event.time;
+
+			jobs_by_id[event.job_id] = jobs.size();
+			jobs.push_back(std::move(arrived));
+			finished.push_back(false);
+			break;
+		}
+		case trace_event::type::job_started:
+			start_times[event.job_id] = event.time;
+			break;
+		case trace_event::type::job_finished: {
+			auto job = jobs_by_id.find(event.job_id);
+			auto start = start_times.find(event.job_id);
+			if (job != jobs_by_id.end() && start != start_times.end()) {
+				jobs[job->second].runtime = event.time - start->second;
+				finished[job->second] = true;
+				start_times.erase(start);
+			}
+			break;
+		}
+		}
+	}
+
+	for (std::size_t i = 0; i < jobs.size(); ++i) {
+		if (finished[i]) {
+			result.jobs.push_back(std::move(jobs[i]));
+		} else {
+			result.skipped_jobs += 1;
+		}
+	}
+
+	return result;
+}
+
+workload synthetic_workload_params::generate() const
+{
+	workload result;
+	std::mt19937 generator(seed);
+	std::exponential_distribution<double> interarrival(1.0 / std::max<double>(1, mean_interarrival.count()));
+	std::exponential_distribution<double> runtime(1.0 / std::max<double>(1, mean_runtime.count()));
+	std::uniform_int_distribution<std::size_t> exercise(1, std::max<std::size_t>(1, exercises));
+
+	for (std::size_t i = 0; i < workers; ++i) {
+		simulated_worker added;
+		added.identity = "worker_" + std::to_string(i + 1);
+		added.hwgroup = "group_1";
+		added.headers = {{"env", "c"}};
+		added.slots = slots;
+		result.workers.push_back(std::move(added));
+	}
+
+	double time = 0;
+	for (std::size_t i = 0; i < jobs; ++i) {
+		time += interarrival(generator);
+
+		simulated_job arrived;
+		arrived.job_id = "job_" + std::to_string(i + 1);
+		arrived.headers = {{"env", "c"}};
+		arrived.metadata = {{"exercise", "exercise_" + std::to_string(exercise(generator))}};
+		arrived.arrival = std::chrono::milliseconds(static_cast<std::int64_t>(time));
+		arrived.runtime = std::chrono::milliseconds(1 + static_cast<std::int64_t>(runtime(generator)));
+		result.jobs.push_back(std::move(arrived));
+	}
+
+	return result;
+}
+
+simulator::simulator(std::chrono::milliseconds tick_interval) : tick_interval_(tick_interval)
+{
+}
+
+std::chrono::milliseconds simulator::now() const
+{
+	return now_;
+}
+
+simulation_report simulator::run(queue_manager_interface &queue, const workload &jobs)
+{
+	simulation_report report;
+	now_ = std::chrono::milliseconds(0);
+
+	std::priority_queue<simulation_event, std::vector<simulation_event>, later_event> events;
+	std::uint64_t sequence = 0;
+	auto schedule = [&](std::chrono::milliseconds time, event_kind kind, std::size_t index, request_ptr request) {
+		events.push(simulation_event{time, sequence++, kind, index, request});
+	};
+
+	std::vector<worker_ptr> workers(jobs.workers.size());
+	std::map<worker_ptr, std::size_t> worker_indices;
+	std::vector<std::chrono::milliseconds> busy_times(jobs.workers.size(), std::chrono::milliseconds(0));
+	std::map<request_ptr, std::size_t> job_indices;
+	std::vector<bool> started(jobs.jobs.size(), false);
+	std::vector<std::chrono::milliseconds> waits;
+	bool tick_scheduled = false;
+
+	/** Requests being processed, the workers processing them and their start times */
+	std::map<request_ptr, std::pair<std::size_t, std::chrono::milliseconds>> running;
+
+	for (std::size_t i = 0; i < jobs.workers.size(); ++i) {
+		schedule(jobs.workers[i].joined, event_kind::worker_joined, i, nullptr);
+		if (jobs.workers[i].left != std::chrono::milliseconds::max()) {
+			schedule(jobs.workers[i].left, event_kind::worker_left, i, nullptr);
+		}
+	}
+
+	for (std::size_t i = 0; i < jobs.jobs.size(); ++i) {
+		schedule(jobs.jobs[i].arrival, event_kind::job_arrived, i, nullptr);
+	}
+
+	// Start processing the requests that occupy a slot of the worker (like the broker does when it sends them)
+	auto start_requests = [&](worker_ptr worker) {
+		auto worker_index = worker_indices[worker];
+		auto prefetched_request = queue.get_prefetched_request(worker);
+
+		for (auto &request : queue.get_current_requests(worker)) {
+			if (request == prefetched_request || running.count(request) > 0) {
+				continue;
+			}
+
+			auto job_index = job_indices[request];
+			if (!started[job_index]) {
+				started[job_index] = true;
+				waits.push_back(now_ - jobs.jobs[job_index].arrival);
+			}
+
+			running.emplace(request, std::make_pair(worker_index, now_));
+			schedule(now_ + jobs.jobs[job_index].runtime, event_kind::job_finished, worker_index, request);
+		}
+	};
+
+	auto fill_worker = [&](worker_ptr worker) {
+		while (queue.assign_request(worker) != nullptr) {
+		}
+		start_requests(worker);
+	};
+
+	while (!events.empty()) {
+		auto event = events.top();
+		events.pop();
+		now_ = event.time;
+
+		switch (event.kind) {
+		case event_kind::worker_joined: {
+			auto &description = jobs.workers[event.index];
+			auto joined = std::make_shared<worker>(description.identity, description.hwgroup, description.headers);
+			joined->slots = std::max<std::size_t>(1, description.slots);
+			joined->prefetch = description.prefetch;
+
+			workers[event.index] = joined;
+			worker_indices[joined] = event.index;
+			queue.add_worker(joined);
+			fill_worker(joined);
+			break;
+		}
+		case event_kind::worker_left: {
+			auto left = workers[event.index];
+			if (left == nullptr) {
+				break;
+			}
+
+			auto requests = queue.worker_terminated(left);
+			workers[event.index] = nullptr;
+
+			for (auto &request : *requests) {
+				auto it = running.find(request);
+				if (it != running.end()) {
+					busy_times[event.index] += now_ - it->second.second;
+					running.erase(it);
+				}
+			}
+
+			// The broker reassigns the jobs of a dead worker
+			for (auto &request : *requests) {
+				auto result = queue.enqueue_request(request);
+				if (result.assigned_to != nullptr) {
+					start_requests(result.assigned_to);
+				}
+			}
+			break;
+		}
+		case event_kind::job_arrived: {
+			auto &description = jobs.jobs[event.index];
+			auto arrived = std::make_shared<request>(
+				description.headers, description.metadata, job_request_data(description.job_id, {}));
+			job_indices[arrived] = event.index;
+
+			auto result = queue.enqueue_request(arrived);
+			if (!result.enqueued) {
+				report.rejected += 1;
+			} else if (result.assigned_to != nullptr) {
+				start_requests(result.assigned_to);
+			}
+			break;
+		}
+		case event_kind::job_finished: {
+			// The job might have been restarted elsewhere after its worker left
+			auto it = running.find(event.finished_request);
+			auto runtime = jobs.jobs[job_indices[event.finished_request]].runtime;
+			if (it == running.end() || it->second.first != event.index || it->second.second + runtime != now_) {
+				break;
+			}
+
+			running.erase(it);
+			busy_times[event.index] += runtime;
+			report.completed += 1;
+			report.makespan = now_;
+
+			auto finished_worker = workers[event.index];
+			queue.worker_finished(finished_worker, event.finished_request->data.get_job_id());
+			fill_worker(finished_worker);
+			break;
+		}
+		case event_kind::tick:
+			tick_scheduled = false;
+			for (auto &pair : queue.assign_waiting_requests()) {
+				start_requests(pair.first);
+			}
+			break;
+		}
+
+		// Ticks are only needed while something waits in the queue and something else can still happen
+		if (!tick_scheduled && !events.empty() && queue.get_queued_request_count() > 0) {
+			schedule(now_ + tick_interval_, event_kind::tick, 0, nullptr);
+			tick_scheduled = true;
+		}
+	}
+
+	report.unfinished = jobs.jobs.size() - report.completed - report.rejected;
+
+	if (report.makespan.count() > 0) {
+		report.throughput = report.completed / (report.makespan.count() / 1000.0);
+	}
+
+	if (!waits.empty()) {
+		std::sort(waits.begin(), waits.end());
+
+		std::chrono::milliseconds total(0);
+		for (auto &wait : waits) {
+			total += wait;
+		}
+		report.mean_wait = total / waits.size();
+
+		for (unsigned percentile : {50, 90, 99}) {
+			auto rank = static_cast<std::size_t>(std::ceil(percentile / 100.0 * waits.size()));
+			report.wait_percentiles[percentile] = waits[std::max<std::size_t>(rank, 1) - 1];
+		}
+	}
+
+	std::map<std::string, double> slot_times;
+	std::map<std::string, double> busy_by_hwgroup;
+	for (std::size_t i = 0; i < jobs.workers.size(); ++i) {
+		auto &description = jobs.workers[i];
+		auto end = std::min(description.left, report.makespan);
+
+		if (end > description.joined) {
+			slot_times[description.hwgroup] += std::max<std::size_t>(1, description.slots) *
+				static_cast<double>((end - description.joined).count());
+			busy_by_hwgroup[description.hwgroup] += busy_times[i].count();
+		}
+	}
+
+	for (auto &pair : slot_times) {
+		report.utilization[pair.first] = std::min(1.0, busy_by_hwgroup[pair.first] / pair.second);
+	}
+
+	return report;
+}
@@ -0,0 +1,149 @@
+#ifndef RECODEX_BROKER_SIMULATOR_H
+#define RECODEX_BROKER_SIMULATOR_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../queuing/queue_manager_interface.h"
+#include "../trace/scheduling_trace.h"
+
+/**
+ * A worker taking part in a simulation
+ */
+struct simulated_worker {
+	/** Identity of the worker */
+	std::string identity;
+	/** Hardware group of the worker */
+	std::string hwgroup;
+	/** Headers describing the worker's capabilities */
+	request::headers_t headers;
+	/** The amount of jobs the worker can process concurrently */
+	std::size_t slots = 1;
+	/** True if the worker accepts one more job while all its slots are occupied */
+	bool prefetch = false;
+	/** Time when the worker connects */
+	std::chrono::milliseconds joined = std::chrono::milliseconds(0);
+	/** Time when the worker disconnects */
+	std::chrono::milliseconds left = std::chrono::milliseconds::max();
+};
+
+/**
+ * A job submitted in a simulation
+ */
+struct simulated_job {
+	/** Identifier of the job */
+	std::string job_id;
+	/** Headers that specify requirements on the worker */
+	request::headers_t headers;
+	/** Metadata of the job */
+	request::metadata_t metadata;
+	/** Time when the job is submitted */
+	std::chrono::milliseconds arrival = std::chrono::milliseconds(0);
+	/** Time it takes to process the job */
+	std::chrono::milliseconds runtime = std::chrono::milliseconds(0);
+};
+
+/**
+ * Workers and jobs to be simulated
+ */
+struct workload {
+	/** The workers in the order they connect */
+	std::vector<simulated_worker> workers;
+	/** The jobs in the order they arrive */
+	std::vector<simulated_job> jobs;
+	/** The amount of traced jobs that were left out because their processing time is unknown */
+	std::size_t skipped_jobs = 0;
+
+	/**
+	 * Load a workload from a scheduling trace recorded by the broker.
+	 * The processing time of a job is the time between its last start and the result that followed it.
+	 * @param reader the trace
+	 * @throws trace_error if the trace is malformed
+	 */
+	static workload from_trace(trace_reader &reader);
+};
+
+/**
+ * Parameters of a synthetic workload with exponentially distributed arrival and processing times
+ */
+struct synthetic_workload_params {
+	/** The amount of workers (all of them in the same hardware group) */
+	std::size_t workers = 4;
+	/** The amount of slots of each worker */
+	std::size_t slots = 1;
+	/** The amount of jobs */
+	std::size_t jobs = 1000;
+	/** Mean time between two job arrivals */
+	std::chrono::milliseconds mean_interarrival = std::chrono::milliseconds(100);
+	/** Mean processing time of a job */
+	std::chrono::milliseconds mean_runtime = std::chrono::milliseconds(350);
+	/** The amount of distinct exercises the jobs belong to (stored in the "exercise" metadata item) */
+	std::size_t exercises = 10;
+	/** Seed of the random generator */
+	unsigned seed = 42;
+
+	/**
+	 * Generate the workload
+	 */
+	workload generate() const;
+};
+
+/**
+ * Results of a simulation
+ */
+struct simulation_report {
+	/** The amount of finished jobs */
+	std::size_t completed = 0;
+	/** The amount of jobs the queue manager refused */
+	std::size_t rejected = 0;
+	/** The amount of jobs that could not be finished (e.g. no suitable worker was left) */
+	std::size_t unfinished = 0;
+	/** Time when the last job was finished */
+	std::chrono::milliseconds makespan = std::chrono::milliseconds(0);
+	/** Finished jobs per second of the simulated time */
+	double throughput = 0;
+	/** Mean time the jobs waited before they were started */
+	std::chrono::milliseconds mean_wait = std::chrono::milliseconds(0);
+	/** Percentiles of the waiting times (50th, 90th and 99th) */
+	std::map<unsigned, std::chrono::milliseconds> wait_percentiles;
+	/** Fraction of the slot time spent processing jobs in each hardware group */
+	std::map<std::string, double> utilization;
+};
+
+/**
+ * Replays a workload through a queue manager under a virtual clock.
+ * Only the dispatching decisions of the queue manager are simulated, the jobs take the time given by the workload.
+ */
+class simulator
+{
+public:
+	/**
+	 * @param tick_interval how often the periodic work of the broker (assigning requests that waited for a worker
+	 *   too long) is simulated
+	 */
+	explicit simulator(std::chrono::milliseconds tick_interval = std::chrono::milliseconds(100));
+
+	/**
+	 * Get the current virtual time (it can be used as a clock of the queue manager's policies)
+	 */
+	std::chrono::milliseconds now() const;
+
+	/**
+	 * Run the simulation
+	 * @param queue a queue manager without any workers
+	 * @param jobs the simulated workers and jobs
+	 * @return statistics of the simulation
+	 */
+	simulation_report run(queue_manager_interface &queue, const workload &jobs);
+
+private:
+	/** How often the periodic work of the broker is simulated */
+	std::chrono::milliseconds tick_interval_;
+
+	/** The virtual time */
+	std::chrono::milliseconds now_ = std::chrono::milliseconds(0);
+};
+
+#endif // RECODEX_BROKER_SIMULATOR_H
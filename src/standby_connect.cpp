@@ -0,0 +1,35 @@
+#include "standby_connect.h"
+
+#include "broker_connect.h"
+#include "handlers/standby_handler.h"
+#include "reactor/router_socket_wrapper.h"
+
+standby_connect::standby_connect(std::shared_ptr<const broker_config> config,
+	std::shared_ptr<zmq::context_t> context,
+	std::shared_ptr<spdlog::logger> logger)
+	: logger_(logger), state_(std::make_shared<replica_state>()),
+	  reactor_(context, config->get_reactor_backend() == "epoll" ? reactor_backend::epoll : reactor_backend::poll)
+{
+	if (logger_ == nullptr) {
+		logger_ = helpers::create_null_logger();
+	}
+
+	auto &replication = config->get_replication_config();
+	auto replication_endpoint = "tcp://" + replication.address + ":" + std::to_string(replication.port);
+	logger_->debug("Binding primary broker to {}", replication_endpoint);
+
+	// The primary sends its messages to a well-known identity (like to the monitor)
+	reactor_.add_socket(broker_connect::KEY_REPLICATION,
+		std::make_shared<router_socket_wrapper>(
+			context, replication_endpoint, true, broker_connect::STANDBY_IDENTITY));
+
+	reactor_.add_handler({broker_connect::KEY_REPLICATION, broker_connect::KEY_TIMER},
+		std::make_shared<standby_handler>(
+			state_, replication.takeover_timeout, [this]() { reactor_.terminate(); }, logger_));
+}
+
+std::shared_ptr<const replica_state> standby_connect::wait_for_takeover()
+{
+	reactor_.start_loop();
+	return state_;
+}
@@ -0,0 +1,42 @@
+#ifndef RECODEX_BROKER_STANDBY_CONNECT_H
+#define RECODEX_BROKER_STANDBY_CONNECT_H
+
+#include <memory>
+
+#include "config/broker_config.h"
+#include "helpers/logger.h"
+#include "reactor/reactor.h"
+#include "replication/replica_state.h"
+
+/**
+ * Mirrors the state of a primary broker until the primary fails.
+ * Only the replication endpoint is bound, the client and worker endpoints are left to the primary.
+ */
+class standby_connect
+{
+private:
+	/** System logger. */
+	std::shared_ptr<spdlog::logger> logger_;
+	/** Replica of the state of the primary broker */
+	std::shared_ptr<replica_state> state_;
+	/** A reactor that receives the replication messages */
+	reactor reactor_;
+
+public:
+	/**
+	 * @param config a configuration object used to set up the replication channel
+	 * @param context ZeroMQ context
+	 * @param logger
+	 */
+	standby_connect(std::shared_ptr<const broker_config> config,
+		std::shared_ptr<zmq::context_t> context,
+		std::shared_ptr<spdlog::logger> logger = nullptr);
+
+	/**
+	 * Receive the replicated state until the primary broker stops responding.
+	 * @return replica of the state of the primary broker at the time it failed
+	 */
+	std::shared_ptr<const replica_state> wait_for_takeover();
+};
+
+#endif // RECODEX_BROKER_STANDBY_CONNECT_H
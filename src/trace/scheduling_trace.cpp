@@ -0,0 +1,252 @@
+#include "scheduling_trace.h"
+
+#include <algorithm>
+
+namespace
+{
+	/** Identifies the format (and its version) at the beginning of a trace */
+	const std::string TRACE_MAGIC = "RXTRACE1";
+} // namespace
+
+trace_error::trace_error(const std::string &msg) : std::runtime_error(msg)
+{
+}
+
+trace_writer::trace_writer(std::unique_ptr<std::ostream> output)
+	: output_(std::move(output)), start_(std::chrono::steady_clock::now())
+{
+	output_->write(TRACE_MAGIC.data(), TRACE_MAGIC.size());
+}
+
+bool trace_writer::good() const
+{
+	return output_->good();
+}
+
+void trace_writer::record(trace_event event)
+{
+	event.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_);
+	write(event);
+}
+
+void trace_writer::write(const trace_event &event)
+{
+	auto time = std::max(event.time, last_time_);
+
+	output_->put(static_cast<char>(event.event_type));
+	write_number((time - last_time_).count());
+	last_time_ = time;
+
+	switch (event.event_type) {
+	case trace_event::type::worker_added:
+		write_string(event.identity);
+		write_string(event.hwgroup);
+		write_map(event.headers);
+		write_number(event.slots);
+		write_number(event.prefetch ? 1 : 0);
+		break;
+	case trace_event::type::worker_removed:
+		write_string(event.identity);
+		break;
+	case trace_event::type::job_arrived:
+		write_string(event.job_id);
+		write_map(event.headers);
+		write_map(event.metadata);
+		break;
+	case trace_event::type::job_started:
+		write_string(event.identity);
+		write_string(event.job_id);
+		break;
+	case trace_event::type::job_finished:
+		write_string(event.identity);
+		write_string(event.job_id);
+		write_string(event.status);
+		break;
+	}
+}
+
+void trace_writer::flush()
+{
+	output_->flush();
+}
+
+void trace_writer::worker_added(const worker &added_worker)
+{
+	trace_event event;
+	event.event_type = trace_event::type::worker_added;
+	event.identity = added_worker.identity;
+	event.hwgroup = added_worker.hwgroup;
+	event.headers = added_worker.get_headers();
+	event.slots = added_worker.slots;
+	event.prefetch = added_worker.prefetch;
+	record(std::move(event));
+}
+
+void trace_writer::worker_removed(const worker &removed_worker)
+{
+	trace_event event;
+	event.event_type = trace_event::type::worker_removed;
+	event.identity = removed_worker.identity;
+	record(std::move(event));
+}
+
+void trace_writer::job_arrived(const request &arrived_request)
+{
+	trace_event event;
+	event.event_type = trace_event::type::job_arrived;
+	event.job_id = arrived_request.data.get_job_id();
+	event.headers = arrived_request.headers;
+	event.metadata = arrived_request.metadata;
+	record(std::move(event));
+}
+
+void trace_writer::job_started(const worker &processing_worker, const std::string &job_id)
+{
+	trace_event event;
+	event.event_type = trace_event::type::job_started;
+	event.identity = processing_worker.identity;
+	event.job_id = job_id;
+	record(std::move(event));
+}
+
+void trace_writer::job_finished(const worker &processing_worker, const std::string &job_id, const std::string &status)
+{
+	trace_event event;
+	event.event_type = trace_event::type::job_finished;
+	event.identity = processing_worker.identity;
+	event.job_id = job_id;
+	event.status = status;
+	record(std::move(event));
+}
+
+void trace_writer::write_number(std::uint64_t value)
+{
+	// 7 bits per byte, the highest bit marks that more bytes follow
+	while (value >= 0x80) {
+		output_->put(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+
+	output_->put(static_cast<char>(value));
+}
+
+void trace_writer::write_string(const std::string &value)
+{
+	write_number(value.size());
+	output_->write(value.data(), value.size());
+}
+
+template <typename map_type> void trace_writer::write_map(const map_type &map)
+{
+	write_number(map.size());
+
+	for (auto &pair : map) {
+		write_string(pair.first);
+		write_string(pair.second);
+	}
+}
+
+trace_reader::trace_reader(std::istream &input) : input_(input)
+{
+	std::string magic(TRACE_MAGIC.size(), '\0');
+	input_.read(&magic[0], magic.size());
+
+	if (!input_ || magic != TRACE_MAGIC) {
+		throw trace_error("The input is not a scheduling trace");
+	}
+}
+
+bool trace_reader::read(trace_event &event)
+{
+	auto type = input_.get();
+	if (type == std::istream::traits_type::eof()) {
+		return false;
+	}
+
+	event = trace_event();
+	event.event_type = static_cast<trace_event::type>(type);
+	last_time_ += std::chrono::milliseconds(read_number());
+	event.time = last_time_;
+
+	switch (event.event_type) {
+	case trace_event::type::worker_added:
+		event.identity = read_string();
+		event.hwgroup = read_string();
+		event.headers = read_map<request::headers_t>();
+		event.slots = read_number();
+		event.prefetch = read_number() != 0;
+		break;
+	case trace_event::type::worker_removed:
+		event.identity = read_string();
+		break;
+	case trace_event::type::job_arrived:
+		event.job_id = read_string();
+		event.headers = read_map<request::headers_t>();
+		event.metadata = read_map<request::metadata_t>();
+		break;
+	case trace_event::type::job_started:
+		event.identity = read_string();
+		event.job_id = read_string();
+		break;
+	case trace_event::type::job_finished:
+		event.identity = read_string();
+		event.job_id = read_string();
+		event.status = read_string();
+		break;
+	default:
+		throw trace_error("Unknown event type " + std::to_string(type) + " in the trace");
+	}
+
+	return true;
+}
+
+std::uint64_t trace_reader::read_number()
+{
+	std::uint64_t result = 0;
+
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		auto byte = input_.get();
+		if (byte == std::istream::traits_type::eof()) {
+			throw trace_error("Unexpected end of the trace");
+		}
+
+		result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return result;
+		}
+	}
+
+	throw trace_error("Malformed number in the trace");
+}
+
+std::string trace_reader::read_string()
+{
+	auto size = read_number();
+	std::string result;
+
+	// Read in chunks so that a corrupted length does not allocate too much memory at once
+	char buffer[4096];
+	while (result.size() < size) {
+		auto chunk = std::min<std::uint64_t>(sizeof(buffer), size - result.size());
+		input_.read(buffer, chunk);
+		if (static_cast<std::uint64_t>(input_.gcount()) != chunk) {
+			throw trace_error("Unexpected end of the trace");
+		}
+		result.append(buffer, chunk);
+	}
+
+	return result;
+}
+
+template <typename map_type> map_type trace_reader::read_map()
+{
+	auto size = read_number();
+	map_type result;
+
+	for (std::uint64_t i = 0; i < size; ++i) {
+		auto key = read_string();
+		result.emplace(std::move(key), read_string());
+	}
+
+	return result;
+}
@@ -0,0 +1,181 @@
+#ifndef RECODEX_BROKER_SCHEDULING_TRACE_H
+#define RECODEX_BROKER_SCHEDULING_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "../worker.h"
+
+/**
+ * A scheduling-relevant event observed by the broker
+ */
+struct trace_event {
+	/** Kinds of traced events */
+	enum class type : std::uint8_t {
+		/** A worker connected (identity, hwgroup, headers, slots and prefetch are set) */
+		worker_added = 1,
+		/** A worker was considered dead (identity is set) */
+		worker_removed = 2,
+		/** A client submitted a job (job_id, headers and metadata are set) */
+		job_arrived = 3,
+		/** A job occupied a slot of a worker (identity and job_id are set) */
+		job_started = 4,
+		/** A worker finished a job (identity, job_id and status are set) */
+		job_finished = 5,
+	};
+
+	/** Kind of the event */
+	type event_type = type::job_arrived;
+	/** Time since the start of the trace */
+	std::chrono::milliseconds time = std::chrono::milliseconds(0);
+	/** Identity of the worker */
+	std::string identity;
+	/** Hardware group of the worker */
+	std::string hwgroup;
+	/** Identifier of the job */
+	std::string job_id;
+	/** Headers of the worker or the job */
+	request::headers_t headers;
+	/** Metadata of the job */
+	request::metadata_t metadata;
+	/** Amount of slots of the worker */
+	std::size_t slots = 1;
+	/** True if the worker supports prefetching */
+	bool prefetch = false;
+	/** Status reported by the worker (e.g. OK or FAILED) */
+	std::string status;
+};
+
+/**
+ * Thrown when a trace cannot be read
+ */
+class trace_error : public std::runtime_error
+{
+public:
+	/**
+	 * @param msg description of the problem
+	 */
+	explicit trace_error(const std::string &msg);
+};
+
+/**
+ * Writes scheduling events into a compact binary trace
+ * (a short magic string followed by records with variable-length integers and length-prefixed strings,
+ * event times are stored as differences from the previous event)
+ */
+class trace_writer
+{
+public:
+	/**
+	 * @param output the stream the trace is written to (it should be opened in binary mode)
+	 */
+	explicit trace_writer(std::unique_ptr<std::ostream> output);
+
+	/**
+	 * Check if the trace can be written
+	 */
+	bool good() const;
+
+	/**
+	 * Write an event with the current time (measured since the writer was created)
+	 */
+	void record(trace_event event);
+
+	/**
+	 * Write an event with its own time (the times must not decrease)
+	 */
+	void write(const trace_event &event);
+
+	/**
+	 * Flush the buffered events to the output
+	 */
+	void flush();
+
+	/**
+	 * Record the connection of a worker
+	 */
+	void worker_added(const worker &added_worker);
+
+	/**
+	 * Record the removal of a worker
+	 */
+	void worker_removed(const worker &removed_worker);
+
+	/**
+	 * Record the arrival of a job
+	 */
+	void job_arrived(const request &arrived_request);
+
+	/**
+	 * Record the start of a job on a worker
+	 */
+	void job_started(const worker &processing_worker, const std::string &job_id);
+
+	/**
+	 * Record a result of a job
+	 */
+	void job_finished(const worker &processing_worker, const std::string &job_id, const std::string &status);
+
+private:
+	/** The output stream */
+	std::unique_ptr<std::ostream> output_;
+
+	/** The time the writer was created */
+	std::chrono::steady_clock::time_point start_;
+
+	/** Time of the last written event */
+	std::chrono::milliseconds last_time_ = std::chrono::milliseconds(0);
+
+	/** Write an unsigned integer in the variable-length format */
+	void write_number(std::uint64_t value);
+
+	/** Write a length-prefixed string */
+	void write_string(const std::string &value);
+
+	/** Write a map of strings */
+	template <typename map_type> void write_map(const map_type &map);
+};
+
+/**
+ * Reads events from a binary trace written by trace_writer
+ */
+class trace_reader
+{
+public:
+	/**
+	 * @param input the stream with the trace
+	 * @throws trace_error if the stream does not contain a trace
+	 */
+	explicit trace_reader(std::istream &input);
+
+	/**
+	 * Read the next event
+	 * @param event the loaded event
+	 * @return false if there are no more events
+	 * @throws trace_error if the trace is malformed
+	 */
+	bool read(trace_event &event);
+
+private:
+	/** The input stream */
+	std::istream &input_;
+
+	/** Time of the last read event */
+	std::chrono::milliseconds last_time_ = std::chrono::milliseconds(0);
+
+	/** Read an unsigned integer in the variable-length format */
+	std::uint64_t read_number();
+
+	/** Read a length-prefixed string */
+	std::string read_string();
+
+	/** Read a map of strings */
+	template <typename map_type> map_type read_map();
+};
+
+#endif // RECODEX_BROKER_SCHEDULING_TRACE_H
@@ -92,6 +92,20 @@ bool count_matcher::match(const std::string &value)
 	return my_count_ >= std::stoul(value);
 }
 
+void request::record_failure(const worker &worker)
+{
+	failed_workers.insert(worker.identity);
+
+	if (!worker.host.empty()) {
+		failed_hosts.insert(worker.host);
+	}
+}
+
+bool request::failed_on(const worker &worker) const
+{
+	return failed_workers.count(worker.identity) > 0 || (!worker.host.empty() && failed_hosts.count(worker.host) > 0);
+}
+
 worker::worker(
 	const std::string &id, const std::string &hwgroup, const std::multimap<std::string, std::string> &headers)
 	: headers_copy_(headers), identity(id), hwgroup(hwgroup), liveness(0)
@@ -140,6 +154,11 @@ std::string worker::get_description() const
 	}
 }
 
+std::size_t worker::get_capacity() const
+{
+	return slots + (prefetch ? 1 : 0);
+}
+
 bool worker::check_headers(const std::multimap<std::string, std::string> &headers)
 {
 	for (auto &header : headers) {
@@ -150,3 +169,8 @@ bool worker::check_headers(const std::multimap<std::string, std::string> &header
 
 	return true;
 }
+
+const std::multimap<std::string, std::string> &worker::get_headers() const
+{
+	return headers_copy_;
+}
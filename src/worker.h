@@ -1,12 +1,16 @@
 #ifndef RECODEX_BROKER_WORKER_H
 #define RECODEX_BROKER_WORKER_H
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <queue>
+#include <set>
 #include <vector>
 #include <string>
 
+class worker;
+
 
 /**
  * Wrapper for request data which holds actual request frames which will be sent to worker
@@ -92,16 +96,29 @@ struct request {
 	/** The data of the request. */
 	const job_request_data data;
 
+	/** Time by which the results are required (time_point::max() if there is no deadline). */
+	const std::chrono::system_clock::time_point deadline;
+
 	/** The amount of failed attempts at processing this request. */
 	std::size_t failure_count = 0;
 
+	/** Set when it is expected that the request cannot be finished before its deadline. */
+	bool deadline_at_risk = false;
+
+	/** Identities of the workers on which processing of the request failed. */
+	std::set<std::string> failed_workers;
+
+	/** Hosts of the workers on which processing of the request failed (if the workers reported them). */
+	std::set<std::string> failed_hosts;
+
 	/**
 	 * Constructor with initialization.
 	 * @param headers Request headers that specify requirements on workers.
+	 * @param metadata Job metadata (the "deadline" item holds a UNIX timestamp in seconds).
 	 * @param data Body of the request.
 	 */
 	request(const headers_t &headers, const metadata_t &metadata, const job_request_data &data)
-		: headers(headers), metadata(metadata), data(data)
+		: headers(headers), metadata(metadata), data(data), deadline(parse_deadline(metadata))
 	{
 	}
 
@@ -109,9 +126,48 @@ struct request {
 	 * A constructor for incomplete requests
 	 * @param data Body of the request.
 	 */
-	request(const job_request_data &data) : data(data)
+	request(const job_request_data &data) : data(data), deadline(std::chrono::system_clock::time_point::max())
 	{
 	}
+
+	/**
+	 * Check if the request has a deadline
+	 */
+	bool has_deadline() const
+	{
+		return deadline != std::chrono::system_clock::time_point::max();
+	}
+
+	/**
+	 * Remember that processing of the request failed on given worker
+	 * @param worker The worker
+	 */
+	void record_failure(const worker &worker);
+
+	/**
+	 * Check if processing of the request failed on given worker or on another worker on the same host
+	 * @param worker The worker
+	 */
+	bool failed_on(const worker &worker) const;
+
+private:
+	/**
+	 * Load the deadline from job metadata
+	 * @return the deadline or time_point::max() if it is missing or malformed
+	 */
+	static std::chrono::system_clock::time_point parse_deadline(const metadata_t &metadata)
+	{
+		auto it = metadata.find("deadline");
+		if (it == metadata.end()) {
+			return std::chrono::system_clock::time_point::max();
+		}
+
+		try {
+			return std::chrono::system_clock::time_point(std::chrono::seconds(std::stoll(it->second)));
+		} catch (std::exception &) {
+			return std::chrono::system_clock::time_point::max();
+		}
+	}
 };
 
 /**
@@ -167,12 +223,36 @@ public:
 	/** An optional human readable description */
 	std::string description = "";
 
+	/** An optional name of the machine the worker runs on (workers on the same host share failures) */
+	std::string host = "";
+
+	/**
+	 * An optional token that the worker keeps when it reconnects (a connection with a known token continues
+	 * the session of the previous one, including its jobs).
+	 */
+	std::string session = "";
+
 	/** A hardware group identifier. */
 	const std::string hwgroup;
 
 	/** The amount of pings the worker can miss before it's considered dead. */
 	std::size_t liveness;
 
+	/** The amount of jobs the worker can process concurrently. */
+	std::size_t slots = 1;
+
+	/**
+	 * True if the worker accepts one more job while all its slots are occupied
+	 * (the job is then started as soon as one of the slots becomes free).
+	 */
+	bool prefetch = false;
+
+	/** True if the worker confirms the receipt of each job with an "ack" message */
+	bool acks = false;
+
+	/** Set when the worker is being drained - it finishes its current jobs, but it does not get any new ones. */
+	bool draining = false;
+
 	/**
 	 * @param id Worker unique identifier.
 	 * @param hwgroup Worker handrware group identifier.
@@ -204,11 +284,24 @@ public:
 	 */
 	virtual bool check_headers(const std::multimap<std::string, std::string> &headers);
 
+	/**
+	 * Get the maximal amount of jobs that can be sent to the worker at once
+	 * (one for each slot and possibly one more that is prefetched)
+	 * @return the capacity of the worker
+	 */
+	std::size_t get_capacity() const;
+
 	/**
 	 * Get a textual description of the worker
 	 * @return textual description of the worker
 	 */
 	std::string get_description() const;
+
+	/**
+	 * Get the headers the worker was created with
+	 * @return the headers describing the worker's capabilities
+	 */
+	const std::multimap<std::string, std::string> &get_headers() const;
 };
 
 #endif // RECODEX_BROKER_WORKER_H
@@ -4,6 +4,7 @@
 
 #include "../src/queuing/multi_queue_manager.h"
 #include "../src/queuing/queue_manager_interface.h"
+#include "../src/queuing/single_queue_manager.h"
 #include "mocks.h"
 
 using namespace testing;
@@ -723,6 +724,140 @@ TEST(broker, worker_expiration_reassign_job)
 	messages.clear();
 }
 
+TEST(broker, worker_disconnected)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// There are two workers in the registry, the one with a job will disconnect
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	auto request_1 = std::make_shared<request>(
+		request::headers_t{{"env", "c"}}, request::metadata_t{{}}, job_request_data("job_id", {"whatever"}));
+	auto worker_2 = std::make_shared<worker>("identity_2", "group_1", worker_headers_t{{"env", "c"}});
+	worker_1->liveness = 100;
+	worker_2->liveness = 100;
+	workers->add_worker(worker_1);
+	workers->add_worker(worker_2);
+	queue->add_worker(worker_1, request_1);
+	queue->add_worker(worker_2);
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	// Unknown peers are ignored
+	handler.on_request(message_container(broker_connect::KEY_WORKER_EVENTS, "identity_3", {"disconnected"}), respond);
+	ASSERT_TRUE(messages.empty());
+
+	// The job is reassigned right away, without waiting for the worker to miss its pings
+	handler.on_request(message_container(broker_connect::KEY_WORKER_EVENTS, "identity_1", {"disconnected"}), respond);
+	ASSERT_THAT(messages,
+		UnorderedElementsAre(
+			message_container(
+				broker_connect::KEY_WORKERS, worker_2->identity, {"eval", request_1->data.get_job_id(), "whatever"}),
+			message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {"job_id", "ABORTED"})));
+
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_1"));
+	ASSERT_EQ(1u, request_1->failure_count);
+}
+
+TEST(broker, worker_expiration_learned_from_pings)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	EXPECT_CALL(*config, get_worker_phi_threshold()).WillRepeatedly(Return(8));
+	EXPECT_CALL(*config, get_worker_phi_min_samples()).WillRepeatedly(Return(5));
+
+	// The first worker pings regularly, the pings of the second one are jittery
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	auto worker_2 = std::make_shared<worker>("identity_2", "group_1", worker_headers_t{{"env", "c"}});
+	workers->add_worker(worker_1);
+	workers->add_worker(worker_2);
+	queue->add_worker(worker_1);
+	queue->add_worker(worker_2);
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	auto advance = [&](std::size_t time) {
+		for (std::size_t elapsed = 0; elapsed < time; elapsed += 100) {
+			handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+		}
+	};
+
+	// The first worker pings every second, the second one after 1.5 and 0.5 seconds in turns
+	for (std::size_t time = 0; time <= 20000; time += 500) {
+		if (time % 1000 == 0) {
+			handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"ping"}), respond);
+		}
+
+		if (time % 2000 == 0 || time % 2000 == 500) {
+			handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_2", {"ping"}), respond);
+		}
+
+		if (time < 20000) {
+			advance(500);
+		}
+	}
+
+	// Both workers go silent, a missed ping is not enough to expire any of them
+	advance(2000);
+	ASSERT_NE(nullptr, workers->find_worker_by_identity("identity_1"));
+	ASSERT_NE(nullptr, workers->find_worker_by_identity("identity_2"));
+
+	// The regular worker is expired well before its liveness would run out, the jittery one gets more time
+	advance(600);
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_1"));
+	ASSERT_NE(nullptr, workers->find_worker_by_identity("identity_2"));
+}
+
+TEST(broker, heartbeats_timestamped_by_clock)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	EXPECT_CALL(*config, get_worker_phi_threshold()).WillRepeatedly(Return(8));
+	EXPECT_CALL(*config, get_worker_phi_min_samples()).WillRepeatedly(Return(5));
+
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	workers->add_worker(worker_1);
+	queue->add_worker(worker_1);
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	std::chrono::milliseconds now(5000);
+	broker_handler handler(config, workers, queue, nullptr, [&now]() { return now; });
+
+	// No timer message comes between the pings (as when the timer is requested on demand)
+	for (std::size_t i = 0; i <= 10; ++i) {
+		handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"ping"}), respond);
+		now += std::chrono::milliseconds(1000);
+	}
+
+	// The intervals between the pings are known precisely, a late ping does not expire the worker right away
+	now += std::chrono::milliseconds(500);
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1500"}), respond);
+	ASSERT_NE(nullptr, workers->find_worker_by_identity("identity_1"));
+
+	now += std::chrono::milliseconds(1100);
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1100"}), respond);
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_1"));
+}
+
 TEST(broker, worker_expiration_dont_reassign_orphan_job)
 {
 	auto config = std::make_shared<NiceMock<mock_broker_config>>();
@@ -818,3 +953,1217 @@ TEST(broker, worker_expiration_cancel_job)
 
 	messages.clear();
 }
+
+TEST(broker, worker_prefetch)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	// A worker that accepts jobs in advance introduces itself
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c", "", "prefetch=1"}),
+		respond);
+
+	auto worker_1 = workers->find_worker_by_identity("identity_1");
+	ASSERT_NE(nullptr, worker_1);
+	ASSERT_TRUE(worker_1->prefetch);
+
+	// Three jobs arrive - the first two are sent to the worker immediately
+	for (std::string job_id : {"job1", "job2", "job3"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	ASSERT_THAT(messages,
+		Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job1", "1"})));
+	ASSERT_THAT(messages,
+		Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job2", "1"})));
+	ASSERT_THAT(messages,
+		Not(Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job3", "1"}))));
+
+	messages.clear();
+
+	// When the first job is done, the worker continues with the prefetched one and gets the third job in advance
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+
+	ASSERT_THAT(messages,
+		UnorderedElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job3", "1"}),
+			message_container(
+				broker_connect::KEY_STATUS_NOTIFIER, "", {"type", "job-status", "id", "job1", "status", "OK"})));
+
+	ASSERT_EQ("job2", queue->get_current_request(worker_1)->data.get_job_id());
+	ASSERT_EQ("job3", queue->get_prefetched_request(worker_1)->data.get_job_id());
+}
+
+TEST(broker, worker_invalid_slots)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	// A malformed slot count leaves the worker with a single slot
+	std::vector<std::string> counts = {"-1", "0", "18446744073709551617", "100000", "2x", ""};
+	for (std::size_t i = 0; i < counts.size(); ++i) {
+		auto identity = "identity_" + std::to_string(i);
+		handler.on_request(message_container(broker_connect::KEY_WORKERS,
+							   identity,
+							   {"init", "group_1", "env=c", "", "slots=" + counts[i]}),
+			respond);
+
+		auto worker = workers->find_worker_by_identity(identity);
+		ASSERT_NE(nullptr, worker);
+		EXPECT_EQ(1u, worker->slots) << "slots=" << counts[i];
+	}
+}
+
+TEST(broker, worker_multiple_slots)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	// A worker that runs two jobs at once introduces itself
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c", "", "slots=2"}),
+		respond);
+
+	auto worker_1 = workers->find_worker_by_identity("identity_1");
+	ASSERT_NE(nullptr, worker_1);
+	ASSERT_EQ(2u, worker_1->slots);
+
+	for (std::string job_id : {"job1", "job2", "job3"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	messages.clear();
+
+	// The second job finishes first - its slot is given to the third job
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job2", "OK"}), respond);
+
+	ASSERT_THAT(messages,
+		UnorderedElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job3", "1"}),
+			message_container(
+				broker_connect::KEY_STATUS_NOTIFIER, "", {"type", "job-status", "id", "job2", "status", "OK"})));
+
+	messages.clear();
+
+	// Both running jobs are reassigned when the worker dies
+	auto worker_2 = std::make_shared<worker>("identity_2", "group_1", worker_headers_t{{"env", "c"}});
+	worker_2->slots = 2;
+	worker_2->liveness = 100;
+	workers->add_worker(worker_2);
+	queue->add_worker(worker_2);
+	worker_1->liveness = 1;
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1100"}), respond);
+
+	ASSERT_THAT(messages,
+		UnorderedElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_2", {"eval", "job1", "1"}),
+			message_container(broker_connect::KEY_WORKERS, "identity_2", {"eval", "job3", "1"}),
+			message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {"job1", "ABORTED"}),
+			message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {"job3", "ABORTED"})));
+}
+
+TEST(broker, admission_queue_depth_limit)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	config->admission.hwgroups["group_1"].max_queue_depth = 1;
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// The first job is sent to the worker, the second one waits in the queue
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	messages.clear();
+
+	// The queue is full - the third job is rejected and the client is told to try again later
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"reject", "The queues are overloaded.", "1000"})));
+	ASSERT_EQ(1u, queue->get_queued_request_count());
+}
+
+TEST(broker, admission_wait_limit)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	config->admission.defaults.max_wait = std::chrono::milliseconds(4000);
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// The first job takes three seconds to process
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+
+	for (int i = 0; i < 3; i++) {
+		handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1000"}), respond);
+	}
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+
+	// The second job is processed right away, the third one is expected to wait for it
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job2", "env=c", "", "1"}), respond);
+
+	messages.clear();
+
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept", "3000"})));
+
+	messages.clear();
+
+	// The fourth job would wait six seconds which exceeds the limit
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job4", "env=c", "", "1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"reject", "The queues are overloaded.", "2000"})));
+}
+
+TEST(broker, runtimes_measured_by_clock)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	std::chrono::milliseconds now(5000);
+	broker_handler handler(config, workers, queue, nullptr, [&now]() { return now; });
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// The job takes 1250 ms although only a single timer message comes in the meantime
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+	now += std::chrono::milliseconds(1000);
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1000"}), respond);
+	now += std::chrono::milliseconds(250);
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+
+	// The third job is expected to wait for the second one
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job2", "env=c", "", "1"}), respond);
+
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept", "1250"})));
+}
+
+TEST(broker, deadline_statistics)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+	auto tomorrow = std::chrono::duration_cast<std::chrono::seconds>(
+		(std::chrono::system_clock::now() + std::chrono::hours(24)).time_since_epoch());
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// The first job will be done in time, the deadline of the second one has passed already
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS,
+						   client_id,
+						   {"eval", "job1", "env=c", "meta.deadline=" + std::to_string(tomorrow.count()), "", "1"}),
+		respond);
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS,
+						   client_id,
+						   {"eval", "job2", "env=c", "meta.deadline=1000", "", "1"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	for (std::string job_id : {"job1", "job2", "job3"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", job_id, "OK"}), respond);
+	}
+
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"get-runtime-stats"}), respond);
+
+	ASSERT_EQ(1u, messages.size());
+
+	std::map<std::string, std::string> stats;
+	auto &data = messages.front().data;
+	for (std::size_t i = 0; i + 1 < data.size(); i += 2) {
+		stats[data[i]] = data[i + 1];
+	}
+
+	ASSERT_EQ("1", stats["deadlines-met"]);
+	ASSERT_EQ("1", stats["deadlines-missed"]);
+	ASSERT_EQ("1", stats["deadlines-at-risk"]);
+}
+
+TEST(broker, duplicate_submission)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<spying_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// The first job is running, the second one is queued
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	messages.clear();
+
+	// Both jobs are submitted again - nothing is enqueued or sent to the worker
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept"})));
+	ASSERT_EQ(2u, queue->received_requests.size());
+	ASSERT_EQ(1u, queue->get_queued_request_count());
+
+	messages.clear();
+
+	// A finished job can be submitted again
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+
+	ASSERT_EQ(3u, queue->received_requests.size());
+}
+
+TEST(broker, eval_batch)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+
+	messages.clear();
+
+	// Every job has two data frames, the first job is already running and the last one is listed twice
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS,
+						   client_id,
+						   {"eval-batch", "env=c", "", "2", "job1", "a", "b", "job2", "c", "d", "job3", "e", "f", "job3",
+							   "e", "f"}),
+		respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"batch-result", "1111"})));
+	ASSERT_EQ(2u, queue->get_queued_request_count());
+
+	messages.clear();
+
+	// The jobs are sent with their own data frames
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+
+	ASSERT_THAT(messages,
+		Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job2", "c", "d"})));
+
+	messages.clear();
+
+	// Nobody can process these jobs
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS,
+						   client_id,
+						   {"eval-batch", "env=java", "", "0", "job4", "job5"}),
+		respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {"job4", "FAILED"}),
+			message_container(broker_connect::KEY_MONITOR, broker_connect::MONITOR_IDENTITY, {"job5", "FAILED"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"batch-result", "00"})));
+}
+
+TEST(broker, tagged_client_requests)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+	messages.clear();
+
+	// The replies to the client carry the id of the request, the worker gets the job as usual
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS,
+						   client_id,
+						   {broker_connect::REQUEST_ID, "7", "eval", "job1", "env=c", "", "1"}),
+		respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {broker_connect::REQUEST_ID, "7", "ack"}),
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job1", "1"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {broker_connect::REQUEST_ID, "7", "accept"})));
+}
+
+TEST(broker, cancel)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	for (std::string job_id : {"job1", "job2", "job3"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	messages.clear();
+
+	// A queued job is just removed
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"cancel", "job2"}), respond);
+
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"})));
+	ASSERT_EQ(1u, queue->get_queued_request_count());
+
+	messages.clear();
+
+	// A running job is aborted and the worker gets the next one
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"cancel", "job1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"cancel", "job1"}),
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job3", "1"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"})));
+
+	messages.clear();
+
+	// An unknown job cannot be cancelled
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"cancel", "job1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"reject", "No such job."})));
+
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"get-runtime-stats"}), respond);
+
+	ASSERT_EQ(1u, messages.size());
+	auto &data = messages.front().data;
+	auto it = std::find(data.begin(), data.end(), "cancelled-jobs");
+	ASSERT_NE(data.end(), it);
+	ASSERT_EQ("2", *std::next(it));
+}
+
+TEST(broker, hedging_straggling_job)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	ON_CALL(*config, get_hedging_runtime_multiple()).WillByDefault(Return(2));
+	ON_CALL(*config, get_hedging_min_samples()).WillByDefault(Return(2));
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// Jobs usually take half a second
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+		handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"500"}), respond);
+		handler.on_request(
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", job_id, "OK"}), respond);
+	}
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	auto slow_worker = queue->find_request("job3").worker;
+	ASSERT_NE(nullptr, slow_worker);
+	std::string fast_identity = slow_worker->identity == "identity_1" ? "identity_2" : "identity_1";
+
+	messages.clear();
+
+	// The job is not straggling yet
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"600"}), respond);
+	ASSERT_THAT(messages,
+		Not(Contains(message_container(broker_connect::KEY_WORKERS, fast_identity, {"eval", "job3", "1"}))));
+
+	// Now it is - a duplicate is sent to the idle worker
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"600"}), respond);
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, fast_identity, {"eval", "job3", "1"})));
+
+	messages.clear();
+
+	// The duplicate finishes first, the original is cancelled
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, fast_identity, {"done", "job3", "OK"}), respond);
+
+	ASSERT_THAT(messages,
+		UnorderedElementsAre(message_container(broker_connect::KEY_WORKERS, slow_worker->identity, {"cancel", "job3"}),
+			message_container(
+				broker_connect::KEY_STATUS_NOTIFIER, "", {"type", "job-status", "id", "job3", "status", "OK"})));
+	ASSERT_EQ(nullptr, queue->find_request("job3").request);
+	ASSERT_EQ(nullptr, queue->get_current_request(slow_worker));
+
+	messages.clear();
+
+	// A late result of the original is ignored
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, slow_worker->identity, {"done", "job3", "OK"}), respond);
+	ASSERT_TRUE(messages.empty());
+}
+
+TEST(broker, hedging_original_worker_lost)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	ON_CALL(*config, get_hedging_runtime_multiple()).WillByDefault(Return(2));
+	ON_CALL(*config, get_hedging_min_samples()).WillByDefault(Return(2));
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+
+	// Jobs usually take half a second
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+		handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"500"}), respond);
+		handler.on_request(
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", job_id, "OK"}), respond);
+	}
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	auto slow_identity = queue->find_request("job3").worker->identity;
+	auto fast_worker = workers->find_worker_by_identity(slow_identity == "identity_1" ? "identity_2" : "identity_1");
+
+	// The job straggles and a duplicate is sent to the idle worker
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1200"}), respond);
+	ASSERT_THAT(messages,
+		Contains(message_container(broker_connect::KEY_WORKERS, fast_worker->identity, {"eval", "job3", "1"})));
+
+	// The worker with the original copy disconnects, the duplicate is now the copy of the job
+	handler.on_request(message_container(broker_connect::KEY_WORKER_EVENTS, slow_identity, {"disconnected"}), respond);
+	ASSERT_EQ(fast_worker, queue->find_request("job3").worker);
+
+	// The job is still known, so it is not started again
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept"})));
+
+	// And it can be cancelled
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"cancel", "job3"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_WORKERS, fast_worker->identity, {"cancel", "job3"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"})));
+	ASSERT_EQ(nullptr, queue->find_request("job3").request);
+}
+
+TEST(broker, quarantine_failing_worker)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	config->quarantine.error_threshold = 0.5;
+	config->quarantine.window = 4;
+	config->quarantine.min_samples = 2;
+	config->quarantine.duration = std::chrono::milliseconds(1000);
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+	auto is_error = [](const message_container &msg) {
+		return msg.key == broker_connect::KEY_STATUS_NOTIFIER && msg.data.size() == 4 && msg.data[1] == "error";
+	};
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c", "", "slots=2"}),
+		respond);
+	auto broken_worker = workers->find_worker_by_identity("identity_1");
+
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+
+	// A single error is not enough, the job is reassigned to the same worker
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "INTERNAL_ERROR", "oops"}),
+		respond);
+	ASSERT_EQ(broken_worker, queue->find_request("job1").worker);
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c"}), respond);
+	messages.clear();
+
+	// The second error quarantines the worker and the job goes elsewhere
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "INTERNAL_ERROR", "oops"}),
+		respond);
+
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_2", {"eval", "job1", "1"})));
+	ASSERT_EQ(2, std::count_if(messages.begin(), messages.end(), is_error)); // the worker and its hwgroup
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_1"));
+
+	// The quarantined worker is kept alive, but it does not get any jobs
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"ping"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"pong"})));
+
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job2", "env=c", "", "1"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job2").worker);
+
+	// After the quarantine, the worker gets a single probe job
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1001"}), respond);
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job2", "1"})));
+	ASSERT_EQ(1u, broken_worker->slots);
+
+	for (std::string job_id : {"job3", "job4"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+		ASSERT_EQ(nullptr, queue->find_request(job_id).worker);
+	}
+
+	// The probe passed, all the slots of the worker are used again
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job2", "OK"}), respond);
+	ASSERT_EQ(2u, broken_worker->slots);
+	ASSERT_EQ(broken_worker, queue->find_request("job3").worker);
+	ASSERT_EQ(broken_worker, queue->find_request("job4").worker);
+}
+
+TEST(broker, retry_failed_job_with_backoff)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	ON_CALL(*config, get_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(100)));
+	ON_CALL(*config, get_max_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(150)));
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+	auto internal_error = [](const std::string &identity, const std::string &job_id) {
+		return message_container(broker_connect::KEY_WORKERS, identity, {"done", job_id, "INTERNAL_ERROR", "oops"});
+	};
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c", "", "host=host_1"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c", "", "host=host_2"}),
+		respond);
+	ASSERT_EQ("host_1", workers->find_worker_by_identity("identity_1")->host);
+
+	// The failed job is not retried right away
+	messages.clear();
+	handler.on_request(internal_error("identity_1", "job1"), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"99"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+
+	// After the backoff, the job goes to the worker on which it has not failed yet
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1"}), respond);
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_2", {"eval", "job1", "1"})));
+
+	// The delay doubles with every failure (up to the limit)
+	messages.clear();
+	handler.on_request(internal_error("identity_2", "job1"), respond);
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"149"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+
+	// The job failed on both workers, so any of them can take it
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1"}), respond);
+	auto retry_worker = queue->find_request("job1").worker;
+	ASSERT_NE(nullptr, retry_worker);
+
+	// A job waiting for its retry can be cancelled
+	messages.clear();
+	handler.on_request(internal_error(retry_worker->identity, "job1"), respond);
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"cancel", "job1"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"})));
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1000"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+}
+
+TEST(broker, resubmit_job_waiting_for_retry)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	ON_CALL(*config, get_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(100)));
+	ON_CALL(*config, get_max_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(100)));
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "INTERNAL_ERROR", "oops"}),
+		respond);
+
+	// The job waits for its retry, so submitting it again does not start another copy
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"accept"})));
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval-batch", "env=c", "", "1", "job1", "2"}),
+		respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"batch-result", "1"})));
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+
+	// After the backoff, the job is retried exactly once
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_THAT(messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job1", "1"})));
+	ASSERT_EQ(0u, queue->get_queued_request_count());
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job1").request);
+	ASSERT_EQ(0u, queue->get_queued_request_count());
+}
+
+TEST(broker, timer_requested_on_demand)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	ON_CALL(*config, get_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(100)));
+	ON_CALL(*config, get_max_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(100)));
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::vector<std::chrono::milliseconds> requests;
+	handler.set_timer_request_callback([&requests](std::chrono::milliseconds delay) { requests.push_back(delay); });
+
+	// Nothing can time out in an empty broker
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_foo", {"get-runtime-stats"}), respond);
+	ASSERT_TRUE(requests.empty());
+	ASSERT_EQ(-1, handler.get_timer_delay().count());
+
+	// The liveness of a worker decreases once it misses a ping
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}),
+		respond);
+	ASSERT_THAT(requests, ElementsAre(std::chrono::milliseconds(1001)));
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"400"}), respond);
+	ASSERT_EQ(std::chrono::milliseconds(601), requests.back());
+
+	// A failed job waits for its retry
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job1", "env=c", "", "1"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "INTERNAL_ERROR", "oops"}),
+		respond);
+	ASSERT_EQ(std::chrono::milliseconds(100), requests.back());
+
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_THAT(messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job1", "1"})));
+
+	// The worker reported the failure 100 ms ago
+	ASSERT_EQ(std::chrono::milliseconds(901), requests.back());
+
+	// A queued job does not need the timer unless it is held back for a particular worker
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job2", "env=c", "", "1"}), respond);
+	ASSERT_EQ(1u, queue->get_queued_request_count());
+	ASSERT_EQ(std::chrono::milliseconds(901), requests.back());
+}
+
+TEST(broker, drain_worker)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_1",
+						   {"init", "group_1", "env=c", "", "description=old_worker"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c"}), respond);
+
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"drain", "description", "no_such_worker"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"reject", "No such worker."})));
+
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"drain", "description", "old_worker"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_CLIENTS, client_id, {"ack", "1"})));
+
+	// New jobs go to the other worker or wait for it
+	for (std::string job_id : {"job2", "job3"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	ASSERT_EQ("identity_2", queue->find_request("job2").worker->identity);
+	ASSERT_EQ(nullptr, queue->find_request("job3").worker);
+
+	// The draining worker finishes its job, but it does not get another one
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job3").worker);
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"10"}), respond);
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"get-runtime-stats"}), respond);
+
+	auto &data = messages.back().data;
+	auto it = std::find(data.begin(), data.end(), "drained-workers");
+	ASSERT_NE(data.end(), it);
+	ASSERT_EQ("1", *std::next(it));
+
+	// After an undrain, the worker gets the queued job
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"undrain", "identity", "identity_1"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job3", "1"}),
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"ack", "1"})));
+}
+
+TEST(broker, worker_reconnect_with_known_job)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	broker_handler handler(config, workers, queue, nullptr);
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client", {"eval", "job1", "env=c", "", "1", "2"}), respond);
+
+	auto worker_1 = workers->find_worker_by_identity("identity_1");
+	ASSERT_EQ("job1", queue->get_current_request(worker_1)->data.get_job_id());
+	messages.clear();
+
+	// The same worker comes back with another identity (e.g. after a broker failover) and reports the job
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_2",
+						   {"init", "group_1", "env=c", "", "current_job=job1"}),
+		respond);
+
+	auto worker_2 = workers->find_worker_by_identity("identity_2");
+
+	// The job is not sent again and the original request is kept
+	ASSERT_TRUE(messages.empty());
+	ASSERT_EQ(nullptr, queue->get_current_request(worker_1));
+	ASSERT_NE(nullptr, queue->get_current_request(worker_2));
+	ASSERT_TRUE(queue->get_current_request(worker_2)->data.is_complete());
+	ASSERT_EQ(worker_2, queue->find_request("job1").worker);
+}
+
+TEST(broker, worker_reconnect_with_session)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	broker_handler handler(config, workers, queue, nullptr);
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_1",
+						   {"init", "group_1", "env=c", "", "session=session_1", "prefetch=1"}),
+		respond);
+
+	// The worker runs the first job and has prefetched the second one
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, "client", {"eval", job_id, "env=c", "", "1"}), respond);
+	}
+
+	auto worker_1 = workers->find_worker_by_identity("identity_1");
+	ASSERT_EQ("job2", queue->get_prefetched_request(worker_1)->data.get_job_id());
+	messages.clear();
+
+	// The connection drops and the worker comes back with another identity in the same session
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_2",
+						   {"init", "group_1", "env=c", "", "session=session_1", "prefetch=1"}),
+		respond);
+
+	// Both jobs are moved to the new connection with their payload, nothing is sent again
+	auto worker_2 = workers->find_worker_by_identity("identity_2");
+	ASSERT_TRUE(messages.empty());
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_1"));
+	ASSERT_EQ(1u, workers->get_workers().size());
+	ASSERT_EQ(2u, queue->get_current_requests(worker_2).size());
+	ASSERT_EQ("job1", queue->get_current_request(worker_2)->data.get_job_id());
+	ASSERT_TRUE(queue->get_current_request(worker_2)->data.is_complete());
+	ASSERT_EQ("job2", queue->get_prefetched_request(worker_2)->data.get_job_id());
+	ASSERT_EQ(worker_2, queue->find_request("job1").worker);
+
+	// The old connection closes, which does not affect the jobs
+	handler.on_request(message_container(broker_connect::KEY_WORKER_EVENTS, "identity_1", {"disconnected"}), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_2", {"done", "job1", "OK"}), respond);
+	ASSERT_EQ("job2", queue->get_current_request(worker_2)->data.get_job_id());
+	ASSERT_EQ(0u, queue->get_current_request(worker_2)->failure_count);
+
+	// A worker restarted with another configuration does not keep the jobs
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_3",
+						   {"init", "group_1", "env=python", "", "session=session_1"}),
+		respond);
+
+	ASSERT_EQ(nullptr, workers->find_worker_by_identity("identity_2"));
+	ASSERT_NE(nullptr, workers->find_worker_by_identity("identity_3"));
+	ASSERT_EQ(nullptr, queue->find_request("job2").worker);
+}
+
+TEST(broker, worker_reconnect_with_session_hedged)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	ON_CALL(*config, get_hedging_runtime_multiple()).WillByDefault(Return(2));
+	ON_CALL(*config, get_hedging_min_samples()).WillByDefault(Return(2));
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_1",
+						   {"init", "group_1", "env=c", "", "session=session_1"}),
+		respond);
+
+	// Jobs usually take half a second
+	for (std::string job_id : {"job1", "job2"}) {
+		handler.on_request(
+			message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", job_id, "env=c", "", "1"}), respond);
+		handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"500"}), respond);
+		handler.on_request(
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", job_id, "OK"}), respond);
+	}
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_2",
+						   {"init", "group_1", "env=c", "", "session=session_2"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job3", "env=c", "", "1"}), respond);
+
+	auto slow_worker = queue->find_request("job3").worker;
+	std::string fast_identity = slow_worker->identity == "identity_1" ? "identity_2" : "identity_1";
+	std::string fast_session = slow_worker->identity == "identity_1" ? "session_2" : "session_1";
+
+	// The job straggles and a duplicate is sent to the idle worker
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1200"}), respond);
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, fast_identity, {"eval", "job3", "1"})));
+
+	// The worker with the duplicate reconnects, the job is still indexed at the original copy
+	handler.on_request(message_container(broker_connect::KEY_WORKERS,
+						   "identity_3",
+						   {"init", "group_1", "env=c", "", "session=" + fast_session}),
+		respond);
+
+	auto resumed_worker = workers->find_worker_by_identity("identity_3");
+	ASSERT_NE(nullptr, resumed_worker);
+	ASSERT_EQ(1u, queue->get_current_requests(resumed_worker).size());
+	ASSERT_EQ(slow_worker, queue->find_request("job3").worker);
+
+	// The original finishes first, the duplicate is cancelled on the new connection
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, slow_worker->identity, {"done", "job3", "OK"}), respond);
+	ASSERT_THAT(messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_3", {"cancel", "job3"})));
+	ASSERT_EQ(nullptr, queue->find_request("job3").request);
+	ASSERT_TRUE(queue->get_current_requests(resumed_worker).empty());
+}
+
+TEST(broker, dispatch_ack_and_redelivery)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<single_queue_manager<>>();
+
+	// Dummy response callback
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	// The test code
+	broker_handler handler(config, workers, queue, nullptr);
+
+	std::string client_id = "client_foo";
+	auto timeout = config->get_worker_ack_timeout();
+	auto timer = [](std::chrono::milliseconds time) {
+		return message_container(broker_connect::KEY_TIMER, "", {std::to_string(time.count())});
+	};
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c", "", "ack=1"}),
+		respond);
+	ASSERT_TRUE(workers->find_worker_by_identity("identity_1")->acks);
+
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job1", "env=c", "", "1"}), respond);
+
+	// An unconfirmed job is sent again
+	messages.clear();
+	handler.on_request(timer(timeout - std::chrono::milliseconds(1)), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(timer(std::chrono::milliseconds(1)), respond);
+	ASSERT_THAT(
+		messages, ElementsAre(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job1", "1"})));
+
+	// A confirmed job is not sent again
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"ack", "job1"}), respond);
+	handler.on_request(timer(timeout * 2), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job1", "OK"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, client_id, {"eval", "job2", "env=c", "", "1"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_2", {"init", "group_1", "env=c", "", "ack=1"}),
+		respond);
+	ASSERT_EQ("identity_1", queue->find_request("job2").worker->identity);
+
+	// A job that is never confirmed is taken from the worker after the last redelivery
+	for (std::size_t i = 0; i < config->get_max_job_redeliveries(); ++i) {
+		handler.on_request(timer(timeout), respond);
+		handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_2", {"ping"}), respond);
+	}
+
+	messages.clear();
+	handler.on_request(timer(timeout), respond);
+	ASSERT_THAT(messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"cancel", "job2"})));
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_2", {"eval", "job2", "1"})));
+	ASSERT_EQ("identity_2", queue->find_request("job2").worker->identity);
+
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, client_id, {"get-runtime-stats"}), respond);
+
+	auto &data = messages.back().data;
+	auto it = std::find(data.begin(), data.end(), "redelivered-jobs");
+	ASSERT_NE(data.end(), it);
+	ASSERT_EQ(std::to_string(1 + config->get_max_job_redeliveries()), *std::next(it));
+
+	it = std::find(data.begin(), data.end(), "unacknowledged-jobs");
+	ASSERT_NE(data.end(), it);
+	ASSERT_EQ("1", *std::next(it));
+}
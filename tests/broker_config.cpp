@@ -15,6 +15,12 @@ TEST(broker_config, config_basic)
 						   "    max_liveness: 10\n"
 						   "    max_request_failures: 10\n"
 						   "    ping_interval: 1234\n"
+						   "    retry_backoff: 200\n"
+						   "    max_retry_backoff: 5000\n"
+						   "    ack_timeout: 300\n"
+						   "    max_redeliveries: 4\n"
+						   "    phi_threshold: 5.5\n"
+						   "    phi_min_samples: 20\n"
 						   "monitor:\n"
 						   "    address: 77.75.76.3\n"
 						   "    port: 5454\n"
@@ -40,6 +46,12 @@ TEST(broker_config, config_basic)
 	ASSERT_EQ(10u, config.get_max_worker_liveness());
 	ASSERT_EQ(10u, config.get_max_request_failures());
 	ASSERT_EQ(1234, config.get_worker_ping_interval().count());
+	ASSERT_EQ(200, config.get_retry_backoff().count());
+	ASSERT_EQ(5000, config.get_max_retry_backoff().count());
+	ASSERT_EQ(300, config.get_worker_ack_timeout().count());
+	ASSERT_EQ(4u, config.get_max_job_redeliveries());
+	ASSERT_EQ(5.5, config.get_worker_phi_threshold());
+	ASSERT_EQ(20u, config.get_worker_phi_min_samples());
 	ASSERT_EQ("77.75.76.3", config.get_monitor_address());
 	ASSERT_EQ(5454, config.get_monitor_port());
 	ASSERT_EQ(expected_log, config.get_log_config());
@@ -67,3 +79,157 @@ TEST(broker_config, invalid_document)
 
 	ASSERT_THROW(broker_config config(yaml), config_error);
 }
+
+TEST(broker_config, admission)
+{
+	auto yaml = YAML::Load("admission:\n"
+						   "    max_queue_depth: 100\n"
+						   "    max_wait: 60000\n"
+						   "    hwgroups:\n"
+						   "        group_1:\n"
+						   "            max_queue_depth: 10\n"
+						   "        group_2:\n"
+						   "            max_wait: 1000\n");
+
+	broker_config config(yaml);
+	const auto &admission = config.get_admission_config();
+
+	ASSERT_EQ(100u, admission.get_limits("group_3").max_queue_depth);
+	ASSERT_EQ(60000, admission.get_limits("group_3").max_wait.count());
+	ASSERT_EQ(10u, admission.get_limits("group_1").max_queue_depth);
+	ASSERT_EQ(60000, admission.get_limits("group_1").max_wait.count());
+	ASSERT_EQ(100u, admission.get_limits("group_2").max_queue_depth);
+	ASSERT_EQ(1000, admission.get_limits("group_2").max_wait.count());
+}
+
+TEST(broker_config, admission_unlimited_by_default)
+{
+	auto yaml = YAML::Load("clients:\n"
+						   "    port: 1234\n");
+
+	broker_config config(yaml);
+
+	ASSERT_EQ(0u, config.get_admission_config().get_limits("group_1").max_queue_depth);
+	ASSERT_EQ(0, config.get_admission_config().get_limits("group_1").max_wait.count());
+}
+
+TEST(broker_config, quarantine)
+{
+	auto yaml = YAML::Load("quarantine:\n"
+						   "    error_threshold: 0.5\n"
+						   "    window: 10\n"
+						   "    min_samples: 3\n"
+						   "    duration: 30000\n");
+
+	broker_config config(yaml);
+	auto &quarantine = config.get_quarantine_config();
+
+	ASSERT_DOUBLE_EQ(0.5, quarantine.error_threshold);
+	ASSERT_EQ(10u, quarantine.window);
+	ASSERT_EQ(3u, quarantine.min_samples);
+	ASSERT_EQ(std::chrono::milliseconds(30000), quarantine.duration);
+	ASSERT_DOUBLE_EQ(0, broker_config().get_quarantine_config().error_threshold);
+}
+
+TEST(broker_config, hedging)
+{
+	auto yaml = YAML::Load("hedging:\n"
+						   "    runtime_multiple: 2.5\n"
+						   "    min_samples: 50\n");
+
+	broker_config config(yaml);
+
+	ASSERT_DOUBLE_EQ(2.5, config.get_hedging_runtime_multiple());
+	ASSERT_EQ(50u, config.get_hedging_min_samples());
+	ASSERT_DOUBLE_EQ(0, broker_config().get_hedging_runtime_multiple());
+}
+
+TEST(broker_config, trace_file)
+{
+	auto yaml = YAML::Load("trace_file: /tmp/trace.bin\n");
+
+	ASSERT_EQ("/tmp/trace.bin", broker_config(yaml).get_trace_file());
+	ASSERT_EQ("", broker_config().get_trace_file());
+}
+
+TEST(broker_config, affinity)
+{
+	auto yaml = YAML::Load("affinity:\n"
+						   "    metadata_key: assignment\n"
+						   "    cache_size: 8\n"
+						   "    max_wait: 500\n");
+
+	broker_config config(yaml);
+
+	ASSERT_EQ("assignment", config.get_affinity_metadata_key());
+	ASSERT_EQ(8u, config.get_affinity_cache_size());
+	ASSERT_EQ(std::chrono::milliseconds(500), config.get_affinity_max_wait());
+	ASSERT_EQ("exercise", broker_config().get_affinity_metadata_key());
+}
+
+TEST(broker_config, replication)
+{
+	auto yaml = YAML::Load("replication:\n"
+						   "    role: standby\n"
+						   "    address: 127.0.0.2\n"
+						   "    port: 9000\n"
+						   "    heartbeat_interval: 200\n"
+						   "    takeover_timeout: 1000\n"
+						   "    ack_timeout: 300\n");
+
+	broker_config config(yaml);
+	auto &replication = config.get_replication_config();
+
+	ASSERT_EQ("standby", replication.role);
+	ASSERT_EQ("127.0.0.2", replication.address);
+	ASSERT_EQ(9000, replication.port);
+	ASSERT_EQ(std::chrono::milliseconds(200), replication.heartbeat_interval);
+	ASSERT_EQ(std::chrono::milliseconds(1000), replication.takeover_timeout);
+	ASSERT_EQ(std::chrono::milliseconds(300), replication.ack_timeout);
+	ASSERT_EQ("", broker_config().get_replication_config().role);
+}
+
+TEST(broker_config, invalid_replication_role)
+{
+	auto yaml = YAML::Load("replication:\n"
+						   "    role: secondary\n");
+
+	ASSERT_THROW(broker_config config(yaml), config_error);
+}
+
+TEST(broker_config, dispatcher)
+{
+	auto yaml = YAML::Load("dispatcher:\n"
+						   "    timeout: 2000\n"
+						   "    backends:\n"
+						   "        - address: 10.0.0.1\n"
+						   "          port: 9660\n"
+						   "          hwgroups: [group_1, group_2]\n"
+						   "        - port: 9661\n");
+
+	broker_config config(yaml);
+	auto &dispatcher = config.get_dispatcher_config();
+
+	ASSERT_EQ(std::chrono::milliseconds(2000), dispatcher.timeout);
+	ASSERT_EQ(2u, dispatcher.backends.size());
+	ASSERT_EQ("10.0.0.1", dispatcher.backends[0].address);
+	ASSERT_EQ(9660, dispatcher.backends[0].port);
+	ASSERT_EQ((std::vector<std::string>{"group_1", "group_2"}), dispatcher.backends[0].hwgroups);
+	ASSERT_EQ("127.0.0.1", dispatcher.backends[1].address);
+	ASSERT_TRUE(dispatcher.backends[1].hwgroups.empty());
+	ASSERT_TRUE(broker_config().get_dispatcher_config().backends.empty());
+}
+
+TEST(broker_config, reactor_backend)
+{
+	ASSERT_EQ("poll", broker_config().get_reactor_backend());
+	ASSERT_EQ("epoll", broker_config(YAML::Load("reactor_backend: epoll")).get_reactor_backend());
+	ASSERT_THROW(broker_config(YAML::Load("reactor_backend: select")), config_error);
+}
+
+TEST(broker_config, notifier_concurrency)
+{
+	ASSERT_EQ(1u, broker_config().get_notifier_config().concurrency);
+	ASSERT_EQ(4u, broker_config(YAML::Load("notifier:\n    concurrency: 4")).get_notifier_config().concurrency);
+	ASSERT_EQ(1u, broker_config(YAML::Load("notifier:\n    concurrency: 0")).get_notifier_config().concurrency);
+}
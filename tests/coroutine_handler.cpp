@@ -0,0 +1,236 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../src/reactor/coroutine_handler.h"
+#include "../src/reactor/reactor.h"
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+	/**
+	 * A coroutine handler whose coroutine is given by the test
+	 */
+	class pluggable_coroutine_handler : public coroutine_handler
+	{
+	public:
+		using fnc_t = std::function<task(pluggable_coroutine_handler &, message_container)>;
+
+		pluggable_coroutine_handler(fnc_t fnc) : fnc_(fnc)
+		{
+		}
+
+		using coroutine_handler::readable;
+		using coroutine_handler::request;
+		using coroutine_handler::send;
+		using coroutine_handler::sleep_for;
+		using coroutine_handler::sleep_until;
+
+	protected:
+		task handle(message_container message) override
+		{
+			return fnc_(*this, std::move(message));
+		}
+
+	private:
+		fnc_t fnc_;
+	};
+
+	message_container timer(std::size_t elapsed)
+	{
+		return message_container(reactor::KEY_TIMER, "", {std::to_string(elapsed)});
+	}
+} // namespace
+
+TEST(coroutine_handler, sleep)
+{
+	pluggable_coroutine_handler handler(
+		[](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			self.send(message_container("out", "", {"start", message.data.at(0)}));
+			co_await self.sleep_for(100ms);
+			self.send(message_container("out", "", {"done", message.data.at(0)}));
+			co_await self.sleep_until(150ms);
+			co_await self.sleep_until(100ms);
+			self.send(message_container("out", "", {"woken", message.data.at(0)}));
+		});
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container("in", "", {"1"}), respond);
+	handler.on_request(timer(50), respond);
+	handler.on_request(message_container("in", "", {"2"}), respond);
+	ASSERT_EQ(2u, handler.get_waiting_count());
+
+	handler.on_request(timer(60), respond);
+	handler.on_request(timer(60), respond);
+
+	// Both coroutines wait until 150ms then, they are resumed in the order they started waiting
+	// and a sleep that has already ended does not suspend them
+	ASSERT_THAT(messages,
+		ElementsAre(message_container("out", "", {"start", "1"}),
+			message_container("out", "", {"start", "2"}),
+			message_container("out", "", {"done", "1"}),
+			message_container("out", "", {"done", "2"}),
+			message_container("out", "", {"woken", "2"}),
+			message_container("out", "", {"woken", "1"})));
+	ASSERT_EQ(0u, handler.get_waiting_count());
+}
+
+TEST(coroutine_handler, request_and_reply)
+{
+	pluggable_coroutine_handler handler(
+		[](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			message_container query("backend", "", {"query", message.data.at(0)});
+			auto reply = co_await self.request(query, 100ms);
+			if (reply) {
+				self.send(message_container("client", message.identity, reply->data));
+			} else {
+				self.send(message_container("client", message.identity, {"timeout"}));
+			}
+		});
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container("client", "client_1", {"a"}), respond);
+	handler.on_request(message_container("client", "client_2", {"b"}), respond);
+	handler.on_request(message_container("client", "client_3", {"c"}), respond);
+	ASSERT_EQ(3u, handler.get_waiting_count());
+
+	// The replies are matched with the requests in order, the last one times out
+	handler.on_request(message_container("backend", "", {"reply", "a"}), respond);
+	handler.on_request(message_container("backend", "", {"reply", "b"}), respond);
+	handler.on_request(timer(150), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container("backend", "", {"query", "a"}),
+			message_container("backend", "", {"query", "b"}),
+			message_container("backend", "", {"query", "c"}),
+			message_container("client", "client_1", {"reply", "a"}),
+			message_container("client", "client_2", {"reply", "b"}),
+			message_container("client", "client_3", {"timeout"})));
+	ASSERT_EQ(0u, handler.get_waiting_count());
+
+	// A message nobody waits for starts a new coroutine
+	messages.clear();
+	handler.on_request(message_container("backend", "", {"reply", "c"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container("backend", "", {"query", "reply"})));
+}
+
+TEST(coroutine_handler, immediate_reply)
+{
+	pluggable_coroutine_handler *handler_ptr = nullptr;
+	std::vector<message_container> messages;
+
+	// The reply is delivered while the request is being sent
+	handler_interface::response_cb respond;
+	respond = [&](const message_container &msg) {
+		messages.push_back(msg);
+		if (msg.key == "backend") {
+			handler_ptr->on_request(message_container("backend", "", {"pong"}), respond);
+		}
+	};
+
+	pluggable_coroutine_handler handler(
+		[](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			message_container ping("backend", "", {"ping"});
+			auto reply = co_await self.request(ping);
+			self.send(message_container("client", "", reply->data));
+		});
+	handler_ptr = &handler;
+
+	handler.on_request(message_container("client", "", {"go"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container("backend", "", {"ping"}), message_container("client", "", {"pong"})));
+	ASSERT_EQ(0u, handler.get_waiting_count());
+}
+
+TEST(coroutine_handler, destroyed_while_waiting)
+{
+	auto destroyed = std::make_shared<std::size_t>(0);
+	auto handler = std::make_unique<pluggable_coroutine_handler>(
+		[destroyed](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			std::shared_ptr<void> guard(nullptr, [destroyed](void *) { ++*destroyed; });
+			co_await self.readable("fd", 1000ms);
+		});
+
+	handler_interface::response_cb respond = [](const message_container &msg) {};
+
+	handler->on_request(message_container("in", "", {}), respond);
+	handler->on_request(message_container("in", "", {}), respond);
+	ASSERT_EQ(2u, handler->get_waiting_count());
+	ASSERT_EQ(0u, *destroyed);
+
+	handler = nullptr;
+	ASSERT_EQ(2u, *destroyed);
+}
+
+TEST(coroutine_handler, exception)
+{
+	pluggable_coroutine_handler handler(
+		[](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			co_await self.sleep_for(10ms);
+			throw std::runtime_error("failure");
+		});
+
+	handler_interface::response_cb respond = [](const message_container &msg) {};
+
+	handler.on_request(message_container("in", "", {}), respond);
+	ASSERT_NO_THROW(handler.on_request(timer(10), respond));
+	ASSERT_EQ(0u, handler.get_waiting_count());
+}
+
+TEST(coroutine_handler, readable_file_descriptor)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context);
+
+	int fds[2];
+	ASSERT_EQ(0, pipe(fds));
+	ASSERT_EQ(0, fcntl(fds[0], F_SETFL, O_NONBLOCK));
+
+	int input = fds[0];
+	std::vector<std::string> read;
+	auto handler = std::make_shared<pluggable_coroutine_handler>(
+		[&read, &r, input](pluggable_coroutine_handler &self, message_container message) -> coroutine_handler::task {
+			// Each coroutine reads a single line
+			std::string line;
+			while (line.empty() || line.back() != '\n') {
+				char buffer;
+				if (::read(input, &buffer, 1) != 1) {
+					co_await self.readable("pipe");
+					continue;
+				}
+
+				line.push_back(buffer);
+			}
+
+			read.push_back(line);
+			if (read.size() == 2) {
+				r.terminate();
+			}
+		});
+
+	r.add_fd("pipe", fds[0]);
+	r.add_handler({"pipe", r.KEY_TIMER}, handler);
+
+	std::thread thread([&r]() { r.start_loop(); });
+
+	// The first coroutine has to wait for the rest of its line
+	ASSERT_EQ(3, write(fds[1], "fir", 3));
+	std::this_thread::sleep_for(100ms);
+	ASSERT_EQ(1u, handler->get_waiting_count());
+	ASSERT_EQ(10, write(fds[1], "st\nsecond\n", 10));
+
+	thread.join();
+	close(fds[0]);
+	close(fds[1]);
+
+	ASSERT_THAT(read, ElementsAre("first\n", "second\n"));
+}
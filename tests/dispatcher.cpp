@@ -0,0 +1,248 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "../src/broker_connect.h"
+#include "../src/handlers/dispatcher_handler.h"
+
+using namespace testing;
+
+namespace
+{
+	dispatcher_config create_config()
+	{
+		dispatcher_config config;
+		config.backends.push_back(dispatcher_backend{"127.0.0.1", 9660, {"group_1"}});
+		config.backends.push_back(dispatcher_backend{"127.0.0.1", 9661, {"group_2", "group_3"}});
+		return config;
+	}
+
+	message_container eval(const std::string &client, const std::string &job_id, const std::string &hwgroup)
+	{
+		return message_container(broker_connect::KEY_CLIENTS, client, {"eval", job_id, "hwgroup=" + hwgroup, "", "1"});
+	}
+
+	/**
+	 * A message exchanged with a back-end, tagged with the id of the request
+	 */
+	message_container tagged(std::size_t backend, std::size_t request_id, std::vector<std::string> data)
+	{
+		data.insert(data.begin(), {broker_connect::REQUEST_ID, std::to_string(request_id)});
+		return message_container(dispatcher_handler::backend_key(backend), "", data);
+	}
+} // namespace
+
+TEST(dispatcher, routing_by_hwgroup)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(eval("client_1", "job_1", "group_1"), respond);
+	handler.on_request(eval("client_1", "job_2", "group_4|group_3"), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"}),
+			tagged(0, 1, {"eval", "job_1", "hwgroup=group_1", "", "1"}),
+			message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"}),
+			tagged(1, 2, {"eval", "job_2", "hwgroup=group_4|group_3", "", "1"})));
+}
+
+TEST(dispatcher, unknown_hwgroup)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(eval("client_1", "job_1", "group_4"), respond);
+
+	ASSERT_EQ(2u, messages.size());
+	ASSERT_EQ(message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"}), messages[0]);
+	ASSERT_EQ(broker_connect::KEY_CLIENTS, messages[1].key);
+	ASSERT_EQ("reject", messages[1].data.at(0));
+	messages.clear();
+
+	// A back-end without hardware groups takes the jobs nobody else serves
+	auto config = create_config();
+	config.backends.push_back(dispatcher_backend{"127.0.0.1", 9662, {}});
+	dispatcher_handler fallback_handler(config);
+
+	fallback_handler.on_request(eval("client_1", "job_1", "group_4"), respond);
+
+	ASSERT_EQ(2u, messages.size());
+	ASSERT_EQ(dispatcher_handler::backend_key(2), messages[1].key);
+}
+
+TEST(dispatcher, malformed_eval_not_forwarded)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_1", {"eval", "job_1", "hwgroup=group_1"}),
+		respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_1", {"eval-batch", "hwgroup=group_1", "", "x"}),
+		respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"})));
+}
+
+TEST(dispatcher, replies_routed_to_clients)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(eval("client_1", "job_1", "group_1"), respond);
+	handler.on_request(eval("client_2", "job_2", "group_1"), respond);
+	handler.on_request(
+		message_container(
+			broker_connect::KEY_CLIENTS, "client_3", {"eval-batch", "hwgroup=group_1", "", "1", "job_3", "a"}),
+		respond);
+	messages.clear();
+
+	// The acknowledgements of the back-end are not passed on, the clients have already got one
+	handler.on_request(tagged(0, 1, {"ack"}), respond);
+	handler.on_request(tagged(0, 1, {"accept", "100"}), respond);
+	handler.on_request(tagged(0, 2, {"ack"}), respond);
+	handler.on_request(tagged(0, 2, {"reject", "The broker is frozen."}), respond);
+	handler.on_request(tagged(0, 3, {"ack"}), respond);
+	handler.on_request(tagged(0, 3, {"batch-result", "1"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_1", {"accept", "100"}),
+			message_container(broker_connect::KEY_CLIENTS, "client_2", {"reject", "The broker is frozen."}),
+			message_container(broker_connect::KEY_CLIENTS, "client_3", {"batch-result", "1"})));
+
+	// Nothing is pending anymore
+	messages.clear();
+	handler.on_request(tagged(0, 3, {"accept"}), respond);
+	handler.on_request(message_container(dispatcher_handler::backend_key(0), "", {"accept"}), respond);
+	ASSERT_TRUE(messages.empty());
+}
+
+TEST(dispatcher, lost_reply)
+{
+	auto config = create_config();
+	config.timeout = std::chrono::milliseconds(200);
+	dispatcher_handler handler(config);
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(eval("client_1", "job_1", "group_1"), respond);
+	handler.on_request(eval("client_2", "job_2", "group_1"), respond);
+	handler.on_request(
+		message_container(
+			broker_connect::KEY_CLIENTS, "client_3", {"eval-batch", "hwgroup=group_1", "", "1", "job_3", "a"}),
+		respond);
+	messages.clear();
+
+	// The reply to the first job got lost, the following one still reaches the right client
+	handler.on_request(tagged(0, 2, {"ack"}), respond);
+	handler.on_request(tagged(0, 2, {"accept"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_2", {"accept"})));
+
+	// The clients do not wait for the missing replies forever
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_EQ(2u, messages.size());
+	ASSERT_EQ(broker_connect::KEY_CLIENTS, messages[0].key);
+	ASSERT_EQ("client_1", messages[0].identity);
+	ASSERT_EQ("reject", messages[0].data.at(0));
+	ASSERT_EQ(message_container(broker_connect::KEY_CLIENTS, "client_3", {"batch-result", "0"}), messages[1]);
+
+	// A late reply is dropped
+	messages.clear();
+	handler.on_request(tagged(0, 1, {"ack"}), respond);
+	handler.on_request(tagged(0, 1, {"accept"}), respond);
+	ASSERT_TRUE(messages.empty());
+}
+
+TEST(dispatcher, runtime_stats_aggregated)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_1", {"get-runtime-stats"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(tagged(0, 1, {"get-runtime-stats"}), tagged(1, 2, {"get-runtime-stats"})));
+	messages.clear();
+
+	handler.on_request(tagged(1, 2, {"queued-jobs", "2", "worker-count", "3", "is-frozen", "1"}), respond);
+	ASSERT_TRUE(messages.empty());
+
+	handler.on_request(tagged(0, 1, {"queued-jobs", "5", "worker-count", "1", "is-frozen", "0"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS,
+			"client_1",
+			{"queued-jobs", "7", "responding-brokers", "2", "worker-count", "4", "is-frozen", "1"})));
+}
+
+TEST(dispatcher, cancel_fanned_out)
+{
+	dispatcher_handler handler(create_config());
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_1", {"cancel", "job_1"}), respond);
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_1", {"cancel", "job_2"}), respond);
+	messages.clear();
+
+	handler.on_request(tagged(0, 1, {"reject", "No such job."}), respond);
+	handler.on_request(tagged(1, 2, {"ack"}), respond);
+	handler.on_request(tagged(0, 3, {"reject", "No such job."}), respond);
+	handler.on_request(tagged(1, 4, {"reject", "No such job."}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack"}),
+			message_container(broker_connect::KEY_CLIENTS, "client_1", {"reject", "No such job."})));
+}
+
+TEST(dispatcher, fan_out_timeout)
+{
+	auto config = create_config();
+	config.timeout = std::chrono::milliseconds(200);
+	dispatcher_handler handler(config);
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	handler.on_request(message_container(broker_connect::KEY_CLIENTS, "client_1", {"drain", "hwgroup", "group_1"}),
+		respond);
+	handler.on_request(tagged(0, 1, {"ack", "2"}), respond);
+	messages.clear();
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_TRUE(messages.empty());
+
+	// The client gets what has arrived so far
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"100"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_1", {"ack", "2"})));
+
+	// The late reply is dropped, but it does not confuse the replies to the following requests
+	messages.clear();
+	handler.on_request(eval("client_2", "job_1", "group_2"), respond);
+	handler.on_request(tagged(1, 2, {"reject", "No such worker."}), respond);
+	handler.on_request(tagged(1, 3, {"ack"}), respond);
+	handler.on_request(tagged(1, 3, {"accept"}), respond);
+
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_CLIENTS, "client_2", {"ack"}),
+			tagged(1, 3, {"eval", "job_1", "hwgroup=group_2", "", "1"}),
+			message_container(broker_connect::KEY_CLIENTS, "client_2", {"accept"})));
+}
@@ -0,0 +1,43 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "../src/queuing/error_rate_tracker.h"
+
+using namespace testing;
+
+TEST(error_rate_tracker, empty)
+{
+	error_rate_tracker tracker;
+
+	ASSERT_EQ(0u, tracker.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(0, tracker.get_error_rate("worker_1"));
+}
+
+TEST(error_rate_tracker, sliding_window)
+{
+	error_rate_tracker tracker(4);
+
+	tracker.add_result("worker_1", true);
+	tracker.add_result("worker_1", true);
+	tracker.add_result("worker_1", false);
+	tracker.add_result("worker_2", false);
+
+	ASSERT_EQ(3u, tracker.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(2.0 / 3, tracker.get_error_rate("worker_1"));
+	ASSERT_DOUBLE_EQ(0, tracker.get_error_rate("worker_2"));
+
+	// The oldest errors drop out of the window
+	tracker.add_result("worker_1", false);
+	tracker.add_result("worker_1", false);
+	tracker.add_result("worker_1", false);
+
+	ASSERT_EQ(4u, tracker.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(0, tracker.get_error_rate("worker_1"));
+
+	tracker.add_result("worker_1", true);
+	ASSERT_DOUBLE_EQ(0.25, tracker.get_error_rate("worker_1"));
+
+	tracker.reset("worker_1");
+	ASSERT_EQ(0u, tracker.get_sample_count("worker_1"));
+	ASSERT_EQ(1u, tracker.get_sample_count("worker_2"));
+}
@@ -21,6 +21,8 @@ class mock_broker_config : public broker_config
 public:
 	const std::string address = "*";
 	const std::string localhost = "127.0.0.1";
+	admission_config admission;
+	quarantine_config quarantine;
 
 	mock_broker_config() : broker_config()
 	{
@@ -39,6 +41,22 @@ public:
 		ON_CALL(*this, get_monitor_port()).WillByDefault(Return(7894));
 
 		ON_CALL(*this, get_max_request_failures()).WillByDefault(Return(9999));
+
+		ON_CALL(*this, get_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(0)));
+
+		ON_CALL(*this, get_max_retry_backoff()).WillByDefault(Return(std::chrono::milliseconds(0)));
+
+		ON_CALL(*this, get_admission_config()).WillByDefault(ReturnRef(admission));
+
+		ON_CALL(*this, get_quarantine_config()).WillByDefault(ReturnRef(quarantine));
+
+		ON_CALL(*this, get_hedging_runtime_multiple()).WillByDefault(Return(0));
+
+		ON_CALL(*this, get_hedging_min_samples()).WillByDefault(Return(20));
+
+		ON_CALL(*this, get_worker_phi_threshold()).WillByDefault(Return(0));
+
+		ON_CALL(*this, get_worker_phi_min_samples()).WillByDefault(Return(10));
 	}
 
 	MOCK_CONST_METHOD0(get_client_address, const std::string &());
@@ -49,6 +67,14 @@ public:
 	MOCK_CONST_METHOD0(get_monitor_port, std::uint16_t());
 	MOCK_CONST_METHOD0(get_worker_ping_interval, std::chrono::milliseconds());
 	MOCK_CONST_METHOD0(get_max_request_failures, std::size_t());
+	MOCK_CONST_METHOD0(get_retry_backoff, std::chrono::milliseconds());
+	MOCK_CONST_METHOD0(get_max_retry_backoff, std::chrono::milliseconds());
+	MOCK_CONST_METHOD0(get_admission_config, const admission_config &());
+	MOCK_CONST_METHOD0(get_quarantine_config, const quarantine_config &());
+	MOCK_CONST_METHOD0(get_hedging_runtime_multiple, double());
+	MOCK_CONST_METHOD0(get_hedging_min_samples, std::size_t());
+	MOCK_CONST_METHOD0(get_worker_phi_threshold, double());
+	MOCK_CONST_METHOD0(get_worker_phi_min_samples, std::size_t());
 };
 
 class mock_worker_registry : public worker_registry
@@ -138,3 +138,232 @@ TEST(multi_queue_manager, load_balancing)
 	ASSERT_NE(result_2.assigned_to, nullptr);
 	ASSERT_NE(result_1.assigned_to, result_2.assigned_to);
 }
+
+TEST(multi_queue_manager, prefetching)
+{
+	multi_queue_manager manager;
+
+	std::multimap<std::string, std::string> headers = {};
+	job_request_data data("", {});
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	worker_1->prefetch = true;
+	manager.add_worker(worker_1);
+
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+
+	// The first request is processed right away, the second one is sent in advance
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_EQ(request_1, manager.get_current_request(worker_1));
+	ASSERT_EQ(request_2, manager.get_prefetched_request(worker_1));
+
+	// A failure of the current job does not affect the prefetched one
+	ASSERT_EQ(request_1, manager.worker_cancelled(worker_1));
+	ASSERT_EQ(request_2, manager.get_current_request(worker_1));
+	ASSERT_EQ(nullptr, manager.get_prefetched_request(worker_1));
+
+	ASSERT_EQ(request_3, manager.assign_request(worker_1));
+	ASSERT_EQ(request_3, manager.get_prefetched_request(worker_1));
+
+	// Both jobs held by the worker are reclaimed when it dies
+	ASSERT_THAT(manager.worker_terminated(worker_1), Pointee(ElementsAre(request_2, request_3)));
+}
+
+TEST(multi_queue_manager, multiple_slots)
+{
+	multi_queue_manager manager;
+
+	std::multimap<std::string, std::string> headers = {};
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	worker_1->slots = 2;
+	manager.add_worker(worker_1);
+
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job3", {}));
+
+	// The worker processes two requests at once
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_THAT(manager.get_current_requests(worker_1), ElementsAre(request_1, request_2));
+
+	// Jobs can be finished in any order
+	ASSERT_EQ(request_3, manager.worker_finished(worker_1, "job2"));
+	ASSERT_THAT(manager.get_current_requests(worker_1), ElementsAre(request_1, request_3));
+
+	ASSERT_THAT(manager.worker_terminated(worker_1), Pointee(ElementsAre(request_1, request_3)));
+}
+
+TEST(multi_queue_manager, queued_requests_per_hwgroup)
+{
+	multi_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_2", {{"env", "c"}}));
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	request::headers_t headers = {{"env", "c"}, {"hwgroup", "group_1"}};
+	job_request_data data("", {});
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+
+	ASSERT_EQ(2u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(0u, manager.get_queued_request_count("group_2"));
+
+	ASSERT_EQ(request_2, manager.worker_finished(worker_1));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+}
+
+TEST(multi_queue_manager, find_request)
+{
+	multi_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+
+	request::headers_t headers = {{"env", "c"}};
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job3", {}));
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+
+	ASSERT_EQ(request_1, manager.find_request("job1").request);
+	ASSERT_EQ(worker_1, manager.find_request("job1").worker);
+	ASSERT_EQ(request_2, manager.find_request("job2").request);
+	ASSERT_EQ(nullptr, manager.find_request("job2").worker);
+	ASSERT_EQ(nullptr, manager.find_request("job4").request);
+
+	// The finished job is forgotten, the next one is assigned
+	manager.worker_finished(worker_1, "job1");
+	ASSERT_EQ(nullptr, manager.find_request("job1").request);
+	ASSERT_EQ(worker_1, manager.find_request("job2").worker);
+
+	manager.worker_cancelled(worker_1, "job2");
+	ASSERT_EQ(nullptr, manager.find_request("job2").request);
+
+	manager.worker_terminated(worker_1);
+	ASSERT_EQ(nullptr, manager.find_request("job3").request);
+}
+
+TEST(multi_queue_manager, bulk_enqueue)
+{
+	multi_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "c"}}));
+	auto worker_3 = worker_ptr(new worker("id123456", "group_1", {{"env", "python"}}));
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+	manager.add_worker(worker_3);
+
+	request::headers_t headers = {{"env", "c"}};
+	std::vector<request_ptr> requests;
+	for (std::string job_id : {"job1", "job2", "job3", "job4"}) {
+		requests.push_back(std::make_shared<request>(headers, request::metadata_t{}, job_request_data(job_id, {})));
+	}
+
+	auto results = manager.enqueue_requests(requests);
+
+	// The requests are distributed among the suitable workers in a round-robin fashion
+	ASSERT_EQ(4u, results.size());
+	ASSERT_NE(nullptr, results[0].assigned_to);
+	ASSERT_NE(nullptr, results[1].assigned_to);
+	ASSERT_NE(results[0].assigned_to, results[1].assigned_to);
+	ASSERT_EQ(nullptr, results[2].assigned_to);
+	ASSERT_EQ(nullptr, results[3].assigned_to);
+	ASSERT_TRUE(results[2].enqueued);
+	ASSERT_TRUE(results[3].enqueued);
+	ASSERT_EQ(2u, manager.get_queued_request_count());
+	ASSERT_EQ(requests[2], manager.worker_finished(results[0].assigned_to));
+	ASSERT_EQ(requests[3], manager.worker_finished(results[1].assigned_to));
+	ASSERT_EQ(nullptr, manager.get_current_request(worker_3));
+}
+
+TEST(multi_queue_manager, remove_queued_request)
+{
+	multi_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+
+	request::headers_t headers = {{"env", "c"}};
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job3", {}));
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+
+	// Only queued requests can be removed
+	ASSERT_EQ(nullptr, manager.remove_queued_request("job1"));
+	ASSERT_EQ(nullptr, manager.remove_queued_request("job4"));
+	ASSERT_EQ(request_2, manager.remove_queued_request("job2"));
+	ASSERT_EQ(nullptr, manager.find_request("job2").request);
+	ASSERT_EQ(1u, manager.get_queued_request_count());
+
+	ASSERT_EQ(request_3, manager.worker_finished(worker_1));
+}
+
+TEST(multi_queue_manager, avoid_failed_workers)
+{
+	std::multimap<std::string, std::string> headers = {};
+	multi_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	auto worker_2 = std::make_shared<worker>("identity2", "group_1", headers);
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	// Worker 2 comes first in the round-robin order, but the job already failed there
+	request_1->record_failure(*worker_2);
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+
+	// The job failed everywhere, it is given to any suitable worker
+	manager.worker_cancelled(worker_1, "job1");
+	request_1->record_failure(*worker_1);
+	ASSERT_TRUE(manager.enqueue_request(request_1).enqueued);
+}
+
+TEST(multi_queue_manager, draining)
+{
+	std::multimap<std::string, std::string> headers = {};
+	multi_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	auto worker_2 = std::make_shared<worker>("identity2", "group_1", headers);
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+
+	manager.add_worker(worker_1);
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+
+	// The queued job is handed back, the current one stays with the worker
+	worker_1->draining = true;
+	ASSERT_THAT(manager.worker_draining(worker_1), ElementsAre(request_2));
+	ASSERT_EQ(request_1, manager.get_current_request(worker_1));
+
+	manager.add_worker(worker_2);
+	ASSERT_EQ(worker_2, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.worker_finished(worker_1, "job1"));
+}
@@ -0,0 +1,105 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "../src/queuing/phi_accrual_detector.h"
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+TEST(phi_accrual_detector, empty)
+{
+	phi_accrual_detector detector;
+
+	ASSERT_EQ(0u, detector.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(0, detector.get_phi("worker_1", 5000ms));
+
+	// A single heartbeat does not give any interval yet
+	detector.heartbeat("worker_1", 1000ms);
+	ASSERT_EQ(0u, detector.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(0, detector.get_phi("worker_1", 5000ms));
+}
+
+TEST(phi_accrual_detector, suspicion_grows_with_silence)
+{
+	phi_accrual_detector detector(100, 100ms);
+
+	for (auto time = 0ms; time <= 10000ms; time += 1000ms) {
+		detector.heartbeat("worker_1", time);
+	}
+
+	ASSERT_EQ(10u, detector.get_sample_count("worker_1"));
+
+	// Shortly after a heartbeat nothing is suspicious, then the suspicion only grows
+	ASSERT_LT(detector.get_phi("worker_1", 10500ms), 0.01);
+	ASSERT_NEAR(0.3, detector.get_phi("worker_1", 11000ms), 0.01);
+
+	double last = 0;
+	for (auto time = 10500ms; time <= 13000ms; time += 100ms) {
+		double phi = detector.get_phi("worker_1", time);
+		ASSERT_GE(phi, last);
+		last = phi;
+	}
+
+	ASSERT_GT(last, 8);
+}
+
+TEST(phi_accrual_detector, suspicion_time)
+{
+	phi_accrual_detector detector(100, 100ms);
+	ASSERT_EQ(std::chrono::milliseconds::max(), detector.get_suspicion_time("worker_1", 8));
+
+	for (auto time = 0ms; time <= 10000ms; time += 1000ms) {
+		detector.heartbeat("worker_1", time);
+	}
+
+	// The first millisecond at which the suspicion reaches the threshold
+	auto time = detector.get_suspicion_time("worker_1", 8);
+	ASSERT_GT(time, 11000ms);
+	ASSERT_GE(detector.get_phi("worker_1", time), 8);
+	ASSERT_LT(detector.get_phi("worker_1", time - 1ms), 8);
+}
+
+TEST(phi_accrual_detector, jitter_delays_suspicion)
+{
+	phi_accrual_detector detector(100, 100ms);
+
+	// Both workers ping every second on average, the second one irregularly
+	for (auto time = 0ms; time <= 20000ms; time += 1000ms) {
+		detector.heartbeat("worker_1", time);
+	}
+
+	for (auto time = 0ms; time <= 20000ms; time += 2000ms) {
+		detector.heartbeat("worker_2", time);
+		if (time < 20000ms) {
+			detector.heartbeat("worker_2", time + 500ms);
+		}
+	}
+
+	ASSERT_GT(detector.get_phi("worker_1", 22000ms), 8);
+	ASSERT_LT(detector.get_phi("worker_2", 22000ms), 3);
+
+	// The other worker is not affected by a reset
+	detector.reset("worker_1");
+	ASSERT_EQ(0u, detector.get_sample_count("worker_1"));
+	ASSERT_DOUBLE_EQ(0, detector.get_phi("worker_1", 22000ms));
+	ASSERT_EQ(20u, detector.get_sample_count("worker_2"));
+}
+
+TEST(phi_accrual_detector, sliding_window)
+{
+	phi_accrual_detector detector(4, 100ms);
+
+	// Long intervals drop out of the window, so the detector adapts to faster heartbeats
+	for (auto time = 0ms; time <= 40000ms; time += 10000ms) {
+		detector.heartbeat("worker_1", time);
+	}
+
+	ASSERT_LT(detector.get_phi("worker_1", 45000ms), 1);
+
+	for (auto time = 41000ms; time <= 44000ms; time += 1000ms) {
+		detector.heartbeat("worker_1", time);
+	}
+
+	ASSERT_EQ(4u, detector.get_sample_count("worker_1"));
+	ASSERT_GT(detector.get_phi("worker_1", 47000ms), 8);
+}
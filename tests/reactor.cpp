@@ -1,8 +1,14 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
+#include <unistd.h>
 
+#include "../src/reactor/peer_monitor_wrapper.h"
 #include "../src/reactor/reactor.h"
+#include "../src/reactor/router_socket_wrapper.h"
 
 using namespace testing;
 
@@ -128,6 +134,40 @@ private:
 	fnc_t fnc_;
 };
 
+/**
+ * A handler which can be called from more threads at the same time
+ */
+class synchronized_handler : public handler_interface
+{
+public:
+	using fnc_t = std::function<void(const message_container &, const response_cb &)>;
+
+	synchronized_handler(fnc_t fnc) : fnc_(fnc)
+	{
+	}
+
+	void on_request(const message_container &message, const response_cb &response) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			received_.push_back(message);
+		}
+
+		fnc_(message, response);
+	}
+
+	std::vector<message_container> received()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return received_;
+	}
+
+private:
+	fnc_t fnc_;
+	std::mutex mutex_;
+	std::vector<message_container> received_;
+};
+
 // Check if the reactor terminates when requested - if this test fails, the other ones will fail too
 TEST(reactor, termination)
 {
@@ -220,6 +260,32 @@ TEST(reactor, timers)
 	thread.join();
 }
 
+TEST(reactor, ticks_on_demand)
+{
+	for (auto backend : {reactor_backend::poll, reactor_backend::epoll}) {
+		auto context = std::make_shared<zmq::context_t>(1);
+		reactor r(context, backend);
+		r.set_tick_on_demand(true);
+
+		// Every tick asks for another one, but only a later one is requested after the first
+		std::vector<std::chrono::milliseconds> ticks;
+		auto handler = std::make_shared<synchronized_handler>(
+			[&](const message_container &message, const handler_interface::response_cb &respond) {
+				ticks.emplace_back(std::stoll(message.data.front()));
+				r.request_tick(std::chrono::milliseconds(ticks.size() == 1 ? 1000 : 10));
+				r.request_tick(std::chrono::milliseconds(2000));
+			});
+		r.add_handler({r.KEY_TIMER}, handler);
+
+		r.request_tick(std::chrono::milliseconds(50));
+		r.schedule_timer(std::chrono::milliseconds(300), [&r](std::chrono::milliseconds elapsed) { r.terminate(); });
+		r.start_loop();
+
+		ASSERT_EQ(1u, ticks.size());
+		EXPECT_LE(std::chrono::milliseconds(50), ticks.front());
+	}
+}
+
 // Make sure that messages to asynchronous handlers don't get mixed up
 TEST(reactor, multiple_asynchronous_handlers)
 {
@@ -266,3 +332,608 @@ TEST(reactor, multiple_asynchronous_handlers)
 	r.terminate();
 	thread.join();
 }
+
+TEST(reactor, epoll_handlers)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context, reactor_backend::epoll);
+	auto socket = std::make_shared<pair_socket_wrapper>(context, "inproc://epoll_handlers_1");
+	auto sync_handler =
+		pluggable_handler::create([](const message_container &msg, handler_interface::response_cb respond) {
+			respond(message_container("socket", "id1", {"Hello!"}));
+		});
+	auto async_handler =
+		pluggable_handler::create([](const message_container &msg, handler_interface::response_cb respond) {
+			respond(message_container("socket", "id2", {"Hello again!"}));
+		});
+
+	r.add_socket("socket", socket);
+	r.add_handler({"socket"}, sync_handler);
+	r.add_async_handler({"socket"}, async_handler);
+
+#ifdef __linux__
+	ASSERT_EQ(reactor_backend::epoll, r.get_backend());
+#endif
+
+	std::thread thread([&r]() { r.start_loop(); });
+
+	for (std::size_t i = 0; i < 10; ++i) {
+		socket->send_message_local(message_container("", "id1", {"Hello??"}));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	EXPECT_EQ(10u, sync_handler->received.size());
+	EXPECT_EQ(10u, async_handler->received.size());
+
+	// Every message got a reply from both handlers
+	std::size_t replies = 0;
+	message_container message;
+	while (socket->receive_message_local(message)) {
+		++replies;
+		message = message_container();
+	}
+
+	EXPECT_EQ(20u, replies);
+
+	r.terminate();
+	thread.join();
+}
+
+TEST(reactor, file_descriptors_and_timers)
+{
+	for (auto backend : {reactor_backend::poll, reactor_backend::epoll}) {
+		auto context = std::make_shared<zmq::context_t>(1);
+		reactor r(context, backend);
+
+		int fds[2];
+		ASSERT_EQ(0, pipe(fds));
+
+		auto handler =
+			pluggable_handler::create([](const message_container &msg, handler_interface::response_cb respond) {
+				if (msg.key == "pipe") {
+					char buffer[16];
+					ASSERT_LT(0, read(std::stoi(msg.data.at(0)), buffer, sizeof(buffer)));
+				}
+			});
+
+		r.add_fd("pipe", fds[0]);
+		r.add_timer("fast_timer", std::chrono::milliseconds(20));
+		r.add_handler({"pipe", "fast_timer"}, handler);
+
+		std::thread thread([&r]() { r.start_loop(); });
+
+		ASSERT_EQ(1, write(fds[1], "x", 1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+		r.terminate();
+		thread.join();
+
+		auto pipe_messages = std::count_if(handler->received.begin(),
+			handler->received.end(),
+			[](const message_container &msg) { return msg.key == "pipe"; });
+		auto timer_messages = handler->received.size() - pipe_messages;
+
+		EXPECT_EQ(1, pipe_messages);
+		EXPECT_LE(3u, timer_messages);
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+}
+
+TEST(reactor, message_ring)
+{
+	message_ring ring(3);
+	ASSERT_EQ(4u, ring.capacity());
+
+	message_container message;
+	ASSERT_FALSE(ring.try_pop(message));
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		ASSERT_TRUE(ring.try_push(message_container("key", "id", {std::to_string(i)})));
+	}
+
+	auto rejected = message_container("key", "id", {"4"});
+	ASSERT_FALSE(ring.try_push(std::move(rejected)));
+	ASSERT_EQ(message_container("key", "id", {"4"}), rejected);
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		ASSERT_TRUE(ring.try_pop(message));
+		ASSERT_EQ(message_container("key", "id", {std::to_string(i)}), message);
+	}
+
+	ASSERT_FALSE(ring.try_pop(message));
+}
+
+TEST(reactor, message_ring_multiple_producers)
+{
+	message_ring ring(64);
+	std::size_t message_count = 10000;
+	std::vector<std::thread> producers;
+
+	for (std::size_t producer = 0; producer < 4; ++producer) {
+		producers.emplace_back([&ring, producer, message_count]() {
+			for (std::size_t i = 0; i < message_count; ++i) {
+				while (!ring.try_push(message_container(std::to_string(producer), "", {std::to_string(i)}))) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	// The messages of each producer arrive in order
+	std::vector<std::size_t> expected(4, 0);
+	message_container message;
+
+	for (std::size_t received = 0; received < 4 * message_count;) {
+		if (!ring.try_pop(message)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		auto &next = expected.at(std::stoul(message.key));
+		ASSERT_EQ(std::to_string(next), message.data.at(0));
+		++next;
+		++received;
+	}
+
+	for (auto &thread : producers) {
+		thread.join();
+	}
+}
+
+TEST(reactor, post_message_waits_for_room)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context);
+
+	auto handler = std::make_shared<synchronized_handler>(
+		[](const message_container &message, const handler_interface::response_cb &respond) {});
+	r.add_handler({"posted"}, handler);
+
+	// The producer fills the ring before the loop starts and sleeps until the loop takes the messages
+	std::size_t message_count = asynchronous_handler_wrapper::DEFAULT_CAPACITY + 10;
+	std::thread producer([&r, message_count]() {
+		for (std::size_t i = 0; i < message_count; ++i) {
+			r.post_message(message_container("posted", "", {std::to_string(i)}));
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	std::thread loop([&r]() { r.start_loop(); });
+
+	for (std::size_t i = 0; i < 500 && handler->received().size() < message_count; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	producer.join();
+	ASSERT_EQ(message_count, handler->received().size());
+	ASSERT_EQ(message_container("posted", "", {std::to_string(message_count - 1)}), handler->received().back());
+
+	// A producer waiting for a reactor that has terminated gives up
+	r.terminate();
+	loop.join();
+
+	std::thread late_producer([&r, message_count]() {
+		for (std::size_t i = 0; i < message_count; ++i) {
+			r.post_message(message_container("posted", "", {std::to_string(i)}));
+		}
+	});
+	late_producer.join();
+}
+
+TEST(reactor, asynchronous_handler_backlog)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context);
+	std::atomic<std::size_t> processed(0);
+
+	auto handler = pluggable_handler::create(
+		[&processed](const message_container &msg, handler_interface::response_cb respond) { ++processed; });
+
+	// More messages than fit in the ring are passed to the handler in order
+	auto wrapper = std::make_shared<asynchronous_handler_wrapper>(r, handler, 1, nullptr, 4);
+	std::size_t message_count = 100;
+
+	for (std::size_t i = 0; i < message_count; ++i) {
+		(*wrapper)(message_container("key", "", {std::to_string(i)}));
+	}
+
+	wrapper = nullptr;
+
+	ASSERT_EQ(message_count, processed.load());
+	for (std::size_t i = 0; i < message_count; ++i) {
+		ASSERT_EQ(std::to_string(i), handler->received.at(i).data.at(0));
+	}
+}
+
+TEST(reactor, asynchronous_handler_pool)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context);
+
+	std::mutex mutex;
+	std::condition_variable released;
+	bool release = false;
+
+	// The handler blocks until it is released, so the messages can only be processed in parallel
+	auto handler = std::make_shared<synchronized_handler>(
+		[&](const message_container &msg, const handler_interface::response_cb &respond) {
+			std::unique_lock<std::mutex> lock(mutex);
+			released.wait(lock, [&release]() { return release; });
+		});
+
+	auto wrapper = std::make_shared<asynchronous_handler_wrapper>(r, handler, 4);
+	ASSERT_EQ(4u, wrapper->get_concurrency());
+
+	for (std::size_t i = 0; i < 6; ++i) {
+		(*wrapper)(message_container("key", "", {std::to_string(i)}));
+	}
+
+	for (std::size_t i = 0; i < 200 && wrapper->get_busy_threads() < 4; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	EXPECT_EQ(4u, wrapper->get_busy_threads());
+	EXPECT_EQ(2u, wrapper->get_queue_depth());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		release = true;
+	}
+
+	released.notify_all();
+	wrapper = nullptr;
+
+	ASSERT_EQ(6u, handler->received().size());
+}
+
+TEST(reactor, asynchronous_handler_ordering)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	reactor r(context);
+
+	auto handler = std::make_shared<synchronized_handler>(
+		[](const message_container &msg, const handler_interface::response_cb &respond) {});
+
+	auto wrapper = std::make_shared<asynchronous_handler_wrapper>(
+		r, handler, 4, [](const message_container &msg) { return msg.identity; });
+
+	std::size_t message_count = 200;
+	for (std::size_t i = 0; i < message_count; ++i) {
+		(*wrapper)(message_container("key", "job_" + std::to_string(i % 10), {std::to_string(i)}));
+	}
+
+	wrapper = nullptr;
+
+	// The messages with the same key are processed in the order they came in
+	std::map<std::string, std::vector<std::size_t>> processed;
+	for (auto &message : handler->received()) {
+		processed[message.identity].push_back(std::stoul(message.data.at(0)));
+	}
+
+	ASSERT_EQ(10u, processed.size());
+	for (auto &pair : processed) {
+		ASSERT_EQ(message_count / 10, pair.second.size());
+		ASSERT_TRUE(std::is_sorted(pair.second.begin(), pair.second.end()));
+	}
+}
+
+TEST(reactor, timer_service)
+{
+	timer_service timers;
+	auto start = timer_service::clock::now();
+	std::vector<std::pair<std::string, std::chrono::milliseconds::rep>> fired;
+
+	auto record = [&fired](const std::string &name) {
+		return [&fired, name](std::chrono::milliseconds elapsed) { fired.emplace_back(name, elapsed.count()); };
+	};
+
+	ASSERT_EQ(-1, timers.get_timeout(start).count());
+
+	timers.schedule_once(std::chrono::milliseconds(30), record("once_30"), start);
+	auto cancelled = timers.schedule_once(std::chrono::milliseconds(10), record("cancelled"), start);
+	timers.schedule_periodic(std::chrono::milliseconds(20), record("periodic"), start);
+	timers.schedule_once(std::chrono::milliseconds(10), record("once_10"), start);
+
+	ASSERT_TRUE(timers.cancel(cancelled));
+	ASSERT_FALSE(timers.cancel(cancelled));
+	ASSERT_EQ(3u, timers.size());
+
+	// The cancelled timer does not shorten the timeout
+	ASSERT_EQ(10, timers.get_timeout(start).count());
+	ASSERT_EQ(0u, timers.run_expired(start + std::chrono::milliseconds(5)));
+
+	ASSERT_EQ(2u, timers.run_expired(start + std::chrono::milliseconds(20)));
+	ASSERT_EQ(10, timers.get_timeout(start + std::chrono::milliseconds(20)).count());
+
+	// The periodic timer missed an expiration, it is merged with the late one
+	ASSERT_EQ(2u, timers.run_expired(start + std::chrono::milliseconds(65)));
+	ASSERT_EQ(20, timers.get_timeout(start + std::chrono::milliseconds(65)).count());
+	ASSERT_EQ(1u, timers.size());
+
+	ASSERT_THAT(fired,
+		ElementsAre(std::make_pair("once_10", 20),
+			std::make_pair("periodic", 20),
+			std::make_pair("once_30", 65),
+			std::make_pair("periodic", 45)));
+}
+
+TEST(reactor, timer_service_cancel_from_callback)
+{
+	timer_service timers;
+	auto now = timer_service::clock::now();
+	std::size_t count = 0;
+
+	timer_service::timer_id id = 0;
+	id = timers.schedule_periodic(
+		std::chrono::milliseconds(10),
+		[&](std::chrono::milliseconds elapsed) {
+			if (++count == 3) {
+				timers.cancel(id);
+			}
+		},
+		now);
+
+	for (std::size_t i = 1; i <= 5; ++i) {
+		timers.run_expired(now + i * std::chrono::milliseconds(10));
+	}
+
+	ASSERT_EQ(3u, count);
+	ASSERT_EQ(0u, timers.size());
+	ASSERT_EQ(-1, timers.get_timeout(now).count());
+}
+
+TEST(reactor, scheduled_timers)
+{
+	for (auto backend : {reactor_backend::poll, reactor_backend::epoll}) {
+		auto context = std::make_shared<zmq::context_t>(1);
+		reactor r(context, backend);
+
+		std::size_t periodic_count = 0;
+		std::chrono::milliseconds once_elapsed(0);
+
+		// There are no sockets and no handler subscribed to the tick, the timers are the only thing that wakes it up
+		r.schedule_timer(std::chrono::milliseconds(50), [&](std::chrono::milliseconds elapsed) {
+			once_elapsed = elapsed;
+		});
+
+		timer_service::timer_id periodic = 0;
+		periodic = r.schedule_periodic_timer(std::chrono::milliseconds(10), [&](std::chrono::milliseconds elapsed) {
+			if (++periodic_count == 3) {
+				r.cancel_timer(periodic);
+			}
+		});
+
+		r.schedule_timer(std::chrono::milliseconds(100), [&r](std::chrono::milliseconds elapsed) { r.terminate(); });
+
+		auto start = std::chrono::steady_clock::now();
+		r.start_loop();
+		auto duration = std::chrono::steady_clock::now() - start;
+
+		EXPECT_EQ(3u, periodic_count);
+		EXPECT_LE(50, once_elapsed.count());
+		EXPECT_LE(std::chrono::milliseconds(100), duration);
+		EXPECT_GT(std::chrono::milliseconds(1000), duration);
+	}
+}
+
+namespace
+{
+	/**
+	 * A router socket that can keep only a single message for each peer
+	 */
+	class small_router_socket_wrapper : public router_socket_wrapper
+	{
+	public:
+		small_router_socket_wrapper(
+			std::shared_ptr<zmq::context_t> context, const std::string &addr, std::size_t max_queued)
+			: router_socket_wrapper(context, addr, true, "", max_queued)
+		{
+			socket_.setsockopt(ZMQ_SNDHWM, 1);
+		}
+
+		/**
+		 * Let the socket notice disconnected peers (which happens when it reads from them)
+		 */
+		void try_receive()
+		{
+			zmq::message_t frame;
+			socket_.recv(&frame, ZMQ_DONTWAIT);
+		}
+	};
+
+	std::unique_ptr<zmq::socket_t> connect_peer(zmq::context_t &context, const std::string &addr, const std::string &id)
+	{
+		auto peer = std::make_unique<zmq::socket_t>(context, zmq::socket_type::dealer);
+		peer->setsockopt(ZMQ_LINGER, 0);
+		peer->setsockopt(ZMQ_RCVHWM, 1);
+		peer->setsockopt(ZMQ_IDENTITY, id.data(), id.size());
+		peer->connect(addr);
+		return peer;
+	}
+} // namespace
+
+TEST(reactor, router_socket_queues_for_slow_peer)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	small_router_socket_wrapper router(context, "inproc://router_queues", 100);
+	router.initialize();
+
+	auto slow = connect_peer(*context, "inproc://router_queues", "slow");
+	auto fast = connect_peer(*context, "inproc://router_queues", "fast");
+
+	// The messages that do not fit in the pipe of the slow peer wait, the other peer is not affected
+	std::size_t message_count = 20;
+	for (std::size_t i = 0; i < message_count; ++i) {
+		ASSERT_TRUE(router.send_message(message_container("", "slow", {std::to_string(i)})));
+	}
+
+	ASSERT_LT(0u, router.get_queued_output());
+	ASSERT_TRUE(router.send_message(message_container("", "fast", {"hello"})));
+
+	zmq::message_t frame;
+	ASSERT_TRUE(fast->recv(&frame, ZMQ_DONTWAIT));
+	ASSERT_EQ("hello", std::string(static_cast<char *>(frame.data()), frame.size()));
+
+	// The slow peer gets everything in order once it reads
+	for (std::size_t i = 0; i < message_count; ++i) {
+		while (!slow->recv(&frame, ZMQ_DONTWAIT)) {
+			router.flush_output();
+		}
+
+		ASSERT_EQ(std::to_string(i), std::string(static_cast<char *>(frame.data()), frame.size()));
+	}
+
+	ASSERT_EQ(0u, router.get_queued_output());
+	ASSERT_EQ(0u, router.get_dropped_count());
+}
+
+TEST(reactor, router_socket_sends_whole_messages)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	small_router_socket_wrapper router(context, "inproc://router_multipart", 100);
+	router.initialize();
+
+	auto slow = connect_peer(*context, "inproc://router_multipart", "slow");
+
+	// Some of the messages are sent right away, the others are queued, but none of them is split
+	std::size_t message_count = 20;
+	for (std::size_t i = 0; i < message_count; ++i) {
+		ASSERT_TRUE(router.send_message(message_container("", "slow", {"begin", std::to_string(i), "end"})));
+	}
+
+	ASSERT_LT(0u, router.get_queued_output());
+
+	zmq::message_t frame;
+	for (std::size_t i = 0; i < message_count; ++i) {
+		std::vector<std::string> frames;
+
+		while (!slow->recv(&frame, ZMQ_DONTWAIT)) {
+			router.flush_output();
+		}
+
+		frames.emplace_back(static_cast<char *>(frame.data()), frame.size());
+		while (frame.more()) {
+			ASSERT_TRUE(slow->recv(&frame));
+			frames.emplace_back(static_cast<char *>(frame.data()), frame.size());
+		}
+
+		ASSERT_EQ((std::vector<std::string>{"begin", std::to_string(i), "end"}), frames);
+	}
+
+	ASSERT_EQ(0u, router.get_queued_output());
+	ASSERT_EQ(0u, router.get_dropped_count());
+}
+
+TEST(reactor, router_socket_drops_messages)
+{
+	auto context = std::make_shared<zmq::context_t>(1);
+	small_router_socket_wrapper router(context, "inproc://router_drops", 2);
+	router.initialize();
+
+	auto slow = connect_peer(*context, "inproc://router_drops", "slow");
+
+	// Unknown peers are reported by the socket
+	ASSERT_FALSE(router.send_message(message_container("", "nobody", {"hello"})));
+	ASSERT_EQ(1u, router.get_unroutable_count());
+
+	// The queue of a peer is bounded
+	std::size_t accepted = 0;
+	for (std::size_t i = 0; i < 20; ++i) {
+		accepted += router.send_message(message_container("", "slow", {std::to_string(i)})) ? 1 : 0;
+	}
+
+	ASSERT_EQ(2u, router.get_queued_output());
+	ASSERT_EQ(20 - accepted, router.get_dropped_count() - 1);
+	ASSERT_LT(0u, router.get_dropped_count() - 1);
+
+	// Messages waiting for a peer that has gone away are dropped
+	slow = nullptr;
+	for (std::size_t i = 0; i < 100 && router.get_queued_output() > 0; ++i) {
+		router.try_receive();
+		router.flush_output();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	ASSERT_EQ(0u, router.get_queued_output());
+	ASSERT_EQ(3u, router.get_unroutable_count());
+}
+
+TEST(reactor, queued_output_flushed)
+{
+	for (auto backend : {reactor_backend::poll, reactor_backend::epoll}) {
+		auto context = std::make_shared<zmq::context_t>(1);
+		reactor r(context, backend);
+
+		auto addr = std::string("inproc://queued_output_") + (backend == reactor_backend::poll ? "poll" : "epoll");
+		auto router = std::make_shared<small_router_socket_wrapper>(context, addr, 100);
+		r.add_socket("router", router);
+
+		// The messages are sent at once from the reactor thread, most of them have to wait in the socket
+		std::size_t message_count = 20;
+		r.schedule_timer(std::chrono::milliseconds(50), [&](std::chrono::milliseconds elapsed) {
+			for (std::size_t i = 0; i < message_count; ++i) {
+				r.send_message(message_container("router", "peer", {std::to_string(i)}));
+			}
+		});
+
+		std::thread thread([&r]() { r.start_loop(); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		auto peer = connect_peer(*context, addr, "peer");
+
+		zmq::message_t frame;
+		for (std::size_t i = 0; i < message_count; ++i) {
+			ASSERT_TRUE(peer->recv(&frame));
+			ASSERT_EQ(std::to_string(i), std::string(static_cast<char *>(frame.data()), frame.size()));
+		}
+
+		r.terminate();
+		thread.join();
+	}
+}
+
+TEST(reactor, peer_monitor)
+{
+	for (auto backend : {reactor_backend::poll, reactor_backend::epoll}) {
+		auto context = std::make_shared<zmq::context_t>(1);
+		reactor r(context, backend);
+
+		std::string addr = backend == reactor_backend::poll ? "tcp://127.0.0.1:28657" : "tcp://127.0.0.1:28658";
+		auto router = std::make_shared<router_socket_wrapper>(context, addr, true);
+		r.add_socket("router", router);
+		r.add_socket("events", std::make_shared<peer_monitor_wrapper>(context, router));
+
+		auto handler = std::make_shared<synchronized_handler>(
+			[](const message_container &message, const handler_interface::response_cb &respond) {});
+		r.add_handler({"router", "events"}, handler);
+
+		auto wait_for = [&handler](std::size_t count) {
+			for (std::size_t i = 0; i < 500 && handler->received().size() < count; ++i) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		};
+
+		std::thread thread([&r]() { r.start_loop(); });
+
+		auto peer_1 = connect_peer(*context, addr, "peer_1");
+		auto peer_2 = connect_peer(*context, addr, "peer_2");
+		peer_1->send("hello", 5, 0);
+		peer_2->send("hello", 5, 0);
+		wait_for(2);
+
+		// Only the peer whose connection was closed is reported
+		peer_1->close();
+		wait_for(3);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		r.terminate();
+		thread.join();
+
+		ASSERT_THAT(handler->received(),
+			UnorderedElementsAre(message_container("router", "peer_1", {"hello"}),
+				message_container("router", "peer_2", {"hello"}),
+				message_container("events", "peer_1", {"disconnected"})));
+	}
+}
@@ -0,0 +1,353 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "../src/handlers/replication_handler.h"
+#include "../src/handlers/standby_handler.h"
+#include "../src/queuing/multi_queue_manager.h"
+#include "../src/replication/replica_state.h"
+#include "../src/replication/replicated_queue_manager.h"
+#include "mocks.h"
+
+using namespace testing;
+
+typedef std::multimap<std::string, std::string> worker_headers_t;
+
+namespace
+{
+	request_ptr create_request(const std::string &job_id, const std::string &env = "c")
+	{
+		return std::make_shared<request>(request::headers_t{{"env", env}},
+			request::metadata_t{{"exercise", "hello"}},
+			job_request_data(job_id, {"frame_1", "frame_2"}));
+	}
+
+	/**
+	 * Apply all events recorded by a replicated manager to a replica
+	 */
+	void apply_events(replicated_queue_manager &primary, replica_state &replica)
+	{
+		for (auto &event : primary.take_events()) {
+			ASSERT_TRUE(replica.apply(event));
+		}
+	}
+} // namespace
+
+TEST(replication, state_round_trip)
+{
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	worker_1->slots = 2;
+	worker_1->prefetch = true;
+	worker_1->acks = true;
+	worker_1->host = "machine_1";
+	worker_1->session = "session_1";
+
+	auto failed_request = create_request("job_1");
+	failed_request->failure_count = 1;
+	failed_request->failed_workers.insert("identity_0");
+
+	replica_state state;
+	ASSERT_TRUE(state.apply(replica_state::worker_added(*worker_1)));
+	ASSERT_TRUE(state.apply(replica_state::job_placed(*failed_request, "identity_1")));
+	ASSERT_TRUE(state.apply(replica_state::job_placed(*create_request("job_2"), "")));
+	ASSERT_FALSE(state.apply({"job-moved", "job_3", "identity_1"}));
+	ASSERT_FALSE(state.apply({"job", "job_4", "", "1", "0", "5"}));
+
+	// A snapshot recreates the same state
+	replica_state copy;
+	for (auto &event : state.snapshot()) {
+		ASSERT_TRUE(copy.apply(event));
+	}
+
+	ASSERT_EQ(1u, copy.get_workers().size());
+	auto worker_copy = copy.get_workers().at("identity_1");
+	ASSERT_EQ("group_1", worker_copy->hwgroup);
+	ASSERT_EQ(2u, worker_copy->slots);
+	ASSERT_TRUE(worker_copy->prefetch);
+	ASSERT_TRUE(worker_copy->acks);
+	ASSERT_EQ("machine_1", worker_copy->host);
+	ASSERT_EQ("session_1", worker_copy->session);
+	ASSERT_TRUE(worker_copy->headers_equal(worker_1->get_headers()));
+
+	ASSERT_EQ(2u, copy.get_job_count());
+	auto job_1 = copy.find_job("job_1");
+	ASSERT_NE(nullptr, job_1);
+	ASSERT_EQ("identity_1", job_1->location);
+	ASSERT_EQ(failed_request->data.get(), job_1->request->data.get());
+	ASSERT_EQ(failed_request->headers, job_1->request->headers);
+	ASSERT_EQ(failed_request->metadata, job_1->request->metadata);
+	ASSERT_EQ(1u, job_1->request->failure_count);
+	ASSERT_EQ(1u, job_1->request->failed_workers.count("identity_0"));
+	ASSERT_EQ("", copy.find_job("job_2")->location);
+}
+
+TEST(replication, events_mirror_queue_manager)
+{
+	auto inner = std::make_shared<multi_queue_manager>();
+	replicated_queue_manager primary(inner);
+	replica_state standby;
+
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	auto worker_2 = std::make_shared<worker>("identity_2", "group_1", worker_headers_t{{"env", "c"}});
+	primary.add_worker(worker_1);
+	primary.add_worker(worker_2);
+
+	for (auto job_id : {"job_1", "job_2", "job_3", "job_4"}) {
+		primary.enqueue_request(create_request(job_id));
+	}
+
+	apply_events(primary, standby);
+	ASSERT_EQ(2u, standby.get_workers().size());
+	ASSERT_EQ(4u, standby.get_job_count());
+
+	// Finishing a job assigns the next one from the queue of the worker
+	auto first_job = primary.get_current_request(worker_1)->data.get_job_id();
+	auto next = primary.worker_finished(worker_1, first_job);
+	ASSERT_NE(nullptr, next);
+	apply_events(primary, standby);
+	ASSERT_EQ(nullptr, standby.find_job(first_job));
+	ASSERT_EQ("identity_1", standby.find_job(next->data.get_job_id())->location);
+
+	// A removed worker takes its jobs with it (until they are enqueued again)
+	auto returned = primary.worker_terminated(worker_2);
+	apply_events(primary, standby);
+	ASSERT_EQ(1u, standby.get_workers().size());
+	ASSERT_EQ(1u, standby.get_job_count());
+
+	for (auto &request : *returned) {
+		primary.enqueue_request(request);
+	}
+
+	apply_events(primary, standby);
+	ASSERT_EQ(3u, standby.get_job_count());
+
+	// Postponed retries are kept by the standby until they are discarded
+	auto cancelled = primary.worker_cancelled(worker_1, next->data.get_job_id());
+	primary.request_postponed(cancelled);
+	apply_events(primary, standby);
+	ASSERT_EQ("", standby.find_job(next->data.get_job_id())->location);
+
+	primary.request_discarded(cancelled);
+	apply_events(primary, standby);
+	ASSERT_EQ(nullptr, standby.find_job(next->data.get_job_id()));
+
+	// The standby state matches the state kept by the primary
+	ASSERT_EQ(primary.get_state().get_job_count(), standby.get_job_count());
+	ASSERT_EQ(primary.get_state().snapshot(), standby.snapshot());
+}
+
+TEST(replication, restore)
+{
+	replica_state state;
+	auto worker_1 = std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}});
+	state.apply(replica_state::worker_added(*worker_1));
+	state.apply(replica_state::job_placed(*create_request("job_1"), "identity_1"));
+	state.apply(replica_state::job_placed(*create_request("job_2"), ""));
+	state.apply(replica_state::job_placed(*create_request("job_3"), "identity_gone"));
+	state.apply(replica_state::job_placed(request(job_request_data("job_4")), "identity_gone"));
+
+	worker_registry workers;
+	multi_queue_manager queue;
+	auto assigned = state.restore(workers, queue, 4);
+
+	ASSERT_EQ(1u, workers.get_workers().size());
+	auto restored_worker = workers.find_worker_by_identity("identity_1");
+	ASSERT_NE(nullptr, restored_worker);
+	ASSERT_EQ(4u, restored_worker->liveness);
+
+	// The running job is not assigned again, the queued ones wait behind it in their original order
+	ASSERT_EQ("job_1", queue.get_current_request(restored_worker)->data.get_job_id());
+	ASSERT_EQ(2u, queue.get_queued_request_count());
+	ASSERT_EQ("job_2", queue.worker_finished(restored_worker, "job_1")->data.get_job_id());
+
+	// The incomplete job of a worker that is gone cannot be processed anymore
+	ASSERT_EQ(1u, assigned.size());
+	ASSERT_EQ(nullptr, assigned[0].first);
+	ASSERT_EQ("job_4", assigned[0].second->data.get_job_id());
+}
+
+TEST(replication, primary_streams_events)
+{
+	auto queue = std::make_shared<replicated_queue_manager>(std::make_shared<multi_queue_manager>());
+	replication_handler handler(queue, std::chrono::milliseconds(500));
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	queue->add_worker(std::make_shared<worker>("identity_1", "group_1", worker_headers_t{{"env", "c"}}));
+	handler.on_request(message_container(broker_connect::KEY_WORKERS, "identity_1", {"init"}), respond);
+
+	ASSERT_EQ(1u, messages.size());
+	ASSERT_EQ(broker_connect::KEY_REPLICATION, messages[0].key);
+	ASSERT_EQ(broker_connect::STANDBY_IDENTITY, messages[0].identity);
+	ASSERT_EQ("event", messages[0].data.at(0));
+	ASSERT_EQ("1", messages[0].data.at(1));
+	ASSERT_EQ("worker", messages[0].data.at(2));
+	messages.clear();
+
+	// Heartbeats carry the last sequence number
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"600"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(
+			message_container(broker_connect::KEY_REPLICATION, broker_connect::STANDBY_IDENTITY, {"heartbeat", "1"})));
+	messages.clear();
+
+	// A snapshot replaces the state of the standby
+	queue->enqueue_request(create_request("job_1"));
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "standby", {"sync"}), respond);
+
+	ASSERT_EQ(3u, messages.size());
+	ASSERT_EQ((std::vector<std::string>{"reset", "1"}), messages[0].data);
+	ASSERT_EQ("2", messages[1].data.at(1));
+	ASSERT_EQ("worker", messages[1].data.at(2));
+	ASSERT_EQ("3", messages[2].data.at(1));
+	ASSERT_EQ("job", messages[2].data.at(2));
+}
+
+TEST(replication, replies_wait_for_standby)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<replicated_queue_manager>(std::make_shared<multi_queue_manager>());
+	auto broker = std::make_shared<broker_handler>(config, workers, queue, nullptr);
+	replication_handler handler(queue, std::chrono::milliseconds(500), broker, std::chrono::milliseconds(1000));
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+	auto client_replies = [&messages]() {
+		std::vector<std::string> result;
+		for (auto &message : messages) {
+			if (message.key == broker_connect::KEY_CLIENTS) {
+				result.push_back(message.data.at(0));
+			}
+		}
+		return result;
+	};
+
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"init", "group_1", "env=c"}), respond);
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "standby", {"ack", "1"}), respond);
+
+	// The job is sent to the worker and to the standby, but the client waits until the standby confirms it
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job_1", "env=c", "", "1"}), respond);
+	ASSERT_THAT(
+		messages, Contains(message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job_1", "1"})));
+	ASSERT_TRUE(client_replies().empty());
+
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "standby", {"ack", "1"}), respond);
+	ASSERT_TRUE(client_replies().empty());
+
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "standby", {"ack", "2"}), respond);
+	ASSERT_THAT(client_replies(), ElementsAre("ack", "accept"));
+
+	// A standby that does not confirm the events in time is not waited for until it confirms again
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job_2", "env=c", "", "1"}), respond);
+	ASSERT_TRUE(client_replies().empty());
+
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"1000"}), respond);
+	ASSERT_THAT(client_replies(), ElementsAre("ack", "accept"));
+
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job_3", "env=c", "", "1"}), respond);
+	ASSERT_THAT(client_replies(), ElementsAre("ack", "accept"));
+
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "standby", {"ack", "4"}), respond);
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_CLIENTS, "client_foo", {"eval", "job_4", "env=c", "", "1"}), respond);
+	ASSERT_TRUE(client_replies().empty());
+}
+
+TEST(replication, standby_follows_primary)
+{
+	auto state = std::make_shared<replica_state>();
+	bool taken_over = false;
+	standby_handler handler(state, std::chrono::milliseconds(1000), [&taken_over]() { taken_over = true; });
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	auto worker_event = replica_state::worker_added(worker("identity_1", "group_1", worker_headers_t{{"env", "c"}}));
+	auto event = [](const std::string &sequence, replica_state::event frames) {
+		frames.insert(frames.begin(), {"event", sequence});
+		return frames;
+	};
+
+	// The standby asks for a snapshot when it starts
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "primary", {"heartbeat", "5"}), respond);
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_REPLICATION, "primary", {"sync"})));
+	ASSERT_FALSE(handler.is_synced());
+
+	// Nobody takes over before the state is known
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"2000"}), respond);
+	ASSERT_FALSE(taken_over);
+
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "primary", {"reset", "5"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_REPLICATION, "primary", event("6", worker_event)), respond);
+	ASSERT_TRUE(handler.is_synced());
+	ASSERT_EQ(1u, state->get_workers().size());
+
+	// Applied events and heartbeats are confirmed
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "primary", {"heartbeat", "6"}), respond);
+	ASSERT_THAT(messages,
+		ElementsAre(message_container(broker_connect::KEY_REPLICATION, "primary", {"ack", "6"}),
+			message_container(broker_connect::KEY_REPLICATION, "primary", {"ack", "6"})));
+
+	// A lost event makes the standby ask for a snapshot again
+	messages.clear();
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION,
+						   "primary",
+						   event("8", replica_state::job_placed(*create_request("job_1"), ""))),
+		respond);
+	ASSERT_FALSE(handler.is_synced());
+	ASSERT_EQ(0u, state->get_job_count());
+	ASSERT_THAT(messages, ElementsAre(message_container(broker_connect::KEY_REPLICATION, "primary", {"sync"})));
+
+	handler.on_request(message_container(broker_connect::KEY_REPLICATION, "primary", {"reset", "8"}), respond);
+	handler.on_request(
+		message_container(broker_connect::KEY_REPLICATION, "primary", event("9", worker_event)), respond);
+	ASSERT_TRUE(handler.is_synced());
+
+	// The standby takes over when the primary falls silent
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"600"}), respond);
+	ASSERT_FALSE(taken_over);
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"600"}), respond);
+	ASSERT_TRUE(taken_over);
+}
+
+TEST(replication, broker_restores_state)
+{
+	auto config = std::make_shared<NiceMock<mock_broker_config>>();
+	auto workers = std::make_shared<worker_registry>();
+	auto queue = std::make_shared<multi_queue_manager>();
+
+	replica_state state;
+	state.apply(replica_state::worker_added(worker("identity_1", "group_1", worker_headers_t{{"env", "c"}})));
+	state.apply(replica_state::job_placed(*create_request("job_1"), ""));
+
+	std::vector<message_container> messages;
+	handler_interface::response_cb respond = [&messages](const message_container &msg) { messages.push_back(msg); };
+
+	broker_handler handler(config, workers, queue, nullptr);
+	handler.restore(state);
+
+	ASSERT_EQ(1u, workers->get_workers().size());
+
+	// The queued job that got assigned during the restoration is sent right away
+	handler.on_request(message_container(broker_connect::KEY_TIMER, "", {"10"}), respond);
+	ASSERT_THAT(messages,
+		Contains(
+			message_container(broker_connect::KEY_WORKERS, "identity_1", {"eval", "job_1", "frame_1", "frame_2"})));
+
+	// The restored worker can finish the job
+	messages.clear();
+	handler.on_request(
+		message_container(broker_connect::KEY_WORKERS, "identity_1", {"done", "job_1", "OK"}), respond);
+	ASSERT_EQ(nullptr, queue->find_request("job_1").request);
+}
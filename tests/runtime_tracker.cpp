@@ -0,0 +1,57 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "../src/queuing/runtime_tracker.h"
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+TEST(runtime_tracker, no_samples)
+{
+	runtime_tracker tracker;
+
+	ASSERT_FALSE(tracker.has_samples("group_1"));
+	ASSERT_EQ(0ms, tracker.get_mean("group_1"));
+}
+
+TEST(runtime_tracker, mean_per_hwgroup)
+{
+	runtime_tracker tracker;
+
+	tracker.add_sample("group_1", 100ms);
+	tracker.add_sample("group_1", 300ms);
+	tracker.add_sample("group_2", 1000ms);
+
+	ASSERT_TRUE(tracker.has_samples("group_1"));
+	ASSERT_TRUE(tracker.has_samples("group_2"));
+	ASSERT_EQ(200ms, tracker.get_mean("group_1"));
+	ASSERT_EQ(1000ms, tracker.get_mean("group_2"));
+}
+
+TEST(runtime_tracker, old_samples_are_forgotten)
+{
+	runtime_tracker tracker(2);
+
+	tracker.add_sample("group_1", 1000ms);
+	tracker.add_sample("group_1", 100ms);
+	tracker.add_sample("group_1", 300ms);
+
+	ASSERT_EQ(200ms, tracker.get_mean("group_1"));
+}
+
+TEST(runtime_tracker, percentiles)
+{
+	runtime_tracker tracker;
+
+	for (int i = 1; i <= 100; i++) {
+		tracker.add_sample("group_1", std::chrono::milliseconds(i * 10));
+	}
+
+	ASSERT_EQ(100u, tracker.get_sample_count("group_1"));
+	ASSERT_EQ(0u, tracker.get_sample_count("group_2"));
+	ASSERT_EQ(500ms, tracker.get_percentile("group_1", 0.5));
+	ASSERT_EQ(990ms, tracker.get_percentile("group_1", 0.99));
+	ASSERT_EQ(1000ms, tracker.get_percentile("group_1", 1));
+	ASSERT_EQ(10ms, tracker.get_percentile("group_1", 0));
+	ASSERT_EQ(0ms, tracker.get_percentile("group_2", 0.99));
+}
@@ -0,0 +1,96 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+
+#include "../src/trace/scheduling_trace.h"
+
+using namespace testing;
+
+/**
+ * Write given events into a trace and return its binary content
+ */
+static std::string write_trace(const std::vector<trace_event> &events)
+{
+	auto stream = std::make_unique<std::stringstream>();
+	auto output = stream.get();
+
+	trace_writer writer(std::move(stream));
+	for (auto &event : events) {
+		writer.write(event);
+	}
+	writer.flush();
+
+	return output->str();
+}
+
+TEST(scheduling_trace, round_trip)
+{
+	trace_event worker_added;
+	worker_added.event_type = trace_event::type::worker_added;
+	worker_added.time = std::chrono::milliseconds(5);
+	worker_added.identity = std::string("id\0\x01", 4);
+	worker_added.hwgroup = "group_1";
+	worker_added.headers = {{"env", "c"}, {"env", "python"}};
+	worker_added.slots = 300;
+	worker_added.prefetch = true;
+
+	trace_event job_arrived;
+	job_arrived.event_type = trace_event::type::job_arrived;
+	job_arrived.time = std::chrono::milliseconds(1000000);
+	job_arrived.job_id = "job1";
+	job_arrived.headers = {{"env", "c"}};
+	job_arrived.metadata = {{"exercise", "ex1"}};
+
+	trace_event job_finished;
+	job_finished.event_type = trace_event::type::job_finished;
+	job_finished.time = std::chrono::milliseconds(1000250);
+	job_finished.identity = worker_added.identity;
+	job_finished.job_id = "job1";
+	job_finished.status = "OK";
+
+	std::istringstream input(write_trace({worker_added, job_arrived, job_finished}));
+	trace_reader reader(input);
+	trace_event event;
+
+	ASSERT_TRUE(reader.read(event));
+	ASSERT_EQ(trace_event::type::worker_added, event.event_type);
+	ASSERT_EQ(std::chrono::milliseconds(5), event.time);
+	ASSERT_EQ(worker_added.identity, event.identity);
+	ASSERT_EQ("group_1", event.hwgroup);
+	ASSERT_EQ(worker_added.headers, event.headers);
+	ASSERT_EQ(300u, event.slots);
+	ASSERT_TRUE(event.prefetch);
+
+	ASSERT_TRUE(reader.read(event));
+	ASSERT_EQ(trace_event::type::job_arrived, event.event_type);
+	ASSERT_EQ(std::chrono::milliseconds(1000000), event.time);
+	ASSERT_EQ("job1", event.job_id);
+	ASSERT_EQ(job_arrived.headers, event.headers);
+	ASSERT_EQ(job_arrived.metadata, event.metadata);
+
+	ASSERT_TRUE(reader.read(event));
+	ASSERT_EQ(trace_event::type::job_finished, event.event_type);
+	ASSERT_EQ(std::chrono::milliseconds(1000250), event.time);
+	ASSERT_EQ("job1", event.job_id);
+	ASSERT_EQ("OK", event.status);
+
+	ASSERT_FALSE(reader.read(event));
+}
+
+TEST(scheduling_trace, malformed)
+{
+	std::istringstream not_a_trace("hello world");
+	ASSERT_THROW(trace_reader reader(not_a_trace), trace_error);
+
+	trace_event job_arrived;
+	job_arrived.event_type = trace_event::type::job_arrived;
+	job_arrived.job_id = "job1";
+
+	auto content = write_trace({job_arrived});
+	std::istringstream truncated(content.substr(0, content.size() - 2));
+	trace_reader reader(truncated);
+	trace_event event;
+
+	ASSERT_THROW(reader.read(event), trace_error);
+}
@@ -0,0 +1,151 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+
+#include "../src/queuing/cache_affinity_worker_selector.h"
+#include "../src/queuing/multi_queue_manager.h"
+#include "../src/queuing/single_queue_manager.h"
+#include "../src/simulator/simulator.h"
+
+using namespace testing;
+
+static simulated_job make_job(const std::string &job_id, std::size_t arrival, std::size_t runtime)
+{
+	simulated_job job;
+	job.job_id = job_id;
+	job.headers = {{"env", "c"}};
+	job.arrival = std::chrono::milliseconds(arrival);
+	job.runtime = std::chrono::milliseconds(runtime);
+	return job;
+}
+
+static simulated_worker make_worker(const std::string &identity)
+{
+	simulated_worker result;
+	result.identity = identity;
+	result.hwgroup = "group_1";
+	result.headers = {{"env", "c"}};
+	return result;
+}
+
+TEST(simulator, single_worker)
+{
+	workload jobs;
+	jobs.workers = {make_worker("worker_1")};
+	jobs.jobs = {make_job("job1", 0, 100), make_job("job2", 0, 100), make_job("job3", 0, 100)};
+
+	single_queue_manager<> queue;
+	simulator sim;
+	auto report = sim.run(queue, jobs);
+
+	ASSERT_EQ(3u, report.completed);
+	ASSERT_EQ(0u, report.rejected);
+	ASSERT_EQ(0u, report.unfinished);
+	ASSERT_EQ(std::chrono::milliseconds(300), report.makespan);
+	ASSERT_DOUBLE_EQ(10.0, report.throughput);
+	ASSERT_EQ(std::chrono::milliseconds(100), report.mean_wait);
+	ASSERT_EQ(std::chrono::milliseconds(100), report.wait_percentiles[50]);
+	ASSERT_EQ(std::chrono::milliseconds(200), report.wait_percentiles[99]);
+	ASSERT_DOUBLE_EQ(1.0, report.utilization["group_1"]);
+}
+
+TEST(simulator, compare_queue_managers)
+{
+	workload jobs;
+	jobs.workers = {make_worker("worker_1"), make_worker("worker_2")};
+	jobs.jobs = {
+		make_job("job1", 0, 1000), make_job("job2", 0, 10), make_job("job3", 1, 10), make_job("job4", 2, 10)};
+
+	simulator sim;
+
+	// The single queue manager gives the short jobs to the worker that is free
+	single_queue_manager<> single;
+	auto single_report = sim.run(single, jobs);
+	ASSERT_EQ(4u, single_report.completed);
+	ASSERT_EQ(std::chrono::milliseconds(18), single_report.wait_percentiles[99]);
+
+	// The multi queue manager puts one of them behind the long job
+	multi_queue_manager multi;
+	auto multi_report = sim.run(multi, jobs);
+	ASSERT_EQ(4u, multi_report.completed);
+	ASSERT_EQ(std::chrono::milliseconds(999), multi_report.wait_percentiles[99]);
+}
+
+TEST(simulator, unprocessable_jobs)
+{
+	workload jobs;
+	jobs.workers = {make_worker("worker_1")};
+	jobs.jobs = {make_job("job1", 0, 100), make_job("job2", 10, 100)};
+	jobs.jobs[1].headers = {{"env", "java"}};
+
+	single_queue_manager<> queue;
+	simulator sim;
+	auto report = sim.run(queue, jobs);
+
+	ASSERT_EQ(1u, report.completed);
+	ASSERT_EQ(1u, report.rejected);
+}
+
+TEST(simulator, synthetic_workload)
+{
+	synthetic_workload_params params;
+	params.jobs = 200;
+	auto jobs = params.generate();
+
+	ASSERT_EQ(4u, jobs.workers.size());
+	ASSERT_EQ(200u, jobs.jobs.size());
+
+	simulator sim;
+	single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector> queue(
+		std::make_unique<fcfs_job_comparator>(),
+		std::make_unique<cache_affinity_worker_selector>(
+			"exercise", 4, std::chrono::milliseconds(1000), [&sim]() { return sim.now(); }));
+
+	auto report = sim.run(queue, jobs);
+	ASSERT_EQ(200u, report.completed);
+	ASSERT_GT(queue.get_statistics()["cache-hits"], 0u);
+}
+
+TEST(simulator, workload_from_trace)
+{
+	auto stream = std::make_unique<std::stringstream>();
+	auto output = stream.get();
+	trace_writer writer(std::move(stream));
+
+	auto write = [&writer](trace_event::type type, std::size_t time, const std::string &identity,
+					 const std::string &job_id) {
+		trace_event event;
+		event.event_type = type;
+		event.time = std::chrono::milliseconds(time);
+		event.identity = identity;
+		event.job_id = job_id;
+		event.hwgroup = "group_1";
+		event.headers = {{"env", "c"}};
+		event.status = "OK";
+		writer.write(event);
+	};
+
+	write(trace_event::type::worker_added, 0, "worker_1", "");
+	write(trace_event::type::job_arrived, 100, "", "job1");
+	write(trace_event::type::job_started, 110, "worker_1", "job1");
+	write(trace_event::type::job_arrived, 150, "", "job2");
+	write(trace_event::type::job_finished, 400, "worker_1", "job1");
+	write(trace_event::type::worker_removed, 500, "worker_1", "");
+	writer.flush();
+
+	std::istringstream input(output->str());
+	trace_reader reader(input);
+	auto jobs = workload::from_trace(reader);
+
+	ASSERT_EQ(1u, jobs.workers.size());
+	ASSERT_EQ("worker_1", jobs.workers[0].identity);
+	ASSERT_EQ(std::chrono::milliseconds(500), jobs.workers[0].left);
+
+	// The second job never finished, so its processing time is unknown
+	ASSERT_EQ(1u, jobs.jobs.size());
+	ASSERT_EQ(1u, jobs.skipped_jobs);
+	ASSERT_EQ("job1", jobs.jobs[0].job_id);
+	ASSERT_EQ(std::chrono::milliseconds(100), jobs.jobs[0].arrival);
+	ASSERT_EQ(std::chrono::milliseconds(290), jobs.jobs[0].runtime);
+}
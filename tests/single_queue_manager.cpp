@@ -1,9 +1,11 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <memory>
+#include <thread>
 
 
 #include "../src/queuing/single_queue_manager.h"
+#include "../src/queuing/cache_affinity_worker_selector.h"
 #include "../src/worker.h"
 
 using namespace testing;
@@ -22,6 +24,30 @@ TEST(single_queue_manager, add_worker)
 	ASSERT_EQ(request_1, manager.get_current_request(worker_1));
 }
 
+TEST(single_queue_manager, add_unassigned_worker)
+{
+	std::multimap<std::string, std::string> headers = {};
+	job_request_data data("", {});
+
+	single_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	auto worker_2 = std::make_shared<worker>("identity2", "group_1", headers);
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+
+	manager.add_worker(worker_1, request_1);
+	manager.enqueue_request(request_2);
+
+	// The queued request is not assigned to the new worker
+	manager.add_unassigned_worker(worker_2);
+	ASSERT_EQ(nullptr, manager.get_current_request(worker_2));
+	ASSERT_EQ(1u, manager.get_queued_request_count());
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+
+	ASSERT_EQ(request_2, manager.assign_request(worker_2));
+}
+
 TEST(single_queue_manager, basic_queueing)
 {
 	std::multimap<std::string, std::string> headers = {};
@@ -188,3 +214,515 @@ TEST(single_queue_manager, rejecting_unprocessable_jobs)
 	ASSERT_FALSE(re_result_11.enqueued);
 	ASSERT_EQ(re_result_11.assigned_to, nullptr);
 }
+
+TEST(single_queue_manager, prefetching)
+{
+	single_queue_manager manager;
+
+	std::multimap<std::string, std::string> headers = {};
+	job_request_data data("", {});
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	worker_1->prefetch = true;
+	manager.add_worker(worker_1);
+
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{{}}, data);
+
+	// The first request is processed right away, the second one is sent in advance
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_EQ(request_1, manager.get_current_request(worker_1));
+	ASSERT_EQ(request_2, manager.get_prefetched_request(worker_1));
+	ASSERT_EQ(1u, manager.get_queued_request_count());
+
+	// The prefetched request becomes current and the free slot is filled again
+	ASSERT_EQ(request_3, manager.worker_finished(worker_1));
+	ASSERT_EQ(request_2, manager.get_current_request(worker_1));
+	ASSERT_EQ(request_3, manager.get_prefetched_request(worker_1));
+	ASSERT_EQ(nullptr, manager.assign_request(worker_1));
+
+	// Both jobs held by the worker are reclaimed when it dies
+	ASSERT_THAT(manager.worker_terminated(worker_1), Pointee(ElementsAre(request_2, request_3)));
+}
+
+TEST(single_queue_manager, multiple_slots)
+{
+	single_queue_manager manager;
+
+	std::multimap<std::string, std::string> headers = {};
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	worker_1->slots = 2;
+	manager.add_worker(worker_1);
+
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{{}}, job_request_data("job3", {}));
+
+	// The worker processes two requests at once
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_THAT(manager.get_current_requests(worker_1), ElementsAre(request_1, request_2));
+	ASSERT_EQ(nullptr, manager.get_prefetched_request(worker_1));
+
+	// Jobs can be finished in any order
+	ASSERT_EQ(request_3, manager.worker_finished(worker_1, "job2"));
+	ASSERT_THAT(manager.get_current_requests(worker_1), ElementsAre(request_1, request_3));
+
+	ASSERT_EQ(request_1, manager.worker_cancelled(worker_1, "job1"));
+	ASSERT_EQ(nullptr, manager.worker_cancelled(worker_1, "job1"));
+	ASSERT_THAT(manager.get_current_requests(worker_1), ElementsAre(request_3));
+
+	ASSERT_THAT(manager.worker_terminated(worker_1), Pointee(ElementsAre(request_3)));
+}
+
+TEST(single_queue_manager, queued_requests_per_hwgroup)
+{
+	single_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_2", {{"env", "c"}}));
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	job_request_data data("", {});
+	auto request_1 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+	auto request_3 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+	auto request_4 = std::make_shared<request>(
+		request::headers_t{{"env", "c"}, {"hwgroup", "group_1"}}, request::metadata_t{{}}, data);
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+	manager.enqueue_request(request_4);
+
+	// The third request can be processed by both groups, the fourth one only by the first group
+	ASSERT_EQ(2u, manager.get_queued_request_count());
+	ASSERT_EQ(2u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_2"));
+	ASSERT_EQ(0u, manager.get_queued_request_count("group_3"));
+
+	ASSERT_EQ(request_3, manager.worker_finished(worker_2));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(0u, manager.get_queued_request_count("group_2"));
+}
+
+TEST(single_queue_manager, queued_requests_per_hwgroup_follow_workers)
+{
+	single_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_2", {{"env", "c"}}));
+	auto worker_3 = worker_ptr(new worker("id123456", "group_2", {{"env", "c"}}));
+	auto worker_4 = worker_ptr(new worker("id1234567", "group_2", {{"env", "python"}}));
+
+	manager.add_worker(worker_1);
+
+	job_request_data data("", {});
+	auto request_1 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+	auto request_2 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+	auto request_3 = std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data);
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+	ASSERT_EQ(2u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(0u, manager.get_queued_request_count("group_2"));
+
+	// A worker of a new group takes a job, the other one waits for both groups
+	ASSERT_EQ(request_2, manager.add_worker(worker_2));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_2"));
+
+	// A worker that cannot process the job does not count
+	manager.add_worker(worker_3);
+	manager.worker_finished(worker_1);
+	manager.add_worker(worker_4);
+	ASSERT_EQ(0u, manager.get_queued_request_count());
+
+	manager.enqueue_request(std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data));
+	manager.enqueue_request(std::make_shared<request>(request::headers_t{{"env", "c"}}, request::metadata_t{{}}, data));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_2"));
+
+	// The group still has a suitable worker after the first one leaves, but not after the second one
+	manager.worker_terminated(worker_2);
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_2"));
+	manager.worker_terminated(worker_3);
+	ASSERT_EQ(0u, manager.get_queued_request_count("group_2"));
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+}
+
+TEST(single_queue_manager, earliest_deadline_first)
+{
+	single_queue_manager<edf_job_comparator> manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+
+	request::headers_t headers = {{"env", "c"}};
+	job_request_data data("", {});
+	auto request_running = std::make_shared<request>(headers, request::metadata_t{}, data);
+	auto request_no_deadline = std::make_shared<request>(headers, request::metadata_t{}, data);
+	auto request_late = std::make_shared<request>(headers, request::metadata_t{{"deadline", "2000"}}, data);
+	auto request_early = std::make_shared<request>(headers, request::metadata_t{{"deadline", "1000"}}, data);
+	auto request_at_risk = std::make_shared<request>(headers, request::metadata_t{{"deadline", "500"}}, data);
+	request_at_risk->deadline_at_risk = true;
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_running).assigned_to);
+
+	for (auto &request : {request_at_risk, request_no_deadline, request_late, request_early}) {
+		ASSERT_TRUE(manager.enqueue_request(request).enqueued);
+	}
+
+	// Jobs that can still meet their deadlines go first, then those without deadlines and the hopeless ones
+	// in the order of arrival
+	ASSERT_EQ(request_early, manager.worker_finished(worker_1));
+	ASSERT_EQ(request_late, manager.worker_finished(worker_1));
+	ASSERT_EQ(request_at_risk, manager.worker_finished(worker_1));
+	ASSERT_EQ(request_no_deadline, manager.worker_finished(worker_1));
+}
+
+TEST(single_queue_manager, find_request)
+{
+	single_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+
+	request::headers_t headers = {{"env", "c"}};
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job3", {}));
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+
+	ASSERT_EQ(request_1, manager.find_request("job1").request);
+	ASSERT_EQ(worker_1, manager.find_request("job1").worker);
+	ASSERT_EQ(request_2, manager.find_request("job2").request);
+	ASSERT_EQ(nullptr, manager.find_request("job2").worker);
+	ASSERT_EQ(nullptr, manager.find_request("job4").request);
+
+	// The finished job is forgotten, the next one is assigned
+	manager.worker_finished(worker_1, "job1");
+	ASSERT_EQ(nullptr, manager.find_request("job1").request);
+	ASSERT_EQ(worker_1, manager.find_request("job2").worker);
+
+	manager.worker_cancelled(worker_1, "job2");
+	ASSERT_EQ(nullptr, manager.find_request("job2").request);
+
+	manager.worker_terminated(worker_1);
+	ASSERT_EQ(nullptr, manager.find_request("job3").request);
+}
+
+TEST(single_queue_manager, bulk_enqueue)
+{
+	single_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "python"}}));
+	worker_1->slots = 2;
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	request::headers_t headers = {{"env", "c"}};
+	std::vector<request_ptr> requests;
+	for (std::string job_id : {"job1", "job2", "job3"}) {
+		requests.push_back(std::make_shared<request>(headers, request::metadata_t{}, job_request_data(job_id, {})));
+	}
+
+	auto results = manager.enqueue_requests(requests);
+
+	ASSERT_EQ(3u, results.size());
+	ASSERT_EQ(worker_1, results[0].assigned_to);
+	ASSERT_EQ(worker_1, results[1].assigned_to);
+	ASSERT_EQ(nullptr, results[2].assigned_to);
+	ASSERT_TRUE(results[2].enqueued);
+	ASSERT_EQ(1u, manager.get_queued_request_count("group_1"));
+	ASSERT_EQ(requests[2], manager.worker_finished(worker_1, "job1"));
+
+	// Nobody can process these requests
+	request::headers_t unknown_headers = {{"env", "java"}};
+	auto unknown_request =
+		std::make_shared<request>(unknown_headers, request::metadata_t{}, job_request_data("job4", {}));
+	results = manager.enqueue_requests({unknown_request});
+
+	ASSERT_EQ(1u, results.size());
+	ASSERT_FALSE(results[0].enqueued);
+	ASSERT_EQ(nullptr, manager.find_request("job4").request);
+}
+
+TEST(single_queue_manager, remove_queued_request)
+{
+	single_queue_manager manager;
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+
+	request::headers_t headers = {{"env", "c"}};
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job3", {}));
+
+	manager.enqueue_request(request_1);
+	manager.enqueue_request(request_2);
+	manager.enqueue_request(request_3);
+
+	// Only queued requests can be removed
+	ASSERT_EQ(nullptr, manager.remove_queued_request("job1"));
+	ASSERT_EQ(nullptr, manager.remove_queued_request("job4"));
+	ASSERT_EQ(request_2, manager.remove_queued_request("job2"));
+	ASSERT_EQ(nullptr, manager.find_request("job2").request);
+	ASSERT_EQ(1u, manager.get_queued_request_count());
+
+	ASSERT_EQ(request_3, manager.worker_finished(worker_1));
+}
+
+TEST(single_queue_manager, cache_affinity)
+{
+	single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector> manager(
+		std::make_unique<fcfs_job_comparator>(),
+		std::make_unique<cache_affinity_worker_selector>("exercise", 2, std::chrono::milliseconds(0)));
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	// Idle workers are tried in the order of their addresses
+	if (worker_2 < worker_1) {
+		std::swap(worker_1, worker_2);
+	}
+
+	request::headers_t headers = {{"env", "c"}};
+	auto make_request = [&headers](const std::string &job_id, const std::string &exercise) {
+		request::metadata_t metadata = {{"exercise", exercise}};
+		return std::make_shared<request>(headers, metadata, job_request_data(job_id, {}));
+	};
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(make_request("job1", "ex1")).assigned_to);
+	ASSERT_EQ(worker_2, manager.enqueue_request(make_request("job2", "ex2")).assigned_to);
+	manager.worker_finished(worker_1, "job1");
+	manager.worker_finished(worker_2, "job2");
+
+	// Both workers are idle, the one that ran the same exercise is preferred
+	ASSERT_EQ(worker_2, manager.enqueue_request(make_request("job3", "ex2")).assigned_to);
+	ASSERT_EQ(worker_1, manager.enqueue_request(make_request("job4", "ex3")).assigned_to);
+	manager.worker_finished(worker_1, "job4");
+
+	// The worker that has a warm cache is busy and the job cannot wait for it
+	ASSERT_EQ(worker_1, manager.enqueue_request(make_request("job5", "ex2")).assigned_to);
+
+	auto statistics = manager.get_statistics();
+	ASSERT_EQ(1u, statistics["cache-hits"]);
+	ASSERT_EQ(4u, statistics["cache-misses"]);
+	ASSERT_EQ(20u, statistics["cache-hit-rate"]);
+}
+
+TEST(single_queue_manager, cache_affinity_bounded_wait)
+{
+	single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector> manager(
+		std::make_unique<fcfs_job_comparator>(),
+		std::make_unique<cache_affinity_worker_selector>("exercise", 2, std::chrono::milliseconds(50)));
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	// Idle workers are tried in the order of their addresses
+	if (worker_2 < worker_1) {
+		std::swap(worker_1, worker_2);
+	}
+
+	request::headers_t headers = {{"env", "c"}};
+	request::metadata_t metadata = {{"exercise", "ex1"}};
+	auto request_1 = std::make_shared<request>(headers, metadata, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, metadata, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, metadata, job_request_data("job3", {}));
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+
+	// The jobs wait for the busy worker with a warm cache although the other one is idle
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_2).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_EQ(request_2, manager.worker_finished(worker_1, "job1"));
+	ASSERT_TRUE(manager.assign_waiting_requests().empty());
+
+	// The last job waited too long, any worker can take it
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	auto assigned = manager.assign_waiting_requests();
+	ASSERT_EQ(1u, assigned.size());
+	ASSERT_EQ(worker_2, assigned[0].first);
+	ASSERT_EQ(request_3, assigned[0].second);
+}
+
+TEST(single_queue_manager, cache_affinity_waiting_delay)
+{
+	std::chrono::milliseconds now(1000);
+	single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector> manager(
+		std::make_unique<fcfs_job_comparator>(),
+		std::make_unique<cache_affinity_worker_selector>(
+			"exercise", 2, std::chrono::milliseconds(50), [&now]() { return now; }));
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	if (worker_2 < worker_1) {
+		std::swap(worker_1, worker_2);
+	}
+
+	request::headers_t headers = {{"env", "c"}};
+	request::metadata_t metadata = {{"exercise", "ex1"}};
+	auto request_1 = std::make_shared<request>(headers, metadata, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, metadata, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, metadata, job_request_data("job3", {}));
+
+	// Nothing is held back
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(-1, manager.get_waiting_delay().count());
+
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_2).assigned_to);
+	now += std::chrono::milliseconds(20);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+	ASSERT_EQ(30, manager.get_waiting_delay().count());
+
+	// The first job got its worker, the other one stops waiting later
+	ASSERT_EQ(request_2, manager.worker_finished(worker_1, "job1"));
+	ASSERT_EQ(50, manager.get_waiting_delay().count());
+
+	now += std::chrono::milliseconds(60);
+	ASSERT_EQ(0, manager.get_waiting_delay().count());
+	ASSERT_EQ(1u, manager.assign_waiting_requests().size());
+	ASSERT_EQ(-1, manager.get_waiting_delay().count());
+}
+
+TEST(single_queue_manager, cache_affinity_removed_requests_stop_waiting)
+{
+	std::chrono::milliseconds now(1000);
+	single_queue_manager<fcfs_job_comparator, cache_affinity_worker_selector> manager(
+		std::make_unique<fcfs_job_comparator>(),
+		std::make_unique<cache_affinity_worker_selector>(
+			"exercise", 2, std::chrono::milliseconds(50), [&now]() { return now; }));
+
+	auto worker_1 = worker_ptr(new worker("id1234", "group_1", {{"env", "c"}}));
+	auto worker_2 = worker_ptr(new worker("id12345", "group_1", {{"env", "c"}}));
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+
+	if (worker_2 < worker_1) {
+		std::swap(worker_1, worker_2);
+	}
+
+	request::headers_t headers = {{"env", "c"}};
+	request::metadata_t metadata = {{"exercise", "ex1"}};
+	auto request_1 = std::make_shared<request>(headers, metadata, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, metadata, job_request_data("job2", {}));
+	auto request_3 = std::make_shared<request>(headers, metadata, job_request_data("job3", {}));
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_2).assigned_to);
+	now += std::chrono::milliseconds(20);
+	ASSERT_EQ(nullptr, manager.enqueue_request(request_3).assigned_to);
+
+	// A removed (e.g. cancelled) job is not held back anymore
+	ASSERT_EQ(request_2, manager.remove_queued_request("job2"));
+	ASSERT_EQ(50, manager.get_waiting_delay().count());
+
+	// A job that cannot be processed after the workers leave is not held back either
+	manager.worker_terminated(worker_2);
+	ASSERT_THAT(manager.worker_terminated(worker_1), Pointee(ElementsAre(request_1, request_3)));
+	ASSERT_EQ(-1, manager.get_waiting_delay().count());
+}
+
+TEST(single_queue_manager, waiting_delay_without_held_back_requests)
+{
+	std::multimap<std::string, std::string> headers = {{"env", "c"}};
+	single_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	manager.add_worker(worker_1);
+
+	// A queued job that waits for a busy worker is not held back
+	manager.enqueue_request(std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {})));
+	manager.enqueue_request(std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {})));
+	ASSERT_EQ(1u, manager.get_queued_request_count());
+	ASSERT_EQ(-1, manager.get_waiting_delay().count());
+}
+
+TEST(single_queue_manager, avoid_failed_workers)
+{
+	std::multimap<std::string, std::string> headers = {};
+	single_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	auto worker_2 = std::make_shared<worker>("identity2", "group_1", headers);
+	auto worker_3 = std::make_shared<worker>("identity3", "group_1", headers);
+	worker_1->host = "host_1";
+	worker_3->host = "host_1";
+
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+
+	manager.add_worker(worker_1);
+	manager.add_worker(worker_2);
+	manager.add_worker(worker_3);
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+	ASSERT_EQ(worker_2, manager.enqueue_request(request_2).assigned_to);
+
+	// The job failed on worker 1, worker 3 runs on the same host
+	manager.worker_cancelled(worker_1, "job1");
+	request_1->record_failure(*worker_1);
+
+	auto result = manager.enqueue_request(request_1);
+	ASSERT_TRUE(result.enqueued);
+	ASSERT_EQ(nullptr, result.assigned_to);
+	ASSERT_EQ(nullptr, manager.assign_request(worker_1));
+	ASSERT_EQ(nullptr, manager.assign_request(worker_3));
+
+	// The job waits for the worker on another host
+	ASSERT_EQ(request_1, manager.worker_finished(worker_2, "job2"));
+
+	// There is no other worker left, so the job can go back to the host where it failed
+	manager.worker_cancelled(worker_2, "job1");
+	request_1->record_failure(*worker_2);
+	manager.worker_terminated(worker_2);
+
+	ASSERT_EQ(worker_1, manager.enqueue_request(request_1).assigned_to);
+}
+
+TEST(single_queue_manager, draining)
+{
+	std::multimap<std::string, std::string> headers = {};
+	single_queue_manager manager;
+
+	auto worker_1 = std::make_shared<worker>("identity1", "group_1", headers);
+	auto request_1 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job1", {}));
+	auto request_2 = std::make_shared<request>(headers, request::metadata_t{}, job_request_data("job2", {}));
+
+	manager.add_worker(worker_1);
+	manager.enqueue_request(request_1);
+
+	worker_1->draining = true;
+	ASSERT_TRUE(manager.worker_draining(worker_1).empty());
+
+	// The job waits for the worker, but it is not assigned to it
+	auto result = manager.enqueue_request(request_2);
+	ASSERT_TRUE(result.enqueued);
+	ASSERT_EQ(nullptr, result.assigned_to);
+	ASSERT_EQ(nullptr, manager.worker_finished(worker_1, "job1"));
+
+	worker_1->draining = false;
+	ASSERT_EQ(request_2, manager.assign_request(worker_1));
+}
@@ -72,3 +72,17 @@ TEST(worker, description)
 
 	ASSERT_EQ("6964656e7469747931 (MyWorker)", worker_1.get_description());
 }
+
+TEST(worker, request_deadline)
+{
+	job_request_data data("job1", {});
+
+	request without_deadline({}, {}, data);
+	request with_deadline({}, {{"deadline", "1500000000"}}, data);
+	request malformed_deadline({}, {{"deadline", "tomorrow"}}, data);
+
+	ASSERT_FALSE(without_deadline.has_deadline());
+	ASSERT_TRUE(with_deadline.has_deadline());
+	ASSERT_EQ(std::chrono::system_clock::time_point(std::chrono::seconds(1500000000)), with_deadline.deadline);
+	ASSERT_FALSE(malformed_deadline.has_deadline());
+}